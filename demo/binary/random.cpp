@@ -0,0 +1,36 @@
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <datapack/examples/entity.hpp>
+#include <datapack/schema/binary.hpp>
+
+// Measures the rate of schema-driven random message generation, with
+// increasing numbers of threads.
+
+using Clock = std::chrono::high_resolution_clock;
+
+int main() {
+    using namespace datapack;
+
+    const Schema schema = create_schema<Entity>();
+    const std::size_t count = 200000;
+    const std::size_t max_threads = std::max(std::thread::hardware_concurrency(), 1u);
+
+    for (std::size_t threads = 1; threads <= max_threads; threads *= 2) {
+        RandomBinaryOptions options;
+        options.threads = threads;
+        std::atomic<std::size_t> bytes = 0;
+
+        auto before = Clock::now();
+        random_binary(schema, count, [&](std::size_t, const std::vector<std::uint8_t>& data) {
+            bytes += data.size();
+        }, options);
+        auto after = Clock::now();
+
+        double seconds = std::chrono::duration<double>(after - before).count();
+        std::cout << "Threads: " << threads
+            << ", messages/s: " << std::size_t(count / seconds)
+            << ", MB/s: " << bytes / seconds / 1e6 << std::endl;
+    }
+}
@@ -0,0 +1,56 @@
+#include <chrono>
+#include <iostream>
+#include <datapack/examples/entity.hpp>
+#include <datapack/format/binary_stream.hpp>
+#include <datapack/util/random.hpp>
+
+// Records and replays a stream of entities with each I/O backend.
+
+using Clock = std::chrono::high_resolution_clock;
+
+int main() {
+    using namespace datapack;
+
+    std::vector<Entity> entities;
+    for (std::size_t i = 0; i < 1000; i++) {
+        entities.push_back(random<Entity>());
+    }
+    const std::size_t count = 500000;
+    const auto path = std::filesystem::temp_directory_path() / "datapack_demo_stream";
+
+    for (IoBackend backend: {IoBackend::Threads, IoBackend::IoUring}) {
+        if (backend == IoBackend::IoUring && !io_uring_supported()) {
+            std::cout << "io_uring: unsupported" << std::endl;
+            continue;
+        }
+        BinaryStreamOptions options;
+        options.backend = backend;
+
+        auto before = Clock::now();
+        {
+            BinaryStreamWriter writer(path, options);
+            for (std::size_t i = 0; i < count; i++) {
+                writer.write(entities[i % entities.size()]);
+            }
+        }
+        auto written = Clock::now();
+        std::size_t read_count = 0;
+        {
+            BinaryStreamReader reader(path, options);
+            Entity entity;
+            while (reader.read(entity)) {
+                read_count++;
+            }
+        }
+        auto read = Clock::now();
+
+        double size = std::filesystem::file_size(path);
+        double write_seconds = std::chrono::duration<double>(written - before).count();
+        double read_seconds = std::chrono::duration<double>(read - written).count();
+        std::cout << (backend == IoBackend::IoUring ? "io_uring" : "threads") << ":" << std::endl;
+        std::cout << "    write (MB/s): " << size / write_seconds / 1e6 << std::endl;
+        std::cout << "    read (MB/s):  " << size / read_seconds / 1e6
+            << " (" << read_count << " messages)" << std::endl;
+    }
+    std::filesystem::remove(path);
+}
@@ -0,0 +1,101 @@
+#include <datapack/format/json.hpp>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+// Prints the memory usage of objects loaded from JSON.
+// Usage: demo_json_memory [file.json ...]
+// Without any arguments, a generated corpus is used instead.
+
+using Clock = std::chrono::high_resolution_clock;
+
+static std::string generate_corpus(std::size_t records) {
+    datapack::Object object;
+    for (std::size_t i = 0; i < records; i++) {
+        auto record = *object.push_back(datapack::Object::map_t());
+        record["index"] = datapack::Object::integer_t(i);
+        record["name"] = "record_with_a_long_name_" + std::to_string(i);
+        record["enabled"] = (i % 2 == 0);
+        auto position = record["position"];
+        position["x"] = 0.5 * i;
+        position["y"] = 0.25 * i;
+        auto values = record["values"];
+        for (std::size_t j = 0; j < 8; j++) {
+            values.push_back(double(i * j) / 3);
+        }
+    }
+    return datapack::dump_json(object);
+}
+
+// Records that mostly repeat the same few values
+static std::string generate_repetitive(std::size_t records) {
+    datapack::Object object;
+    for (std::size_t i = 0; i < records; i++) {
+        auto record = *object.push_back(datapack::Object::map_t());
+        record["unit"] = "metres_per_second";
+        record["status"] = (i % 3 == 0 ? "calibrating_sensor" : "measuring_sensor");
+        auto range = record["range"];
+        range["min"] = 0.0;
+        range["max"] = 100.0;
+        auto tags = record["tags"];
+        tags.push_back("outdoor_weather_station");
+        tags.push_back("wind_speed");
+    }
+    return datapack::dump_json(object);
+}
+
+static std::string generate_numbers(std::size_t count) {
+    datapack::Object object;
+    for (std::size_t i = 0; i < count; i++) {
+        object.push_back_packed(0.001 * i);
+    }
+    return datapack::dump_json(object);
+}
+
+static void report(const std::string& label, const std::string& json, bool dedupe = false) {
+    auto before = Clock::now();
+    datapack::Object object = datapack::load_json(json, {.dedupe = dedupe});
+    auto after = Clock::now();
+    auto stats = object.memory_stats();
+
+    std::cout << label << "\n";
+    std::cout << "    json bytes:        " << json.size() << "\n";
+    std::cout << "    load time (us):    " << std::chrono::duration_cast<std::chrono::microseconds>(after - before).count() << "\n";
+    std::cout << "    nodes:             " << stats.node_count << "\n";
+    std::cout << "    node slots:        " << stats.node_slots << " (capacity " << stats.node_capacity << ", free " << stats.free_slots << ")\n";
+    std::cout << "    node bytes:        " << stats.node_bytes << " (" << stats.node_bytes / std::max<std::size_t>(stats.node_capacity, 1) << " per slot)\n";
+    std::cout << "    free list bytes:   " << stats.free_list_bytes << "\n";
+    std::cout << "    key bytes:         " << stats.key_bytes << "\n";
+    std::cout << "    key table bytes:   " << stats.key_table_bytes << "\n";
+    std::cout << "    string bytes:      " << stats.string_bytes << "\n";
+    std::cout << "    binary bytes:      " << stats.binary_bytes << "\n";
+    std::cout << "    array bytes:       " << stats.array_bytes << "\n";
+    std::cout << "    shared bytes:      " << stats.shared_bytes << " (" << stats.shared_count << " subtrees)\n";
+    std::cout << "    total bytes:       " << stats.total_bytes() << "\n";
+    std::cout << "    fragmentation:     " << stats.fragmentation() << "\n";
+    std::cout << "    overhead per node: " << stats.overhead_per_node() << std::endl;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        report("generated (1000 records)", generate_corpus(1000));
+        report("generated (100000 records)", generate_corpus(100000));
+        report("generated (1000000 numbers)", generate_numbers(1000000));
+        std::string repetitive = generate_repetitive(100000);
+        report("repetitive (100000 records)", repetitive);
+        report("repetitive (100000 records, dedupe)", repetitive, true);
+        return 0;
+    }
+    for (int i = 1; i < argc; i++) {
+        std::ifstream file(argv[i]);
+        if (!file.is_open()) {
+            std::cerr << "Failed to open " << argv[i] << std::endl;
+            return 1;
+        }
+        std::stringstream ss;
+        ss << file.rdbuf();
+        report(argv[i], ss.str());
+    }
+    return 0;
+}
@@ -0,0 +1,72 @@
+#include <chrono>
+#include <iostream>
+#include <datapack/common.hpp>
+#include <datapack/format/json.hpp>
+#include <datapack/util/logger.hpp>
+
+// Measures the cost of logging an event on each thread, then views the
+// start of the log as JSON.
+
+struct TradeEvent {
+    std::uint64_t order_id;
+    std::int64_t price;
+    std::uint32_t quantity;
+    bool is_buy;
+};
+
+namespace datapack {
+DATAPACK_INLINE(TradeEvent, value, packer) {
+    packer.object_begin();
+    packer.value("order_id", value.order_id);
+    packer.value("price", value.price);
+    packer.value("quantity", value.quantity);
+    packer.value("is_buy", value.is_buy);
+    packer.object_end();
+}
+} // namespace datapack
+
+using Clock = std::chrono::high_resolution_clock;
+
+int main() {
+    using namespace datapack;
+
+    const auto path = std::filesystem::temp_directory_path() / "datapack_demo_log";
+    const std::size_t thread_count = std::max(std::thread::hardware_concurrency(), 1u);
+    const std::size_t count = 1000000;
+
+    auto before = Clock::now();
+    double total_ns = 0;
+    {
+        Logger logger(path);
+        std::vector<std::thread> threads;
+        std::vector<double> thread_ns(thread_count);
+        for (std::size_t t = 0; t < thread_count; t++) {
+            threads.emplace_back([&, t]() {
+                auto thread_before = Clock::now();
+                for (std::size_t i = 0; i < count; i++) {
+                    logger.log("trade", TradeEvent{i, std::int64_t(1000 + i % 50), std::uint32_t(i % 100), i % 2 == 0});
+                }
+                auto thread_after = Clock::now();
+                thread_ns[t] = std::chrono::duration<double, std::nano>(thread_after - thread_before).count() / count;
+            });
+        }
+        for (auto& thread: threads) {
+            thread.join();
+        }
+        for (double ns: thread_ns) {
+            total_ns += ns;
+        }
+    }
+    auto after = Clock::now();
+
+    std::cout << "Threads: " << thread_count << std::endl;
+    std::cout << "Log call (ns/event): " << total_ns / thread_count << std::endl;
+    std::cout << "Total, including writing (s): " << std::chrono::duration<double>(after - before).count() << std::endl;
+
+    auto view_before = Clock::now();
+    Object log = load_log(path);
+    auto view_after = Clock::now();
+    std::cout << "load_log (s): " << std::chrono::duration<double>(view_after - view_before).count() << std::endl;
+    std::cout << dump_json(log[0]) << std::endl;
+    std::filesystem::remove(path);
+}
@@ -0,0 +1,112 @@
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <vector>
+#include <datapack/format/json.hpp>
+#include <datapack/util/simd.hpp>
+
+// Benchmarks each SIMD level supported by this machine.
+// Use DATAPACK_SIMD=<level> to change the level used by default.
+
+using Clock = std::chrono::high_resolution_clock;
+
+static double measure_us(std::size_t N, const std::function<void()>& func) {
+    auto before = Clock::now();
+    for (std::size_t i = 0; i < N; i++) {
+        func();
+    }
+    auto after = Clock::now();
+    return double(std::chrono::duration_cast<std::chrono::microseconds>(after - before).count()) / N;
+}
+
+static std::string generate_json(std::size_t records) {
+    datapack::Object object;
+    for (std::size_t i = 0; i < records; i++) {
+        auto record = *object.push_back(datapack::Object::map_t());
+        record["name"] = "record_with_a_long_name_" + std::to_string(i);
+        record["description"] = std::string(40 + i % 50, 'x');
+        record["enabled"] = (i % 2 == 0);
+    }
+    return datapack::dump_json(object);
+}
+
+int main() {
+    using namespace datapack;
+
+    std::cout << "Detected: " << simd_level_name(simd_detected_level()) << std::endl;
+    std::cout << "Active: " << simd_level_name(simd_level()) << std::endl;
+
+    // Long runs between matches, so the kernels process full vectors
+    std::string text;
+    std::string whitespace;
+    for (std::size_t i = 0; i < (1 << 16); i++) {
+        text += std::string(200, 'x') + '"';
+        whitespace += std::string(200, ' ') + 'x';
+    }
+    const std::string json = generate_json(50000);
+    // Mostly ASCII, with a multi-byte character every few words
+    std::string utf8;
+    for (std::size_t i = 0; i < (1 << 16); i++) {
+        utf8 += (i % 4 == 0) ? "caf\xC3\xA9 \xE6\x97\xA5 " : "plain words ";
+    }
+    // 10-bit values, such as indices into a small table
+    std::vector<std::uint32_t> values(1 << 20);
+    for (std::size_t i = 0; i < values.size(); i++) {
+        values[i] = (i * 37) % 1024;
+    }
+    std::vector<std::uint8_t> packed(values.size() / 128 * 16 * 10);
+    std::vector<std::uint32_t> unpacked(values.size());
+    volatile std::size_t sink = 0;
+
+    SimdLevel initial = simd_level();
+    for (int i = 0; i <= int(SimdLevel::NEON); i++) {
+        SimdLevel level = SimdLevel(i);
+        if (!simd_supported(level)) {
+            continue;
+        }
+        const auto& kernels = simd_kernels(level);
+
+        double find_quote_us = measure_us(10, [&]() {
+            std::size_t pos = 0;
+            while (pos < text.size()) {
+                pos += kernels.find_quote(text.data() + pos, text.size() - pos) + 1;
+            }
+            sink = pos;
+        });
+        double skip_whitespace_us = measure_us(10, [&]() {
+            std::size_t pos = 0;
+            while (pos < whitespace.size()) {
+                pos += kernels.skip_whitespace(whitespace.data() + pos, whitespace.size() - pos) + 1;
+            }
+            sink = pos;
+        });
+        double pack_us = measure_us(10, [&]() {
+            for (std::size_t i = 0; i < values.size(); i += 128) {
+                kernels.pack_block(&values[i], 10, &packed[i / 128 * 160]);
+            }
+        });
+        double unpack_us = measure_us(10, [&]() {
+            for (std::size_t i = 0; i < values.size(); i += 128) {
+                kernels.unpack_block(&packed[i / 128 * 160], 10, &unpacked[i]);
+            }
+            sink = unpacked.back();
+        });
+        double validate_utf8_us = measure_us(10, [&]() {
+            sink = kernels.validate_utf8(utf8.data(), utf8.size());
+        });
+        set_simd_level(level);
+        double load_json_us = measure_us(5, [&]() {
+            sink = load_json(json).size();
+        });
+
+        std::cout << simd_level_name(level) << ":" << std::endl;
+        std::cout << "    find_quote (GB/s):      " << text.size() / find_quote_us / 1e3 << std::endl;
+        std::cout << "    skip_whitespace (GB/s): " << whitespace.size() / skip_whitespace_us / 1e3 << std::endl;
+        std::cout << "    pack_block (GB/s):      " << values.size() * 4 / pack_us / 1e3 << std::endl;
+        std::cout << "    unpack_block (GB/s):    " << values.size() * 4 / unpack_us / 1e3 << std::endl;
+        std::cout << "    validate_utf8 (GB/s):   " << utf8.size() / validate_utf8_us / 1e3 << std::endl;
+        std::cout << "    load_json (us):         " << load_json_us << std::endl;
+    }
+    set_simd_level(initial);
+    return 0;
+}
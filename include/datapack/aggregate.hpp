@@ -0,0 +1,215 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include "datapack/packer.hpp"
+
+
+namespace datapack {
+
+// Automatic pack functions for aggregates, packing each field as an object
+// value named after the field, in declaration order:
+//
+// struct Pose { double x; double y; double angle; };
+// DATAPACK_AUTO(Pose);
+//
+// The number of fields is found by brace initialization, fields are
+// accessed with structured bindings, and names are read from the
+// compiler's function signature (GCC and Clang). Fields must be public
+// and can't be C arrays or bitfields, and the aggregate can't have base
+// classes. A compile-time check rejects types where the detected fields
+// don't account for the whole size of the type. Up to 16 fields are
+// supported.
+
+static constexpr std::size_t aggregate_max_fields = 16;
+
+namespace aggregate_detail {
+
+struct any_field {
+    template <typename T>
+    operator T() const;
+};
+
+template <typename T, std::size_t... I>
+constexpr bool initializable(std::index_sequence<I...>) {
+    return requires { T{ (void(I), any_field{})... }; };
+}
+
+// Each initializer converts to any type, so brace elision doesn't apply,
+// and the largest valid number of initializers is the number of fields
+template <typename T, std::size_t N = 0>
+constexpr std::size_t count_fields() {
+    if constexpr (N > aggregate_max_fields) {
+        return N;
+    } else if constexpr (initializable<T>(std::make_index_sequence<N + 1>())) {
+        return count_fields<T, N + 1>();
+    } else {
+        return N;
+    }
+}
+
+#define DATAPACK_TIE_FIELDS(N, ...) \
+    else if constexpr (Count == N) { \
+        auto& [__VA_ARGS__] = value; \
+        return std::tie(__VA_ARGS__); \
+    }
+
+template <std::size_t Count, typename T>
+constexpr auto tie_fields(T& value) {
+    if constexpr (Count == 0) {
+        return std::tie();
+    }
+    DATAPACK_TIE_FIELDS(1, f0)
+    DATAPACK_TIE_FIELDS(2, f0, f1)
+    DATAPACK_TIE_FIELDS(3, f0, f1, f2)
+    DATAPACK_TIE_FIELDS(4, f0, f1, f2, f3)
+    DATAPACK_TIE_FIELDS(5, f0, f1, f2, f3, f4)
+    DATAPACK_TIE_FIELDS(6, f0, f1, f2, f3, f4, f5)
+    DATAPACK_TIE_FIELDS(7, f0, f1, f2, f3, f4, f5, f6)
+    DATAPACK_TIE_FIELDS(8, f0, f1, f2, f3, f4, f5, f6, f7)
+    DATAPACK_TIE_FIELDS(9, f0, f1, f2, f3, f4, f5, f6, f7, f8)
+    DATAPACK_TIE_FIELDS(10, f0, f1, f2, f3, f4, f5, f6, f7, f8, f9)
+    DATAPACK_TIE_FIELDS(11, f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10)
+    DATAPACK_TIE_FIELDS(12, f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11)
+    DATAPACK_TIE_FIELDS(13, f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12)
+    DATAPACK_TIE_FIELDS(14, f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12, f13)
+    DATAPACK_TIE_FIELDS(15, f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12, f13, f14)
+    DATAPACK_TIE_FIELDS(16, f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12, f13, f14, f15)
+}
+
+#undef DATAPACK_TIE_FIELDS
+
+// Never defined, only used for the addresses of its fields
+template <typename T>
+struct fake_wrapper {
+    const T value;
+};
+template <typename T>
+extern const fake_wrapper<T> fake_object;
+
+template <auto Pointer>
+constexpr std::string_view pointer_signature() {
+#if defined(__GNUC__) || defined(__clang__)
+    return __PRETTY_FUNCTION__;
+#else
+    static_assert(sizeof(Pointer) == 0, "Field names need GCC or Clang");
+#endif
+}
+
+// The signature ends with the pointer, as "...fake_object.value.x)]" (GCC,
+// which also qualifies the field as "T::x") or "...fake_object.value.x]"
+// (Clang)
+constexpr std::string_view parse_field_name(std::string_view signature) {
+    signature = signature.substr(signature.find("Pointer = ") + 10);
+    signature = signature.substr(0, signature.find_first_of(";]"));
+    while (!signature.empty() && signature.back() == ')') {
+        signature.remove_suffix(1);
+    }
+    return signature.substr(signature.find_last_of(".:") + 1);
+}
+
+template <typename T, std::size_t I>
+struct field_name {
+    static constexpr std::size_t count = count_fields<T>();
+    static constexpr std::string_view view = parse_field_name(
+        pointer_signature<&std::get<I>(tie_fields<count>(fake_object<T>.value))>());
+    // Null-terminated copy, since keys are passed as C strings
+    static constexpr auto chars = []() {
+        std::array<char, view.size() + 1> chars = {};
+        for (std::size_t i = 0; i < view.size(); i++) {
+            chars[i] = view[i];
+        }
+        return chars;
+    }();
+};
+
+template <typename T>
+using field_types = decltype(tie_fields<count_fields<T>()>(std::declval<T&>()));
+
+template <typename T, std::size_t I>
+using field_type = std::remove_cvref_t<std::tuple_element_t<I, field_types<T>>>;
+
+// Size of T laid out from the detected fields, as a C struct
+template <typename T>
+constexpr std::size_t layout_size() {
+    std::size_t offset = 0;
+    std::size_t align = 1;
+    [&]<std::size_t... I>(std::index_sequence<I...>) {
+        ((
+            offset = (offset + alignof(field_type<T, I>) - 1) / alignof(field_type<T, I>) * alignof(field_type<T, I>)
+                + sizeof(field_type<T, I>),
+            align = std::max(align, alignof(field_type<T, I>))
+        ), ...);
+    }(std::make_index_sequence<count_fields<T>()>());
+    return (offset + align - 1) / align * align;
+}
+
+} // namespace aggregate_detail
+
+template <typename T>
+concept reflectable_aggregate =
+    std::is_aggregate_v<T>
+    && aggregate_detail::count_fields<T>() <= aggregate_max_fields;
+
+template <reflectable_aggregate T>
+static constexpr std::size_t aggregate_field_count = aggregate_detail::count_fields<T>();
+
+// Field names of T, in declaration order
+template <reflectable_aggregate T>
+constexpr std::array<const char*, aggregate_field_count<T>> aggregate_field_names() {
+    return [&]<std::size_t... I>(std::index_sequence<I...>) {
+        return std::array<const char*, sizeof...(I)>{
+            aggregate_detail::field_name<T, I>::chars.data()...
+        };
+    }(std::make_index_sequence<aggregate_field_count<T>>());
+}
+
+// Aggregates whose fields are all numbers or other such aggregates, and so
+// are packed as trivial objects (given their size in object_begin), whose
+// binary layout matches their memory layout
+template <typename T>
+constexpr bool is_trivial_aggregate() {
+    if constexpr (std::is_arithmetic_v<T>) {
+        return true;
+    } else if constexpr (reflectable_aggregate<T> && std::is_trivially_constructible_v<T>) {
+        return [&]<std::size_t... I>(std::index_sequence<I...>) {
+            return (is_trivial_aggregate<aggregate_detail::field_type<T, I>>() && ...);
+        }(std::make_index_sequence<aggregate_field_count<T>>());
+    } else {
+        return false;
+    }
+}
+
+template <reflectable_aggregate T, int Mode>
+void pack_aggregate(packref<T, Mode> value, Packer<Mode>& packer) {
+    static constexpr std::size_t count = aggregate_field_count<T>;
+    static_assert(
+        aggregate_detail::layout_size<T>() == sizeof(T),
+        "The detected fields don't cover the type, which may have a C array or bitfield");
+    static constexpr std::size_t size = is_trivial_aggregate<T>() ? sizeof(T) : 0;
+
+    auto fields = aggregate_detail::tie_fields<count>(value);
+    packer.object_begin(size);
+    [&]<std::size_t... I>(std::index_sequence<I...>) {
+        (packer.value(aggregate_detail::field_name<T, I>::chars.data(), std::get<I>(fields)), ...);
+    }(std::make_index_sequence<count>());
+    packer.object_end(size);
+}
+
+#define DATAPACK_AUTO(T) \
+template <int Mode> \
+void pack(packref<T, Mode> value, Packer<Mode>& packer) { \
+    pack_aggregate<T, Mode>(value, packer); \
+}
+
+#define DATAPACK_AUTO_IMPL(T) \
+DATAPACK_IMPL(T, value, packer) { \
+    pack_aggregate<T, Mode>(value, packer); \
+}
+
+} // namespace datapack
@@ -10,7 +10,11 @@ template <typename T, std::size_t N>
 requires writeable<T>
 void pack(const std::array<T, N>& value, Writer& writer) {
     if (std::is_trivially_constructible_v<T> && writer.trivial_as_binary()) {
-        writer.binary((const std::uint8_t*)value.data(), value.size(), sizeof(T), true);
+        if constexpr(int_type_of<T>::defined) {
+            writer.integer_array(int_type_of<T>::value, value.data(), value.size(), true);
+        } else {
+            writer.binary((const std::uint8_t*)value.data(), value.size(), sizeof(T), true);
+        }
 
     } else {
         std::size_t trivial_size = std::is_trivially_constructible_v<T> ? N * sizeof(T) : 0;
@@ -33,7 +37,18 @@ template <typename T, std::size_t N>
 requires readable<T>
 void pack(std::array<T, N>& value, Reader& reader) {
     if (std::is_trivially_constructible_v<T> && reader.trivial_as_binary()) {
-        auto [data, length] = reader.binary(N, sizeof(T));
+        const std::uint8_t* data;
+        std::size_t length;
+        if constexpr(int_type_of<T>::defined) {
+            std::tie(data, length) = reader.integer_array(int_type_of<T>::value, N);
+        } else if constexpr(float_type_of<T>::defined) {
+            std::tie(data, length) = reader.floating_array(float_type_of<T>::value, N);
+        } else {
+            std::tie(data, length) = reader.binary(N, sizeof(T));
+        }
+        if (!data) {
+            return;
+        }
         std::size_t size = length * sizeof(T);
         std::memcpy((std::uint8_t*)value.data(), data, size);
 
@@ -53,6 +68,9 @@ template <typename T, std::size_t N>
 requires (!readable<T> && std::is_trivially_constructible_v<T>)
 void pack(std::array<T, N>& value, Reader& reader) {
     auto [data, length] = reader.binary(N, sizeof(T));
+    if (!data) {
+        return;
+    }
     std::size_t size = length * sizeof(T);
     std::memcpy((std::uint8_t*)value.data(), data, size);
 }
@@ -11,7 +11,11 @@ template <typename T>
 requires writeable<T>
 void pack(const std::vector<T>& value, Writer& writer) {
     if (std::is_trivially_constructible_v<T> && writer.trivial_as_binary()) {
-        writer.binary((const std::uint8_t*)value.data(), value.size(), sizeof(T), false);
+        if constexpr(int_type_of<T>::defined) {
+            writer.integer_array(int_type_of<T>::value, value.data(), value.size(), false);
+        } else {
+            writer.binary((const std::uint8_t*)value.data(), value.size(), sizeof(T), false);
+        }
 
     } else {
         writer.list_begin(std::is_trivially_constructible_v<T>);
@@ -33,7 +37,19 @@ template <typename T>
 requires readable<T>
 void pack(std::vector<T>& value, Reader& reader) {
     if (std::is_trivially_constructible_v<T> && reader.trivial_as_binary()) {
-        auto [data, length] = reader.binary(0, sizeof(T));
+        const std::uint8_t* data;
+        std::size_t length;
+        if constexpr(int_type_of<T>::defined) {
+            std::tie(data, length) = reader.integer_array(int_type_of<T>::value, 0);
+        } else if constexpr(float_type_of<T>::defined) {
+            std::tie(data, length) = reader.floating_array(float_type_of<T>::value, 0);
+        } else {
+            std::tie(data, length) = reader.binary(0, sizeof(T));
+        }
+        if (!data) {
+            value.clear();
+            return;
+        }
         value.resize(length);
         std::memcpy((std::uint8_t*)value.data(), data, length * sizeof(T));
 
@@ -52,6 +68,10 @@ template <typename T>
 requires (std::is_trivially_constructible_v<T> && !readable<T>)
 void pack(std::vector<T>& value, Reader& reader) {
     auto [data, length] = reader.binary(0, sizeof(T));
+    if (!data) {
+        value.clear();
+        return;
+    }
     value.resize(length);
     std::memcpy((std::uint8_t*)value.data(), data, length * sizeof(T));
 }
@@ -0,0 +1,25 @@
+#pragma once
+#ifndef EMBEDDED
+
+#include <cstddef>
+#include <cstdint>
+
+
+namespace datapack {
+
+// Values are packed in blocks of 128 using the SIMD kernels, with any
+// remainder packed one after another, least significant bit first.
+constexpr std::size_t bitpack_block_size = 128;
+
+// Number of bits needed to store the value, from 0 to 32
+int bitpack_width(std::uint32_t value);
+
+// Bytes used by count values, where a full block uses 16 * width bytes
+std::size_t bitpacked_size(std::size_t count, int width);
+
+// The values must be below 2^width
+void bitpack(const std::uint32_t* input, std::size_t count, int width, std::uint8_t* output);
+void bitunpack(const std::uint8_t* input, std::size_t count, int width, std::uint32_t* output);
+
+} // namespace datapack
+#endif
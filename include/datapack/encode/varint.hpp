@@ -0,0 +1,42 @@
+#pragma once
+#ifndef EMBEDDED
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+namespace datapack {
+
+// Maps signed values to unsigned, so that values near zero stay small:
+// 0, -1, 1, -2, ... become 0, 1, 2, 3, ...
+inline std::uint64_t zigzag(std::int64_t value) {
+    return (std::uint64_t(value) << 1) ^ std::uint64_t(value >> 63);
+}
+
+inline std::int64_t unzigzag(std::uint64_t value) {
+    return std::int64_t(value >> 1) ^ -std::int64_t(value & 1);
+}
+
+// Varints (LEB128) store 7 bits per byte, least significant first, with
+// the top bit set on every byte but the last
+
+inline std::size_t varint_size(std::uint64_t value) {
+    std::size_t size = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        size++;
+    }
+    return size;
+}
+
+inline void write_varint(std::vector<std::uint8_t>& output, std::uint64_t value) {
+    while (value >= 0x80) {
+        output.push_back(std::uint8_t(value) | 0x80);
+        value >>= 7;
+    }
+    output.push_back(std::uint8_t(value));
+}
+
+} // namespace datapack
+#endif
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+
+namespace datapack {
+
+class EncodingPlan;
+
+// Bounds for BinaryReader on untrusted input, where zero means unlimited.
+// Exceeding a limit invalidates the reader.
+struct BinaryLimits {
+    // Nested objects, tuples, lists and variants
+    std::size_t max_depth = 0;
+    // Elements of a list or array, or bytes of a string. Non-trivial lists
+    // aren't checked in embedded builds.
+    std::size_t max_length = 0;
+    // Total bytes of the variable-length strings and arrays returned by the
+    // reader, which the caller copies into its own containers
+    std::size_t max_allocation = 0;
+};
+
+// Options for BinaryWriter and BinaryReader. The format doesn't record which
+// options were used, so data must be read with the options it was written
+// with.
+struct BinaryOptions {
+    bool trivial_as_binary = true;
+    // Trivial integer arrays (std::vector and std::array) are split into
+    // blocks of 128 values, each stored as a width byte, the block minimum
+    // and the bitpacked offsets from the minimum. Schema-based readers
+    // (use_schema, binary_to_object) don't support this.
+    bool pack_integers = false;
+    // Trivial objects, tuples and lists have no padding between fields.
+    // Copying trivial vectors and arrays directly would keep the padded
+    // layout of the type, so they are written element by element, as
+    // without trivial_as_binary, which also disables pack_integers. This
+    // keeps the bytes the same as schema-based writers and readers. See
+    // suggest_field_order (schema/layout.hpp) to reduce padding without
+    // this option.
+    bool packed = false;
+    // Pads before the data of each trivial vector and array (and any other
+    // trivial list or tuple), so that it starts at a multiple of this many
+    // bytes from the start of the buffer. This is the same whether they're
+    // written as binary or element by element, as by schema-based writers.
+    // Zero disables it. Use the alignment of the element type, or 64 to
+    // align to cache lines. Doesn't apply inside trivial objects, which
+    // keep their layout. See BinaryReader::binary_view.
+    std::size_t binary_alignment = 0;
+    // Per-field encodings, see encoding_plan.hpp. Must outlive the writer
+    // or reader.
+    const EncodingPlan* plan = nullptr;
+    // Reader only
+    BinaryLimits limits = {};
+    // Reader only. Rejects strings that aren't valid UTF-8. Ignored in
+    // embedded builds.
+    bool validate_utf8 = false;
+    // Reader only. Throws BinaryReadError at the first invalid value,
+    // instead of invalidating the reader. Ignored in embedded builds.
+    bool fail_fast = false;
+};
+
+} // namespace datapack
@@ -1,21 +1,63 @@
 #pragma once
 
 #include "datapack/reader.hpp"
+#include "datapack/format/binary_options.hpp"
+#ifndef EMBEDDED
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include "datapack/format/encoding_plan.hpp"
+#endif
+#include <cstdint>
+#include <type_traits>
 #include <vector>
 
 
 namespace datapack {
 
+#ifndef EMBEDDED
+class BinaryReadError: public std::runtime_error {
+public:
+    BinaryReadError(const std::string& message, std::size_t pos):
+        std::runtime_error(message + " (at byte " + std::to_string(pos) + ")"),
+        pos(pos)
+    {}
+    const std::size_t pos;
+};
+#endif
+
+// Once invalid, the reader stops consuming data, so list_next returns false
+// and values are left unchanged.
+
 class BinaryReader : public Reader {
 public:
     BinaryReader(const std::span<const std::uint8_t>& data, bool trivial_as_binary=true):
-        Reader(trivial_as_binary),
+        BinaryReader(data, BinaryOptions{trivial_as_binary})
+    {}
+    BinaryReader(const std::span<const std::uint8_t>& data, const BinaryOptions& options):
+        Reader(options.trivial_as_binary && !options.packed),
         data(data),
         pos(0),
+        base(0),
+        after(0),
         binary_depth(0),
         binary_start(0),
-        trivial_list_remaining(0)
-    {}
+        trivial_list_remaining(0),
+        pack_integers(options.pack_integers),
+        packed(options.packed),
+        binary_alignment(options.binary_alignment),
+        limits(options.limits),
+        fail_fast(options.fail_fast),
+        validate_utf8(options.validate_utf8),
+        depth(0),
+        allocated(0)
+    {
+#ifndef EMBEDDED
+        if (options.plan) {
+            plan = std::make_unique<PlanState>(*options.plan);
+        }
+#endif
+    }
 
     void integer(IntType type, void* value) override;
     void floating(FloatType type, void* value) override;
@@ -23,42 +65,133 @@ public:
     const char* string() override;
     int enumerate(const std::span<const char*>& labels) override;
     std::tuple<const std::uint8_t*, std::size_t> binary(std::size_t length, std::size_t stride) override;
+#ifndef EMBEDDED
+    std::tuple<const std::uint8_t*, std::size_t> integer_array(IntType type, std::size_t length) override;
+#endif
 
     bool optional_begin() override;
     void optional_end() override {}
 
     int variant_begin(const std::span<const char*>& labels) override;
-    void variant_end() override {}
+    void variant_end() override;
 
     void object_begin(std::size_t size) override;
     void object_end(std::size_t size) override;
-    void object_next(const char* key) override {}
+    void object_next(const char* key) override;
 
-    void tuple_begin(std::size_t size) override { object_begin(size); }
-    void tuple_end(std::size_t size) override { object_end(size); }
-    void tuple_next() override {}
+    void tuple_begin(std::size_t size) override;
+    void tuple_end(std::size_t size) override;
+    void tuple_next() override;
 
     void list_begin(bool is_trivial) override;
     bool list_next() override;
     void list_end() override;
 
+    // Reads an array written as binary (eg: a trivial std::vector) in place,
+    // instead of copying it. Invalidates the reader if the array isn't
+    // aligned for T in memory, so the data must be written with a
+    // binary_alignment of at least alignof(T), into a buffer that is
+    // aligned as much.
+    template <typename T>
+    requires std::is_trivially_copyable_v<T>
+    std::span<const T> binary_view(std::size_t length = 0) {
+        auto [data, size] = binary(length, sizeof(T));
+        if (!data) {
+            return {};
+        }
+        if (reinterpret_cast<std::uintptr_t>(data) % alignof(T) != 0) {
+            fail("Binary data isn't aligned");
+            return {};
+        }
+        return std::span<const T>(reinterpret_cast<const T*>(data), size);
+    }
+
+protected:
+    // For readers over input split across several buffers (see
+    // ChainReader), where data is a window onto the input. Called when
+    // fewer than size bytes remain in the window, to move it to cover at
+    // least size bytes from the current position. Returns false if the
+    // input doesn't have them.
+    virtual bool refill(std::size_t /*size*/) {
+        return false;
+    }
+    // Position within the whole input
+    std::size_t position() const {
+        return base + pos;
+    }
+    // Sets the window to begin at the given position within the input,
+    // with the given number of bytes of input after it
+    void set_window(const std::span<const std::uint8_t>& window, std::size_t begin, std::size_t after) {
+        pos = position() - begin;
+        data = window;
+        base = begin;
+        this->after = after;
+    }
+
 private:
+    bool available(std::size_t size) {
+        return size <= data.size() - pos || refill(size);
+    }
+    std::size_t remaining() const {
+        return data.size() - pos + after;
+    }
+    bool can_read();
+    void fail(const char* message);
+    void depth_begin();
+    void allocate(std::size_t size);
+    const char* plain_string();
+    void trivial_begin(std::size_t size);
+    void trivial_end(std::size_t size);
     void pad(std::size_t size);
+    void align_binary();
     template <typename T>
     void value_number(T& value);
     bool value_bool();
+#ifndef EMBEDDED
+    bool value_varint(std::uint64_t& value);
+    template <typename T>
+    void packed_integers(T* values, std::size_t length);
+#endif
 
     std::span<const std::uint8_t> data;
     std::size_t pos;
+    std::size_t base; // Position of the window within the input
+    std::size_t after; // Bytes of input after the window
     std::size_t binary_depth;
     std::int64_t binary_start;
-    int trivial_list_remaining;
+    std::uint64_t trivial_list_remaining;
+    const bool pack_integers;
+    const bool packed;
+    const std::size_t binary_alignment;
+    const BinaryLimits limits;
+    const bool fail_fast;
+    const bool validate_utf8;
+    std::size_t depth;
+    std::size_t allocated;
+#ifndef EMBEDDED
+    std::vector<std::size_t> list_lengths;
+    std::vector<std::uint8_t> unpacked;
+    std::unique_ptr<PlanState> plan;
+#endif
 };
 
 template <readable T>
 T read_binary(const std::span<const std::uint8_t>& data) {
+    MetricTimer timer(MetricOp::ReadBinary);
+    T result;
+    BinaryReader reader(data);
+    reader.value(result);
+    timer.done(data.size(), reader.valid());
+    return result;
+}
+
+template <readable T>
+T read_binary(const std::span<const std::uint8_t>& data, const BinaryOptions& options) {
+    MetricTimer timer(MetricOp::ReadBinary);
     T result;
-    BinaryReader(data).value(result);
+    BinaryReader reader(data, options);
+    reader.value(result);
+    timer.done(data.size(), reader.valid());
     return result;
 }
 
@@ -0,0 +1,107 @@
+#pragma once
+#ifndef EMBEDDED
+
+#include <span>
+#include "datapack/format/binary_reader.hpp"
+#include "datapack/format/binary_writer.hpp"
+#include "datapack/util/async_file.hpp"
+
+
+namespace datapack {
+
+struct BinaryStreamOptions {
+    std::size_t buffer_size = 1 << 20;
+    // With two buffers, one is encoded or decoded while the other is
+    // written or read. More buffers absorb bursts of slow I/O.
+    std::size_t buffer_count = 2;
+    IoBackend backend = IoBackend::Auto;
+    BinaryOptions binary = {};
+};
+
+// Writes a file of binary messages, each prefixed by its size (u64).
+// Messages are copied into a buffer, which is written asynchronously once
+// full, while the next buffer is filled.
+class BinaryStreamWriter {
+public:
+    BinaryStreamWriter(const std::filesystem::path& path, const BinaryStreamOptions& options = {});
+    ~BinaryStreamWriter();
+
+    template <writeable T>
+    void write(const T& value) {
+        message.clear();
+        BinaryWriter(message, options.binary).value(value);
+        write_message(message);
+    }
+    // Writes a message that is already encoded
+    void write_message(const std::span<const std::uint8_t>& data);
+    // Writes a sequence of messages that already have their size prefixes
+    void write_framed(const std::span<const std::uint8_t>& data);
+
+    // Writes the partial buffer and waits for all writes to complete.
+    // Called by the destructor, which ignores errors.
+    void close();
+
+    AsyncFile& file() { return file_; }
+
+private:
+    void append(const std::uint8_t* data, std::size_t size);
+    void flush();
+
+    BinaryStreamOptions options;
+    AsyncFile file_;
+    std::size_t current;
+    std::size_t used;
+    std::uint64_t offset;
+    bool closed;
+    std::vector<std::uint8_t> message;
+};
+
+// Reads a file written by BinaryStreamWriter, reading ahead into every
+// buffer other than the one being decoded
+class BinaryStreamReader {
+public:
+    BinaryStreamReader(const std::filesystem::path& path, const BinaryStreamOptions& options = {});
+
+    // Returns false at the end of the stream. The data is valid until the
+    // next call. Throws IoError if a message is larger than the rest of the
+    // file, before allocating for it.
+    bool next(std::span<const std::uint8_t>& data);
+
+    // Returns false at the end of the stream, and throws IoError if the
+    // message doesn't match the type
+    template <readable T>
+    bool read(T& value) {
+        std::span<const std::uint8_t> data;
+        if (!next(data)) {
+            return false;
+        }
+        BinaryReader reader(data, options.binary);
+        reader.value(value);
+        if (!reader.valid()) {
+            throw IoError("Message doesn't match the type");
+        }
+        return true;
+    }
+
+    AsyncFile& file() { return file_; }
+
+private:
+    // Copies size bytes from the stream into output, returning false if
+    // the stream ends first
+    bool take(std::uint8_t* output, std::size_t size);
+    bool fill();
+    void read_ahead(std::size_t buffer);
+
+    BinaryStreamOptions options;
+    AsyncFile file_;
+    std::size_t current;
+    std::size_t available; // Bytes read into the current buffer
+    std::size_t used;
+    std::uint64_t next_offset;
+    std::uint64_t remaining; // Bytes of the file not yet taken
+    bool end;
+    std::vector<std::uint8_t> message;
+};
+
+} // namespace datapack
+#endif
@@ -2,6 +2,11 @@
 
 #include "datapack/reader.hpp"
 #include "datapack/writer.hpp"
+#include "datapack/format/binary_options.hpp"
+#ifndef EMBEDDED
+#include <memory>
+#include "datapack/format/encoding_plan.hpp"
+#endif
 #include <cstring>
 #include <vector>
 #include <assert.h>
@@ -19,13 +24,27 @@ public:
         mct::vector<std::uint8_t>
     >;
     BinaryWriter_(data_t& data, bool trivial_as_binary=true):
-        Writer(trivial_as_binary),
+        BinaryWriter_(data, BinaryOptions{trivial_as_binary})
+    {}
+    BinaryWriter_(data_t& data, const BinaryOptions& options):
+        Writer(options.trivial_as_binary && !options.packed),
         data(data),
         pos(data.size()),
         binary_depth(false),
         binary_start(0),
-        trivial_list_length(0)
-    {}
+        trivial_list_length(0),
+        trivial_list_pos(0),
+        pack_integers(options.pack_integers),
+        packed(options.packed),
+        binary_alignment(options.binary_alignment),
+        referenced(0)
+    {
+#ifndef EMBEDDED
+        if (options.plan) {
+            plan = std::make_unique<PlanState>(*options.plan);
+        }
+#endif
+    }
 
     void integer(IntType type, const void* value) override;
     void floating(FloatType type, const void* value) override;
@@ -37,41 +56,70 @@ public:
         std::size_t length,
         std::size_t stride,
         bool fixed_length) override;
+    void integer_array(
+        IntType type,
+        const void* input_data,
+        std::size_t length,
+        bool fixed_length) override;
 
     void optional_begin(bool has_value) override;
     void optional_end() override {}
 
     void variant_begin(int value, const char* label) override;
-    void variant_end() override {}
+    void variant_end() override;
 
     void object_begin(std::size_t size) override;
-    void object_next(const char* key) override {};
+    void object_next(const char* key) override;
     void object_end(std::size_t size) override;
 
     void list_begin(bool is_trivial) override;
     void list_next() override;
     void list_end() override;
 
-    void tuple_begin(std::size_t size) override { object_begin(size); }
-    void tuple_next() override {}
-    void tuple_end(std::size_t size) override { object_end(size); }
+    void tuple_begin(std::size_t size) override;
+    void tuple_next() override;
+    void tuple_end(std::size_t size) override;
 
     std::span<std::uint8_t> result() const {
         return std::span(&data[0], pos);
     }
 
+protected:
+#ifndef EMBEDDED
+    // Called with the data of each array written as binary, outside trivial
+    // objects. Returning true leaves the data out of the buffer, for a
+    // writer that refers to it in place instead (see ScatterWriter).
+    virtual bool reference_binary(const std::uint8_t* /*input_data*/, std::size_t /*size*/) {
+        return false;
+    }
+#endif
+
 private:
+    void trivial_begin(std::size_t size);
+    void trivial_end(std::size_t size);
     bool pad(std::size_t size);
+    bool align_binary();
     bool resize(std::size_t new_size);
     template <typename T>
     void value_number(T value);
     void value_bool(bool value);
+    void value_varint(std::uint64_t value);
+    template <typename T>
+    void packed_integers(const T* values, std::size_t length);
 
     data_t& data;
     std::size_t pos;
     std::size_t binary_depth;
     std::size_t binary_start;
     std::size_t trivial_list_length;
+    std::size_t trivial_list_pos; // Position of the length
+    const bool pack_integers;
+    const bool packed;
+    const std::size_t binary_alignment;
+    std::size_t referenced; // Bytes left out by reference_binary
+#ifndef EMBEDDED
+    std::unique_ptr<PlanState> plan;
+#endif
 };
 
 using BinaryWriter = BinaryWriter_<true>;
@@ -80,8 +128,19 @@ using BinaryWriterStatic = BinaryWriter_<false>;
 
 template <writeable T>
 std::vector<std::uint8_t> write_binary(const T& value) {
+    MetricTimer timer(MetricOp::WriteBinary);
     std::vector<std::uint8_t> data;
     BinaryWriter(data).value(value);
+    timer.done(data.size());
+    return data;
+}
+
+template <writeable T>
+std::vector<std::uint8_t> write_binary(const T& value, const BinaryOptions& options) {
+    MetricTimer timer(MetricOp::WriteBinary);
+    std::vector<std::uint8_t> data;
+    BinaryWriter(data, options).value(value);
+    timer.done(data.size());
     return data;
 }
 
@@ -0,0 +1,43 @@
+#pragma once
+#ifndef EMBEDDED
+
+#include <cstdint>
+#include <deque>
+#include <span>
+#include <vector>
+#include "datapack/format/binary_reader.hpp"
+
+
+namespace datapack {
+
+// Binary reader over input split across several buffers, eg: the segments
+// of a ring buffer or pages, read as if they were concatenated.
+// Values, strings and arrays within a single buffer are read in place.
+// Those that cross a boundary are copied into a stitch buffer, which is
+// kept so that returned pointers stay valid for the life of the reader.
+// The buffers must also outlive the reader.
+class ChainReader: public BinaryReader {
+public:
+    ChainReader(
+        const std::vector<std::span<const std::uint8_t>>& buffers,
+        const BinaryOptions& options = {});
+
+protected:
+    bool refill(std::size_t size) override;
+
+private:
+    std::vector<std::span<const std::uint8_t>> buffers;
+    std::vector<std::size_t> offsets; // Position of each buffer in the input
+    std::size_t total;
+    std::deque<std::vector<std::uint8_t>> stitches;
+};
+
+template <readable T>
+T read_binary(const std::vector<std::span<const std::uint8_t>>& buffers, const BinaryOptions& options = {}) {
+    T result;
+    ChainReader(buffers, options).value(result);
+    return result;
+}
+
+} // namespace datapack
+#endif
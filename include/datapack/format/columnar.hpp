@@ -0,0 +1,362 @@
+#pragma once
+#ifndef EMBEDDED
+
+#include <optional>
+#include <stdexcept>
+#include "datapack/writer.hpp"
+#include "datapack/reader.hpp"
+#include "datapack/object.hpp"
+#include "datapack/common.hpp"
+#include "datapack/labelled_enum.hpp"
+#include "datapack/labelled_variant.hpp"
+#include "datapack/schema/schema.hpp"
+#include "datapack/format/binary_reader.hpp"
+#include "datapack/format/binary_writer.hpp"
+
+
+namespace datapack {
+
+// Columnar files store a sequence of records with the same schema.
+// Records are split into row groups, and each leaf of the record (found by
+// following object keys and tuple indices) is stored as a separate column
+// chunk within each row group. Optional leaves are stored as nullable
+// columns. Values without a fixed set of leaves (lists, variants, binary
+// and optional containers) are stored as an opaque column, where each value
+// is written with the binary format.
+//
+// Layout: "DPCF" | column chunks | metadata | metadata size (u64) | "DPCF"
+// The metadata contains the schema and the location, encoding and
+// statistics of each column chunk.
+
+class ColumnarError: public std::runtime_error {
+public:
+    ColumnarError(const std::string& message):
+        std::runtime_error(message)
+    {}
+};
+
+enum class ColumnType {
+    Integer,
+    Floating,
+    Boolean,
+    String,
+    Enumerate,
+    Opaque
+};
+
+enum class ColumnEncoding {
+    Plain,
+    Dictionary, // Distinct values, followed by bitpacked indices
+    Delta,      // Zigzag varint differences between consecutive values
+    Bitpacked   // Offset from the minimum, with the minimum number of bits (up to 32)
+};
+DATAPACK_LABELLED_ENUM(ColumnEncoding, 4);
+
+// Integer, boolean and enumerate columns use the integer value, except
+// for u64 columns, which use the unsigned value
+using ColumnValue = std::variant<std::int64_t, double, std::string, std::uint64_t>;
+DATAPACK_LABELLED_VARIANT(ColumnValue, 4);
+
+struct ColumnStatistics {
+    std::uint64_t null_count = 0;
+    // Range of non-null values, not set for opaque columns
+    std::optional<ColumnValue> min;
+    std::optional<ColumnValue> max;
+};
+DATAPACK(ColumnStatistics);
+
+struct ColumnChunk {
+    std::uint64_t offset = 0;
+    std::uint64_t size = 0;
+    ColumnEncoding encoding = ColumnEncoding::Plain;
+    ColumnStatistics statistics;
+};
+DATAPACK(ColumnChunk);
+
+struct RowGroup {
+    std::uint64_t row_count = 0;
+    std::vector<ColumnChunk> columns;
+};
+DATAPACK(RowGroup);
+
+struct ColumnarMetadata {
+    Schema schema;
+    std::vector<RowGroup> row_groups;
+};
+DATAPACK(ColumnarMetadata);
+
+struct ColumnInfo {
+    std::string path; // Keys and tuple indices separated by '.'
+    ColumnType type;
+    bool nullable;
+    std::vector<Token> tokens; // Schema of each value, excluding the optional
+};
+
+// Columns are always derived from the schema, so aren't stored in the file
+std::vector<ColumnInfo> get_columns(const Schema& schema);
+
+// Values of a column within a row group. Only non-null values are stored.
+struct ColumnData {
+    std::vector<std::uint8_t> valid; // Per row, for nullable columns
+    std::vector<std::int64_t> integers;
+    std::vector<double> floats;
+    std::vector<std::string> strings;
+    std::vector<std::vector<std::uint8_t>> blobs;
+    void clear();
+};
+
+// Writer that splits records into columns, used by ColumnarWriter
+class ColumnShredder: public Writer {
+public:
+    ColumnShredder(const std::vector<ColumnInfo>& columns, std::vector<ColumnData>& data);
+
+    void begin_record();
+    void end_record();
+
+    void integer(IntType type, const void* value) override;
+    void floating(FloatType type, const void* value) override;
+    void boolean(bool value) override;
+    void string(const char* value) override;
+    void enumerate(int value, const char* label) override;
+    void binary(const std::uint8_t* data, std::size_t length, std::size_t stride, bool fixed_length) override;
+
+    void optional_begin(bool has_value) override;
+    void optional_end() override;
+
+    void variant_begin(int value, const char* label) override;
+    void variant_end() override;
+
+    void object_begin(std::size_t size) override;
+    void object_next(const char* key) override;
+    void object_end(std::size_t size) override;
+
+    void tuple_begin(std::size_t size) override;
+    void tuple_next() override;
+    void tuple_end(std::size_t size) override;
+
+    void list_begin(bool is_trivial) override;
+    void list_next() override;
+    void list_end() override;
+
+private:
+    // Opaque values are forwarded to the inner writer or reader, starting
+    // with a call matching the first token of the column. The call returns
+    // the change in depth, and the value ends when the depth returns to 0.
+    template <typename StartToken, typename Call>
+    bool forward(const Call& call);
+    ColumnData& next_leaf(ColumnType type);
+
+    const std::vector<ColumnInfo>& columns;
+    std::vector<ColumnData>& data;
+    std::size_t column;
+    std::vector<std::uint8_t> capture_data;
+    std::optional<BinaryWriter> capture;
+    int capture_depth;
+};
+
+// Reads empty values, used to skip opaque columns that aren't projected
+class DefaultReader: public Reader {
+public:
+    DefaultReader():
+        Reader(false)
+    {}
+
+    void integer(IntType type, void* value) override;
+    void floating(FloatType type, void* value) override {
+        if (type == FloatType::F32) {
+            *(float*)value = 0;
+        } else {
+            *(double*)value = 0;
+        }
+    }
+    bool boolean() override { return false; }
+    const char* string() override { return ""; }
+    int enumerate(const std::span<const char*>& labels) override { return 0; }
+    std::tuple<const std::uint8_t*, std::size_t> binary(std::size_t length, std::size_t stride) override;
+
+    bool optional_begin() override { return false; }
+    void optional_end() override {}
+
+    int variant_begin(const std::span<const char*>& labels) override { return 0; }
+    void variant_end() override {}
+
+    void object_begin(std::size_t size) override {}
+    void object_next(const char* key) override {}
+    void object_end(std::size_t size) override {}
+
+    void tuple_begin(std::size_t size) override {}
+    void tuple_next() override {}
+    void tuple_end(std::size_t size) override {}
+
+    void list_begin(bool is_trivial) override {}
+    bool list_next() override { return false; }
+    void list_end() override {}
+
+private:
+    std::vector<std::uint8_t> zeros;
+};
+
+// Reader that reassembles records from columns, used by ColumnarReader.
+// Columns that aren't projected leave the value unchanged, or read as
+// null or empty.
+class ColumnAssembler: public Reader {
+public:
+    ColumnAssembler(
+        const std::vector<ColumnInfo>& columns,
+        const std::vector<ColumnData>& data,
+        const std::vector<bool>& projected);
+
+    void begin_record();
+
+    void integer(IntType type, void* value) override;
+    void floating(FloatType type, void* value) override;
+    bool boolean() override;
+    const char* string() override;
+    int enumerate(const std::span<const char*>& labels) override;
+    std::tuple<const std::uint8_t*, std::size_t> binary(std::size_t length, std::size_t stride) override;
+
+    bool optional_begin() override;
+    void optional_end() override;
+
+    int variant_begin(const std::span<const char*>& labels) override;
+    void variant_end() override;
+
+    void object_begin(std::size_t size) override;
+    void object_next(const char* key) override;
+    void object_end(std::size_t size) override;
+
+    void tuple_begin(std::size_t size) override;
+    void tuple_next() override;
+    void tuple_end(std::size_t size) override;
+
+    void list_begin(bool is_trivial) override;
+    bool list_next() override;
+    void list_end() override;
+
+private:
+    template <typename StartToken, typename Call>
+    bool forward(const Call& call);
+    const ColumnData* next_leaf(ColumnType type, std::size_t& index);
+
+    const std::vector<ColumnInfo>& columns;
+    const std::vector<ColumnData>& data;
+    const std::vector<bool>& projected;
+    std::size_t column;
+    std::size_t row;
+    std::size_t next_row;
+    std::vector<std::size_t> value_index;
+    std::optional<BinaryReader> capture;
+    DefaultReader defaults;
+    Reader* inner;
+    int capture_depth;
+};
+
+class ColumnarWriter {
+public:
+    ColumnarWriter(const Schema& schema, std::size_t row_group_size = 1 << 16);
+
+    template <writeable T>
+    void write(const T& record) {
+        shredder.begin_record();
+        shredder.value(record);
+        shredder.end_record();
+        row_count++;
+        if (row_count == row_group_size) {
+            flush();
+        }
+    }
+
+    // Writes any remaining rows and the metadata, and returns the file
+    std::vector<std::uint8_t> finish();
+
+private:
+    void flush();
+
+    ColumnarMetadata metadata;
+    std::vector<ColumnInfo> columns;
+    std::vector<ColumnData> data;
+    ColumnShredder shredder;
+    std::size_t row_group_size;
+    std::size_t row_count;
+    std::vector<std::uint8_t> output;
+};
+
+// Keeps row groups that may contain values within [min, max] for a column
+struct ColumnRange {
+    std::string path;
+    std::optional<ColumnValue> min;
+    std::optional<ColumnValue> max;
+};
+
+class ColumnarReader {
+public:
+    // The data must outlive the reader. The limits apply to the metadata,
+    // and max_length also bounds the rows of each row group, since column
+    // chunks of constant values can hold any number of rows.
+    ColumnarReader(const std::span<const std::uint8_t>& data, const BinaryLimits& limits = {});
+
+    const ColumnarMetadata& metadata() const { return metadata_; }
+    const std::vector<ColumnInfo>& columns() const { return columns_; }
+    std::size_t row_count() const;
+
+    // Row groups that may contain rows satisfying all the ranges, using
+    // the statistics of each column chunk
+    std::vector<std::size_t> select_row_groups(const std::vector<ColumnRange>& ranges = {}) const;
+
+    // Values of a single column, as a list with null for null values
+    Object read_column(const std::string& path, const std::vector<std::size_t>& row_groups) const;
+
+    // Reads records from the given row groups. If projection is non-empty,
+    // only the listed columns are decoded.
+    template <readable T>
+    std::vector<T> read(
+        const std::vector<std::size_t>& row_groups,
+        const std::vector<std::string>& projection = {}) const
+    {
+        if (!(create_schema<T>() == metadata_.schema)) {
+            throw ColumnarError("Record type doesn't match the schema of the file");
+        }
+        std::vector<bool> projected = get_projected(projection);
+        std::vector<T> result;
+        for (std::size_t row_group: row_groups) {
+            auto data = decode_row_group(row_group, projected);
+            ColumnAssembler assembler(columns_, data, projected);
+            for (std::size_t i = 0; i < metadata_.row_groups[row_group].row_count; i++) {
+                result.emplace_back();
+                assembler.begin_record();
+                assembler.value(result.back());
+            }
+            if (!assembler.valid()) {
+                throw ColumnarError("Failed to read records");
+            }
+        }
+        return result;
+    }
+
+private:
+    std::vector<bool> get_projected(const std::vector<std::string>& projection) const;
+    std::vector<ColumnData> decode_row_group(std::size_t row_group, const std::vector<bool>& projected) const;
+
+    std::span<const std::uint8_t> data;
+    ColumnarMetadata metadata_;
+    std::vector<ColumnInfo> columns_;
+};
+
+template <readable T>
+requires writeable<T>
+std::vector<std::uint8_t> write_columnar(const std::vector<T>& records, std::size_t row_group_size = 1 << 16) {
+    ColumnarWriter writer(create_schema<T>(), row_group_size);
+    for (const auto& record: records) {
+        writer.write(record);
+    }
+    return writer.finish();
+}
+
+template <readable T>
+std::vector<T> read_columnar(const std::span<const std::uint8_t>& data, const BinaryLimits& limits = {}) {
+    ColumnarReader reader(data, limits);
+    return reader.read<T>(reader.select_row_groups());
+}
+
+} // namespace datapack
+#endif
@@ -0,0 +1,150 @@
+#pragma once
+#ifndef EMBEDDED
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "datapack/common.hpp"
+#include "datapack/labelled_enum.hpp"
+#include "datapack/schema/schema.hpp"
+
+
+namespace datapack {
+
+// Encodings the binary format can use for individual fields, in place of
+// the fixed-size default. Fields are identified by their path: object keys,
+// tuple indices, variant labels and "*" for list elements, separated by '.'
+// (eg: "items.*.count").
+enum class FieldEncoding {
+    Fixed,
+    Varint,     // Integers, LEB128 with zigzag for signed types
+    Delta,      // Integers, zigzag varint difference from the previous value
+                // of the same field within the message
+    Dictionary  // Strings, varint index of an earlier value, or 0 followed
+                // by a new value
+};
+DATAPACK_LABELLED_ENUM(FieldEncoding, 4);
+
+struct FieldPlan {
+    std::string path;
+    FieldEncoding encoding;
+};
+DATAPACK(FieldPlan);
+
+// Used with BinaryOptions::plan. Data written with a plan must be read with
+// the same plan.
+class EncodingPlan {
+public:
+    EncodingPlan();
+    EncodingPlan(const std::vector<FieldPlan>& fields);
+
+    const std::vector<FieldPlan>& fields() const { return fields_; }
+    FieldEncoding encoding(const std::string& path) const;
+
+private:
+    friend class PlanState;
+    struct Node {
+        std::vector<std::pair<std::string, int>> children;
+        FieldEncoding encoding = FieldEncoding::Fixed;
+    };
+    int find_child(int node, const char* key) const;
+
+    std::vector<FieldPlan> fields_;
+    std::vector<Node> nodes; // Tree of path segments, with the root first
+};
+
+void pack(const EncodingPlan& value, Writer& writer);
+void pack(EncodingPlan& value, Reader& reader);
+
+// Follows the position of the current value within the plan, along with
+// the state of delta and dictionary fields. Used by BinaryWriter and
+// BinaryReader, which forward their container calls.
+class PlanState {
+public:
+    PlanState(const EncodingPlan& plan);
+
+    void object_begin();
+    void object_next(const char* key);
+    void tuple_begin();
+    void tuple_next();
+    void list_begin();
+    void list_next();
+    void variant_begin(const char* label);
+    void container_end();
+
+    // Encoding of the current value, falling back to fixed where the
+    // planned encoding doesn't apply to the type
+    FieldEncoding integer_encoding() const;
+    FieldEncoding string_encoding() const;
+
+    std::int64_t& previous();
+    std::unordered_map<std::string, std::uint64_t>& write_dictionary();
+    std::vector<const char*>& read_dictionary();
+
+private:
+    struct Frame {
+        int node;
+        int child;
+        int index;
+        int element;
+    };
+    struct NodeState {
+        std::int64_t previous = 0;
+        std::unordered_map<std::string, std::uint64_t> write_dictionary;
+        std::vector<const char*> read_dictionary;
+    };
+    FieldEncoding encoding() const;
+    NodeState& node_state();
+
+    const EncodingPlan& plan;
+    std::vector<Frame> frames;
+    std::vector<NodeState> node_states;
+};
+
+struct FieldStatistics {
+    std::string path;
+    bool is_string = false;
+    std::uint64_t count = 0;
+    // Range of integer values
+    std::int64_t min = 0;
+    std::int64_t max = 0;
+    // Number of distinct values, up to 65536
+    std::uint64_t distinct = 0;
+    // Fraction of values greater or equal to the previous value, and
+    // fraction equal to an earlier value, within the same message
+    double monotonic = 0;
+    double repeated = 0;
+    // Size with each encoding, or 0 where it doesn't apply
+    std::uint64_t fixed_bytes = 0;
+    std::uint64_t varint_bytes = 0;
+    std::uint64_t delta_bytes = 0;
+    std::uint64_t dictionary_bytes = 0;
+    FieldEncoding encoding = FieldEncoding::Fixed;
+};
+DATAPACK(FieldStatistics);
+
+struct EncodingReport {
+    EncodingPlan plan;
+    std::vector<FieldStatistics> fields;
+    // The corpus re-encoded with the default options and with the plan,
+    // and the time to encode and decode all of it
+    std::uint64_t default_bytes = 0;
+    std::uint64_t planned_bytes = 0;
+    double default_encode_seconds = 0;
+    double planned_encode_seconds = 0;
+    double default_decode_seconds = 0;
+    double planned_decode_seconds = 0;
+};
+DATAPACK(EncodingReport);
+
+// Chooses the smallest encoding for each integer and string field of the
+// schema, over a corpus of messages written with the default binary
+// options. Fields stay fixed unless another encoding saves at least
+// min_saving of their size, since the fixed encoding is the fastest.
+EncodingReport train_encoding_plan(
+    const Schema& schema,
+    const std::vector<std::vector<std::uint8_t>>& corpus,
+    double min_saving = 0.1);
+
+} // namespace datapack
+#endif
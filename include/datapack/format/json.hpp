@@ -18,12 +18,23 @@ public:
     {}
 };
 
-Object load_json(const std::string& json);
-std::string dump_json(const Object::ConstReference& object);
+struct JsonOptions {
+    // Throws JsonLoadError for keys and strings that aren't valid UTF-8
+    bool validate_utf8 = false;
+    // Identical maps and lists share their children as they're loaded, see
+    // Object::dedupe
+    bool dedupe = false;
+};
+
+Object load_json(const std::string& json, const JsonOptions& options = {});
+// With more than one thread, large objects are written in parallel, using
+// the given number of threads, or the number of hardware threads if zero.
+// The output doesn't depend on the number of threads.
+std::string dump_json(const Object::ConstReference& object, std::size_t threads = 1);
 
 template <readable T>
-T read_json(const std::string& json) {
-    Object object = load_json(json);
+T read_json(const std::string& json, const JsonOptions& options = {}) {
+    Object object = load_json(json, options);
     T result;
     ObjectReader(object).value(result);
     return result;
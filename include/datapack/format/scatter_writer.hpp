@@ -0,0 +1,56 @@
+#pragma once
+#ifndef EMBEDDED
+
+#include <cstdint>
+#include <vector>
+#include <sys/uio.h>
+#include "datapack/format/binary_writer.hpp"
+
+
+namespace datapack {
+
+// Binary writer that refers to large arrays in place instead of copying
+// them into the buffer. The output is a list of segments, alternating
+// between ranges of the buffer and referenced arrays, which concatenate to
+// the same bytes as BinaryWriter with the same options.
+// Referenced arrays must stay unchanged until the segments are written.
+class ScatterWriter: public BinaryWriter {
+public:
+    // Arrays of at least threshold bytes are referenced
+    ScatterWriter(
+        std::vector<std::uint8_t>& data,
+        std::size_t threshold = 1 << 14,
+        const BinaryOptions& options = {}
+    ):
+        BinaryWriter(data, options),
+        threshold(threshold)
+    {}
+
+    // Points into the buffer, so only valid until the next write
+    std::vector<iovec> segments() const;
+    // Total size of the segments
+    std::size_t size() const;
+    // Copies the segments into a single buffer
+    std::vector<std::uint8_t> flatten() const;
+
+    // Writes all segments with writev (or pwritev at an offset), handling
+    // partial writes. Throws IoError on failure.
+    void write_to(int fd) const;
+    void write_to(int fd, std::uint64_t offset) const;
+
+protected:
+    bool reference_binary(const std::uint8_t* input_data, std::size_t size) override;
+
+private:
+    struct Reference {
+        std::size_t pos; // Position in the buffer the array follows
+        const std::uint8_t* data;
+        std::size_t size;
+    };
+    const std::size_t threshold;
+    std::vector<Reference> references;
+    std::size_t referenced_size = 0;
+};
+
+} // namespace datapack
+#endif
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstdint>
+
 namespace datapack {
 
 enum class IntType {
@@ -15,4 +17,61 @@ enum class FloatType {
     F64
 };
 
+constexpr int float_type_size(FloatType type) {
+    switch (type) {
+        case FloatType::F32:
+            return 4;
+        case FloatType::F64:
+            return 8;
+    }
+    return 0;
+}
+
+constexpr int int_type_size(IntType type) {
+    switch (type) {
+        case IntType::I32:
+        case IntType::U32:
+            return 4;
+        case IntType::I64:
+        case IntType::U64:
+            return 8;
+        case IntType::U8:
+            return 1;
+    }
+    return 0;
+}
+
+// Maps integer types to their IntType, if they have one
+template <typename T>
+struct int_type_of {
+    static constexpr bool defined = false;
+};
+
+template <IntType Type>
+struct int_type_of_defined {
+    static constexpr bool defined = true;
+    static constexpr IntType value = Type;
+};
+
+template <> struct int_type_of<std::int32_t>: int_type_of_defined<IntType::I32> {};
+template <> struct int_type_of<std::int64_t>: int_type_of_defined<IntType::I64> {};
+template <> struct int_type_of<std::uint32_t>: int_type_of_defined<IntType::U32> {};
+template <> struct int_type_of<std::uint64_t>: int_type_of_defined<IntType::U64> {};
+template <> struct int_type_of<std::uint8_t>: int_type_of_defined<IntType::U8> {};
+
+// Maps floating point types to their FloatType, if they have one
+template <typename T>
+struct float_type_of {
+    static constexpr bool defined = false;
+};
+
+template <FloatType Type>
+struct float_type_of_defined {
+    static constexpr bool defined = true;
+    static constexpr FloatType value = Type;
+};
+
+template <> struct float_type_of<float>: float_type_of_defined<FloatType::F32> {};
+template <> struct float_type_of<double>: float_type_of_defined<FloatType::F64> {};
+
 } // namespace datapack
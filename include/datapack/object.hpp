@@ -8,11 +8,15 @@
 #include <stdexcept>
 #include <memory>
 #include <stack>
+#include <unordered_map>
+#include <cstdint>
 #include <assert.h>
 
 
 namespace datapack {
 
+class Journal;
+
 class Object {
 public:
     using integer_t = std::int64_t;
@@ -21,6 +25,12 @@ public:
     struct null_t {};
     struct map_t {};
     struct list_t {};
+    // Lists of numbers with a single type are stored contiguously, instead
+    // of with a node per element. These are expanded into a regular list
+    // when their elements are accessed through a mutable reference. Const
+    // references read the elements in place.
+    using integer_array_t = std::vector<integer_t>;
+    using floating_array_t = std::vector<floating_t>;
 
     using value_t = std::variant<
         integer_t,
@@ -30,7 +40,9 @@ public:
         binary_t,
         null_t,
         map_t,
-        list_t
+        list_t,
+        integer_array_t,
+        floating_array_t
     >;
 
     class LookupException: public std::runtime_error {
@@ -50,14 +62,15 @@ public:
 private:
     struct Node {
         value_t value;
-        std::string key;
+        int key; // Index into keys
         int parent;
         int child;
         int prev;
         int next;
+        int last_child;
         int child_count;
-        Node(const value_t& value, const std::string& key, int parent, int prev):
-            value(value), key(key), parent(parent), child(-1), prev(prev), next(-1), child_count(0)
+        Node(const value_t& value, int key, int parent, int prev):
+            value(value), key(key), parent(parent), child(-1), prev(prev), next(-1), last_child(-1), child_count(0)
         {}
     };
 
@@ -71,7 +84,8 @@ private:
     public:
         template <bool OtherConst, typename = std::enable_if_t<!OtherConst || IsConst>>
         Reference_(const Reference_<OtherConst>& other):
-            object(other.object), index(other.index)
+            object(other.object), index(other.index), element(other.element),
+            link(other.link), link_index(other.link_index)
         {}
 
         const Reference_& operator=(const value_t& value) const;
@@ -83,27 +97,69 @@ private:
 
         Iterator_<IsConst> insert(const std::string& key, const value_t& value) const;
         Iterator_<IsConst> push_back(const value_t& value) const;
+        // Appends to a list, keeping it packed if possible. Doesn't return
+        // an iterator, since this would require expanding the list.
+        void push_back_packed(const value_t& value) const;
         Iterator_<IsConst> erase() const;
         void clear() const;
         std::size_t size() const;
 
+        // Moves the value of another object into a new child of this map or
+        // list. Its nodes are moved across in one block, so strings, arrays
+        // and shared children aren't copied. The source is left null.
+        Iterator_<IsConst> splice(const std::string& key, Object&& source) const;
+        Iterator_<IsConst> splice(Object&& source) const;
+        // Moves this node, with its children, to the end of another map or
+        // list in the same object. Nodes are relinked in place, so this takes
+        // constant time, and references into the subtree stay valid.
+        Iterator_<IsConst> move_to(const Reference_<false>& parent, const std::string& key) const;
+        Iterator_<IsConst> move_to(const Reference_<false>& parent) const;
+
         Object clone() const;
 
-        bool is_map() const { return std::get_if<map_t>(&value()); }
-        bool is_list() const { return std::get_if<list_t>(&value()); }
-        bool is_null() const { return std::get_if<null_t>(&value()); }
+        // True if the children of this node are shared with identical
+        // subtrees, see Object::dedupe
+        bool is_shared() const { return element == -1 && object->nodes[index].child_count < 0; }
+        // True if both nodes share the same children, in which case they
+        // are equal without comparing their children
+        bool shares_with(const Reference_<true>& other) const {
+            return is_shared() && other.is_shared()
+                && object->shared_nodes.at(index) == other.object->shared_nodes.at(other.index);
+        }
+
+        bool is_map() const { return element == -1 && std::get_if<map_t>(&node_value()); }
+        bool is_list() const { return element == -1 && (std::get_if<list_t>(&node_value()) || is_packed()); }
+        bool is_packed() const {
+            return element == -1
+                && (std::get_if<integer_array_t>(&node_value()) || std::get_if<floating_array_t>(&node_value()));
+        }
+        bool is_null() const { return element == -1 && std::get_if<null_t>(&node_value()); }
 
+        // Elements of packed arrays are read from the array, so only have
+        // integer() or floating(), and don't have a value().
         std::conditional_t<IsConst, const integer_t&, integer_t&> integer() const {
+            if constexpr (IsConst) {
+                if (element != -1) return std::get<integer_array_t>(node_value())[element];
+            }
             return std::get<integer_t>(value());
         }
         std::conditional_t<IsConst, const integer_t*, integer_t*> integer_if() const {
+            if constexpr (IsConst) {
+                if (element != -1) return packed_element_if<integer_t>();
+            }
             return std::get_if<integer_t>(&value());
         }
 
         std::conditional_t<IsConst, const floating_t&, floating_t&> floating() const {
+            if constexpr (IsConst) {
+                if (element != -1) return std::get<floating_array_t>(node_value())[element];
+            }
             return std::get<floating_t>(value());
         }
         std::conditional_t<IsConst, const floating_t*, floating_t*> floating_if() const {
+            if constexpr (IsConst) {
+                if (element != -1) return packed_element_if<floating_t>();
+            }
             return std::get_if<floating_t>(&value());
         }
 
@@ -111,6 +167,7 @@ private:
             return std::get<bool>(value());
         }
         std::conditional_t<IsConst, const bool*, bool*> boolean_if() const {
+            if (element != -1) return nullptr;
             return std::get_if<bool>(&value());
         }
 
@@ -118,6 +175,7 @@ private:
             return std::get<std::string>(value());
         }
         std::conditional_t<IsConst, const std::string*, std::string*> string_if() const {
+            if (element != -1) return nullptr;
             return std::get_if<std::string>(&value());
         }
 
@@ -125,26 +183,107 @@ private:
             return std::get<binary_t>(value());
         }
         std::conditional_t<IsConst, const binary_t*, binary_t*> binary_if() const {
+            if (element != -1) return nullptr;
             return std::get_if<binary_t>(&value());
         }
 
+        std::conditional_t<IsConst, const integer_array_t*, integer_array_t*> integer_array_if() const {
+            if (element != -1) return nullptr;
+            return std::get_if<integer_array_t>(&value());
+        }
+        std::conditional_t<IsConst, const floating_array_t*, floating_array_t*> floating_array_if() const {
+            if (element != -1) return nullptr;
+            return std::get_if<floating_array_t>(&value());
+        }
+
         const std::string& key() const {
-            return object->nodes[index].key;
+            if (element != -1) return object->keys[0];
+            return object->keys[object->nodes[index].key];
         }
         std::conditional_t<IsConst, const value_t&, value_t&> value() const {
+            if constexpr (IsConst) {
+                if (element != -1) {
+                    throw ValueException("Tried to access the value of a packed array element, use integer() or floating()");
+                }
+            }
             return object->nodes[index].value;
         }
         Iterator_<IsConst> iter() const;
 
     private:
+        // For an element, the value of the packed array
+        const value_t& node_value() const {
+            return object->nodes[index].value;
+        }
+        template <typename T>
+        const T* packed_element_if() const {
+            auto values = std::get_if<std::vector<T>>(&node_value());
+            return values ? &(*values)[element] : nullptr;
+        }
+        // Copy of the value of an element
+        value_t element_value() const {
+            if (auto x = packed_element_if<integer_t>()) return *x;
+            return std::get<floating_array_t>(node_value())[element];
+        }
+
         Reference_(object_t object, int index):
-            object(object), index(index)
+            object(object), index(index), element(-1), link(nullptr), link_index(-1)
         {}
+        // Element of the packed array at another reference, read without
+        // expanding it
+        Reference_(const Reference_& array, int element) requires IsConst:
+            Reference_(array)
+        {
+            this->element = element;
+        }
+
+        // The node holding the children of this node. Shared children are
+        // read in place, but are copied into this node before modifying them.
+        std::pair<object_t, int> contents() const {
+            if (!is_shared()) {
+                return { object, index };
+            }
+            if constexpr (IsConst) {
+                const auto& shared = object->shared_nodes.at(index);
+                return { shared.get(), shared->root_index };
+            } else {
+                object->index_unshare(index);
+                return { object, index };
+            }
+        }
+
+        // A node in the same object, or in the contents() of this node,
+        // keeping the link to the node that shares the children it's in
+        Reference_ relative(object_t target, int target_index) const {
+            Reference_ result(target, target_index);
+            if (target == object) {
+                result.link = link;
+                result.link_index = link_index;
+            } else {
+                result.link = object;
+                result.link_index = index;
+            }
+            return result;
+        }
+
         object_t object;
         int index;
+        // For an element of a packed array, its position, since it has no
+        // node. Only const references use this.
+        int element;
+        // For a node inside shared children, the node sharing them, which
+        // shared children don't store since they can have many. Shared
+        // children don't contain shared nodes themselves, see Object::dedupe,
+        // so this is a single link. Only const references use these.
+        object_t link;
+        int link_index;
 
+        template <bool OtherConst>
+        friend class Reference_;
         template <bool OtherConst>
         friend class Iterator_;
+        template <bool OtherConst>
+        friend class Cursor_;
         friend class Object;
     };
 
@@ -158,21 +297,48 @@ private:
         const Reference_<IsConst>* operator->() const { return &ref; }
         operator bool() const { return valid(); }
 
+        // Within shared children (see Object::dedupe), the parent of the
+        // top-level children is the node that shares them
         Iterator_ parent() const {
             if (!valid()) return Iterator_();
-            return Iterator_(ref.object, node().parent);
+            if (ref.element != -1) return Iterator_(ref.relative(ref.object, ref.index));
+            if (ref.link && node().parent == ref.object->root_index) {
+                return Iterator_(ref.link, ref.link_index);
+            }
+            return Iterator_(ref.relative(ref.object, node().parent));
         }
         Iterator_ child() const {
-            if (!valid()) return Iterator_();
-            return Iterator_(ref.object, node().child);
+            if (!valid() || ref.element != -1) return Iterator_();
+            auto [object, index] = ref.contents();
+            if constexpr (IsConst) {
+                if (ref.is_packed()) {
+                    if (object->index_size(index) == 0) return Iterator_();
+                    return Iterator_(Reference_<IsConst>(ref.relative(object, index), 0));
+                }
+            } else {
+                object->index_expand(index);
+            }
+            return Iterator_(ref.relative(object, object->nodes[index].child));
         }
         Iterator_ prev() const {
             if (!valid()) return Iterator_();
-            return Iterator_(ref.object, node().prev);
+            if constexpr (IsConst) {
+                if (ref.element != -1) {
+                    if (ref.element == 0) return Iterator_();
+                    return Iterator_(Reference_<IsConst>(ref, ref.element - 1));
+                }
+            }
+            return Iterator_(ref.relative(ref.object, node().prev));
         }
         Iterator_ next() const {
             if (!valid()) return Iterator_();
-            return Iterator_(ref.object, node().next);
+            if constexpr (IsConst) {
+                if (ref.element != -1) {
+                    if (std::size_t(ref.element) + 1 == ref.object->index_size(ref.index)) return Iterator_();
+                    return Iterator_(Reference_<IsConst>(ref, ref.element + 1));
+                }
+            }
+            return Iterator_(ref.relative(ref.object, node().next));
         }
 
         template <bool OtherConst, typename = std::enable_if_t<!OtherConst || IsConst>>
@@ -188,6 +354,9 @@ private:
         Iterator_(object_t object, int index):
             ref(object, index)
         {}
+        Iterator_(const Reference_<IsConst>& ref):
+            ref(ref)
+        {}
 
         bool valid() const {
             return ref.object != nullptr && ref.index != -1;
@@ -200,16 +369,136 @@ private:
         }
 
         Reference_<IsConst> ref;
+        template <bool OtherConst>
+        friend class Cursor_;
         friend class Object;
     };
 
+    // Depth-first walk over a subtree, which follows the parent/child/next
+    // links stored in each node, so doesn't require any additional memory,
+    // other than the link to the shared node (see Object::dedupe) it's inside.
+    // Every node produces an enter event. Maps and lists also produce an
+    // exit event, once all their children have been visited.
+    template <bool IsConst>
+    class Cursor_ {
+        using object_t = std::conditional_t<IsConst, const Object*, Object*>;
+
+    public:
+        Cursor_(const Reference_<IsConst>& root):
+            object(root.object),
+            root_object(root.object),
+            root(root.index),
+            root_element(root.element),
+            index(root.index),
+            link(root.link),
+            link_index(root.link_index),
+            depth_(0),
+            entering_(true),
+            skip_(false)
+        {}
+
+        operator bool() const { return index != -1; }
+        Iterator_<IsConst> iter() const {
+            Reference_<IsConst> ref(object, index);
+            ref.link = link;
+            ref.link_index = link_index;
+            if constexpr (IsConst) {
+                if (index == root && object == root_object && root_element != -1) {
+                    return Iterator_<IsConst>(Reference_<IsConst>(ref, root_element));
+                }
+            }
+            return Iterator_<IsConst>(ref);
+        }
+
+        // Depth relative to the root of the cursor
+        int depth() const { return depth_; }
+        // True for the enter event, false for the exit event
+        bool entering() const { return entering_; }
+
+        void next() {
+            if (index == -1) return;
+            const Node& node = object->nodes[index];
+            bool skip = skip_;
+            skip_ = false;
+            if (entering_ && is_container(node)) {
+                if (skip) {
+                    entering_ = false;
+                    return;
+                }
+                auto [contents_object, contents_index] = Reference_<IsConst>(object, index).contents();
+                int child = contents_object->nodes[contents_index].child;
+                if (child == -1) {
+                    entering_ = false;
+                    return;
+                }
+                if (contents_object != object) {
+                    link = object;
+                    link_index = index;
+                    object = contents_object;
+                }
+                index = child;
+                depth_++;
+                return;
+            }
+            if (index == root && object == root_object) {
+                index = -1;
+                return;
+            }
+            if (node.next != -1) {
+                index = node.next;
+                entering_ = true;
+                return;
+            }
+            depth_--;
+            entering_ = false;
+            // Leaving shared children, back to the node that shares them
+            if (object != root_object && node.parent == object->root_index) {
+                object = link;
+                index = link_index;
+                link = nullptr;
+                link_index = -1;
+                return;
+            }
+            index = node.parent;
+        }
+
+        // Don't visit the children of the current node. If the node is a
+        // map or list, the next event is its exit event.
+        void skip() {
+            skip_ = true;
+        }
+
+    private:
+        static bool is_container(const Node& node) {
+            return std::get_if<map_t>(&node.value) || std::get_if<list_t>(&node.value);
+        }
+
+        object_t object;
+        object_t root_object;
+        int root;
+        int root_element; // See Reference_::element
+        int index;
+        object_t link; // See Reference_::link
+        int link_index;
+        int depth_;
+        bool entering_;
+        bool skip_;
+    };
+
 public:
     using Reference = Reference_<false>;
     using ConstReference = Reference_<true>;
     using Iterator = Iterator_<false>;
     using ConstIterator = Iterator_<true>;
+    using Cursor = Cursor_<false>;
+    using ConstCursor = Cursor_<true>;
 
     Object();
+    Object(const Object&) = default;
+    Object(Object&&) = default;
+    // Recorded as a new checkpoint if the object has a journal
+    Object& operator=(const Object& other);
+    Object& operator=(Object&& other);
 
     operator Reference();
     operator ConstReference() const;
@@ -227,14 +516,91 @@ public:
 
     Iterator insert(const std::string& key, const value_t& value);
     Iterator push_back(const value_t& value);
+    void push_back_packed(const value_t& value);
     Iterator erase();
     void clear();
     std::size_t size() const;
 
+    Iterator splice(const std::string& key, Object&& source);
+    Iterator splice(Object&& source);
+
     Object clone() const;
 
+    // Heap usage of the object. Byte counts for keys and strings only
+    // include heap allocations, not strings held in the small string buffer.
+    struct MemoryStats {
+        std::size_t node_count;     // Live nodes
+        std::size_t node_slots;     // Live and free nodes in the node array
+        std::size_t node_capacity;  // Allocated capacity of the node array
+        std::size_t free_slots;
+        std::size_t node_bytes;     // Size of the node array
+        std::size_t free_list_bytes;
+        std::size_t key_bytes;      // Each distinct key, counted once
+        std::size_t key_table_bytes;  // Table of distinct keys, excluding key_bytes
+        std::size_t string_bytes;
+        std::size_t binary_bytes;
+        std::size_t array_bytes;    // Packed numeric arrays
+        std::size_t shared_count;   // Distinct shared subtrees, see dedupe
+        std::size_t shared_bytes;   // Shared subtrees, counted once, and links to them
+
+        std::size_t total_bytes() const {
+            return node_bytes + free_list_bytes + key_bytes + key_table_bytes + string_bytes + binary_bytes
+                + array_bytes + shared_bytes;
+        }
+        // Fraction of the node array that is unused, either free slots or
+        // spare capacity
+        double fragmentation() const {
+            if (node_capacity == 0) return 0;
+            return 1.0 - double(node_count) / node_capacity;
+        }
+        // Bytes used per live node, excluding string and binary payloads
+        double overhead_per_node() const {
+            if (node_count == 0) return 0;
+            return double(node_bytes + free_list_bytes + key_bytes + key_table_bytes) / node_count;
+        }
+    };
+    MemoryStats memory_stats() const;
+
+    // Shares identical subtrees between the nodes of one object, so that
+    // each distinct subtree is stored once. Maps and lists are added once
+    // complete, children before parents, and each non-empty map or list
+    // identical to one added previously (including keys, and the exact
+    // values of floats) is linked to a shared copy of its children.
+    // Nodes must belong to the same object, which must outlive the deduper.
+    class Deduper {
+    public:
+        void add(const Reference& node);
+
+    private:
+        struct Candidate {
+            std::shared_ptr<const Object> shared;
+            int index; // First occurrence, until it's shared
+        };
+        std::uint64_t shared_hash(const std::shared_ptr<const Object>& shared);
+
+        std::unordered_map<std::uint64_t, std::vector<Candidate>> candidates;
+        std::unordered_map<const Object*, std::uint64_t> shared_hashes;
+        std::vector<std::uint64_t> hashes; // By node index, for added maps and lists
+    };
+
+    // Stores each distinct map or list once, with identical subtrees sharing
+    // their children. Shared children are immutable, and are copied back into
+    // a node when it or its children are modified, so sharing doesn't change
+    // the value of the object. Copies and clones keep sharing the children,
+    // and comparing two nodes that share children doesn't visit them.
+    // Shared children don't nest: sharing a subtree that contains shared
+    // nodes copies their children into the new shared children.
+    // Invalidates references into the object.
+    // Shared children are never modified, since packed arrays are only
+    // expanded through mutable references, which copy the shared children
+    // first, so objects sharing children can be read concurrently.
+    void dedupe();
+
     bool is_map() const { return std::get_if<map_t>(&value()); }
-    bool is_list() const { return std::get_if<list_t>(&value()); }
+    bool is_list() const { return std::get_if<list_t>(&value()) || is_packed(); }
+    bool is_packed() const {
+        return std::get_if<integer_array_t>(&value()) || std::get_if<floating_array_t>(&value());
+    }
     bool is_null() const { return std::get_if<null_t>(&value()); }
 
     integer_t& integer() { return std::get<integer_t>(value()); }
@@ -262,6 +628,11 @@ public:
     binary_t* binary_if() { return std::get_if<binary_t>(&value()); }
     const binary_t* binary_if() const { return std::get_if<binary_t>(&value()); }
 
+    integer_array_t* integer_array_if() { return std::get_if<integer_array_t>(&value()); }
+    const integer_array_t* integer_array_if() const { return std::get_if<integer_array_t>(&value()); }
+    floating_array_t* floating_array_if() { return std::get_if<floating_array_t>(&value()); }
+    const floating_array_t* floating_array_if() const { return std::get_if<floating_array_t>(&value()); }
+
     const value_t& value() const {
         return nodes[root_index].value;
     }
@@ -280,7 +651,15 @@ public:
 private:
     int add_node(const Node& node);
     int add_child(int parent, const std::string& key = "");
+    // Adds a use of the key, returning its index
+    int add_key(const std::string& key);
+    void release_key(int key);
+    int find_key(const std::string& key) const;
     int get_last_child(int node) const;
+    // Links a node as the last child of the parent
+    void link_child(int parent, int node);
+    // Removes a node from its parent's children, without freeing it
+    void unlink(int node);
 
     void index_assign(int index, const value_t& value);
 
@@ -290,14 +669,59 @@ private:
 
     int index_insert(int parent, const std::string& key, const value_t& value);
     int index_push_back(int parent, const value_t& value);
+    void index_push_back_packed(int parent, const value_t& value);
     int index_erase(int index);
     void index_clear(int index);
+    // Key is null when appending to a list
+    int index_splice(int parent, const std::string* key, Object&& source);
+    int index_move(int index, int parent, const std::string* key);
+    std::size_t index_size(int index) const;
+
+    // Converts a packed array into a regular list
+    void index_expand(int index);
+
+    Object index_clone(int index, bool keep_shared = true) const;
 
-    Object index_clone(int index) const;
+    // Replaces the children of a node with shared children
+    void index_share(int index, std::shared_ptr<const Object> shared);
+    // Copies shared children into the node, so they can be modified
+    void index_unshare(int index);
+
+    // Copies the subtree at "from" into the node "to", which is overwritten.
+    // Shared children stay shared, unless keep_shared is false.
+    static void copy_into(Iterator to, ConstReference from, bool keep_shared = true);
+    friend Object merge(const ConstReference& base, const ConstReference& diff);
+
+    struct SharedStats;
+    void add_memory_stats(MemoryStats& stats, SharedStats& shared) const;
 
     std::vector<Node> nodes;
     std::stack<int> free;
     int root_index;
+    // Children of shared nodes, which are marked with a negative child count,
+    // so this is only searched for shared nodes
+    std::unordered_map<int, std::shared_ptr<const Object>> shared_nodes;
+    // Each distinct key is stored once, since maps in the same document
+    // usually have the same keys, and nodes store an index into the table.
+    // Keys count the nodes using them, and are removed once the last is
+    // erased, so maps keyed by changing ids don't grow the table. Their
+    // slots are reused for new keys. The empty key (index 0) is never removed.
+    std::vector<std::string> keys;
+    std::vector<int> key_counts;
+    std::stack<int> free_keys;
+    std::unordered_map<std::string, int> key_indices;
+
+    // Not copied with the object, see Journal
+    struct JournalLink {
+        Journal* journal = nullptr;
+        bool busy = false; // In a mutation, so nested mutations aren't recorded
+        JournalLink() = default;
+        JournalLink(const JournalLink&) {}
+        JournalLink& operator=(const JournalLink&) { return *this; }
+    };
+    class JournalScope;
+    JournalLink journal_link;
+    friend class Journal;
 };
 
 // How merge and diff work:
@@ -330,8 +754,8 @@ private:
 //       the last element. There is no wasy for diff(base, modified) to distinguish
 //       between the two.
 
-Object merge(Object::ConstReference base, Object::ConstReference diff);
-Object diff(Object::ConstReference base, Object::ConstReference modified);
+Object merge(const Object::ConstReference& base, const Object::ConstReference& diff);
+Object diff(const Object::ConstReference& base, const Object::ConstReference& modified);
 
 bool operator==(const Object::ConstReference& lhs, const Object::ConstReference& rhs);
 inline bool operator==(const Object::Reference& lhs, const Object::Reference& rhs) {
@@ -8,6 +8,7 @@
 #include "datapack/packer.hpp"
 #include "datapack/number.hpp"
 #include "datapack/constraint.hpp"
+#include "datapack/util/metrics.hpp"
 
 
 namespace datapack {
@@ -64,6 +65,12 @@ public:
     virtual const char* string() = 0;
     virtual int enumerate(const std::span<const char*>& labels) = 0;
     virtual std::tuple<const std::uint8_t*, std::size_t> binary(std::size_t length, std::size_t stride) = 0;
+    virtual std::tuple<const std::uint8_t*, std::size_t> integer_array(IntType type, std::size_t length) {
+        return binary(length, int_type_size(type));
+    }
+    virtual std::tuple<const std::uint8_t*, std::size_t> floating_array(FloatType type, std::size_t length) {
+        return binary(length, float_type_size(type));
+    }
 
     // Single-element containers
 
@@ -92,7 +99,12 @@ public:
 
     // Other
 
-    void invalidate() { valid_ = false; }
+    void invalidate() {
+        if (valid_) {
+            metric_invalidated();
+        }
+        valid_ = false;
+    }
     bool valid() const { return valid_; }
     bool trivial_as_binary() const { return trivial_as_binary_; }
     bool is_tokenizer() const { return is_tokenizer_; }
@@ -1,13 +1,83 @@
 #pragma once
 #ifndef EMBEDDED
 
+#include <chrono>
+#include <functional>
 #include "datapack/schema/schema.hpp"
 #include "datapack/object.hpp"
+#include "datapack/format/binary_options.hpp"
+#include "datapack/format/binary_writer.hpp"
+#include "datapack/util/object_reader.hpp"
+#include "datapack/util/random.hpp"
 
 namespace datapack {
 
 Object binary_to_object(const Schema& schema, const std::vector<std::uint8_t>& bytes);
 std::vector<std::uint8_t> object_to_binary(const Schema& schema, const Object::ConstReference& object);
 
+// Encodes a snapshot to the binary format over several calls, eg: one per
+// tick of a control loop, so that encoding a large value doesn't have to
+// fit within one tick. The snapshot is held by the job, so the source can
+// change while it runs. Copies of a deduped object share their children
+// (see Object::dedupe), so a snapshot of a mostly unchanged object is
+// cheap to take.
+// The budget is checked every few values, so a step can overrun it by the
+// time to encode a few values, or one large string or array. Growing the
+// output copies it, which for large outputs takes longer than a typical
+// budget, so reserve the expected size, eg: that of the previous snapshot.
+class BinaryEncodeJob {
+public:
+    BinaryEncodeJob(
+        const Schema& schema,
+        Object snapshot,
+        std::size_t reserve = 0,
+        const BinaryOptions& options = {});
+
+    BinaryEncodeJob(const BinaryEncodeJob&) = delete;
+    BinaryEncodeJob& operator=(const BinaryEncodeJob&) = delete;
+
+    // Each returns true once the snapshot is encoded
+    bool step_bytes(std::size_t byte_budget);
+    bool step(std::chrono::nanoseconds time_budget);
+
+    bool done() const { return runner.done(); }
+    // False if the snapshot doesn't match the schema
+    bool valid() const { return reader.valid(); }
+    // The encoded data so far
+    const std::vector<std::uint8_t>& result() const { return data; }
+
+private:
+    const Schema schema;
+    const Object snapshot;
+    std::vector<std::uint8_t> data;
+    ObjectReader reader;
+    BinaryWriter writer;
+    SchemaRunner runner;
+};
+
+struct RandomBinaryOptions {
+    RandomOptions random;
+    BinaryOptions binary;
+    std::uint64_t seed = 0;
+    std::size_t threads = 0; // Zero for the hardware concurrency
+};
+
+// Generates random messages for a schema, in the binary format. Each message
+// is seeded from the seed and its index, so the output doesn't depend on the
+// number of threads. Schemas don't include constraints, so these aren't
+// applied.
+// Output is called from the worker threads, in no particular order, and the
+// data is only valid during the call.
+void random_binary(
+    const Schema& schema,
+    std::size_t count,
+    const std::function<void(std::size_t index, const std::vector<std::uint8_t>& data)>& output,
+    const RandomBinaryOptions& options = {});
+
+std::vector<std::vector<std::uint8_t>> random_binary(
+    const Schema& schema,
+    std::size_t count,
+    const RandomBinaryOptions& options = {});
+
 } // namespace datapack
 #endif
@@ -0,0 +1,33 @@
+#pragma once
+#ifndef EMBEDDED
+
+#include <string>
+#include <vector>
+#include "datapack/common.hpp"
+#include "datapack/schema/schema.hpp"
+
+
+namespace datapack {
+
+// A field order for a trivial object (one given its size in object_begin)
+// with less padding, where each field is aligned to its own alignment as
+// in a C struct. Paths use the same form as encoding plans, with "" for the
+// root.
+struct FieldOrder {
+    std::string path;
+    std::vector<std::string> fields;
+    std::vector<std::string> suggested;
+    std::size_t size = 0;
+    std::size_t suggested_size = 0;
+};
+DATAPACK(FieldOrder);
+
+// Suggests a new order for each trivial object in the schema where
+// reordering reduces padding, by sorting fields from largest to smallest
+// alignment, keeping the current order between fields of equal alignment.
+// Nested objects count as a single field with the largest alignment of
+// their own fields.
+std::vector<FieldOrder> suggest_field_order(const Schema& schema);
+
+} // namespace datapack
+#endif
@@ -3,6 +3,7 @@
 #include "datapack/schema/token.hpp"
 #include "datapack/schema/tokenizer.hpp"
 #include "datapack/packer.hpp"
+#include <stack>
 
 
 namespace datapack {
@@ -19,11 +20,61 @@ Schema create_schema() {
     return schema;
 }
 
+// Returns the position after the tokens for the value starting at begin
+std::size_t get_tokens_end(const std::vector<Token>& tokens, std::size_t begin);
+
 void use_schema(const Schema& schema, Reader& reader, Writer& writer);
 inline void use_schema(const Schema& schema, Reader&& reader, Writer&& writer) {
     use_schema(schema, reader, writer);
 }
 
+// Runs use_schema a number of tokens at a time, so that converting a large
+// value can be spread over several calls. The schema, reader and writer
+// must outlive the runner.
+class SchemaRunner {
+public:
+    SchemaRunner(const Schema& schema, Reader& reader, Writer& writer);
+
+    // Processes up to max_tokens tokens, counting the tokens of a list's
+    // element again for each element. Returns true once the value is
+    // complete.
+    bool step(std::size_t max_tokens);
+    bool done() const { return finished; }
+
+private:
+    enum class StateType {
+        None,
+        List,
+        Array,
+        Optional,
+        Variant
+    };
+    struct State {
+        const StateType type;
+        const std::size_t value_tokens_begin;
+        const std::size_t value_tokens_end;
+        int remaining;
+        State(
+            StateType type,
+            std::size_t value_tokens_begin,
+            std::size_t value_tokens_end,
+            int remaining
+        ):
+            type(type),
+            value_tokens_begin(value_tokens_begin),
+            value_tokens_end(value_tokens_end),
+            remaining(remaining)
+        {}
+    };
+
+    const Schema& schema;
+    Reader& reader;
+    Writer& writer;
+    std::stack<State> states;
+    std::size_t token_pos;
+    bool finished;
+};
+
 DATAPACK(Schema);
 
 bool operator==(const Schema& lhs, const Schema& rhs);
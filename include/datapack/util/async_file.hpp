@@ -0,0 +1,87 @@
+#pragma once
+#ifndef EMBEDDED
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+
+namespace datapack {
+
+class IoError: public std::runtime_error {
+public:
+    IoError(const std::string& message):
+        std::runtime_error(message)
+    {}
+};
+
+enum class IoBackend {
+    Auto,    // io_uring if the kernel allows it, otherwise threads
+    IoUring,
+    Threads  // Blocking reads and writes on a shared thread pool
+};
+
+class AsyncIo;
+
+// Asynchronous positional reads and writes on a file, each using one of a
+// fixed set of buffers. With io_uring the buffers are registered with the
+// kernel, so they aren't mapped again for every request.
+class AsyncFile {
+public:
+    enum class Mode {
+        Read,
+        Write // Creates or truncates the file
+    };
+
+    AsyncFile(
+        const std::filesystem::path& path,
+        Mode mode,
+        std::size_t buffer_size,
+        std::size_t buffer_count = 2,
+        IoBackend backend = IoBackend::Auto);
+    ~AsyncFile();
+
+    AsyncFile(const AsyncFile&) = delete;
+    AsyncFile& operator=(const AsyncFile&) = delete;
+
+    IoBackend backend() const { return backend_; }
+    std::size_t buffer_size() const { return buffer_size_; }
+    std::size_t buffer_count() const { return buffers.size(); }
+    std::uint8_t* buffer(std::size_t index) { return buffers[index]; }
+
+    // Starts a request on the first size bytes of a buffer. The buffer
+    // must not be used again until the request is waited for.
+    void write(std::size_t buffer, std::size_t size, std::uint64_t offset);
+    void read(std::size_t buffer, std::size_t size, std::uint64_t offset);
+
+    bool pending(std::size_t buffer) const { return pending_[buffer]; }
+    // Waits for the request on a buffer, returning the number of bytes
+    // transferred. Reads are only short at the end of the file.
+    std::size_t wait(std::size_t buffer);
+
+private:
+    struct Request {
+        bool write;
+        std::size_t size;
+        std::uint64_t offset;
+    };
+    void submit(bool write, std::size_t buffer, std::size_t size, std::uint64_t offset);
+    void release();
+
+    int fd;
+    std::size_t buffer_size_;
+    std::vector<std::uint8_t*> buffers;
+    std::vector<bool> pending_;
+    std::vector<Request> requests;
+    IoBackend backend_;
+    std::unique_ptr<AsyncIo> io;
+};
+
+// Whether io_uring can be used, which may be disabled by the kernel or a
+// seccomp policy
+bool io_uring_supported();
+
+} // namespace datapack
+#endif
@@ -0,0 +1,121 @@
+#pragma once
+#ifndef EMBEDDED
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "datapack/object.hpp"
+
+
+namespace datapack {
+
+class JournalError: public std::runtime_error {
+public:
+    JournalError(const std::string& message):
+        std::runtime_error(message)
+    {}
+};
+
+struct JournalOptions {
+    // Entries are buffered and written once the buffer reaches this size
+    std::size_t buffer_size = 1 << 16;
+    // When flushing, the journal is compacted once the entries written since
+    // the checkpoint are larger than the checkpoint by this ratio. Zero
+    // disables compaction, other than by calling compact().
+    double compact_ratio = 2.0;
+};
+
+struct JournalStats {
+    std::size_t entries = 0;            // Since the last checkpoint
+    std::uint64_t entry_bytes = 0;      // Since the last checkpoint, including buffered entries
+    std::uint64_t checkpoint_bytes = 0;
+    std::size_t compactions = 0;        // Checkpoints written after the first
+};
+
+// Records each mutation of an object (assign, insert, push_back, erase,
+// clear, splice and move_to, including through operator[]) to a file, as a checkpoint of the
+// whole object followed by an entry per mutation. Nodes are identified by
+// their path from the root, as the position of each node within its parent,
+// since node indices aren't kept when the object is reloaded.
+// Entries are written when the buffer fills or on flush(), and a crash
+// loses at most the unflushed entries.
+// Assigning a whole object to it (eg: the result of merge()) is recorded as
+// a new checkpoint. Values are read through any reference, but are only
+// recorded when written with operator=, so writes through the references
+// returned by the accessors (eg: integer()) aren't recorded. Copies of the
+// object aren't journaled. The object must outlive the journal.
+class Journal {
+public:
+    // Truncates the file, starting it with a checkpoint of the object
+    Journal(const std::filesystem::path& path, Object& object, const JournalOptions& options = {});
+    ~Journal();
+
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+
+    // Writes buffered entries, compacting if needed
+    void flush();
+    // Replaces the file with a checkpoint of the object's current value,
+    // via a temporary file, so the file is complete if interrupted
+    void compact();
+
+    const JournalStats& stats() const { return stats_; }
+
+private:
+    void record_assign(int index, const Object::value_t& value);
+    void record_insert(int parent, const std::string& key, const Object::value_t& value);
+    void record_push_back(int parent, const Object::value_t& value, bool packed);
+    void record_erase(int index);
+    void record_clear(int index);
+    void record_splice(int parent, const std::string* key, Object::ConstReference subtree);
+    void record_move(int index, int parent, const std::string* key);
+    void record_checkpoint();
+
+    // Keep the positions of the nodes up to date, see Siblings
+    void link_node(int parent, int index);
+    void unlink_node(int index);
+    void free_node(int index);
+    void reset_nodes();
+
+    void begin_entry(std::uint8_t op, int index);
+    void write_path(int index);
+    std::uint64_t position(int index);
+    void end_entry();
+    void write_buffer();
+
+    std::filesystem::path path;
+    Object& object;
+    const JournalOptions options;
+    std::ofstream file;
+    std::vector<std::uint8_t> buffer;
+    std::size_t entry_begin;
+    std::vector<std::uint64_t> path_buffer;
+    JournalStats stats_;
+
+    // Children are only ever appended, so each child is numbered in the
+    // order it was linked, and its position is the number of children still
+    // linked with a lower number, counted by a Fenwick tree over the numbers.
+    // This is built when a path first goes through the parent, then updated
+    // as children are linked and unlinked, so recording an entry doesn't
+    // walk the siblings on its path.
+    struct Siblings {
+        std::vector<std::int64_t> tree;
+        std::size_t count = 0; // Linked children
+    };
+    Siblings& siblings_of(int parent);
+    std::unordered_map<int, Siblings> siblings; // By parent index
+    std::vector<std::uint64_t> sequence; // By node index, for parents with siblings
+
+    friend class Object;
+};
+
+// Reads the checkpoint and replays the entries after it. An incomplete
+// entry at the end of the file, from an interrupted write, is ignored.
+Object load_journal(const std::filesystem::path& path);
+
+} // namespace datapack
+#endif
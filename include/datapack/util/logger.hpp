@@ -0,0 +1,121 @@
+#pragma once
+#ifndef EMBEDDED
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include "datapack/format/binary_stream.hpp"
+#include "datapack/object.hpp"
+#include "datapack/schema/schema.hpp"
+
+
+namespace datapack {
+
+// Event types are registered once per process, on their first use. The log
+// file includes the schema of each type, so it can be read without the
+// types.
+struct LogType {
+    std::uint32_t id;
+    std::string name;
+    Schema schema;
+};
+DATAPACK(LogType);
+
+std::uint32_t register_log_type(const char* name, const Schema& schema);
+
+struct LoggerOptions {
+    // A thread's buffer is queued for writing once it reaches this size
+    std::size_t buffer_size = 1 << 16;
+    BinaryStreamOptions stream = {};
+};
+
+// Structured logger, where each thread binary-encodes events into its own
+// buffer. Filled buffers go on a lock-free queue, which a background thread
+// writes to a stream file (see BinaryStreamWriter). Each record is the type
+// id (u32), the time (u64, nanoseconds since the epoch) and the event.
+//
+// Events are written once their thread's buffer fills, the thread calls
+// flush, or the logger is destroyed, which must not happen while other
+// threads are logging.
+class Logger {
+public:
+    Logger(const std::filesystem::path& path, const LoggerOptions& options = {});
+    ~Logger();
+
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger&) = delete;
+
+    // The type name is taken from the first call for each type
+    template <typename T>
+    requires readable<T> && writeable<T>
+    void log(const char* type, const T& event) {
+        static const std::uint32_t type_id = register_log_type(type, create_schema<T>());
+        ThreadState& state = thread_state();
+        std::vector<std::uint8_t>& data = state.buffer->data;
+        std::size_t begin = data.size();
+        data.resize(begin + record_header_size);
+        BinaryWriter(data).value(event);
+        write_header(&data[begin], data.size() - begin - sizeof(std::uint64_t), type_id);
+        if (data.size() >= options.buffer_size) {
+            submit(state);
+        }
+    }
+
+    // Queues the calling thread's events for writing
+    void flush();
+
+private:
+    static constexpr std::size_t record_header_size = 2 * sizeof(std::uint64_t) + sizeof(std::uint32_t);
+
+    struct Buffer {
+        std::vector<std::uint8_t> data;
+        Buffer* next = nullptr;
+    };
+    struct ThreadState {
+        Buffer* buffer;
+    };
+
+    static void write_header(std::uint8_t* record, std::uint64_t size, std::uint32_t type_id) {
+        std::uint64_t time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        std::memcpy(record, &size, sizeof(size));
+        std::memcpy(record + 8, &type_id, sizeof(type_id));
+        std::memcpy(record + 12, &time, sizeof(time));
+    }
+
+    ThreadState& thread_state() {
+        thread_local std::uint64_t cached_id = 0;
+        thread_local ThreadState* cached_state = nullptr;
+        if (cached_id != id) {
+            cached_state = &register_thread();
+            cached_id = id;
+        }
+        return *cached_state;
+    }
+    ThreadState& register_thread();
+    // Queues the thread's buffer and gives it a new one
+    void submit(ThreadState& state);
+    Buffer* new_buffer();
+    void run();
+
+    const std::uint64_t id; // Unique per logger, so thread caches can't refer to an old logger
+    LoggerOptions options;
+    BinaryStreamWriter writer;
+
+    std::atomic<Buffer*> queue;
+    std::atomic<std::uint64_t> submitted;
+    std::atomic<bool> stopping;
+
+    std::mutex threads_mutex;
+    std::unordered_map<std::thread::id, ThreadState> threads;
+    std::thread worker;
+};
+
+// Reads a log as a list of {type, time, event}, for viewing with dump_json
+Object load_log(const std::filesystem::path& path, const BinaryStreamOptions& options = {});
+
+} // namespace datapack
+#endif
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#if defined(DATAPACK_METRICS) && !defined(EMBEDDED)
+#include <chrono>
+#endif
+
+
+namespace datapack {
+
+// Operations with metrics, when built with DATAPACK_METRICS. Each thread
+// counts into its own counters, which are only summed for a snapshot.
+enum class MetricOp {
+    WriteBinary,
+    ReadBinary,
+    LoadJson,
+    DumpJson,
+    UseSchema
+};
+static constexpr std::size_t metric_op_count = 5;
+
+#if defined(DATAPACK_METRICS) && !defined(EMBEDDED)
+
+void metric_record(MetricOp op, std::size_t bytes, std::uint64_t ns, bool ok);
+void metric_invalidated();
+
+// Records a call when it goes out of scope. Calls that don't reach done(),
+// eg: because they throw, are counted as failed.
+class MetricTimer {
+    using Clock = std::chrono::steady_clock;
+public:
+    MetricTimer(MetricOp op):
+        op(op),
+        start(Clock::now())
+    {}
+    ~MetricTimer() {
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+        metric_record(op, bytes, ns, ok);
+    }
+    void done(std::size_t bytes, bool ok = true) {
+        this->bytes = bytes;
+        this->ok = ok;
+    }
+
+private:
+    const MetricOp op;
+    const Clock::time_point start;
+    std::size_t bytes = 0;
+    bool ok = false;
+};
+
+#else
+
+inline void metric_invalidated() {}
+
+class MetricTimer {
+public:
+    MetricTimer(MetricOp) {}
+    void done(std::size_t, bool = true) {}
+};
+
+#endif
+
+#ifndef EMBEDDED
+class Object;
+
+// Sums the counters of all threads, including threads that have exited,
+// into a map from operation name to:
+// { calls, failed, bytes, total_ns, latency: [{ max_ns, count }] }
+// where latency is a histogram with power-of-two buckets, omitting empty
+// buckets. The map also has the number of readers invalidated.
+// Empty if metrics aren't built.
+Object metrics_snapshot();
+
+// Counts recorded while resetting may be kept or lost
+void metrics_reset();
+
+bool metrics_enabled();
+#endif
+
+} // namespace datapack
@@ -9,14 +9,21 @@ namespace datapack {
 
 class ObjectReader: public Reader {
 public:
-    ObjectReader(Object::ConstReference object);
+    // With validate_utf8, strings that aren't valid UTF-8 invalidate the
+    // reader
+    ObjectReader(Object::ConstReference object, bool validate_utf8 = false);
 
     void integer(IntType type, void* value) override;
     void floating(FloatType type, void* value) override;
     bool boolean() override;
     const char* string() override;
     int enumerate(const std::span<const char*>& labels) override;
+    // Packed arrays are only read with integer_array and floating_array,
+    // which give the element type. Elements that don't fit in the type
+    // invalidate the reader.
     std::tuple<const std::uint8_t*, std::size_t> binary(std::size_t length, std::size_t stride) override;
+    std::tuple<const std::uint8_t*, std::size_t> integer_array(IntType type, std::size_t length) override;
+    std::tuple<const std::uint8_t*, std::size_t> floating_array(FloatType type, std::size_t length) override;
 
     bool optional_begin() override;
     void optional_end() override;
@@ -56,10 +63,21 @@ private:
     }
 #endif
 
+    const Object::integer_t* packed_integer() const;
+    const Object::floating_t* packed_floating() const;
+    template <typename T>
+    std::tuple<const std::uint8_t*, std::size_t> packed_array(std::size_t length);
+
     Object::ConstIterator node;
     std::stack<Object::ConstIterator> nodes;
     bool list_start;
     const char* next_variant_label;
+    // When reading the elements of a packed array, node is the array and
+    // packed_index is the current element. Otherwise packed_index is
+    // no_packed_index.
+    static constexpr std::size_t no_packed_index = -1;
+    std::size_t packed_index;
+    const bool validate_utf8;
     std::vector<std::uint8_t> data_temp;
 };
 
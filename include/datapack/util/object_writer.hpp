@@ -10,7 +10,9 @@ namespace datapack {
 
 class ObjectWriter: public Writer {
 public:
-    ObjectWriter(Object::Reference object);
+    // With dedupe, identical maps and lists share their children as they're
+    // written, see Object::dedupe
+    ObjectWriter(Object::Reference object, bool dedupe = false);
 
     void integer(IntType type, const void* value) override;
     void floating(FloatType type, const void* value) override;
@@ -39,19 +41,21 @@ public:
 
 private:
     void set_value(const Object::value_t& value);
+    void end_node();
 
     Object::Reference object;
     std::stack<Object::Iterator> nodes;
     std::string next_key;
     std::size_t next_stride;
+    std::optional<Object::Deduper> deduper;
 };
 
 
 
 template <writeable T>
-Object write_object(const T& value) {
+Object write_object(const T& value, bool dedupe = false) {
     Object object;
-    ObjectWriter(object).value(value);
+    ObjectWriter(object, dedupe).value(value);
     return object;
 }
 
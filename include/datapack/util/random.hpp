@@ -7,9 +7,24 @@
 
 namespace datapack {
 
+// Sizes are uniform within each range, inclusive
+struct RandomOptions {
+    std::size_t min_list_length = 0;
+    std::size_t max_list_length = 9;
+    std::size_t min_string_length = 4;
+    std::size_t max_string_length = 20;
+    std::size_t min_binary_length = 0;
+    std::size_t max_binary_length = 99;
+    double optional_probability = 0.5;
+};
+
 class RandomReader: public Reader {
 public:
+    // Seeded from rand()
     RandomReader();
+    RandomReader(std::uint64_t seed, const RandomOptions& options = {});
+
+    void seed(std::uint64_t seed) { state = seed; }
 
     void integer(IntType type, void* value) override;
     void floating(FloatType type, void* value) override;
@@ -37,8 +52,15 @@ public:
     void list_end() override;
 
 private:
+    std::uint64_t next();
+    // Uniform in [min, max]
+    std::uint64_t uniform(std::uint64_t min, std::uint64_t max);
+    double unit();
+
+    RandomOptions options;
+    std::uint64_t state;
     std::vector<std::uint8_t> data_temp;
-    std::stack<int> list_counters;
+    std::stack<std::size_t> list_counters;
     std::string string_temp;
 };
 
@@ -0,0 +1,59 @@
+#pragma once
+#ifndef EMBEDDED
+
+#include <cstddef>
+#include <cstdint>
+
+
+namespace datapack {
+
+// Instruction set levels, in increasing order of preference for each
+// architecture. NEON is only available on ARM, the others only on x86.
+enum class SimdLevel {
+    Scalar,
+    SSE2,
+    SSE42,
+    AVX2,
+    AVX512,
+    NEON
+};
+
+const char* simd_level_name(SimdLevel level);
+bool simd_level_from_name(const char* name, SimdLevel& level);
+
+// Functions with a variant for each SIMD level. Levels without a
+// dedicated variant use the variant of the next level down.
+struct SimdKernels {
+    SimdLevel level;
+    // Position of the first '"' in data, or size if not found
+    std::size_t (*find_quote)(const char* data, std::size_t size);
+    // Number of leading JSON whitespace characters (space, \t, \n, \r)
+    std::size_t (*skip_whitespace)(const char* data, std::size_t size);
+    // Bitpack 128 values below 2^width, for width 0 to 32, into 16 * width
+    // bytes. Value i is in lane i % 4 of four interleaved 32-bit streams
+    // (the SIMD-BP128 layout), so every level produces the same bytes.
+    void (*pack_block)(const std::uint32_t* input, int width, std::uint8_t* output);
+    void (*unpack_block)(const std::uint8_t* input, int width, std::uint32_t* output);
+    // Whether data is valid UTF-8. Vectorized levels (from SSE4.2) use
+    // lookup tables over 16 or 64 bytes at a time, and skip ASCII blocks.
+    bool (*validate_utf8)(const char* data, std::size_t size);
+};
+
+// Whether the CPU and build support the given level
+bool simd_supported(SimdLevel level);
+// Best level supported by the CPU
+SimdLevel simd_detected_level();
+
+// The active level defaults to the detected level, unless overridden by
+// the DATAPACK_SIMD environment variable (eg: DATAPACK_SIMD=sse2).
+// Requests for an unsupported level use the best supported level below it.
+SimdLevel simd_level();
+SimdLevel set_simd_level(SimdLevel level);
+
+// Kernels of the active level, chosen at the first call and by
+// set_simd_level, so this doesn't check the CPU
+const SimdKernels& simd_kernels();
+const SimdKernels& simd_kernels(SimdLevel level);
+
+} // namespace datapack
+#endif
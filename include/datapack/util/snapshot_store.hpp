@@ -0,0 +1,142 @@
+#pragma once
+#ifndef EMBEDDED
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <span>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+#include "datapack/common.hpp"
+#include "datapack/format/binary_reader.hpp"
+#include "datapack/format/binary_writer.hpp"
+
+
+namespace datapack {
+
+class SnapshotError: public std::runtime_error {
+public:
+    SnapshotError(const std::string& message):
+        std::runtime_error(message)
+    {}
+};
+
+// Content-defined chunking (FastCDC), using a gear rolling hash with
+// normalized chunking around the average size. The average size must be a
+// power of two.
+struct ChunkingOptions {
+    std::size_t min_size = 2048;
+    std::size_t average_size = 8192;
+    std::size_t max_size = 65536;
+};
+
+// Returns the end of each chunk. Where a cut point is followed closely by a
+// record boundary, the chunk ends at the boundary instead, so that edits
+// within a record don't move chunk boundaries in the records around it.
+// Boundaries must be sorted.
+std::vector<std::size_t> find_chunks(
+    const std::span<const std::uint8_t>& data,
+    const ChunkingOptions& options = {},
+    const std::vector<std::size_t>& boundaries = {});
+
+// Binary writer that also records the offset of each list element, used as
+// record boundaries for chunking
+class BoundaryWriter: public BinaryWriter {
+public:
+    BoundaryWriter(std::vector<std::uint8_t>& data):
+        BinaryWriter(data)
+    {}
+
+    void list_next() override {
+        boundaries.push_back(result().size());
+        BinaryWriter::list_next();
+    }
+
+    std::vector<std::size_t> boundaries;
+};
+
+struct ChunkRef {
+    std::uint64_t offset; // Of the chunk data within the pack file
+    std::uint64_t size;
+};
+
+struct SnapshotStats {
+    std::size_t snapshots = 0;
+    std::size_t chunks = 0;          // Unique chunks in the pack file
+    std::uint64_t logical_bytes = 0; // Total size of all snapshots
+    std::uint64_t stored_bytes = 0;  // Size of the pack and manifest files
+};
+
+// Stores snapshots in a directory, as a pack file of unique chunks and a
+// manifest listing the chunks of each snapshot. Both files are only
+// appended to. Chunks are keyed by a 64-bit hash and their size, and a
+// chunk matching a stored key is compared with the stored bytes before
+// reusing it, so colliding chunks are stored separately.
+class SnapshotStore {
+public:
+    SnapshotStore(const std::filesystem::path& directory, const ChunkingOptions& options = {});
+
+    // Returns the index of the new snapshot
+    std::size_t add(
+        const std::span<const std::uint8_t>& data,
+        const std::vector<std::size_t>& boundaries = {});
+
+    template <writeable T>
+    std::size_t write(const T& value) {
+        std::vector<std::uint8_t> data;
+        BoundaryWriter writer(data);
+        writer.value(value);
+        return add(data, writer.boundaries);
+    }
+
+    std::vector<std::uint8_t> load(std::size_t snapshot);
+
+    // Reassembles the snapshot into a buffer reused between reads
+    template <readable T>
+    T read(std::size_t snapshot) {
+        load_into(snapshot, buffer);
+        T result;
+        BinaryReader reader(buffer);
+        reader.value(result);
+        if (!reader.valid()) {
+            throw SnapshotError("Snapshot doesn't match the type");
+        }
+        return result;
+    }
+
+    std::size_t size() const { return snapshots.size(); }
+    SnapshotStats stats() const;
+
+private:
+    void load_into(std::size_t snapshot, std::vector<std::uint8_t>& output);
+    struct ChunkKey {
+        std::uint64_t hash;
+        std::uint64_t size;
+        bool operator==(const ChunkKey& other) const {
+            return hash == other.hash && size == other.size;
+        }
+    };
+    struct ChunkKeyHash {
+        std::size_t operator()(const ChunkKey& key) const {
+            return key.hash ^ (key.size * 0x9E3779B97F4A7C15);
+        }
+    };
+
+    // Offset of a stored chunk with the same bytes, or -1 if there isn't one
+    std::int64_t find_chunk(const ChunkKey& key, const std::uint8_t* data);
+
+    ChunkingOptions options;
+    std::fstream pack;
+    std::fstream manifest;
+    std::uint64_t pack_size;
+    std::uint64_t manifest_size;
+    std::unordered_multimap<ChunkKey, std::uint64_t, ChunkKeyHash> chunks;
+    std::vector<std::vector<ChunkRef>> snapshots;
+    std::uint64_t logical_bytes;
+    std::vector<std::uint8_t> buffer;
+    std::vector<std::uint8_t> compare_buffer;
+};
+
+} // namespace datapack
+#endif
@@ -53,6 +53,10 @@ public:
     virtual void string(const char* string) = 0;
     virtual void enumerate(int value, const char* label) = 0;
     virtual void binary(const std::uint8_t* data, std::size_t length, std::size_t stride, bool fixed_length) = 0;
+    // Trivial integer arrays, which formats may encode more compactly
+    virtual void integer_array(IntType type, const void* data, std::size_t length, bool fixed_length) {
+        binary((const std::uint8_t*)data, length, int_type_size(type), fixed_length);
+    }
 
     // Single-element containers
 
@@ -0,0 +1,63 @@
+#include "datapack/encode/bitpack.hpp"
+#include "datapack/util/simd.hpp"
+#include <algorithm>
+#include <cstring>
+
+
+namespace datapack {
+
+int bitpack_width(std::uint32_t value) {
+    return value == 0 ? 0 : 32 - __builtin_clz(value);
+}
+
+std::size_t bitpacked_size(std::size_t count, int width) {
+    std::size_t blocks = count / bitpack_block_size;
+    std::size_t remainder = count % bitpack_block_size;
+    return blocks * 16 * width + (remainder * width + 7) / 8;
+}
+
+void bitpack(const std::uint32_t* input, std::size_t count, int width, std::uint8_t* output) {
+    const auto& kernels = simd_kernels();
+    std::size_t i = 0;
+    for (; i + bitpack_block_size <= count; i += bitpack_block_size) {
+        kernels.pack_block(input + i, width, output);
+        output += 16 * width;
+    }
+
+    std::memset(output, 0, ((count - i) * width + 7) / 8);
+    std::size_t bit = 0;
+    for (; i < count; i++) {
+        std::uint64_t value = input[i];
+        for (int written = 0; written < width;) {
+            int offset = bit % 8;
+            int n = std::min(8 - offset, width - written);
+            output[bit / 8] |= ((value >> written) & ((1u << n) - 1)) << offset;
+            written += n;
+            bit += n;
+        }
+    }
+}
+
+void bitunpack(const std::uint8_t* input, std::size_t count, int width, std::uint32_t* output) {
+    const auto& kernels = simd_kernels();
+    std::size_t i = 0;
+    for (; i + bitpack_block_size <= count; i += bitpack_block_size) {
+        kernels.unpack_block(input, width, output + i);
+        input += 16 * width;
+    }
+
+    std::size_t bit = 0;
+    for (; i < count; i++) {
+        std::uint32_t value = 0;
+        for (int read = 0; read < width;) {
+            int offset = bit % 8;
+            int n = std::min(8 - offset, width - read);
+            value |= std::uint32_t((input[bit / 8] >> offset) & ((1u << n) - 1)) << read;
+            read += n;
+            bit += n;
+        }
+        output[i] = value;
+    }
+}
+
+} // namespace datapack
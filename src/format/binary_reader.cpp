@@ -1,11 +1,88 @@
 #include "datapack/format/binary_reader.hpp"
 #include <assert.h>
+#include <algorithm>
 #include <cstring>
+#ifndef EMBEDDED
+#include "datapack/encode/bitpack.hpp"
+#include "datapack/encode/varint.hpp"
+#include "datapack/util/simd.hpp"
+#include <limits>
+#include <type_traits>
+#endif
 
 
 namespace datapack {
 
+#ifndef EMBEDDED
+// Inverse of planned_integer in binary_writer.cpp
+static std::int64_t planned_integer(PlanState& plan, FieldEncoding encoding, std::uint64_t value, bool is_signed) {
+    if (encoding == FieldEncoding::Delta) {
+        std::int64_t& previous = plan.previous();
+        previous = std::uint64_t(previous) + std::uint64_t(unzigzag(value));
+        return previous;
+    }
+    return is_signed ? unzigzag(value) : std::int64_t(value);
+}
+
+// Planned integers are decoded as 64 bits, so corrupt data can hold values
+// that don't fit the field
+template <typename T>
+static bool planned_fits(std::int64_t value) {
+    return value >= std::int64_t(std::numeric_limits<T>::min())
+        && value <= std::int64_t(std::numeric_limits<T>::max());
+}
+#endif
+
 void BinaryReader::integer(IntType type, void* value) {
+#ifndef EMBEDDED
+    if (plan && binary_depth == 0) {
+        FieldEncoding encoding = plan->integer_encoding();
+        std::uint64_t encoded;
+        if (encoding != FieldEncoding::Fixed) {
+            if (!value_varint(encoded)) {
+                return;
+            }
+            bool is_signed = type == IntType::I32 || type == IntType::I64;
+            std::int64_t result = planned_integer(*plan, encoding, encoded, is_signed);
+            bool fits = true;
+            switch (type) {
+                case IntType::I32:
+                    fits = planned_fits<std::int32_t>(result);
+                    break;
+                case IntType::U32:
+                    fits = planned_fits<std::uint32_t>(result);
+                    break;
+                case IntType::U8:
+                    fits = planned_fits<std::uint8_t>(result);
+                    break;
+                default:
+                    break;
+            }
+            if (!fits) {
+                fail("Integer out of range");
+                return;
+            }
+            switch (type) {
+                case IntType::I32:
+                    *(std::int32_t*)value = result;
+                    break;
+                case IntType::I64:
+                    *(std::int64_t*)value = result;
+                    break;
+                case IntType::U32:
+                    *(std::uint32_t*)value = result;
+                    break;
+                case IntType::U64:
+                    *(std::uint64_t*)value = result;
+                    break;
+                case IntType::U8:
+                    *(std::uint8_t*)value = result;
+                    break;
+            }
+            return;
+        }
+    }
+#endif
     switch (type) {
         case IntType::I32:
             value_number(*(std::int32_t*)value);
@@ -41,18 +118,84 @@ bool BinaryReader::boolean() {
 }
 
 const char* BinaryReader::string() {
-    std::size_t max_len = data.size() - pos;
-    std::size_t len = strnlen((char*)&data[pos], max_len);
+#ifndef EMBEDDED
+    if (plan && binary_depth == 0 && plan->string_encoding() == FieldEncoding::Dictionary) {
+        auto& dictionary = plan->read_dictionary();
+        std::uint64_t index;
+        if (!value_varint(index)) {
+            return nullptr;
+        }
+        if (index > dictionary.size()) {
+            fail("Invalid dictionary index");
+            return nullptr;
+        }
+        if (index > 0) {
+            return dictionary[index - 1];
+        }
+        // Strings stay in the data, so the dictionary refers to them there
+        const char* result = plain_string();
+        if (result) {
+            dictionary.push_back(result);
+        }
+        return result;
+    }
+#endif
+    return plain_string();
+}
+
+const char* BinaryReader::plain_string() {
+    if (!can_read()) {
+        return nullptr;
+    }
+    std::size_t max_len = remaining();
+    if (limits.max_length != 0) {
+        max_len = std::min(max_len, limits.max_length + 1);
+    }
+    std::size_t len = strnlen((const char*)data.data() + pos, std::min(max_len, data.size() - pos));
+    // Widens the window while the string continues past its end
+    while (len == data.size() - pos && len < max_len) {
+        if (!refill(std::min(max_len, std::max(2 * len, len + 64)))) {
+            break;
+        }
+        len = strnlen((const char*)data.data() + pos, std::min(max_len, data.size() - pos));
+    }
     if (len == max_len) {
-        invalidate();
+        fail(max_len == remaining() ? "Unterminated string" : "Exceeded the maximum length");
+        return nullptr;
+    }
+    const char* result = (const char*)data.data() + pos;
+#ifndef EMBEDDED
+    if (validate_utf8 && !simd_kernels().validate_utf8(result, len)) {
+        fail("Invalid UTF-8");
+        return nullptr;
+    }
+#endif
+    allocate(len + 1);
+    if (!valid()) {
         return nullptr;
     }
-    const char* result = (char*)&data[pos];
     pos += (len + 1);
     return result;
 }
 
 int BinaryReader::enumerate(const std::span<const char*>& labels) {
+#ifndef EMBEDDED
+    if (plan && binary_depth == 0) {
+        FieldEncoding encoding = plan->integer_encoding();
+        std::uint64_t encoded;
+        if (encoding != FieldEncoding::Fixed) {
+            if (!value_varint(encoded)) {
+                return -1;
+            }
+            std::int64_t result = planned_integer(*plan, encoding, encoded, true);
+            if (!planned_fits<int>(result)) {
+                fail("Integer out of range");
+                return -1;
+            }
+            return result;
+        }
+    }
+#endif
     int value = -1;
     value_number(value);
     return value;
@@ -63,41 +206,234 @@ bool BinaryReader::optional_begin() {
 }
 
 int BinaryReader::variant_begin(const std::span<const char*>& labels) {
+    depth_begin();
     int value = -1;
     value_number(value);
+#ifndef EMBEDDED
+    if (plan) {
+        plan->variant_begin(value >= 0 && value < int(labels.size()) ? labels[value] : "");
+    }
+#endif
     return value;
 }
 
+void BinaryReader::variant_end() {
+    depth--;
+#ifndef EMBEDDED
+    if (plan) {
+        plan->container_end();
+    }
+#endif
+}
+
 std::tuple<const std::uint8_t*, std::size_t> BinaryReader::binary(
     std::size_t length,
     std::size_t stride)
 {
-    if (length == 0) {
+    bool variable = length == 0;
+    if (variable) {
         value_number(length);
     }
-    std::size_t size = length * stride;
-    if (pos + size > data.size()) {
-        invalidate();
+    if (!can_read()) {
+        return { nullptr, 0 };
+    }
+    align_binary();
+    if (!valid()) {
         return { nullptr, 0 };
     }
+    // Length may be untrusted, so avoid overflow in length * stride
+    if (stride != 0 && length > remaining() / stride) {
+        fail("Array exceeds the data");
+        return { nullptr, 0 };
+    }
+    if (variable) {
+        if (limits.max_length != 0 && length > limits.max_length) {
+            fail("Exceeded the maximum length");
+            return { nullptr, 0 };
+        }
+        allocate(length * stride);
+        if (!valid()) {
+            return { nullptr, 0 };
+        }
+    }
 
-    const std::uint8_t* output_data = &data[pos];
-    pos += size;
+    if (!available(length * stride)) {
+        fail("Unexpected end of data");
+        return { nullptr, 0 };
+    }
+    const std::uint8_t* output_data = data.data() + pos;
+    pos += length * stride;
     return std::make_tuple(output_data, length);
 }
 
+#ifndef EMBEDDED
+std::tuple<const std::uint8_t*, std::size_t> BinaryReader::integer_array(
+    IntType type,
+    std::size_t length)
+{
+    std::size_t stride = int_type_size(type);
+    if (!pack_integers || binary_depth > 0) {
+        return binary(length, stride);
+    }
+    bool variable = length == 0;
+    if (variable) {
+        value_number(length);
+    }
+    if (!can_read()) {
+        return { nullptr, 0 };
+    }
+    // Every block uses at least a width byte and the minimum
+    std::size_t blocks = length / bitpack_block_size + (length % bitpack_block_size != 0);
+    if (blocks > remaining() / (1 + stride)) {
+        fail("Array exceeds the data");
+        return { nullptr, 0 };
+    }
+    if (variable) {
+        if (limits.max_length != 0 && length > limits.max_length) {
+            fail("Exceeded the maximum length");
+            return { nullptr, 0 };
+        }
+        allocate(length * stride);
+        if (!valid()) {
+            return { nullptr, 0 };
+        }
+    }
+
+    unpacked.resize(length * stride);
+    switch (type) {
+        case IntType::I32:
+            packed_integers((std::int32_t*)unpacked.data(), length);
+            break;
+        case IntType::I64:
+            packed_integers((std::int64_t*)unpacked.data(), length);
+            break;
+        case IntType::U32:
+            packed_integers((std::uint32_t*)unpacked.data(), length);
+            break;
+        case IntType::U64:
+            packed_integers((std::uint64_t*)unpacked.data(), length);
+            break;
+        case IntType::U8:
+            packed_integers((std::uint8_t*)unpacked.data(), length);
+            break;
+    }
+    if (!valid()) {
+        return { nullptr, 0 };
+    }
+    return std::make_tuple(unpacked.data(), length);
+}
+
+template <typename T>
+void BinaryReader::packed_integers(T* values, std::size_t length) {
+    using U = std::make_unsigned_t<T>;
+    std::uint32_t offsets[bitpack_block_size];
+
+    for (std::size_t begin = 0; begin < length; begin += bitpack_block_size) {
+        T* block = values + begin;
+        std::size_t count = std::min(bitpack_block_size, length - begin);
+        if (!available(1)) {
+            fail("Unexpected end of data");
+            return;
+        }
+        int width = data[pos];
+
+        if (width == 0xFF && sizeof(T) == 8) {
+            if (!available(1 + count * sizeof(T))) {
+                fail("Unexpected end of data");
+                return;
+            }
+            std::memcpy(block, &data[pos + 1], count * sizeof(T));
+            pos += 1 + count * sizeof(T);
+            continue;
+        }
+        if (width > 32 || !available(1 + sizeof(T) + bitpacked_size(count, width))) {
+            fail("Invalid packed integer block");
+            return;
+        }
+
+        T min;
+        std::memcpy(&min, &data[pos + 1], sizeof(T));
+        bitunpack(&data[pos + 1 + sizeof(T)], count, width, offsets);
+        for (std::size_t i = 0; i < count; i++) {
+            block[i] = U(min) + U(offsets[i]);
+        }
+        pos += 1 + sizeof(T) + bitpacked_size(count, width);
+    }
+}
+#endif
+
 void BinaryReader::object_begin(std::size_t size) {
+    depth_begin();
+#ifndef EMBEDDED
+    if (plan) {
+        plan->object_begin();
+    }
+#endif
+    trivial_begin(size);
+}
+
+void BinaryReader::object_next(const char* key) {
+#ifndef EMBEDDED
+    if (plan) {
+        plan->object_next(key);
+    }
+#endif
+}
+
+void BinaryReader::object_end(std::size_t size) {
+    depth--;
+#ifndef EMBEDDED
+    if (plan) {
+        plan->container_end();
+    }
+#endif
+    trivial_end(size);
+}
+
+void BinaryReader::tuple_begin(std::size_t size) {
+    depth_begin();
+#ifndef EMBEDDED
+    if (plan) {
+        plan->tuple_begin();
+    }
+#endif
+    // Aligned the same as an array read as binary
+    if (size != 0) {
+        align_binary();
+    }
+    trivial_begin(size);
+}
+
+void BinaryReader::tuple_next() {
+#ifndef EMBEDDED
+    if (plan) {
+        plan->tuple_next();
+    }
+#endif
+}
+
+void BinaryReader::tuple_end(std::size_t size) {
+    depth--;
+#ifndef EMBEDDED
+    if (plan) {
+        plan->container_end();
+    }
+#endif
+    trivial_end(size);
+}
+
+void BinaryReader::trivial_begin(std::size_t size) {
     if (size == 0) {
         return;
     }
     if (binary_depth == 0) {
-        binary_start = pos;
+        binary_start = base + pos;
     }
     pad(size);
     binary_depth++;
 }
 
-void BinaryReader::object_end(std::size_t size) {
+void BinaryReader::trivial_end(std::size_t size) {
     if (size == 0) {
         return;
     }
@@ -106,8 +442,17 @@ void BinaryReader::object_end(std::size_t size) {
 }
 
 void BinaryReader::list_begin(bool is_trivial) {
+#ifndef EMBEDDED
+    if (plan) {
+        plan->list_begin();
+    }
+    if (limits.max_length != 0) {
+        list_lengths.push_back(0);
+    }
+#endif
+    depth_begin();
     if (binary_depth != 0) {
-        invalidate();
+        fail("List within a trivial value");
         return;
     }
     if (!is_trivial) {
@@ -115,13 +460,27 @@ void BinaryReader::list_begin(bool is_trivial) {
     }
     std::uint64_t length = 0;
     value_number(length);
+    if (limits.max_length != 0 && length > limits.max_length) {
+        fail("Exceeded the maximum length");
+        length = 0;
+    }
     trivial_list_remaining = length;
+    // Aligned the same as a vector read as binary
+    align_binary();
 
     binary_depth++;
-    binary_start = pos;
+    binary_start = base + pos;
 }
 
 bool BinaryReader::list_next() {
+#ifndef EMBEDDED
+    if (plan) {
+        plan->list_next();
+    }
+#endif
+    if (!can_read()) {
+        return false;
+    }
     if (binary_depth > 0) {
         if (trivial_list_remaining == 0) {
             return false;
@@ -129,10 +488,28 @@ bool BinaryReader::list_next() {
         trivial_list_remaining--;
         return true;
     }
-    return value_bool();
+    if (!value_bool()) {
+        return false;
+    }
+#ifndef EMBEDDED
+    if (limits.max_length != 0 && ++list_lengths.back() > limits.max_length) {
+        fail("Exceeded the maximum length");
+        return false;
+    }
+#endif
+    return true;
 }
 
 void BinaryReader::list_end() {
+#ifndef EMBEDDED
+    if (plan) {
+        plan->container_end();
+    }
+    if (limits.max_length != 0) {
+        list_lengths.pop_back();
+    }
+#endif
+    depth--;
     if (binary_depth == 0) {
         return;
     }
@@ -140,34 +517,119 @@ void BinaryReader::list_end() {
     assert(binary_depth == 0);
 }
 
+bool BinaryReader::can_read() {
+    if (valid()) {
+        return true;
+    }
+#ifndef EMBEDDED
+    // Invalidated by a pack function, eg: for an out of range enum
+    if (fail_fast) {
+        throw BinaryReadError("Invalid value", base + pos);
+    }
+#endif
+    return false;
+}
+
+void BinaryReader::fail(const char* message) {
+    invalidate();
+#ifndef EMBEDDED
+    if (fail_fast) {
+        throw BinaryReadError(message, base + pos);
+    }
+#endif
+}
+
+void BinaryReader::depth_begin() {
+    depth++;
+    if (limits.max_depth != 0 && depth > limits.max_depth && valid()) {
+        fail("Exceeded the maximum depth");
+    }
+}
+
+void BinaryReader::allocate(std::size_t size) {
+    allocated += size;
+    if (limits.max_allocation != 0 && allocated > limits.max_allocation) {
+        fail("Exceeded the maximum allocation");
+    }
+}
+
 void BinaryReader::pad(std::size_t size) {
-    if ((pos-binary_start) % size != 0) {
-        pos += (size - (pos-binary_start) % size);
+    if (packed) {
+        return;
+    }
+    if ((base+pos-binary_start) % size != 0) {
+        std::size_t padding = size - (base+pos-binary_start) % size;
+        if (!available(padding)) {
+            fail("Unexpected end of data");
+            return;
+        }
+        pos += padding;
+    }
+}
+
+void BinaryReader::align_binary() {
+    std::size_t offset = base + pos;
+    if (binary_alignment != 0 && binary_depth == 0 && valid() && offset % binary_alignment != 0) {
+        std::size_t padding = binary_alignment - offset % binary_alignment;
+        if (!available(padding)) {
+            fail("Unexpected end of data");
+            return;
+        }
+        pos += padding;
     }
 }
 
 template <typename T>
 void BinaryReader::value_number(T& value) {
+    if (!can_read()) {
+        return;
+    }
     if (binary_depth > 0) {
         pad(sizeof(T));
     }
-    if (pos + sizeof(T) > data.size()) {
-        invalidate();
+    if (!available(sizeof(T))) {
+        fail("Unexpected end of data");
         return;
     }
 
-    value = *((T*)&data[pos]);
+    // Values aren't aligned outside trivial blocks, or in packed mode
+    std::memcpy(&value, &data[pos], sizeof(T));
     pos += sizeof(T);
 }
 
+#ifndef EMBEDDED
+bool BinaryReader::value_varint(std::uint64_t& value) {
+    value = 0;
+    if (!can_read()) {
+        return false;
+    }
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (!available(1)) {
+            fail("Unexpected end of data");
+            return false;
+        }
+        std::uint8_t byte = data[pos++];
+        value |= std::uint64_t(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    fail("Invalid varint");
+    return false;
+}
+#endif
+
 bool BinaryReader::value_bool() {
-    if (pos + 1 > data.size()) {
-        invalidate();
+    if (!can_read()) {
+        return false;
+    }
+    if (!available(1)) {
+        fail("Unexpected end of data");
         return false;
     }
-    std::uint8_t value_int = *((bool*)&data[pos]);
+    std::uint8_t value_int = data[pos];
     if (value_int >= 2) {
-        invalidate();
+        fail("Invalid boolean");
         return false;
     }
     pos++;
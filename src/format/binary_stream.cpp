@@ -0,0 +1,166 @@
+#include "datapack/format/binary_stream.hpp"
+#include <algorithm>
+#include <cstring>
+
+
+namespace datapack {
+
+// ===========================================================================
+// BinaryStreamWriter
+
+BinaryStreamWriter::BinaryStreamWriter(const std::filesystem::path& path, const BinaryStreamOptions& options):
+    options(options),
+    file_(path, AsyncFile::Mode::Write, options.buffer_size, options.buffer_count, options.backend),
+    current(0),
+    used(0),
+    offset(0),
+    closed(false)
+{}
+
+BinaryStreamWriter::~BinaryStreamWriter() {
+    try {
+        close();
+    } catch (const IoError&) {}
+}
+
+void BinaryStreamWriter::write_message(const std::span<const std::uint8_t>& data) {
+    if (closed) {
+        throw IoError("Stream is closed");
+    }
+    std::uint64_t size = data.size();
+    append((const std::uint8_t*)&size, sizeof(size));
+    append(data.data(), data.size());
+}
+
+void BinaryStreamWriter::write_framed(const std::span<const std::uint8_t>& data) {
+    if (closed) {
+        throw IoError("Stream is closed");
+    }
+    append(data.data(), data.size());
+}
+
+void BinaryStreamWriter::append(const std::uint8_t* data, std::size_t size) {
+    while (size > 0) {
+        std::size_t count = std::min(size, file_.buffer_size() - used);
+        std::memcpy(file_.buffer(current) + used, data, count);
+        used += count;
+        data += count;
+        size -= count;
+        if (used == file_.buffer_size()) {
+            flush();
+        }
+    }
+}
+
+void BinaryStreamWriter::flush() {
+    file_.write(current, used, offset);
+    offset += used;
+    used = 0;
+    current = (current + 1) % file_.buffer_count();
+    // Only blocks once encoding gets ahead of every buffer
+    file_.wait(current);
+}
+
+void BinaryStreamWriter::close() {
+    if (closed) {
+        return;
+    }
+    closed = true;
+    if (used > 0) {
+        flush();
+    }
+    for (std::size_t i = 0; i < file_.buffer_count(); i++) {
+        file_.wait(i);
+    }
+}
+
+// ===========================================================================
+// BinaryStreamReader
+
+BinaryStreamReader::BinaryStreamReader(const std::filesystem::path& path, const BinaryStreamOptions& options):
+    options(options),
+    file_(path, AsyncFile::Mode::Read, options.buffer_size, options.buffer_count, options.backend),
+    current(0),
+    available(0),
+    used(0),
+    next_offset(0),
+    remaining(std::filesystem::file_size(path)),
+    end(false)
+{
+    for (std::size_t i = 0; i < file_.buffer_count(); i++) {
+        read_ahead(i);
+    }
+    available = file_.wait(current);
+}
+
+void BinaryStreamReader::read_ahead(std::size_t buffer) {
+    file_.read(buffer, file_.buffer_size(), next_offset);
+    next_offset += file_.buffer_size();
+}
+
+bool BinaryStreamReader::fill() {
+    if (end) {
+        return false;
+    }
+    if (available < file_.buffer_size()) {
+        // A short read is the end of the file
+        end = true;
+        return false;
+    }
+    // The buffer is reused for the read after the others
+    read_ahead(current);
+    current = (current + 1) % file_.buffer_count();
+    available = file_.wait(current);
+    used = 0;
+    if (available == 0) {
+        end = true;
+        return false;
+    }
+    return true;
+}
+
+bool BinaryStreamReader::take(std::uint8_t* output, std::size_t size) {
+    while (size > 0) {
+        if (used == available && !fill()) {
+            return false;
+        }
+        std::size_t count = std::min(size, available - used);
+        std::memcpy(output, file_.buffer(current) + used, count);
+        used += count;
+        remaining -= count;
+        output += count;
+        size -= count;
+    }
+    return true;
+}
+
+bool BinaryStreamReader::next(std::span<const std::uint8_t>& data) {
+    if (used == available && !fill()) {
+        return false;
+    }
+    std::uint64_t size;
+    if (!take((std::uint8_t*)&size, sizeof(size))) {
+        throw IoError("Truncated message size");
+    }
+    // Messages within the current buffer are used in place
+    if (size <= available - used) {
+        data = std::span<const std::uint8_t>(file_.buffer(current) + used, size);
+        used += size;
+        remaining -= size;
+        return true;
+    }
+    if (size > remaining) {
+        throw IoError("Truncated message");
+    }
+    if (size > options.binary.limits.max_allocation && options.binary.limits.max_allocation != 0) {
+        throw IoError("Message exceeds the maximum allocation");
+    }
+    message.resize(size);
+    if (!take(message.data(), size)) {
+        throw IoError("Truncated message");
+    }
+    data = message;
+    return true;
+}
+
+} // namespace datapack
@@ -1,10 +1,49 @@
 #include "datapack/format/binary_writer.hpp"
+#include "datapack/encode/bitpack.hpp"
+#include "datapack/encode/varint.hpp"
+#include <algorithm>
+#include <type_traits>
 
 
 namespace datapack {
 
+static std::int64_t get_integer(IntType type, const void* value) {
+    switch (type) {
+        case IntType::I32:
+            return *(const std::int32_t*)value;
+        case IntType::I64:
+            return *(const std::int64_t*)value;
+        case IntType::U32:
+            return *(const std::uint32_t*)value;
+        case IntType::U64:
+            return *(const std::uint64_t*)value;
+        case IntType::U8:
+            return *(const std::uint8_t*)value;
+    }
+    return 0;
+}
+
+// Value to write as a varint, for the varint and delta encodings
+static std::uint64_t planned_integer(PlanState& plan, FieldEncoding encoding, std::int64_t value, bool is_signed) {
+    if (encoding == FieldEncoding::Delta) {
+        std::int64_t& previous = plan.previous();
+        std::uint64_t delta = zigzag(std::uint64_t(value) - std::uint64_t(previous));
+        previous = value;
+        return delta;
+    }
+    return is_signed ? zigzag(value) : std::uint64_t(value);
+}
+
 template <bool Dynamic>
 void BinaryWriter_<Dynamic>::integer(IntType type, const void* value) {
+    if (plan && binary_depth == 0) {
+        FieldEncoding encoding = plan->integer_encoding();
+        if (encoding != FieldEncoding::Fixed) {
+            bool is_signed = type == IntType::I32 || type == IntType::I64;
+            value_varint(planned_integer(*plan, encoding, get_integer(type, value), is_signed));
+            return;
+        }
+    }
     switch (type) {
         case IntType::I32:
             value_number(*(std::int32_t*)value);
@@ -43,6 +82,16 @@ void BinaryWriter_<Dynamic>::boolean(bool value) {
 
 template <bool Dynamic>
 void BinaryWriter_<Dynamic>::string(const char* value) {
+    if (plan && binary_depth == 0 && plan->string_encoding() == FieldEncoding::Dictionary) {
+        auto& dictionary = plan->write_dictionary();
+        auto iter = dictionary.find(value);
+        if (iter != dictionary.end()) {
+            value_varint(iter->second + 1);
+            return;
+        }
+        value_varint(0);
+        dictionary.emplace(value, dictionary.size());
+    }
     std::size_t size = std::strlen(value) + 1;
     if (!resize(pos + size)) {
         return;
@@ -53,6 +102,13 @@ void BinaryWriter_<Dynamic>::string(const char* value) {
 
 template <bool Dynamic>
 void BinaryWriter_<Dynamic>::enumerate(int value, const char* label) {
+    if (plan && binary_depth == 0) {
+        FieldEncoding encoding = plan->integer_encoding();
+        if (encoding != FieldEncoding::Fixed) {
+            value_varint(planned_integer(*plan, encoding, value, true));
+            return;
+        }
+    }
     value_number(value);
 }
 
@@ -63,9 +119,19 @@ void BinaryWriter_<Dynamic>::optional_begin(bool has_value) {
 
 template <bool Dynamic>
 void BinaryWriter_<Dynamic>::variant_begin(int value, const char* label) {
+    if (plan) {
+        plan->variant_begin(label);
+    }
     value_number(value);
 }
 
+template <bool Dynamic>
+void BinaryWriter_<Dynamic>::variant_end() {
+    if (plan) {
+        plan->container_end();
+    }
+}
+
 template <bool Dynamic>
 void BinaryWriter_<Dynamic>::binary(
     const std::uint8_t* input_data,
@@ -77,6 +143,15 @@ void BinaryWriter_<Dynamic>::binary(
     if (!fixed_length) {
         value_number(std::uint64_t(length));
     }
+    if (!align_binary()) {
+        return;
+    }
+#ifndef EMBEDDED
+    if (binary_depth == 0 && reference_binary(input_data, size)) {
+        referenced += size;
+        return;
+    }
+#endif
     if (!resize(pos + size)) {
         return;
     }
@@ -84,8 +159,132 @@ void BinaryWriter_<Dynamic>::binary(
     pos += size;
 }
 
+template <bool Dynamic>
+void BinaryWriter_<Dynamic>::integer_array(
+    IntType type,
+    const void* input_data,
+    std::size_t length,
+    bool fixed_length)
+{
+    // Arrays within a trivial object keep the padded layout
+    if (!pack_integers || binary_depth > 0) {
+        binary((const std::uint8_t*)input_data, length, int_type_size(type), fixed_length);
+        return;
+    }
+    if (!fixed_length) {
+        value_number(std::uint64_t(length));
+    }
+    switch (type) {
+        case IntType::I32:
+            packed_integers((const std::int32_t*)input_data, length);
+            break;
+        case IntType::I64:
+            packed_integers((const std::int64_t*)input_data, length);
+            break;
+        case IntType::U32:
+            packed_integers((const std::uint32_t*)input_data, length);
+            break;
+        case IntType::U64:
+            packed_integers((const std::uint64_t*)input_data, length);
+            break;
+        case IntType::U8:
+            packed_integers((const std::uint8_t*)input_data, length);
+            break;
+    }
+}
+
+// Each block is: width (u8) | minimum (T) | bitpacked offsets from the minimum
+// Blocks of 64-bit values with a range of 2^32 or more use width 0xFF,
+// followed by the values unchanged.
+template <bool Dynamic>
+template <typename T>
+void BinaryWriter_<Dynamic>::packed_integers(const T* values, std::size_t length) {
+    using U = std::make_unsigned_t<T>;
+    std::uint32_t offsets[bitpack_block_size];
+
+    for (std::size_t begin = 0; begin < length; begin += bitpack_block_size) {
+        const T* block = values + begin;
+        std::size_t count = std::min(bitpack_block_size, length - begin);
+        auto [min, max] = std::minmax_element(block, block + count);
+        U range = U(*max) - U(*min);
+
+        if (range > U(UINT32_MAX)) {
+            if (!resize(pos + 1 + count * sizeof(T))) {
+                return;
+            }
+            data[pos] = 0xFF;
+            std::memcpy(&data[pos + 1], block, count * sizeof(T));
+            pos += 1 + count * sizeof(T);
+            continue;
+        }
+
+        for (std::size_t i = 0; i < count; i++) {
+            offsets[i] = U(block[i]) - U(*min);
+        }
+        int width = bitpack_width(range);
+        std::size_t size = 1 + sizeof(T) + bitpacked_size(count, width);
+        if (!resize(pos + size)) {
+            return;
+        }
+        data[pos] = width;
+        std::memcpy(&data[pos + 1], &*min, sizeof(T));
+        bitpack(offsets, count, width, &data[pos + 1 + sizeof(T)]);
+        pos += size;
+    }
+}
+
 template <bool Dynamic>
 void BinaryWriter_<Dynamic>::object_begin(std::size_t size) {
+    if (plan) {
+        plan->object_begin();
+    }
+    trivial_begin(size);
+}
+
+template <bool Dynamic>
+void BinaryWriter_<Dynamic>::object_next(const char* key) {
+    if (plan) {
+        plan->object_next(key);
+    }
+}
+
+template <bool Dynamic>
+void BinaryWriter_<Dynamic>::object_end(std::size_t size) {
+    if (plan) {
+        plan->container_end();
+    }
+    trivial_end(size);
+}
+
+template <bool Dynamic>
+void BinaryWriter_<Dynamic>::tuple_begin(std::size_t size) {
+    if (plan) {
+        plan->tuple_begin();
+    }
+    // Aligned the same as an array written as binary
+    if (size != 0) {
+        align_binary();
+    }
+    trivial_begin(size);
+}
+
+template <bool Dynamic>
+void BinaryWriter_<Dynamic>::tuple_next() {
+    if (plan) {
+        plan->tuple_next();
+    }
+}
+
+template <bool Dynamic>
+void BinaryWriter_<Dynamic>::tuple_end(std::size_t size) {
+    if (plan) {
+        plan->container_end();
+    }
+    trivial_end(size);
+}
+
+template <bool Dynamic>
+void BinaryWriter_<Dynamic>::trivial_begin(std::size_t size) {
     if (size == 0){
         return;
     }
@@ -97,7 +296,7 @@ void BinaryWriter_<Dynamic>::object_begin(std::size_t size) {
 }
 
 template <bool Dynamic>
-void BinaryWriter_<Dynamic>::object_end(std::size_t size) {
+void BinaryWriter_<Dynamic>::trivial_end(std::size_t size) {
     if (size == 0) {
         return;
     }
@@ -107,6 +306,9 @@ void BinaryWriter_<Dynamic>::object_end(std::size_t size) {
 
 template <bool Dynamic>
 void BinaryWriter_<Dynamic>::list_begin(bool is_trivial) {
+    if (plan) {
+        plan->list_begin();
+    }
     if (binary_depth != 0) {
         assert(false);
         return;
@@ -116,7 +318,10 @@ void BinaryWriter_<Dynamic>::list_begin(bool is_trivial) {
     }
 
     trivial_list_length = 0;
+    trivial_list_pos = pos;
     value_number(std::uint64_t(0)); // Placeholder
+    // Aligned the same as a vector written as binary
+    align_binary();
 
     binary_depth++;
     binary_start = pos;
@@ -124,18 +329,25 @@ void BinaryWriter_<Dynamic>::list_begin(bool is_trivial) {
 
 template <bool Dynamic>
 void BinaryWriter_<Dynamic>::list_end() {
+    if (plan) {
+        plan->container_end();
+    }
     if (binary_depth == 0) {
         value_bool(false);
         return;
     }
 
-    *(std::uint64_t*)&data[binary_start - sizeof(std::uint64_t)] = trivial_list_length;
+    std::uint64_t length = trivial_list_length;
+    std::memcpy(&data[trivial_list_pos], &length, sizeof(length));
     binary_depth--;
     assert(binary_depth == 0);
 }
 
 template <bool Dynamic>
 void BinaryWriter_<Dynamic>::list_next() {
+    if (plan) {
+        plan->list_next();
+    }
     if (binary_depth == 0) {
         value_bool(true);
         return;
@@ -145,6 +357,9 @@ void BinaryWriter_<Dynamic>::list_next() {
 
 template <bool Dynamic>
 bool BinaryWriter_<Dynamic>::pad(std::size_t size) {
+    if (packed) {
+        return true;
+    }
     if ((pos-binary_start) % size != 0) {
         pos += (size - (pos-binary_start) % size);
         return resize(pos);
@@ -152,6 +367,17 @@ bool BinaryWriter_<Dynamic>::pad(std::size_t size) {
     return true;
 }
 
+// Padding inside a trivial block would change its layout
+template <bool Dynamic>
+bool BinaryWriter_<Dynamic>::align_binary() {
+    std::size_t offset = pos + referenced;
+    if (binary_alignment != 0 && binary_depth == 0 && offset % binary_alignment != 0) {
+        pos += binary_alignment - offset % binary_alignment;
+        return resize(pos);
+    }
+    return true;
+}
+
 template <bool Dynamic>
 bool BinaryWriter_<Dynamic>::resize(std::size_t new_size) {
     if constexpr(Dynamic) {
@@ -175,10 +401,19 @@ void BinaryWriter_<Dynamic>::value_number(T value) {
         return;
     }
 
-    *((T*)&data[pos]) = value;
+    std::memcpy(&data[pos], &value, sizeof(T));
     pos += sizeof(T);
 }
 
+template <bool Dynamic>
+void BinaryWriter_<Dynamic>::value_varint(std::uint64_t value) {
+    while (value >= 0x80) {
+        value_number(std::uint8_t(value | 0x80));
+        value >>= 7;
+    }
+    value_number(std::uint8_t(value));
+}
+
 template <bool Dynamic>
 void BinaryWriter_<Dynamic>::value_bool(bool value) {
     if (!resize(pos + 1)) {
@@ -0,0 +1,60 @@
+#include "datapack/format/chain_reader.hpp"
+#include <algorithm>
+#include <cstring>
+
+
+namespace datapack {
+
+ChainReader::ChainReader(
+    const std::vector<std::span<const std::uint8_t>>& buffers,
+    const BinaryOptions& options
+):
+    BinaryReader(std::span<const std::uint8_t>(), options),
+    total(0)
+{
+    // Empty buffers would give several buffers at the same position
+    for (const auto& buffer: buffers) {
+        if (buffer.empty()) {
+            continue;
+        }
+        this->buffers.push_back(buffer);
+        offsets.push_back(total);
+        total += buffer.size();
+    }
+    if (!this->buffers.empty()) {
+        set_window(this->buffers[0], 0, total - this->buffers[0].size());
+    }
+}
+
+bool ChainReader::refill(std::size_t size) {
+    std::size_t begin = position();
+    if (size > total - begin) {
+        return false;
+    }
+    auto find = [&](std::size_t position) {
+        return std::upper_bound(offsets.begin(), offsets.end(), position) - offsets.begin() - 1;
+    };
+
+    // Usually the next buffer holds all of it
+    std::size_t first = find(begin);
+    std::size_t first_end = offsets[first] + buffers[first].size();
+    if (first_end - begin >= size) {
+        set_window(buffers[first], offsets[first], total - first_end);
+        return true;
+    }
+
+    // Otherwise copy exactly what is needed, so the next refill can return
+    // to reading in place
+    auto& stitch = stitches.emplace_back(size);
+    std::size_t copied = 0;
+    for (std::size_t i = first; copied < size; i++) {
+        std::size_t offset = begin + copied - offsets[i];
+        std::size_t count = std::min(size - copied, buffers[i].size() - offset);
+        std::memcpy(stitch.data() + copied, buffers[i].data() + offset, count);
+        copied += count;
+    }
+    set_window(stitch, begin, total - begin - size);
+    return true;
+}
+
+} // namespace datapack
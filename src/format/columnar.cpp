@@ -0,0 +1,1199 @@
+#include "datapack/format/columnar.hpp"
+#include "datapack/util/object_writer.hpp"
+#include "datapack/encode/bitpack.hpp"
+#include "datapack/encode/varint.hpp"
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+
+namespace datapack {
+
+// ===========================================================================
+// Metadata
+
+DATAPACK_LABELLED_ENUM_DEF(ColumnEncoding) = {
+    "plain", "dictionary", "delta", "bitpacked"
+};
+
+DATAPACK_LABELLED_VARIANT_DEF(ColumnValue) = {
+    "integer", "floating", "string", "unsigned"
+};
+
+DATAPACK_IMPL(ColumnStatistics, value, packer) {
+    packer.object_begin();
+    packer.value("null_count", value.null_count);
+    packer.value("min", value.min);
+    packer.value("max", value.max);
+    packer.object_end();
+}
+
+DATAPACK_IMPL(ColumnChunk, value, packer) {
+    packer.object_begin();
+    packer.value("offset", value.offset);
+    packer.value("size", value.size);
+    packer.value("encoding", value.encoding);
+    packer.value("statistics", value.statistics);
+    packer.object_end();
+}
+
+DATAPACK_IMPL(RowGroup, value, packer) {
+    packer.object_begin();
+    packer.value("row_count", value.row_count);
+    packer.value("columns", value.columns);
+    packer.object_end();
+}
+
+DATAPACK_IMPL(ColumnarMetadata, value, packer) {
+    packer.object_begin();
+    packer.value("schema", value.schema);
+    packer.value("row_groups", value.row_groups);
+    packer.object_end();
+}
+
+static const char magic[4] = {'D', 'P', 'C', 'F'};
+
+// ===========================================================================
+// Columns
+
+static bool get_leaf_type(const Token& token, ColumnType& type) {
+    if (std::get_if<IntType>(&token)) {
+        type = ColumnType::Integer;
+    } else if (std::get_if<FloatType>(&token)) {
+        type = ColumnType::Floating;
+    } else if (std::get_if<bool>(&token)) {
+        type = ColumnType::Boolean;
+    } else if (std::get_if<std::string>(&token)) {
+        type = ColumnType::String;
+    } else if (std::get_if<token::Enumerate>(&token)) {
+        type = ColumnType::Enumerate;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+std::vector<ColumnInfo> get_columns(const Schema& schema) {
+    const auto& tokens = schema.tokens;
+    std::vector<ColumnInfo> columns;
+
+    // Key of the current value in each enclosing object or tuple
+    struct Level {
+        std::string key;
+        int tuple_index;
+    };
+    std::vector<Level> levels;
+    auto get_path = [&levels]() {
+        std::string path;
+        for (std::size_t i = 0; i < levels.size(); i++) {
+            if (i != 0) {
+                path += ".";
+            }
+            path += levels[i].key;
+        }
+        return path;
+    };
+
+    std::size_t pos = 0;
+    while (pos < tokens.size()) {
+        const Token& token = tokens[pos];
+        ColumnType type;
+
+        if (std::get_if<token::ObjectBegin>(&token)) {
+            levels.push_back(Level{"", -1});
+            pos++;
+        }
+        else if (auto value = std::get_if<token::ObjectNext>(&token)) {
+            levels.back().key = value->key;
+            pos++;
+        }
+        else if (std::get_if<token::TupleBegin>(&token)) {
+            levels.push_back(Level{"", -1});
+            pos++;
+        }
+        else if (std::get_if<token::TupleNext>(&token)) {
+            levels.back().tuple_index++;
+            levels.back().key = std::to_string(levels.back().tuple_index);
+            pos++;
+        }
+        else if (std::get_if<token::ObjectEnd>(&token) || std::get_if<token::TupleEnd>(&token)) {
+            levels.pop_back();
+            pos++;
+        }
+        else if (get_leaf_type(token, type)) {
+            columns.push_back(ColumnInfo{get_path(), type, false, {token}});
+            pos++;
+        }
+        else if (std::get_if<token::Optional>(&token)
+            && pos + 1 < tokens.size()
+            && get_leaf_type(tokens[pos + 1], type))
+        {
+            columns.push_back(ColumnInfo{get_path(), type, true, {tokens[pos + 1]}});
+            pos += 2;
+        }
+        else {
+            // Lists, variants, binary and optional containers
+            // get_tokens_end expects the position after any list or
+            // optional tokens that prefix the value
+            std::size_t value_begin = pos;
+            while (value_begin < tokens.size()
+                && (std::get_if<token::List>(&tokens[value_begin])
+                    || std::get_if<token::Optional>(&tokens[value_begin])))
+            {
+                value_begin++;
+            }
+            std::size_t end = get_tokens_end(tokens, value_begin);
+            columns.push_back(ColumnInfo{
+                get_path(),
+                ColumnType::Opaque,
+                false,
+                std::vector<Token>(tokens.begin() + pos, tokens.begin() + end)
+            });
+            pos = end;
+        }
+    }
+    return columns;
+}
+
+void ColumnData::clear() {
+    valid.clear();
+    integers.clear();
+    floats.clear();
+    strings.clear();
+    blobs.clear();
+}
+
+// ===========================================================================
+// Shredder
+
+ColumnShredder::ColumnShredder(const std::vector<ColumnInfo>& columns, std::vector<ColumnData>& data):
+    Writer(false),
+    columns(columns),
+    data(data),
+    column(0),
+    capture_depth(0)
+{}
+
+void ColumnShredder::begin_record() {
+    column = 0;
+}
+
+void ColumnShredder::end_record() {
+    if (column != columns.size() || capture) {
+        throw ColumnarError("Record doesn't match the schema");
+    }
+}
+
+template <typename StartToken, typename Call>
+bool ColumnShredder::forward(const Call& call) {
+    if (!capture) {
+        if constexpr(std::is_void_v<StartToken>) {
+            return false;
+        } else {
+            if (column >= columns.size()
+                || columns[column].type != ColumnType::Opaque
+                || !std::get_if<StartToken>(&columns[column].tokens.front()))
+            {
+                return false;
+            }
+            capture_data.clear();
+            capture.emplace(capture_data, false);
+            capture_depth = 0;
+        }
+    }
+    capture_depth += call(*capture);
+    if (capture_depth == 0) {
+        auto result = capture->result();
+        data[column].blobs.emplace_back(result.begin(), result.end());
+        capture.reset();
+        column++;
+    }
+    return true;
+}
+
+ColumnData& ColumnShredder::next_leaf(ColumnType type) {
+    if (column >= columns.size() || columns[column].type != type) {
+        throw ColumnarError("Record doesn't match the schema");
+    }
+    return data[column++];
+}
+
+void ColumnShredder::integer(IntType type, const void* value) {
+    if (forward<void>([&](Writer& writer) { writer.integer(type, value); return 0; })) return;
+    std::int64_t integer_value = 0;
+    switch (type) {
+        case IntType::I32:
+            integer_value = *(const std::int32_t*)value;
+            break;
+        case IntType::I64:
+            integer_value = *(const std::int64_t*)value;
+            break;
+        case IntType::U32:
+            integer_value = *(const std::uint32_t*)value;
+            break;
+        case IntType::U64:
+            integer_value = *(const std::uint64_t*)value;
+            break;
+        case IntType::U8:
+            integer_value = *(const std::uint8_t*)value;
+            break;
+    }
+    next_leaf(ColumnType::Integer).integers.push_back(integer_value);
+}
+
+void ColumnShredder::floating(FloatType type, const void* value) {
+    if (forward<void>([&](Writer& writer) { writer.floating(type, value); return 0; })) return;
+    double floating_value = 0;
+    switch (type) {
+        case FloatType::F32:
+            floating_value = *(const float*)value;
+            break;
+        case FloatType::F64:
+            floating_value = *(const double*)value;
+            break;
+    }
+    next_leaf(ColumnType::Floating).floats.push_back(floating_value);
+}
+
+void ColumnShredder::boolean(bool value) {
+    if (forward<void>([&](Writer& writer) { writer.boolean(value); return 0; })) return;
+    next_leaf(ColumnType::Boolean).integers.push_back(value);
+}
+
+void ColumnShredder::string(const char* value) {
+    if (forward<void>([&](Writer& writer) { writer.string(value); return 0; })) return;
+    next_leaf(ColumnType::String).strings.push_back(value);
+}
+
+void ColumnShredder::enumerate(int value, const char* label) {
+    if (forward<void>([&](Writer& writer) { writer.enumerate(value, label); return 0; })) return;
+    next_leaf(ColumnType::Enumerate).integers.push_back(value);
+}
+
+void ColumnShredder::binary(const std::uint8_t* data, std::size_t length, std::size_t stride, bool fixed_length) {
+    if (forward<token::Binary>([&](Writer& writer) { writer.binary(data, length, stride, fixed_length); return 0; })) return;
+    throw ColumnarError("Record doesn't match the schema");
+}
+
+void ColumnShredder::optional_begin(bool has_value) {
+    if (forward<token::Optional>([&](Writer& writer) { writer.optional_begin(has_value); return has_value ? 1 : 0; })) return;
+    if (column >= columns.size() || !columns[column].nullable) {
+        throw ColumnarError("Record doesn't match the schema");
+    }
+    data[column].valid.push_back(has_value);
+    if (!has_value) {
+        column++;
+    }
+}
+
+void ColumnShredder::optional_end() {
+    forward<void>([&](Writer& writer) { writer.optional_end(); return -1; });
+}
+
+void ColumnShredder::variant_begin(int value, const char* label) {
+    if (forward<token::VariantBegin>([&](Writer& writer) { writer.variant_begin(value, label); return 1; })) return;
+    throw ColumnarError("Record doesn't match the schema");
+}
+
+void ColumnShredder::variant_end() {
+    if (forward<void>([&](Writer& writer) { writer.variant_end(); return -1; })) return;
+    throw ColumnarError("Record doesn't match the schema");
+}
+
+void ColumnShredder::object_begin(std::size_t size) {
+    forward<void>([&](Writer& writer) { writer.object_begin(size); return 1; });
+}
+
+void ColumnShredder::object_next(const char* key) {
+    forward<void>([&](Writer& writer) { writer.object_next(key); return 0; });
+}
+
+void ColumnShredder::object_end(std::size_t size) {
+    forward<void>([&](Writer& writer) { writer.object_end(size); return -1; });
+}
+
+void ColumnShredder::tuple_begin(std::size_t size) {
+    forward<void>([&](Writer& writer) { writer.tuple_begin(size); return 1; });
+}
+
+void ColumnShredder::tuple_next() {
+    forward<void>([&](Writer& writer) { writer.tuple_next(); return 0; });
+}
+
+void ColumnShredder::tuple_end(std::size_t size) {
+    forward<void>([&](Writer& writer) { writer.tuple_end(size); return -1; });
+}
+
+void ColumnShredder::list_begin(bool is_trivial) {
+    if (forward<token::List>([&](Writer& writer) { writer.list_begin(is_trivial); return 1; })) return;
+    throw ColumnarError("Record doesn't match the schema");
+}
+
+void ColumnShredder::list_next() {
+    if (forward<void>([&](Writer& writer) { writer.list_next(); return 0; })) return;
+    throw ColumnarError("Record doesn't match the schema");
+}
+
+void ColumnShredder::list_end() {
+    if (forward<void>([&](Writer& writer) { writer.list_end(); return -1; })) return;
+    throw ColumnarError("Record doesn't match the schema");
+}
+
+// ===========================================================================
+// Assembler
+
+void DefaultReader::integer(IntType type, void* value) {
+    std::uint64_t zero = 0;
+    std::memcpy(value, &zero, type == IntType::U8 ? 1 : (type == IntType::I32 || type == IntType::U32) ? 4 : 8);
+}
+
+std::tuple<const std::uint8_t*, std::size_t> DefaultReader::binary(std::size_t length, std::size_t stride) {
+    zeros.assign(std::max<std::size_t>(length * stride, 1), 0);
+    return std::make_tuple(zeros.data(), length);
+}
+
+ColumnAssembler::ColumnAssembler(
+    const std::vector<ColumnInfo>& columns,
+    const std::vector<ColumnData>& data,
+    const std::vector<bool>& projected
+):
+    Reader(false),
+    columns(columns),
+    data(data),
+    projected(projected),
+    column(0),
+    row(0),
+    next_row(0),
+    value_index(columns.size(), 0),
+    inner(nullptr),
+    capture_depth(0)
+{}
+
+void ColumnAssembler::begin_record() {
+    column = 0;
+    row = next_row++;
+}
+
+template <typename StartToken, typename Call>
+bool ColumnAssembler::forward(const Call& call) {
+    if (!inner) {
+        if constexpr(std::is_void_v<StartToken>) {
+            return false;
+        } else {
+            if (column >= columns.size()
+                || columns[column].type != ColumnType::Opaque
+                || !std::get_if<StartToken>(&columns[column].tokens.front()))
+            {
+                return false;
+            }
+            if (projected[column]) {
+                const auto& blob = data[column].blobs[value_index[column]++];
+                capture.emplace(std::span<const std::uint8_t>(blob), false);
+                inner = &*capture;
+            } else {
+                inner = &defaults;
+            }
+            capture_depth = 0;
+        }
+    }
+    capture_depth += call(*inner);
+    if (capture_depth == 0) {
+        if (!inner->valid()) {
+            invalidate();
+        }
+        capture.reset();
+        inner = nullptr;
+        column++;
+    }
+    return true;
+}
+
+const ColumnData* ColumnAssembler::next_leaf(ColumnType type, std::size_t& index) {
+    if (column >= columns.size() || columns[column].type != type) {
+        invalidate();
+        return nullptr;
+    }
+    std::size_t i = column++;
+    if (!projected[i]) {
+        return nullptr;
+    }
+    index = value_index[i]++;
+    return &data[i];
+}
+
+void ColumnAssembler::integer(IntType type, void* value) {
+    if (forward<void>([&](Reader& reader) { reader.integer(type, value); return 0; })) return;
+    std::size_t index;
+    auto column_data = next_leaf(ColumnType::Integer, index);
+    if (!column_data) return;
+    std::int64_t integer_value = column_data->integers[index];
+    switch (type) {
+        case IntType::I32:
+            *(std::int32_t*)value = integer_value;
+            break;
+        case IntType::I64:
+            *(std::int64_t*)value = integer_value;
+            break;
+        case IntType::U32:
+            *(std::uint32_t*)value = integer_value;
+            break;
+        case IntType::U64:
+            *(std::uint64_t*)value = integer_value;
+            break;
+        case IntType::U8:
+            *(std::uint8_t*)value = integer_value;
+            break;
+    }
+}
+
+void ColumnAssembler::floating(FloatType type, void* value) {
+    if (forward<void>([&](Reader& reader) { reader.floating(type, value); return 0; })) return;
+    std::size_t index;
+    auto column_data = next_leaf(ColumnType::Floating, index);
+    if (!column_data) return;
+    switch (type) {
+        case FloatType::F32:
+            *(float*)value = column_data->floats[index];
+            break;
+        case FloatType::F64:
+            *(double*)value = column_data->floats[index];
+            break;
+    }
+}
+
+bool ColumnAssembler::boolean() {
+    bool result = false;
+    if (forward<void>([&](Reader& reader) { result = reader.boolean(); return 0; })) return result;
+    std::size_t index;
+    auto column_data = next_leaf(ColumnType::Boolean, index);
+    if (!column_data) return false;
+    return column_data->integers[index] != 0;
+}
+
+const char* ColumnAssembler::string() {
+    const char* result = "";
+    if (forward<void>([&](Reader& reader) { result = reader.string(); return 0; })) return result;
+    std::size_t index;
+    auto column_data = next_leaf(ColumnType::String, index);
+    if (!column_data) return "";
+    return column_data->strings[index].c_str();
+}
+
+int ColumnAssembler::enumerate(const std::span<const char*>& labels) {
+    int result = 0;
+    if (forward<void>([&](Reader& reader) { result = reader.enumerate(labels); return 0; })) return result;
+    std::size_t index;
+    auto column_data = next_leaf(ColumnType::Enumerate, index);
+    if (!column_data) return 0;
+    std::int64_t value = column_data->integers[index];
+    if (value < 0 || value >= std::int64_t(labels.size())) {
+        invalidate();
+        return 0;
+    }
+    return value;
+}
+
+std::tuple<const std::uint8_t*, std::size_t> ColumnAssembler::binary(std::size_t length, std::size_t stride) {
+    std::tuple<const std::uint8_t*, std::size_t> result = { nullptr, 0 };
+    if (forward<token::Binary>([&](Reader& reader) { result = reader.binary(length, stride); return 0; })) return result;
+    invalidate();
+    return defaults.binary(length, stride);
+}
+
+bool ColumnAssembler::optional_begin() {
+    bool result = false;
+    if (forward<token::Optional>([&](Reader& reader) { result = reader.optional_begin(); return result ? 1 : 0; })) return result;
+    if (column >= columns.size() || !columns[column].nullable) {
+        invalidate();
+        return false;
+    }
+    if (!projected[column] || !data[column].valid[row]) {
+        column++;
+        return false;
+    }
+    return true;
+}
+
+void ColumnAssembler::optional_end() {
+    forward<void>([&](Reader& reader) { reader.optional_end(); return -1; });
+}
+
+int ColumnAssembler::variant_begin(const std::span<const char*>& labels) {
+    int result = 0;
+    if (forward<token::VariantBegin>([&](Reader& reader) { result = reader.variant_begin(labels); return 1; })) return result;
+    invalidate();
+    return 0;
+}
+
+void ColumnAssembler::variant_end() {
+    forward<void>([&](Reader& reader) { reader.variant_end(); return -1; });
+}
+
+void ColumnAssembler::object_begin(std::size_t size) {
+    forward<void>([&](Reader& reader) { reader.object_begin(size); return 1; });
+}
+
+void ColumnAssembler::object_next(const char* key) {
+    forward<void>([&](Reader& reader) { reader.object_next(key); return 0; });
+}
+
+void ColumnAssembler::object_end(std::size_t size) {
+    forward<void>([&](Reader& reader) { reader.object_end(size); return -1; });
+}
+
+void ColumnAssembler::tuple_begin(std::size_t size) {
+    forward<void>([&](Reader& reader) { reader.tuple_begin(size); return 1; });
+}
+
+void ColumnAssembler::tuple_next() {
+    forward<void>([&](Reader& reader) { reader.tuple_next(); return 0; });
+}
+
+void ColumnAssembler::tuple_end(std::size_t size) {
+    forward<void>([&](Reader& reader) { reader.tuple_end(size); return -1; });
+}
+
+void ColumnAssembler::list_begin(bool is_trivial) {
+    if (forward<token::List>([&](Reader& reader) { reader.list_begin(is_trivial); return 1; })) return;
+    invalidate();
+}
+
+bool ColumnAssembler::list_next() {
+    bool result = false;
+    if (forward<void>([&](Reader& reader) { result = reader.list_next(); return 0; })) return result;
+    invalidate();
+    return false;
+}
+
+void ColumnAssembler::list_end() {
+    forward<void>([&](Reader& reader) { reader.list_end(); return -1; });
+}
+
+// ===========================================================================
+// Encoding
+
+template <typename T>
+static void write_fixed(std::vector<std::uint8_t>& output, T value) {
+    std::size_t pos = output.size();
+    output.resize(pos + sizeof(T));
+    std::memcpy(&output[pos], &value, sizeof(T));
+}
+
+// The values must be below 2^width, see bitpack.hpp
+static void write_bitpacked(std::vector<std::uint8_t>& output, const std::vector<std::uint32_t>& values, int width) {
+    std::size_t start = output.size();
+    output.resize(start + bitpacked_size(values.size(), width));
+    bitpack(values.data(), values.size(), width, &output[start]);
+}
+
+class ChunkReader {
+public:
+    ChunkReader(const std::span<const std::uint8_t>& data):
+        data(data), pos(0)
+    {}
+
+    std::uint64_t varint() {
+        std::uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            std::uint8_t byte = bytes(1)[0];
+            value |= std::uint64_t(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) {
+                return value;
+            }
+        }
+        throw ColumnarError("Invalid varint in column chunk");
+    }
+
+    template <typename T>
+    T fixed() {
+        T value;
+        std::memcpy(&value, bytes(sizeof(T)).data(), sizeof(T));
+        return value;
+    }
+
+    std::vector<std::uint32_t> bitpacked(std::size_t count, int width) {
+        if (width > 32) {
+            throw ColumnarError("Invalid bit width in column chunk");
+        }
+        check_count(count, width);
+        auto packed = bytes(bitpacked_size(count, width));
+        std::vector<std::uint32_t> values(count);
+        bitunpack(packed.data(), count, width, values.data());
+        return values;
+    }
+
+    // Checks that count values of at least the given number of bits fit in
+    // the rest of the chunk, before allocating for them
+    void check_count(std::size_t count, std::size_t bits) const {
+        if (bits != 0 && count > (data.size() - pos) * 8 / bits) {
+            throw ColumnarError("Column chunk is truncated");
+        }
+    }
+
+    std::span<const std::uint8_t> bytes(std::size_t size) {
+        if (size > data.size() - pos) {
+            throw ColumnarError("Column chunk is truncated");
+        }
+        auto result = data.subspan(pos, size);
+        pos += size;
+        return result;
+    }
+
+    bool done() const { return pos == data.size(); }
+
+private:
+    std::span<const std::uint8_t> data;
+    std::size_t pos;
+};
+
+static void encode_integers(
+    std::vector<std::uint8_t>& output,
+    const std::vector<std::int64_t>& values,
+    ColumnEncoding& encoding)
+{
+    std::vector<std::uint8_t> plain;
+    for (std::int64_t value: values) {
+        write_fixed(plain, value);
+    }
+
+    std::vector<std::uint8_t> delta;
+    std::int64_t prev = 0;
+    for (std::int64_t value: values) {
+        // Differences wrap around, which is reversed when decoding
+        write_varint(delta, zigzag(std::int64_t(std::uint64_t(value) - std::uint64_t(prev))));
+        prev = value;
+    }
+
+    // Only for a range below 2^32, which wider offsets barely improve on
+    std::vector<std::uint8_t> bitpacked;
+    auto [min, max] = std::minmax_element(values.begin(), values.end());
+    if (!values.empty() && std::uint64_t(*max) - std::uint64_t(*min) <= UINT32_MAX) {
+        std::vector<std::uint32_t> offsets(values.size());
+        for (std::size_t i = 0; i < values.size(); i++) {
+            offsets[i] = std::uint64_t(values[i]) - std::uint64_t(*min);
+        }
+        int width = bitpack_width(std::uint64_t(*max) - std::uint64_t(*min));
+        write_fixed(bitpacked, *min);
+        bitpacked.push_back(width);
+        write_bitpacked(bitpacked, offsets, width);
+    }
+
+    const std::vector<std::uint8_t>* best = &plain;
+    encoding = ColumnEncoding::Plain;
+    if (!bitpacked.empty() && bitpacked.size() < best->size()) {
+        best = &bitpacked;
+        encoding = ColumnEncoding::Bitpacked;
+    }
+    if (delta.size() < best->size()) {
+        best = &delta;
+        encoding = ColumnEncoding::Delta;
+    }
+    output.insert(output.end(), best->begin(), best->end());
+}
+
+static std::vector<std::int64_t> decode_integers(ChunkReader& reader, std::size_t count, ColumnEncoding encoding) {
+    std::vector<std::int64_t> values;
+    switch (encoding) {
+        case ColumnEncoding::Plain:
+            reader.check_count(count, 64);
+            values.resize(count);
+            for (auto& value: values) {
+                value = reader.fixed<std::int64_t>();
+            }
+            break;
+        case ColumnEncoding::Delta: {
+            reader.check_count(count, 8);
+            values.resize(count);
+            std::uint64_t prev = 0;
+            for (auto& value: values) {
+                prev += std::uint64_t(unzigzag(reader.varint()));
+                value = prev;
+            }
+            break;
+        }
+        case ColumnEncoding::Bitpacked: {
+            if (count == 0) break;
+            std::int64_t min = reader.fixed<std::int64_t>();
+            int width = reader.fixed<std::uint8_t>();
+            auto offsets = reader.bitpacked(count, width);
+            values.resize(count);
+            for (std::size_t i = 0; i < count; i++) {
+                values[i] = std::uint64_t(min) + offsets[i];
+            }
+            break;
+        }
+        default:
+            throw ColumnarError("Invalid encoding for an integer column");
+    }
+    return values;
+}
+
+static void encode_strings(
+    std::vector<std::uint8_t>& output,
+    const std::vector<std::string>& values,
+    ColumnEncoding& encoding)
+{
+    std::vector<std::uint8_t> plain;
+    for (const auto& value: values) {
+        write_varint(plain, value.size());
+        plain.insert(plain.end(), value.begin(), value.end());
+    }
+
+    std::vector<std::uint8_t> dictionary;
+    std::unordered_map<std::string, std::uint64_t> indices;
+    std::vector<const std::string*> distinct;
+    std::vector<std::uint32_t> value_indices;
+    for (const auto& value: values) {
+        auto [iter, inserted] = indices.emplace(value, distinct.size());
+        if (inserted) {
+            distinct.push_back(&iter->first);
+        }
+        value_indices.push_back(iter->second);
+    }
+    if (distinct.size() < values.size() && distinct.size() <= UINT32_MAX) {
+        write_varint(dictionary, distinct.size());
+        for (const auto* value: distinct) {
+            write_varint(dictionary, value->size());
+            dictionary.insert(dictionary.end(), value->begin(), value->end());
+        }
+        int width = bitpack_width(distinct.size() - 1);
+        dictionary.push_back(width);
+        write_bitpacked(dictionary, value_indices, width);
+    }
+
+    if (!dictionary.empty() && dictionary.size() < plain.size()) {
+        encoding = ColumnEncoding::Dictionary;
+        output.insert(output.end(), dictionary.begin(), dictionary.end());
+    } else {
+        encoding = ColumnEncoding::Plain;
+        output.insert(output.end(), plain.begin(), plain.end());
+    }
+}
+
+static std::string read_string(ChunkReader& reader) {
+    auto bytes = reader.bytes(reader.varint());
+    return std::string((const char*)bytes.data(), bytes.size());
+}
+
+static std::vector<std::string> decode_strings(ChunkReader& reader, std::size_t count, ColumnEncoding encoding) {
+    std::vector<std::string> values;
+    if (encoding == ColumnEncoding::Plain) {
+        reader.check_count(count, 8);
+        values.reserve(count);
+        for (std::size_t i = 0; i < count; i++) {
+            values.push_back(read_string(reader));
+        }
+        return values;
+    }
+    if (encoding != ColumnEncoding::Dictionary) {
+        throw ColumnarError("Invalid encoding for a string column");
+    }
+    std::size_t distinct_count = reader.varint();
+    reader.check_count(distinct_count, 8);
+    std::vector<std::string> distinct(distinct_count);
+    for (auto& value: distinct) {
+        value = read_string(reader);
+    }
+    int width = reader.fixed<std::uint8_t>();
+    auto indices = reader.bitpacked(count, width);
+    values.reserve(count);
+    for (std::uint32_t index: indices) {
+        if (index >= distinct.size()) {
+            throw ColumnarError("Invalid dictionary index");
+        }
+        values.push_back(distinct[index]);
+    }
+    return values;
+}
+
+static void encode_column(
+    std::vector<std::uint8_t>& output,
+    const ColumnInfo& info,
+    const ColumnData& data,
+    std::size_t row_count,
+    ColumnChunk& chunk)
+{
+    if (info.nullable) {
+        write_bitpacked(output, std::vector<std::uint32_t>(data.valid.begin(), data.valid.end()), 1);
+        chunk.statistics.null_count = std::count(data.valid.begin(), data.valid.end(), 0);
+    }
+
+    switch (info.type) {
+        case ColumnType::Integer:
+        case ColumnType::Boolean:
+        case ColumnType::Enumerate:
+            encode_integers(output, data.integers, chunk.encoding);
+            if (data.integers.empty()) {
+                break;
+            }
+            // U64 values are stored with the same bits as int64, but are
+            // ordered as unsigned
+            if (info.type == ColumnType::Integer && std::get<IntType>(info.tokens.front()) == IntType::U64) {
+                auto [min, max] = std::minmax_element(data.integers.begin(), data.integers.end(),
+                    [](std::int64_t lhs, std::int64_t rhs) {
+                        return std::uint64_t(lhs) < std::uint64_t(rhs);
+                    });
+                chunk.statistics.min = std::uint64_t(*min);
+                chunk.statistics.max = std::uint64_t(*max);
+            } else {
+                auto [min, max] = std::minmax_element(data.integers.begin(), data.integers.end());
+                chunk.statistics.min = *min;
+                chunk.statistics.max = *max;
+            }
+            break;
+        case ColumnType::Floating: {
+            bool is_f32 = std::get<FloatType>(info.tokens.front()) == FloatType::F32;
+            for (double value: data.floats) {
+                if (is_f32) {
+                    write_fixed(output, float(value));
+                } else {
+                    write_fixed(output, value);
+                }
+            }
+            chunk.encoding = ColumnEncoding::Plain;
+            // NaN values are excluded from the range
+            for (double value: data.floats) {
+                if (value != value) continue;
+                if (!chunk.statistics.min || value < std::get<double>(*chunk.statistics.min)) {
+                    chunk.statistics.min = value;
+                }
+                if (!chunk.statistics.max || value > std::get<double>(*chunk.statistics.max)) {
+                    chunk.statistics.max = value;
+                }
+            }
+            break;
+        }
+        case ColumnType::String:
+            encode_strings(output, data.strings, chunk.encoding);
+            if (!data.strings.empty()) {
+                auto [min, max] = std::minmax_element(data.strings.begin(), data.strings.end());
+                chunk.statistics.min = *min;
+                chunk.statistics.max = *max;
+            }
+            break;
+        case ColumnType::Opaque:
+            for (const auto& blob: data.blobs) {
+                write_varint(output, blob.size());
+                output.insert(output.end(), blob.begin(), blob.end());
+            }
+            chunk.encoding = ColumnEncoding::Plain;
+            break;
+    }
+}
+
+static ColumnData decode_column(
+    const std::span<const std::uint8_t>& bytes,
+    const ColumnInfo& info,
+    std::size_t row_count,
+    const ColumnChunk& chunk)
+{
+    ColumnData data;
+    ChunkReader reader(bytes);
+
+    std::size_t count = row_count;
+    if (info.nullable) {
+        for (std::uint32_t valid: reader.bitpacked(row_count, 1)) {
+            data.valid.push_back(valid);
+        }
+        count = std::count(data.valid.begin(), data.valid.end(), 1);
+    }
+
+    switch (info.type) {
+        case ColumnType::Integer:
+        case ColumnType::Boolean:
+        case ColumnType::Enumerate:
+            data.integers = decode_integers(reader, count, chunk.encoding);
+            break;
+        case ColumnType::Floating: {
+            if (chunk.encoding != ColumnEncoding::Plain) {
+                throw ColumnarError("Invalid encoding for a floating column");
+            }
+            bool is_f32 = std::get<FloatType>(info.tokens.front()) == FloatType::F32;
+            reader.check_count(count, is_f32 ? 32 : 64);
+            data.floats.resize(count);
+            for (auto& value: data.floats) {
+                value = is_f32 ? reader.fixed<float>() : reader.fixed<double>();
+            }
+            break;
+        }
+        case ColumnType::String:
+            data.strings = decode_strings(reader, count, chunk.encoding);
+            break;
+        case ColumnType::Opaque:
+            for (std::size_t i = 0; i < count; i++) {
+                auto blob = reader.bytes(reader.varint());
+                data.blobs.emplace_back(blob.begin(), blob.end());
+            }
+            break;
+    }
+    if (!reader.done()) {
+        throw ColumnarError("Unexpected data at the end of a column chunk");
+    }
+    return data;
+}
+
+// ===========================================================================
+// Writer
+
+ColumnarWriter::ColumnarWriter(const Schema& schema, std::size_t row_group_size):
+    columns(get_columns(schema)),
+    data(columns.size()),
+    shredder(columns, data),
+    row_group_size(row_group_size),
+    row_count(0),
+    output(std::begin(magic), std::end(magic))
+{
+    metadata.schema = schema;
+}
+
+void ColumnarWriter::flush() {
+    if (row_count == 0) {
+        return;
+    }
+    RowGroup row_group;
+    row_group.row_count = row_count;
+    for (std::size_t i = 0; i < columns.size(); i++) {
+        ColumnChunk chunk;
+        chunk.offset = output.size();
+        encode_column(output, columns[i], data[i], row_count, chunk);
+        chunk.size = output.size() - chunk.offset;
+        row_group.columns.push_back(chunk);
+        data[i].clear();
+    }
+    metadata.row_groups.push_back(row_group);
+    row_count = 0;
+}
+
+std::vector<std::uint8_t> ColumnarWriter::finish() {
+    flush();
+    std::vector<std::uint8_t> footer = write_binary(metadata);
+    output.insert(output.end(), footer.begin(), footer.end());
+    write_fixed<std::uint64_t>(output, footer.size());
+    output.insert(output.end(), std::begin(magic), std::end(magic));
+
+    std::vector<std::uint8_t> result = std::move(output);
+    output.assign(std::begin(magic), std::end(magic));
+    metadata.row_groups.clear();
+    return result;
+}
+
+// ===========================================================================
+// Reader
+
+ColumnarReader::ColumnarReader(const std::span<const std::uint8_t>& data, const BinaryLimits& limits):
+    data(data)
+{
+    static constexpr std::size_t trailer_size = sizeof(std::uint64_t) + sizeof(magic);
+    if (data.size() < sizeof(magic) + trailer_size
+        || std::memcmp(data.data(), magic, sizeof(magic)) != 0
+        || std::memcmp(data.data() + data.size() - sizeof(magic), magic, sizeof(magic)) != 0)
+    {
+        throw ColumnarError("Not a columnar file");
+    }
+
+    std::uint64_t footer_size;
+    std::memcpy(&footer_size, data.data() + data.size() - trailer_size, sizeof(footer_size));
+    if (footer_size > data.size() - sizeof(magic) - trailer_size) {
+        throw ColumnarError("Invalid metadata size");
+    }
+    std::size_t footer_begin = data.size() - trailer_size - footer_size;
+
+    BinaryReader reader(data.subspan(footer_begin, footer_size), BinaryOptions{.limits = limits});
+    reader.value(metadata_);
+    if (!reader.valid()) {
+        throw ColumnarError("Invalid metadata");
+    }
+    columns_ = get_columns(metadata_.schema);
+
+    for (const auto& row_group: metadata_.row_groups) {
+        if (row_group.columns.size() != columns_.size()) {
+            throw ColumnarError("Row group doesn't match the schema");
+        }
+        if (limits.max_length != 0 && row_group.row_count > limits.max_length) {
+            throw ColumnarError("Row group exceeds the maximum length");
+        }
+        for (const auto& chunk: row_group.columns) {
+            if (chunk.offset < sizeof(magic) || chunk.offset > footer_begin || chunk.size > footer_begin - chunk.offset) {
+                throw ColumnarError("Column chunk out of bounds");
+            }
+        }
+    }
+}
+
+std::size_t ColumnarReader::row_count() const {
+    std::size_t count = 0;
+    for (const auto& row_group: metadata_.row_groups) {
+        count += row_group.row_count;
+    }
+    return count;
+}
+
+// Returns -1, 0 or 1, or nullopt if the values can't be compared
+static std::optional<int> compare(const ColumnValue& lhs, const ColumnValue& rhs) {
+    auto as_double = [](const ColumnValue& value) -> std::optional<double> {
+        if (auto x = std::get_if<std::int64_t>(&value)) return double(*x);
+        if (auto x = std::get_if<std::uint64_t>(&value)) return double(*x);
+        if (auto x = std::get_if<double>(&value)) return *x;
+        return std::nullopt;
+    };
+    if (lhs.index() == rhs.index()) {
+        return (lhs < rhs) ? -1 : (rhs < lhs) ? 1 : 0;
+    }
+    // Signed and unsigned integers are compared exactly
+    auto lhs_signed = std::get_if<std::int64_t>(&lhs);
+    auto rhs_signed = std::get_if<std::int64_t>(&rhs);
+    auto lhs_unsigned = std::get_if<std::uint64_t>(&lhs);
+    auto rhs_unsigned = std::get_if<std::uint64_t>(&rhs);
+    if (lhs_signed && rhs_unsigned) {
+        return (*lhs_signed < 0 || std::uint64_t(*lhs_signed) < *rhs_unsigned) ? -1
+            : (std::uint64_t(*lhs_signed) > *rhs_unsigned) ? 1 : 0;
+    }
+    if (lhs_unsigned && rhs_signed) {
+        return (*rhs_signed < 0 || *lhs_unsigned > std::uint64_t(*rhs_signed)) ? 1
+            : (*lhs_unsigned < std::uint64_t(*rhs_signed)) ? -1 : 0;
+    }
+    auto lhs_double = as_double(lhs);
+    auto rhs_double = as_double(rhs);
+    if (!lhs_double || !rhs_double) {
+        return std::nullopt;
+    }
+    return (*lhs_double < *rhs_double) ? -1 : (*rhs_double < *lhs_double) ? 1 : 0;
+}
+
+std::vector<std::size_t> ColumnarReader::select_row_groups(const std::vector<ColumnRange>& ranges) const {
+    std::vector<std::size_t> range_columns;
+    for (const auto& range: ranges) {
+        auto iter = std::find_if(columns_.begin(), columns_.end(), [&](const ColumnInfo& column) {
+            return column.path == range.path;
+        });
+        if (iter == columns_.end()) {
+            throw ColumnarError("Unknown column '" + range.path + "'");
+        }
+        range_columns.push_back(iter - columns_.begin());
+    }
+
+    std::vector<std::size_t> result;
+    for (std::size_t i = 0; i < metadata_.row_groups.size(); i++) {
+        bool keep = true;
+        for (std::size_t j = 0; j < ranges.size() && keep; j++) {
+            const auto& statistics = metadata_.row_groups[i].columns[range_columns[j]].statistics;
+            if (columns_[range_columns[j]].type == ColumnType::Opaque) {
+                continue;
+            }
+            if (!statistics.min || !statistics.max) {
+                // Only null values, which are never in range
+                keep = false;
+                break;
+            }
+            if (ranges[j].min) {
+                auto order = compare(*statistics.max, *ranges[j].min);
+                keep = !order || *order >= 0;
+            }
+            if (keep && ranges[j].max) {
+                auto order = compare(*statistics.min, *ranges[j].max);
+                keep = !order || *order <= 0;
+            }
+        }
+        if (keep) {
+            result.push_back(i);
+        }
+    }
+    return result;
+}
+
+std::vector<bool> ColumnarReader::get_projected(const std::vector<std::string>& projection) const {
+    std::vector<bool> projected(columns_.size(), projection.empty());
+    for (const auto& path: projection) {
+        bool found = false;
+        for (std::size_t i = 0; i < columns_.size(); i++) {
+            // Projecting a path includes all the columns below it
+            const auto& column_path = columns_[i].path;
+            if (column_path == path || (column_path.size() > path.size()
+                && column_path.compare(0, path.size(), path) == 0
+                && column_path[path.size()] == '.'))
+            {
+                projected[i] = true;
+                found = true;
+            }
+        }
+        if (!found) {
+            throw ColumnarError("Unknown column '" + path + "'");
+        }
+    }
+    return projected;
+}
+
+std::vector<ColumnData> ColumnarReader::decode_row_group(std::size_t row_group, const std::vector<bool>& projected) const {
+    const auto& info = metadata_.row_groups.at(row_group);
+    std::vector<ColumnData> result(columns_.size());
+    for (std::size_t i = 0; i < columns_.size(); i++) {
+        if (!projected[i]) {
+            continue;
+        }
+        const auto& chunk = info.columns[i];
+        result[i] = decode_column(data.subspan(chunk.offset, chunk.size), columns_[i], info.row_count, chunk);
+    }
+    return result;
+}
+
+Object ColumnarReader::read_column(const std::string& path, const std::vector<std::size_t>& row_groups) const {
+    auto iter = std::find_if(columns_.begin(), columns_.end(), [&](const ColumnInfo& column) {
+        return column.path == path;
+    });
+    if (iter == columns_.end()) {
+        throw ColumnarError("Unknown column '" + path + "'");
+    }
+    std::size_t column = iter - columns_.begin();
+    const ColumnInfo& info = *iter;
+    Schema opaque_schema = { info.tokens };
+
+    Object result;
+    result = Object::list_t();
+    for (std::size_t row_group: row_groups) {
+        const auto& chunk = metadata_.row_groups.at(row_group).columns[column];
+        std::size_t row_count = metadata_.row_groups[row_group].row_count;
+        ColumnData data = decode_column(this->data.subspan(chunk.offset, chunk.size), info, row_count, chunk);
+
+        std::size_t index = 0;
+        for (std::size_t row = 0; row < row_count; row++) {
+            if (info.nullable && !data.valid[row]) {
+                result.push_back(Object::null_t());
+                continue;
+            }
+            switch (info.type) {
+                case ColumnType::Integer:
+                    result.push_back_packed(Object::integer_t(data.integers[index]));
+                    break;
+                case ColumnType::Floating:
+                    result.push_back_packed(data.floats[index]);
+                    break;
+                case ColumnType::Boolean:
+                    result.push_back(data.integers[index] != 0);
+                    break;
+                case ColumnType::String:
+                    result.push_back(data.strings[index]);
+                    break;
+                case ColumnType::Enumerate: {
+                    const auto& labels = std::get<token::Enumerate>(info.tokens.front()).labels;
+                    std::int64_t value = data.integers[index];
+                    if (value < 0 || value >= std::int64_t(labels.size())) {
+                        throw ColumnarError("Invalid enumerate value");
+                    }
+                    result.push_back(labels[value]);
+                    break;
+                }
+                case ColumnType::Opaque: {
+                    auto element = result.push_back(Object::null_t());
+                    BinaryReader reader(data.blobs[index], false);
+                    ObjectWriter writer(*element);
+                    use_schema(opaque_schema, reader, writer);
+                    break;
+                }
+            }
+            index++;
+        }
+    }
+    return result;
+}
+
+} // namespace datapack
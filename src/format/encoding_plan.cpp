@@ -0,0 +1,487 @@
+#include "datapack/format/encoding_plan.hpp"
+#include "datapack/format/binary_reader.hpp"
+#include "datapack/format/binary_writer.hpp"
+#include "datapack/encode/varint.hpp"
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <unordered_set>
+
+
+namespace datapack {
+
+DATAPACK_LABELLED_ENUM_DEF(FieldEncoding) = {
+    "fixed", "varint", "delta", "dictionary"
+};
+
+DATAPACK_IMPL(FieldPlan, value, packer) {
+    packer.object_begin();
+    packer.value("path", value.path);
+    packer.value("encoding", value.encoding);
+    packer.object_end();
+}
+
+DATAPACK_IMPL(FieldStatistics, value, packer) {
+    packer.object_begin();
+    packer.value("path", value.path);
+    packer.value("is_string", value.is_string);
+    packer.value("count", value.count);
+    packer.value("min", value.min);
+    packer.value("max", value.max);
+    packer.value("distinct", value.distinct);
+    packer.value("monotonic", value.monotonic);
+    packer.value("repeated", value.repeated);
+    packer.value("fixed_bytes", value.fixed_bytes);
+    packer.value("varint_bytes", value.varint_bytes);
+    packer.value("delta_bytes", value.delta_bytes);
+    packer.value("dictionary_bytes", value.dictionary_bytes);
+    packer.value("encoding", value.encoding);
+    packer.object_end();
+}
+
+DATAPACK_IMPL(EncodingReport, value, packer) {
+    packer.object_begin();
+    packer.value("plan", value.plan);
+    packer.value("fields", value.fields);
+    packer.value("default_bytes", value.default_bytes);
+    packer.value("planned_bytes", value.planned_bytes);
+    packer.value("default_encode_seconds", value.default_encode_seconds);
+    packer.value("planned_encode_seconds", value.planned_encode_seconds);
+    packer.value("default_decode_seconds", value.default_decode_seconds);
+    packer.value("planned_decode_seconds", value.planned_decode_seconds);
+    packer.object_end();
+}
+
+// ===========================================================================
+// EncodingPlan
+
+EncodingPlan::EncodingPlan():
+    nodes(1)
+{}
+
+EncodingPlan::EncodingPlan(const std::vector<FieldPlan>& fields):
+    fields_(fields),
+    nodes(1)
+{
+    for (const auto& field: fields) {
+        int node = 0;
+        std::size_t begin = 0;
+        while (begin < field.path.size()) {
+            std::size_t end = field.path.find('.', begin);
+            if (end == std::string::npos) {
+                end = field.path.size();
+            }
+            std::string key = field.path.substr(begin, end - begin);
+            int child = find_child(node, key.c_str());
+            if (child == -1) {
+                child = nodes.size();
+                nodes[node].children.emplace_back(key, child);
+                nodes.emplace_back();
+            }
+            node = child;
+            begin = end + 1;
+        }
+        nodes[node].encoding = field.encoding;
+    }
+}
+
+FieldEncoding EncodingPlan::encoding(const std::string& path) const {
+    for (const auto& field: fields_) {
+        if (field.path == path) {
+            return field.encoding;
+        }
+    }
+    return FieldEncoding::Fixed;
+}
+
+int EncodingPlan::find_child(int node, const char* key) const {
+    if (node < 0) {
+        return -1;
+    }
+    for (const auto& [child_key, child]: nodes[node].children) {
+        if (child_key == key) {
+            return child;
+        }
+    }
+    return -1;
+}
+
+void pack(const EncodingPlan& value, Writer& writer) {
+    writer.value(value.fields());
+}
+
+void pack(EncodingPlan& value, Reader& reader) {
+    std::vector<FieldPlan> fields;
+    reader.value(fields);
+    value = EncodingPlan(fields);
+}
+
+// ===========================================================================
+// PlanState
+
+PlanState::PlanState(const EncodingPlan& plan):
+    plan(plan),
+    node_states(plan.nodes.size())
+{
+    frames.push_back(Frame{-1, 0, 0, -1});
+}
+
+void PlanState::object_begin() {
+    frames.push_back(Frame{frames.back().child, -1, 0, -1});
+}
+
+void PlanState::object_next(const char* key) {
+    frames.back().child = plan.find_child(frames.back().node, key);
+}
+
+void PlanState::tuple_begin() {
+    frames.push_back(Frame{frames.back().child, -1, 0, -1});
+}
+
+void PlanState::tuple_next() {
+    auto& frame = frames.back();
+    if (frame.node >= 0) {
+        frame.child = plan.find_child(frame.node, std::to_string(frame.index).c_str());
+    }
+    frame.index++;
+}
+
+void PlanState::list_begin() {
+    int node = frames.back().child;
+    frames.push_back(Frame{node, -1, 0, plan.find_child(node, "*")});
+}
+
+void PlanState::list_next() {
+    frames.back().child = frames.back().element;
+}
+
+void PlanState::variant_begin(const char* label) {
+    int node = frames.back().child;
+    frames.push_back(Frame{node, plan.find_child(node, label), 0, -1});
+}
+
+void PlanState::container_end() {
+    frames.pop_back();
+}
+
+FieldEncoding PlanState::encoding() const {
+    int node = frames.back().child;
+    return node < 0 ? FieldEncoding::Fixed : plan.nodes[node].encoding;
+}
+
+FieldEncoding PlanState::integer_encoding() const {
+    FieldEncoding result = encoding();
+    if (result == FieldEncoding::Varint || result == FieldEncoding::Delta) {
+        return result;
+    }
+    return FieldEncoding::Fixed;
+}
+
+FieldEncoding PlanState::string_encoding() const {
+    FieldEncoding result = encoding();
+    return result == FieldEncoding::Dictionary ? result : FieldEncoding::Fixed;
+}
+
+PlanState::NodeState& PlanState::node_state() {
+    return node_states[frames.back().child];
+}
+
+std::int64_t& PlanState::previous() {
+    return node_state().previous;
+}
+
+std::unordered_map<std::string, std::uint64_t>& PlanState::write_dictionary() {
+    return node_state().write_dictionary;
+}
+
+std::vector<const char*>& PlanState::read_dictionary() {
+    return node_state().read_dictionary;
+}
+
+// ===========================================================================
+// Training
+
+// Collects statistics for each leaf while a message is passed through
+// use_schema
+class FieldCollector: public Writer {
+public:
+    struct Field {
+        FieldStatistics statistics;
+        bool is_signed = true;
+        std::unordered_set<std::string> distinct;
+        std::uint64_t monotonic = 0;
+        std::uint64_t repeated = 0;
+        // Reset for each message
+        std::uint64_t message = -1;
+        std::int64_t previous = 0;
+        std::unordered_set<std::string> message_values;
+    };
+    std::map<std::string, Field> fields;
+
+    FieldCollector():
+        Writer(false),
+        message(0),
+        trivial_depth(0)
+    {}
+
+    void next_message() {
+        message++;
+        path.clear();
+        frames.clear();
+        trivial_depth = 0;
+    }
+
+    void integer(IntType type, const void* value) override {
+        if (trivial_depth > 0) {
+            return;
+        }
+        std::int64_t integer_value = 0;
+        bool is_signed = true;
+        switch (type) {
+            case IntType::I32:
+                integer_value = *(const std::int32_t*)value;
+                break;
+            case IntType::I64:
+                integer_value = *(const std::int64_t*)value;
+                break;
+            case IntType::U32:
+                integer_value = *(const std::uint32_t*)value;
+                is_signed = false;
+                break;
+            case IntType::U64:
+                integer_value = *(const std::uint64_t*)value;
+                is_signed = false;
+                break;
+            case IntType::U8:
+                integer_value = *(const std::uint8_t*)value;
+                is_signed = false;
+                break;
+        }
+        add_integer(integer_value, int_type_size(type), is_signed);
+    }
+
+    void enumerate(int value, const char* label) override {
+        if (trivial_depth > 0) {
+            return;
+        }
+        add_integer(value, sizeof(int), true);
+    }
+
+    void string(const char* value) override {
+        if (trivial_depth > 0) {
+            return;
+        }
+        Field& field = get_field();
+        auto& statistics = field.statistics;
+        statistics.is_string = true;
+        statistics.count++;
+
+        std::size_t size = std::strlen(value) + 1;
+        statistics.fixed_bytes += size;
+        auto [iter, inserted] = field.message_values.insert(value);
+        if (inserted) {
+            statistics.dictionary_bytes += 1 + size;
+        } else {
+            field.repeated++;
+            statistics.dictionary_bytes += varint_size(field.message_values.size());
+        }
+        if (field.distinct.size() < max_distinct) {
+            field.distinct.insert(value);
+        }
+    }
+
+    void floating(FloatType type, const void* value) override {}
+    void boolean(bool value) override {}
+    void binary(const std::uint8_t* data, std::size_t length, std::size_t stride, bool fixed_length) override {}
+
+    void optional_begin(bool has_value) override {}
+    void optional_end() override {}
+
+    void variant_begin(int value, const char* label) override {
+        begin();
+        append(label);
+    }
+    void variant_end() override { end(); }
+
+    void object_begin(std::size_t size) override { begin(size != 0); }
+    void object_next(const char* key) override { append(key); }
+    void object_end(std::size_t size) override { end(); }
+
+    void tuple_begin(std::size_t size) override { begin(size != 0); }
+    void tuple_next() override { append(std::to_string(frames.back().index++).c_str()); }
+    void tuple_end(std::size_t size) override { end(); }
+
+    void list_begin(bool is_trivial) override { begin(is_trivial); }
+    void list_next() override { append("*"); }
+    void list_end() override { end(); }
+
+private:
+    static constexpr std::size_t max_distinct = 65536;
+
+    struct Frame {
+        std::size_t length;
+        int index;
+        bool trivial;
+    };
+
+    // Values inside trivial blocks are written as they are in memory, and
+    // never use the plan, so aren't collected
+    void begin(bool trivial = false) {
+        frames.push_back(Frame{path.size(), 0, trivial});
+        if (trivial) {
+            trivial_depth++;
+        }
+    }
+    void append(const char* key) {
+        path.resize(frames.back().length);
+        if (!path.empty()) {
+            path += '.';
+        }
+        path += key;
+    }
+    void end() {
+        path.resize(frames.back().length);
+        if (frames.back().trivial) {
+            trivial_depth--;
+        }
+        frames.pop_back();
+    }
+
+    Field& get_field() {
+        Field& field = fields[path];
+        if (field.message != message) {
+            field.message = message;
+            field.previous = 0;
+            field.message_values.clear();
+        }
+        return field;
+    }
+
+    void add_integer(std::int64_t value, std::size_t size, bool is_signed) {
+        Field& field = get_field();
+        auto& statistics = field.statistics;
+        if (statistics.count == 0 || value < statistics.min) {
+            statistics.min = value;
+        }
+        if (statistics.count == 0 || value > statistics.max) {
+            statistics.max = value;
+        }
+        statistics.count++;
+        field.is_signed = is_signed;
+
+        statistics.fixed_bytes += size;
+        statistics.varint_bytes += varint_size(is_signed ? zigzag(value) : std::uint64_t(value));
+        statistics.delta_bytes += varint_size(zigzag(std::uint64_t(value) - std::uint64_t(field.previous)));
+        if (value >= field.previous) {
+            field.monotonic++;
+        }
+        field.previous = value;
+
+        std::string key((const char*)&value, sizeof(value));
+        if (!field.message_values.insert(key).second) {
+            field.repeated++;
+        }
+        if (field.distinct.size() < max_distinct) {
+            field.distinct.insert(key);
+        }
+    }
+
+    std::uint64_t message;
+    std::string path;
+    std::vector<Frame> frames;
+    int trivial_depth;
+};
+
+using Clock = std::chrono::steady_clock;
+
+// Passes each message through the schema, from one set of binary options
+// to another
+static double convert_corpus(
+    const Schema& schema,
+    const std::vector<std::vector<std::uint8_t>>& corpus,
+    const BinaryOptions& from,
+    const BinaryOptions& to,
+    std::vector<std::vector<std::uint8_t>>& output)
+{
+    output.resize(corpus.size());
+    auto before = Clock::now();
+    for (std::size_t i = 0; i < corpus.size(); i++) {
+        output[i].clear();
+        BinaryReader reader(corpus[i], from);
+        BinaryWriter writer(output[i], to);
+        use_schema(schema, reader, writer);
+        if (!reader.valid()) {
+            throw std::runtime_error("Message " + std::to_string(i) + " doesn't match the schema");
+        }
+    }
+    return std::chrono::duration<double>(Clock::now() - before).count();
+}
+
+EncodingReport train_encoding_plan(
+    const Schema& schema,
+    const std::vector<std::vector<std::uint8_t>>& corpus,
+    double min_saving)
+{
+    FieldCollector collector;
+    for (const auto& message: corpus) {
+        collector.next_message();
+        BinaryReader reader(message);
+        use_schema(schema, reader, collector);
+        if (!reader.valid()) {
+            throw std::runtime_error("Corpus doesn't match the schema");
+        }
+    }
+
+    EncodingReport report;
+    std::vector<FieldPlan> plan;
+    for (auto& [path, field]: collector.fields) {
+        auto& statistics = field.statistics;
+        statistics.path = path;
+        statistics.distinct = field.distinct.size();
+        if (statistics.count > 0) {
+            statistics.monotonic = double(field.monotonic) / statistics.count;
+            statistics.repeated = double(field.repeated) / statistics.count;
+        }
+
+        std::uint64_t best_bytes = statistics.fixed_bytes;
+        FieldEncoding best = FieldEncoding::Fixed;
+        auto consider = [&](FieldEncoding encoding, std::uint64_t bytes) {
+            if (bytes < best_bytes) {
+                best = encoding;
+                best_bytes = bytes;
+            }
+        };
+        if (statistics.is_string) {
+            consider(FieldEncoding::Dictionary, statistics.dictionary_bytes);
+        } else {
+            consider(FieldEncoding::Varint, statistics.varint_bytes);
+            consider(FieldEncoding::Delta, statistics.delta_bytes);
+        }
+        if (best_bytes > statistics.fixed_bytes * (1 - min_saving)) {
+            best = FieldEncoding::Fixed;
+        }
+        statistics.encoding = best;
+        if (best != FieldEncoding::Fixed) {
+            plan.push_back(FieldPlan{path, best});
+        }
+        report.fields.push_back(statistics);
+    }
+    report.plan = EncodingPlan(plan);
+
+    BinaryOptions default_options;
+    BinaryOptions planned_options;
+    planned_options.plan = &report.plan;
+
+    std::vector<std::vector<std::uint8_t>> default_corpus, planned_corpus, decoded;
+    report.default_encode_seconds = convert_corpus(schema, corpus, default_options, default_options, default_corpus);
+    report.planned_encode_seconds = convert_corpus(schema, corpus, default_options, planned_options, planned_corpus);
+    report.default_decode_seconds = convert_corpus(schema, default_corpus, default_options, default_options, decoded);
+    report.planned_decode_seconds = convert_corpus(schema, planned_corpus, planned_options, default_options, decoded);
+    for (std::size_t i = 0; i < corpus.size(); i++) {
+        report.default_bytes += default_corpus[i].size();
+        report.planned_bytes += planned_corpus[i].size();
+    }
+    return report;
+}
+
+} // namespace datapack
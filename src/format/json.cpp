@@ -1,12 +1,58 @@
 #include "datapack/format/json.hpp"
 #include <assert.h>
+#include <atomic>
+#include <thread>
 #include "datapack/encode/base64.hpp"
 #include "datapack/encode/float_string.hpp"
+#include "datapack/util/metrics.hpp"
+#include "datapack/util/simd.hpp"
 
 
 namespace datapack {
 
-Object load_json(const std::string& json) {
+// Parses a number, bool or null, ending at whitespace or a delimiter
+static Object::value_t parse_literal(const std::string& json, std::size_t& pos) {
+    std::size_t begin = pos;
+    while (true) {
+        if (pos == json.size()) {
+            break;
+        }
+        const char c = json[pos];
+        if (std::isspace(c) || c == ',' || c == '}' || c == ']') {
+            break;
+        }
+        pos++;
+    }
+    std::size_t end = pos;
+
+    std::string value = json.substr(begin, end-begin);
+    if (value == "true") {
+        return true;
+    }
+    if (value == "false") {
+        return false;
+    }
+    if (value == "null") {
+        return Object::null_t();
+    }
+
+    char* float_end = nullptr;
+    Object::floating_t result_float = std::strtod(value.c_str(), &float_end);
+    if (value.empty() || float_end != value.c_str() + value.size()) {
+        throw JsonLoadError("Invalid value '" + value + "'");
+    }
+    Object::integer_t result_int = std::strtoll(value.c_str(), nullptr, 10);
+    // Note: If a double/float has an integer value, comparisons are
+    // still valid since it is guaranteed to represent the integer
+    // exactly
+    if (result_int == result_float) {
+        return result_int;
+    }
+    return result_float;
+}
+
+Object load_json(const std::string& json, const JsonOptions& options) {
+    MetricTimer timer(MetricOp::LoadJson);
     static constexpr int EXPECT_ELEMENT = 1 << 0;
     static constexpr int EXPECT_VALUE = 1 << 1;
     static constexpr int EXPECT_END = 1 << 2;
@@ -14,11 +60,16 @@ Object load_json(const std::string& json) {
     static constexpr int IS_OBJECT = 1 << 4;
     static constexpr int IS_ARRAY = 1 << 5;
 
+    const SimdKernels& kernels = simd_kernels();
     std::size_t pos = 0;
     std::stack<int> states;
     states.push(EXPECT_VALUE);
     Object object;
     Object::Iterator iter = object.iter();
+    std::optional<Object::Deduper> deduper;
+    if (options.dedupe) {
+        deduper.emplace();
+    }
 
     while (true) {
         int& state = states.top();
@@ -35,6 +86,7 @@ Object load_json(const std::string& json) {
         const char c = json[pos];
         if (std::isspace(c)) {
             pos++;
+            pos += kernels.skip_whitespace(json.data() + pos, json.size() - pos);
             continue;
         }
         assert(iter);
@@ -42,18 +94,15 @@ Object load_json(const std::string& json) {
         if (c == '"' && (state & IS_OBJECT) && (state & EXPECT_ELEMENT)) {
             pos++;
             std::size_t begin = pos;
-            while (true) {
-                if (pos == json.size()) {
-                    throw JsonLoadError("Key missing terminating '\"'");
-                }
-                const char c = json[pos];
-                if (c == '"') {
-                    break;
-                }
-                pos++;
+            pos += kernels.find_quote(json.data() + pos, json.size() - pos);
+            if (pos == json.size()) {
+                throw JsonLoadError("Key missing terminating '\"'");
             }
             std::size_t end = pos;
             pos++;
+            if (options.validate_utf8 && !kernels.validate_utf8(json.data() + begin, end - begin)) {
+                throw JsonLoadError("Key isn't valid UTF-8");
+            }
 
             while (true) {
                 if (pos == json.size()) {
@@ -76,8 +125,14 @@ Object load_json(const std::string& json) {
             continue;
         }
 
-        if ((state & IS_ARRAY) && (state & EXPECT_ELEMENT)) {
+        if ((state & IS_ARRAY) && (state & EXPECT_ELEMENT) && c != ']') {
             state &= ~EXPECT_ELEMENT;
+            if (c != '"' && c != '{' && c != '[') {
+                // Append literals directly, so lists of numbers are packed
+                iter->push_back_packed(parse_literal(json, pos));
+                state |= EXPECT_END | EXPECT_NEXT;
+                continue;
+            }
             state |= EXPECT_VALUE;
             iter = iter->push_back(Object::null_t());
             continue;
@@ -111,6 +166,9 @@ Object load_json(const std::string& json) {
             int& new_state = states.top();
             new_state &= ~EXPECT_VALUE;
             new_state |= EXPECT_NEXT | EXPECT_END;
+            if (deduper) {
+                deduper->add(*iter);
+            }
             iter = iter.parent();
             continue;
         }
@@ -124,6 +182,9 @@ Object load_json(const std::string& json) {
             int& new_state = states.top();
             new_state &= ~EXPECT_VALUE;
             new_state |= EXPECT_NEXT | EXPECT_END;
+            if (deduper) {
+                deduper->add(*iter);
+            }
             iter = iter.parent();
             continue;
         }
@@ -148,141 +209,97 @@ Object load_json(const std::string& json) {
         if (c == '"') {
             pos++;
             std::size_t begin = pos;
-            while (true) {
-                if (pos == json.size()) {
-                    throw JsonLoadError("String missing terminating '\"'");
-                }
-                if (json[pos] == '"') {
-                    break;
-                }
-                pos++;
+            pos += kernels.find_quote(json.data() + pos, json.size() - pos);
+            if (pos == json.size()) {
+                throw JsonLoadError("String missing terminating '\"'");
             }
             std::size_t end = pos;
             pos++;
+            if (options.validate_utf8 && !kernels.validate_utf8(json.data() + begin, end - begin)) {
+                throw JsonLoadError("String isn't valid UTF-8");
+            }
             *iter = json.substr(begin, end-begin);
             iter = iter.parent();
             continue;
         }
 
-        std::size_t begin = pos;
-        while (true) {
-            if (pos == json.size()) {
-                break;
-            }
-            const char c = json[pos];
-            if (std::isspace(c) || c == ',' || c == '}' || c == ']') {
-                break;
-            }
-            pos++;
-        }
-        std::size_t end = pos;
+        *iter = parse_literal(json, pos);
+        iter = iter.parent();
+    }
 
-        std::string value = json.substr(begin, end-begin);
-        if (value == "true") {
-            *iter = true;
-            iter = iter.parent();
-            continue;
-        }
-        if (value == "false") {
-            *iter = false;
-            iter = iter.parent();
-            continue;
-        }
-        if (value == "null") {
-            *iter = Object::null_t();
-            iter = iter.parent();
-            continue;
-        }
-        try {
-            Object::integer_t result_int = std::strtoll(value.c_str(), nullptr, 10);
-            Object::floating_t result_float = std::strtod(value.c_str(), nullptr);
-            // Note: If a double/float has an integer value, comparisons are
-            // still valid since it is guaranteed to represent the integer
-            // exactly
-            if (result_int == result_float) {
-                *iter = result_int;
-            } else {
-                *iter = result_float;
-            }
-            iter = iter.parent();
-            continue;
-        } catch (std::invalid_argument) {
-        } catch (std::out_of_range) {}
+    timer.done(json.size());
+    return object;
+}
 
-        throw JsonLoadError("Invalid value '" + std::string(value) + "'");
+static void indent(std::string& json, int depth) {
+    for (int i = 0; i < depth; i++) {
+        json += "    ";
     }
+}
 
-    return object;
+// Packed arrays are written the same as a regular list
+template <typename Array, typename ToString>
+static void dump_packed(std::string& json, const Array& array, int depth, const ToString& to_string) {
+    json += "[\n";
+    for (std::size_t i = 0; i < array.size(); i++) {
+        if (i > 0) {
+            json += ",\n";
+        }
+        indent(json, depth + 1);
+        json += to_string(array[i]);
+    }
+    if (!array.empty()) {
+        json += "\n";
+        indent(json, depth);
+    }
+    json += "]";
 }
 
-std::string dump_json(const Object::ConstReference& object) {
-    std::string json = "";
+// Writes the separator from the previous sibling, indentation and key
+static void dump_prefix(std::string& json, Object::ConstIterator iter, int depth) {
+    if (depth > 0 && iter.prev()) {
+        json += ",\n";
+    }
+    indent(json, depth);
+    if (depth > 0 && !iter->key().empty()) {
+        json += "\"" + iter->key() + "\": ";
+    }
+}
 
-    std::stack<Object::ConstIterator> stack;
-    stack.push(object.iter());
-    bool start = true;
-    bool end = false;
+static void dump_close(std::string& json, Object::ConstIterator iter, int depth) {
+    if (iter->size() != 0) {
+        json += "\n";
+        indent(json, depth);
+    }
+    json += (iter->is_map() ? "}" : "]");
+}
 
-    while (!stack.empty()) {
-        auto iter = stack.top();
-        if (!iter) {
-            stack.pop();
-            end = true;
-            continue;
-        }
+// Writes a node and its subtree, where depth is the depth of the node in
+// the document being written
+static void dump_node(std::string& json, Object::ConstIterator node, int depth) {
+    for (auto cursor = Object::ConstCursor(*node); cursor; cursor.next()) {
+        auto iter = cursor.iter();
+        int iter_depth = depth + cursor.depth();
 
-        if (end) {
-            end = false;
-            if (!start) {
-                json += "\n";
-                for (int i = 0; i < (stack.size()-1); i++) {
-                    json += "    ";
-                }
-            }
-            start = false;
-            if (iter->is_map()) {
-                json += "}";
-                stack.pop();
-                stack.push(iter.next());
-                continue;
-            }
-            if (iter->is_list()) {
-                json += "]";
-                stack.pop();
-                stack.push(iter.next());
-                continue;
-            }
-            stack.pop();
-            assert(stack.empty());
+        if (!cursor.entering()) {
+            dump_close(json, iter, iter_depth);
             continue;
         }
+        dump_prefix(json, iter, iter_depth);
 
-        if (!start) {
-            json += ",\n";
+        if (auto array = iter->integer_array_if()) {
+            dump_packed(json, *array, iter_depth, [](auto value) { return std::to_string(value); });
         }
-        start = false;
-
-        for (int i = 0; i < (stack.size()-1); i++) {
-            json += "    ";
+        else if (auto array = iter->floating_array_if()) {
+            dump_packed(json, *array, iter_depth, [](auto value) { return float_to_string(value); });
         }
-        if (!iter->key().empty()) {
-            json += "\"" + iter->key() + "\": ";
-        }
-
-        if (iter->is_map()) {
+        else if (iter->is_map()) {
             json += "{\n";
-            stack.push(iter.child());
-            start = true;
-            continue;
         }
-        if (iter->is_list()) {
+        else if (iter->is_list()) {
             json += "[\n";
-            stack.push(iter.child());
-            start = true;
-            continue;
         }
-
-        if (auto value = iter->integer_if()) {
+        else if (auto value = iter->integer_if()) {
             json += std::to_string(*value);
         }
         else if (auto value = iter->floating_if()) {
@@ -300,11 +317,150 @@ std::string dump_json(const Object::ConstReference& object) {
         else if (auto value = iter->binary_if()) {
             json += "\"" + base64_encode(*value) + "\"";
         }
+    }
+}
 
-        stack.pop();
-        stack.push(iter.next());
+// A parallel dump splits the document into a sequence of pieces, each
+// either literal text or a task that writes a run of sibling nodes.
+// Pieces are concatenated in order, so the output matches a serial dump.
+struct DumpPiece {
+    std::string text;
+    Object::ConstIterator first;
+    std::size_t count = 0;
+    int depth = 0;
+};
+
+// Number of nodes in each subtree, by the position of its root in a
+// depth-first walk, found in one pass over the tree
+static std::vector<std::size_t> subtree_sizes(Object::ConstIterator root) {
+    std::vector<std::size_t> sizes;
+    // Positions of the maps and lists being visited
+    std::vector<std::size_t> open;
+    for (auto cursor = Object::ConstCursor(*root); cursor; cursor.next()) {
+        if (!cursor.entering()) {
+            sizes[open.back()] = sizes.size() - open.back();
+            open.pop_back();
+            continue;
+        }
+        auto node = cursor.iter();
+        if (node->is_map() || (node->is_list() && !node->is_packed())) {
+            open.push_back(sizes.size());
+        }
+        sizes.push_back(1);
     }
+    return sizes;
+}
 
+// Splits the children of a map or list into tasks of roughly chunk_nodes
+// nodes, descending into children that are larger than this. The node is
+// at the given position in sizes.
+static void plan_dump(
+    std::vector<DumpPiece>& pieces,
+    Object::ConstIterator node,
+    std::size_t position,
+    const std::vector<std::size_t>& sizes,
+    int depth,
+    std::size_t chunk_nodes)
+{
+    pieces.emplace_back();
+    dump_prefix(pieces.back().text, node, depth);
+    pieces.back().text += (node->is_map() ? "{\n" : "[\n");
+
+    DumpPiece task;
+    std::size_t task_nodes = 0;
+    auto flush = [&]() {
+        if (task.count != 0) {
+            pieces.push_back(std::move(task));
+        }
+        task = DumpPiece();
+        task_nodes = 0;
+    };
+
+    std::size_t child_position = position + 1;
+    for (auto child = node.child(); child; child = child.next()) {
+        std::size_t child_nodes = sizes[child_position];
+        if (child_nodes > chunk_nodes && (child->is_map() || child->is_list()) && !child->is_packed()) {
+            flush();
+            plan_dump(pieces, child, child_position, sizes, depth + 1, chunk_nodes);
+            child_position += child_nodes;
+            continue;
+        }
+        child_position += child_nodes;
+        if (task.count == 0) {
+            task.first = child;
+            task.depth = depth + 1;
+        }
+        task.count++;
+        task_nodes += child_nodes;
+        if (task_nodes >= chunk_nodes) {
+            flush();
+        }
+    }
+    flush();
+
+    pieces.emplace_back();
+    dump_close(pieces.back().text, node, depth);
+}
+
+std::string dump_json(const Object::ConstReference& object, std::size_t threads) {
+    MetricTimer timer(MetricOp::DumpJson);
+    // Below this, the overhead of planning and starting threads isn't worth it
+    static constexpr std::size_t min_parallel_nodes = 1 << 16;
+    // Each thread gets several tasks, to balance uneven subtrees
+    static constexpr std::size_t tasks_per_thread = 4;
+
+    if (threads == 0) {
+        threads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    auto root = object.iter();
+    std::vector<std::size_t> sizes;
+    if (threads > 1 && (root->is_map() || root->is_list()) && !root->is_packed()) {
+        sizes = subtree_sizes(root);
+    }
+    std::size_t nodes = sizes.empty() ? 0 : sizes[0];
+    if (nodes < min_parallel_nodes) {
+        std::string json;
+        dump_node(json, root, 0);
+        timer.done(json.size());
+        return json;
+    }
+
+    std::vector<DumpPiece> pieces;
+    plan_dump(pieces, root, 0, sizes, 0, std::max<std::size_t>(nodes / (threads * tasks_per_thread), 1));
+
+    std::atomic<std::size_t> next_piece = 0;
+    auto worker = [&]() {
+        while (true) {
+            std::size_t i = next_piece++;
+            if (i >= pieces.size()) {
+                break;
+            }
+            auto iter = pieces[i].first;
+            for (std::size_t j = 0; j < pieces[i].count; j++) {
+                dump_node(pieces[i].text, iter, pieces[i].depth);
+                iter = iter.next();
+            }
+        }
+    };
+    std::vector<std::thread> workers;
+    for (std::size_t i = 1; i < threads; i++) {
+        workers.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : workers) {
+        thread.join();
+    }
+
+    std::size_t size = 0;
+    for (const auto& piece : pieces) {
+        size += piece.text.size();
+    }
+    std::string json;
+    json.reserve(size);
+    for (const auto& piece : pieces) {
+        json += piece.text;
+    }
+    timer.done(json.size());
     return json;
 }
 
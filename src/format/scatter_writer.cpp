@@ -0,0 +1,93 @@
+#include "datapack/format/scatter_writer.hpp"
+#include "datapack/util/async_file.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <string>
+
+
+namespace datapack {
+
+bool ScatterWriter::reference_binary(const std::uint8_t* input_data, std::size_t size) {
+    if (size < threshold) {
+        return false;
+    }
+    references.push_back(Reference{result().size(), input_data, size});
+    referenced_size += size;
+    return true;
+}
+
+std::vector<iovec> ScatterWriter::segments() const {
+    auto buffer = result();
+    std::vector<iovec> segments;
+    std::size_t begin = 0;
+    for (const auto& reference: references) {
+        if (reference.pos > begin) {
+            segments.push_back(iovec{buffer.data() + begin, reference.pos - begin});
+        }
+        segments.push_back(iovec{(void*)reference.data, reference.size});
+        begin = reference.pos;
+    }
+    if (buffer.size() > begin) {
+        segments.push_back(iovec{buffer.data() + begin, buffer.size() - begin});
+    }
+    return segments;
+}
+
+std::size_t ScatterWriter::size() const {
+    return result().size() + referenced_size;
+}
+
+std::vector<std::uint8_t> ScatterWriter::flatten() const {
+    std::vector<std::uint8_t> output(size());
+    std::size_t pos = 0;
+    for (const auto& segment: segments()) {
+        std::memcpy(&output[pos], segment.iov_base, segment.iov_len);
+        pos += segment.iov_len;
+    }
+    return output;
+}
+
+// A negative offset uses writev, at the current file position
+static void write_segments(int fd, std::vector<iovec> segments, std::int64_t offset) {
+    std::size_t first = 0;
+    while (first < segments.size()) {
+        int count = std::min<std::size_t>(segments.size() - first, IOV_MAX);
+        ssize_t written = offset < 0
+            ? ::writev(fd, &segments[first], count)
+            : ::pwritev(fd, &segments[first], count, offset);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw IoError("Failed to write segments: " + std::string(std::strerror(errno)));
+        }
+        if (written == 0) {
+            throw IoError("Failed to write segments");
+        }
+        if (offset >= 0) {
+            offset += written;
+        }
+        // Skip whole segments, then advance into a partially written one
+        std::size_t remaining = written;
+        while (first < segments.size() && remaining >= segments[first].iov_len) {
+            remaining -= segments[first].iov_len;
+            first++;
+        }
+        if (remaining > 0) {
+            segments[first].iov_base = (std::uint8_t*)segments[first].iov_base + remaining;
+            segments[first].iov_len -= remaining;
+        }
+    }
+}
+
+void ScatterWriter::write_to(int fd) const {
+    write_segments(fd, segments(), -1);
+}
+
+void ScatterWriter::write_to(int fd, std::uint64_t offset) const {
+    write_segments(fd, segments(), offset);
+}
+
+} // namespace datapack
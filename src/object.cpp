@@ -1,5 +1,10 @@
 #include "datapack/object.hpp"
-#include <stack>
+#include "datapack/util/journal.hpp"
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cstring>
+#include <unordered_set>
 #include <assert.h>
 
 namespace datapack {
@@ -22,7 +27,22 @@ Object::Reference Object::Reference::operator[](const std::string& key) const {
 
 template <bool IsConst>
 Object::Reference_<IsConst> Object::Reference_<IsConst>::operator[](std::size_t list_index) const {
-    return Reference_(object, object->index_list_access(index, list_index));
+    if (element != -1) {
+        throw ValueException("Tried to access value by index on a non-list node");
+    }
+    auto [target, target_index] = contents();
+    if constexpr (IsConst) {
+        // Elements of packed arrays are read in place
+        if (is_packed()) {
+            if (list_index >= target->index_size(target_index)) {
+                return Reference_(target, -1);
+            }
+            return Reference_(relative(target, target_index), list_index);
+        }
+    } else {
+        target->index_expand(target_index);
+    }
+    return relative(target, target->index_list_access(target_index, list_index));
 }
 template Object::Reference Object::Reference::operator[](std::size_t list_index) const;
 template Object::ConstReference Object::ConstReference::operator[](std::size_t list_index) const;
@@ -30,7 +50,8 @@ template Object::ConstReference Object::ConstReference::operator[](std::size_t l
 
 template <bool IsConst>
 Object::Iterator_<IsConst> Object::Reference_<IsConst>::find(const std::string& key) const {
-    return Iterator_<IsConst>(object, object->index_map_access(index, key));
+    auto [target, target_index] = contents();
+    return Iterator_<IsConst>(relative(target, target->index_map_access(target_index, key)));
 }
 template Object::Iterator Object::Reference::find(const std::string& key) const;
 template Object::ConstIterator Object::ConstReference::find(const std::string& key) const;
@@ -38,11 +59,12 @@ template Object::ConstIterator Object::ConstReference::find(const std::string& k
 
 template <bool IsConst>
 Object::Reference_<IsConst> Object::Reference_<IsConst>::at(const std::string& key) const {
-    int element_index = object->index_map_access(index, key);
+    auto [target, target_index] = contents();
+    int element_index = target->index_map_access(target_index, key);
     if (element_index == -1) {
         throw LookupException("Could not find key '" + key + "'");
     }
-    return Reference_(object, element_index);
+    return relative(target, element_index);
 }
 template Object::Reference Object::Reference::at(const std::string& key) const;
 template Object::ConstReference Object::ConstReference::at(const std::string& key) const;
@@ -58,6 +80,11 @@ Object::Iterator Object::Reference::push_back(const value_t& value) const {
     return Iterator(object, object->index_push_back(index, value));
 }
 
+template <>
+void Object::Reference::push_back_packed(const value_t& value) const {
+    object->index_push_back_packed(index, value);
+}
+
 template <>
 Object::Iterator Object::Reference::erase() const {
     return Iterator(object, object->index_erase(index));
@@ -68,13 +95,40 @@ void Object::Reference::clear() const {
     object->index_clear(index);
 }
 
+template <>
+Object::Iterator Object::Reference::splice(const std::string& key, Object&& source) const {
+    return Iterator(object, object->index_splice(index, &key, std::move(source)));
+}
+
+template <>
+Object::Iterator Object::Reference::splice(Object&& source) const {
+    return Iterator(object, object->index_splice(index, nullptr, std::move(source)));
+}
+
+template <>
+Object::Iterator Object::Reference::move_to(const Reference& parent, const std::string& key) const {
+    if (parent.object != object) {
+        throw ValueException("Tried to move a node to another object, use splice instead");
+    }
+    return Iterator(object, object->index_move(index, parent.index, &key));
+}
+
+template <>
+Object::Iterator Object::Reference::move_to(const Reference& parent) const {
+    if (parent.object != object) {
+        throw ValueException("Tried to move a node to another object, use splice instead");
+    }
+    return Iterator(object, object->index_move(index, parent.index, nullptr));
+}
+
 
 template <bool IsConst>
 std::size_t Object::Reference_<IsConst>::size() const {
-    if (!is_map() && !is_list()) {
+    if (element != -1) {
         throw ValueException("Tried to query size on a node that is not a map or list");
     }
-    return object->nodes[index].child_count;
+    auto [target, target_index] = Reference_<true>(*this).contents();
+    return target->index_size(target_index);
 }
 template std::size_t Object::Reference::size() const;
 template std::size_t Object::ConstReference::size() const;
@@ -82,7 +136,13 @@ template std::size_t Object::ConstReference::size() const;
 
 template <bool IsConst>
 Object Object::Reference_<IsConst>::clone() const {
-    return object->index_clone(index);
+    if (element != -1) {
+        Object result;
+        result = element_value();
+        return result;
+    }
+    auto [target, target_index] = Reference_<true>(*this).contents();
+    return target->index_clone(target_index);
 }
 template Object Object::Reference::clone() const;
 template Object Object::ConstReference::clone() const;
@@ -90,7 +150,7 @@ template Object Object::ConstReference::clone() const;
 
 template <bool IsConst>
 Object::Iterator_<IsConst> Object::Reference_<IsConst>::iter() const {
-    return Iterator_<IsConst>(object, index);
+    return Iterator_<IsConst>(*this);
 }
 template Object::Iterator Object::Reference::iter() const;
 template Object::ConstIterator Object::ConstReference::iter() const;
@@ -102,7 +162,10 @@ template Object::ConstIterator Object::ConstReference::iter() const;
 Object::Object():
     root_index(0)
 {
-    nodes.push_back(Node(null_t(), "", -1, -1));
+    keys.push_back("");
+    key_counts.push_back(0);
+    key_indices.emplace("", 0);
+    nodes.push_back(Node(null_t(), 0, -1, -1));
 }
 
 Object::operator Reference() {
@@ -123,11 +186,11 @@ Object::Reference Object::operator[](const std::string& key) {
 }
 
 Object::ConstReference Object::operator[](std::size_t list_index) const {
-    return ConstReference(this, index_list_access(root_index, list_index));
+    return ConstReference(*this)[list_index];
 }
 
 Object::Reference Object::operator[](std::size_t list_index) {
-    return Reference(this, index_list_access(root_index, list_index));
+    return Reference(*this)[list_index];
 }
 
 Object::ConstIterator Object::find(const std::string key) const {
@@ -162,29 +225,111 @@ Object::Iterator Object::push_back(const value_t& value) {
     return Iterator(this, index_push_back(root_index, value));
 }
 
+void Object::push_back_packed(const value_t& value) {
+    index_push_back_packed(root_index, value);
+}
+
 Object::Iterator Object::erase() {
     return Iterator(this, index_erase(root_index));
 }
 
+Object::Iterator Object::splice(const std::string& key, Object&& source) {
+    return Reference(*this).splice(key, std::move(source));
+}
+
+Object::Iterator Object::splice(Object&& source) {
+    return Reference(*this).splice(std::move(source));
+}
+
 void Object::clear() {
     index_clear(root_index);
 }
 
 std::size_t Object::size() const {
-    if (!is_map() && !is_list()) {
-        throw ValueException("Tried to query size on a node that is not a map or list");
-    }
-    return nodes[root_index].child_count;
+    return index_size(root_index);
 }
 
 Object Object::clone() const {
     return index_clone(root_index);
 }
 
+static std::size_t string_heap_bytes(const std::string& value) {
+    static const std::size_t small_capacity = std::string().capacity();
+    if (value.capacity() <= small_capacity) {
+        return 0;
+    }
+    return value.capacity() + 1;
+}
+
+// Shared children already counted, which may be shared by nodes in
+// different objects, or by other shared children
+struct Object::SharedStats {
+    std::unordered_set<const Object*> counted;
+};
+
+Object::MemoryStats Object::memory_stats() const {
+    MemoryStats stats = {};
+    SharedStats shared;
+    add_memory_stats(stats, shared);
+    return stats;
+}
+
+void Object::add_memory_stats(MemoryStats& stats, SharedStats& shared) const {
+    // Approximate, assuming a node per map entry and a pointer per bucket
+    stats.shared_bytes = shared_nodes.bucket_count() * sizeof(void*)
+        + shared_nodes.size() * (sizeof(decltype(shared_nodes)::value_type) + sizeof(void*));
+    stats.node_slots = nodes.size();
+    for (const auto& key: keys) {
+        stats.key_bytes += string_heap_bytes(key);
+    }
+    // Keys are stored in the vector and the map, approximating the map as
+    // above
+    stats.key_table_bytes = keys.capacity() * (sizeof(std::string) + sizeof(int)) + stats.key_bytes
+        + key_indices.bucket_count() * sizeof(void*)
+        + key_indices.size() * (sizeof(decltype(key_indices)::value_type) + sizeof(void*));
+    stats.node_capacity = nodes.capacity();
+    stats.free_slots = free.size();
+    stats.node_bytes = nodes.capacity() * sizeof(Node);
+    stats.free_list_bytes = free.size() * sizeof(int);
+
+    for (auto cursor = ConstCursor(*this); cursor; cursor.next()) {
+        if (!cursor.entering()) {
+            continue;
+        }
+        int index = cursor.iter().index();
+        const Node& node = nodes[index];
+        stats.node_count++;
+        if (node.child_count < 0) {
+            cursor.skip();
+            const Object* object = shared_nodes.at(index).get();
+            if (shared.counted.insert(object).second) {
+                MemoryStats object_stats = {};
+                object->add_memory_stats(object_stats, shared);
+                stats.shared_count += 1 + object_stats.shared_count;
+                stats.shared_bytes += sizeof(Object) + object_stats.total_bytes();
+            }
+            continue;
+        }
+        if (auto value = std::get_if<std::string>(&node.value)) {
+            stats.string_bytes += string_heap_bytes(*value);
+        }
+        else if (auto value = std::get_if<binary_t>(&node.value)) {
+            stats.binary_bytes += value->capacity();
+        }
+        else if (auto value = std::get_if<integer_array_t>(&node.value)) {
+            stats.array_bytes += value->capacity() * sizeof(integer_t);
+        }
+        else if (auto value = std::get_if<floating_array_t>(&node.value)) {
+            stats.array_bytes += value->capacity() * sizeof(floating_t);
+        }
+    }
+}
+
 int Object::add_node(const Node& node) {
     if (!free.empty()) {
         int result = free.top();
         free.pop();
+        nodes[result] = node;
         return result;
     }
     int result = nodes.size();
@@ -193,29 +338,137 @@ int Object::add_node(const Node& node) {
 }
 
 int Object::add_child(int parent, const std::string& key) {
+    int node = add_node(Node(null_t(), add_key(key), parent, -1));
+    link_child(parent, node);
+    return node;
+}
+
+int Object::add_key(const std::string& key) {
+    auto [iter, inserted] = key_indices.emplace(key, free_keys.empty() ? keys.size() : free_keys.top());
+    if (inserted) {
+        if (iter->second == static_cast<int>(keys.size())) {
+            keys.push_back(key);
+            key_counts.push_back(0);
+        } else {
+            free_keys.pop();
+            keys[iter->second] = key;
+        }
+    }
+    key_counts[iter->second]++;
+    return iter->second;
+}
+
+void Object::release_key(int key) {
+    if (key == 0 || --key_counts[key] > 0) {
+        return;
+    }
+    key_indices.erase(keys[key]);
+    std::string().swap(keys[key]);
+    free_keys.push(key);
+}
+
+int Object::find_key(const std::string& key) const {
+    auto iter = key_indices.find(key);
+    return iter == key_indices.end() ? -1 : iter->second;
+}
+
+int Object::get_last_child(int node) const {
+    return nodes[node].last_child;
+}
+
+void Object::link_child(int parent, int node) {
     int last_child = get_last_child(parent);
-    int node = add_node(Node(null_t(), key, parent, last_child));
+    nodes[node].parent = parent;
+    nodes[node].prev = last_child;
+    nodes[node].next = -1;
     if (last_child == -1) {
         nodes[parent].child = node;
     } else {
         nodes[last_child].next = node;
     }
-    return node;
+    nodes[parent].last_child = node;
+    nodes[parent].child_count++;
+    if (journal_link.journal) {
+        journal_link.journal->link_node(parent, node);
+    }
 }
 
-int Object::get_last_child(int node) const {
-    int iter = nodes[node].child;
-    int last_child = iter;
-    while (iter != -1) {
-        last_child = iter;
-        iter = nodes[iter].next;
+void Object::unlink(int node) {
+    if (journal_link.journal) {
+        journal_link.journal->unlink_node(node);
+    }
+    if (int prev = nodes[node].prev; prev != -1) {
+        nodes[prev].next = nodes[node].next;
+    }
+    if (int next = nodes[node].next; next != -1) {
+        nodes[next].prev = nodes[node].prev;
+    }
+    if (int parent = nodes[node].parent; parent != -1) {
+        if (nodes[parent].child == node) {
+            nodes[parent].child = nodes[node].next;
+        }
+        if (nodes[parent].last_child == node) {
+            nodes[parent].last_child = nodes[node].prev;
+        }
+        nodes[parent].child_count--;
     }
-    return last_child;
+}
+
+// Mutations made while another is in progress are part of it, so only the
+// outermost mutation is recorded in the journal
+class Object::JournalScope {
+public:
+    JournalScope(Object& object):
+        link(object.journal_link),
+        outer(link.busy)
+    {
+        link.busy = true;
+    }
+    ~JournalScope() {
+        link.busy = outer;
+    }
+    Journal* journal() const {
+        return outer ? nullptr : link.journal;
+    }
+private:
+    JournalLink& link;
+    const bool outer;
+};
+
+// Recorded as a checkpoint, since the whole object changes
+Object& Object::operator=(const Object& other) {
+    return *this = Object(other);
+}
+
+Object& Object::operator=(Object&& other) {
+    if (&other == this) {
+        return *this;
+    }
+    JournalScope scope(*this);
+    nodes = std::move(other.nodes);
+    free = std::move(other.free);
+    root_index = other.root_index;
+    shared_nodes = std::move(other.shared_nodes);
+    keys = std::move(other.keys);
+    key_counts = std::move(other.key_counts);
+    free_keys = std::move(other.free_keys);
+    key_indices = std::move(other.key_indices);
+    if (journal_link.journal) {
+        journal_link.journal->reset_nodes();
+    }
+    if (auto journal = scope.journal()) {
+        journal->record_checkpoint();
+    }
+    return *this;
 }
 
 void Object::index_assign(int index, const value_t& value) {
+    JournalScope scope(*this);
     index_clear(index);
     nodes[index].value = value;
+    if (auto journal = scope.journal()) {
+        journal->record_assign(index, value);
+    }
 }
 
 int Object::index_map_access(int parent, const std::string& key) const {
@@ -223,18 +476,22 @@ int Object::index_map_access(int parent, const std::string& key) const {
     if (!iter->is_map()) {
         throw ValueException("Tried to access value by key on a non-map node");
     }
-    iter = iter.child();
-
-    while (iter) {
-        if (iter->key() == key) {
-            return iter.index();
+    // Keys that aren't in the key table aren't in any map
+    int key_index = find_key(key);
+    if (key_index == -1) {
+        return -1;
+    }
+    for (int child = nodes[parent].child; child != -1; child = nodes[child].next) {
+        if (nodes[child].key == key_index) {
+            return child;
         }
-        iter = iter.next();
     }
     return -1;
 }
 
 int Object::index_map_access_or_create(int parent, const std::string& key) {
+    JournalScope scope(*this);
+    index_unshare(parent);
     auto iter = Iterator(this, parent);
     if (iter->is_null()) {
         *iter = map_t();
@@ -245,6 +502,9 @@ int Object::index_map_access_or_create(int parent, const std::string& key) {
     int child_index = index_map_access(parent, key);
     if (child_index == -1) {
         child_index = add_child(parent, key);
+        if (auto journal = scope.journal()) {
+            journal->record_insert(parent, key, null_t());
+        }
     }
     return child_index;
 }
@@ -265,6 +525,8 @@ int Object::index_list_access(int parent, std::size_t index) const {
 }
 
 int Object::index_insert(int parent, const std::string& key, const value_t& value) {
+    JournalScope scope(*this);
+    index_unshare(parent);
     auto iter = Iterator(this, parent);
     if (iter->is_null()) {
         *iter = map_t();
@@ -274,38 +536,84 @@ int Object::index_insert(int parent, const std::string& key, const value_t& valu
 
     iter = Iterator(this, add_child(parent, key));
     *iter = value;
+    if (auto journal = scope.journal()) {
+        journal->record_insert(parent, key, value);
+    }
     return iter.index();
 }
 
 int Object::index_push_back(int parent, const value_t& value) {
+    JournalScope scope(*this);
+    index_unshare(parent);
     auto iter = Iterator(this, parent);
     if (iter->is_null()) {
         *iter = list_t();
     } else if (!iter->is_list()) {
         throw ValueException("Tried to call push_back on a non-list node");
     }
+    index_expand(parent);
 
     iter = Iterator(this, add_child(parent));
     *iter = value;
+    if (auto journal = scope.journal()) {
+        journal->record_push_back(parent, value, false);
+    }
     return iter.index();
 }
 
-
-int Object::index_erase(int index) {
-    index_clear(index);
-    if (int prev = nodes[index].prev; prev != -1) {
-        nodes[prev].next = nodes[index].next;
+void Object::index_push_back_packed(int parent, const value_t& value) {
+    JournalScope scope(*this);
+    auto record = [&]() {
+        if (auto journal = scope.journal()) {
+            journal->record_push_back(parent, value, true);
+        }
+    };
+    index_unshare(parent);
+    Node& node = nodes[parent];
+    bool empty = std::get_if<null_t>(&node.value)
+        || (std::get_if<list_t>(&node.value) && node.child_count == 0);
+
+    // Lists stay packed while all their elements have the same type, so
+    // each element reads back with the type it was added with
+    if (auto integer = std::get_if<integer_t>(&value)) {
+        if (empty) {
+            node.value = integer_array_t();
+        }
+        if (auto array = std::get_if<integer_array_t>(&node.value)) {
+            array->push_back(*integer);
+            record();
+            return;
+        }
     }
-    if (int next = nodes[index].next; next != -1) {
-        nodes[next].prev = nodes[index].prev;
+    else if (auto floating = std::get_if<floating_t>(&value)) {
+        if (empty) {
+            node.value = floating_array_t();
+        }
+        if (auto array = std::get_if<floating_array_t>(&node.value)) {
+            array->push_back(*floating);
+            record();
+            return;
+        }
     }
-    if (int parent = nodes[index].parent; parent != -1
-        && nodes[parent].child == index)
-    {
-        nodes[parent].child = nodes[index].next;
+    index_push_back(parent, value);
+    record();
+}
+
+
+int Object::index_erase(int index) {
+    JournalScope scope(*this);
+    // Recorded first, since the node's position is needed
+    if (auto journal = scope.journal()) {
+        journal->record_erase(index);
     }
+    index_clear(index);
+    unlink(index);
 
     int after = nodes[index].next;
+    release_key(nodes[index].key);
+    if (journal_link.journal) {
+        journal_link.journal->free_node(index);
+    }
 
     if (index == nodes.size() - 1) {
         nodes.pop_back();
@@ -317,6 +625,19 @@ int Object::index_erase(int index) {
 }
 
 void Object::index_clear(int index) {
+    JournalScope scope(*this);
+    if (auto journal = scope.journal()) {
+        journal->record_clear(index);
+    }
+    if (nodes[index].child_count < 0) {
+        shared_nodes.erase(index);
+        nodes[index].child_count = 0;
+        return;
+    }
+    if (std::get_if<integer_array_t>(&nodes[index].value) || std::get_if<floating_array_t>(&nodes[index].value)) {
+        nodes[index].value = list_t();
+        return;
+    }
     int iter = nodes[index].child;
     while (iter != -1) {
         int prev = iter;
@@ -325,65 +646,506 @@ void Object::index_clear(int index) {
     }
 }
 
-Object Object::index_clone(int index) const {
-    auto iter = ConstIterator(this, index);
+// Moves the source's live nodes to the end of the node array, in depth-first
+// order, so the subtree is contiguous. Values are moved rather than copied,
+// and keys are looked up once per distinct key rather than once per node.
+int Object::index_splice(int parent, const std::string* key, Object&& source) {
+    if (&source == this) {
+        throw ValueException("Tried to splice an object into itself");
+    }
+    JournalScope scope(*this);
+    index_unshare(parent);
+    auto iter = Iterator(this, parent);
+    if (iter->is_null()) {
+        *iter = key ? value_t(map_t()) : value_t(list_t());
+    } else if (key ? !iter->is_map() : !iter->is_list()) {
+        throw ValueException(key ? "Tried to call splice on a non-map node" : "Tried to call splice on a non-list node");
+    }
+    index_expand(parent);
+
+    std::vector<int> order;
+    order.reserve(source.nodes.size() - source.free.size());
+    for (int index = source.root_index; index != -1;) {
+        order.push_back(index);
+        if (source.nodes[index].child != -1) {
+            index = source.nodes[index].child;
+            continue;
+        }
+        while (index != source.root_index && source.nodes[index].next == -1) {
+            index = source.nodes[index].parent;
+        }
+        index = index == source.root_index ? -1 : source.nodes[index].next;
+    }
 
-    Object result;
-    result = iter->value();
+    const int begin = nodes.size();
+    std::vector<int> new_index(source.nodes.size(), -1);
+    for (std::size_t i = 0; i < order.size(); i++) {
+        new_index[order[i]] = begin + i;
+    }
+    auto remap = [&](int index) {
+        return index == -1 ? -1 : new_index[index];
+    };
+    std::vector<int> new_key(source.keys.size(), -1);
+
+    nodes.reserve(begin + order.size());
+    for (int index: order) {
+        Node& node = source.nodes[index];
+        int& key_index = new_key[node.key];
+        if (key_index == -1) {
+            key_index = add_key(source.keys[node.key]);
+        } else {
+            key_counts[key_index]++;
+        }
+        nodes.push_back(Node(null_t(), key_index, remap(node.parent), remap(node.prev)));
+        Node& moved = nodes.back();
+        moved.value = std::move(node.value);
+        moved.child = remap(node.child);
+        moved.next = remap(node.next);
+        moved.last_child = remap(node.last_child);
+        moved.child_count = node.child_count;
+    }
+    for (auto& [index, shared]: source.shared_nodes) {
+        shared_nodes.emplace(new_index[index], std::move(shared));
+    }
 
-    if (!iter->is_map() && !iter->is_list()) {
-        return result;
+    int root_key = key ? add_key(*key) : 0;
+    release_key(nodes[begin].key);
+    nodes[begin].key = root_key;
+    link_child(parent, begin);
+
+    {
+        // The source's journal records it becoming null
+        JournalScope source_scope(source);
+        source.nodes.clear();
+        source.free = {};
+        source.shared_nodes.clear();
+        source.keys.resize(1);
+        source.key_counts.assign(1, 0);
+        source.free_keys = {};
+        source.key_indices.clear();
+        source.key_indices.emplace("", 0);
+        source.root_index = 0;
+        source.nodes.push_back(Node(null_t(), 0, -1, -1));
+        if (source.journal_link.journal) {
+            source.journal_link.journal->reset_nodes();
+        }
+        if (auto journal = source_scope.journal()) {
+            journal->record_assign(source.root_index, null_t());
+        }
     }
-    if (!iter.child()) {
-        return result;
+
+    if (auto journal = scope.journal()) {
+        journal->record_splice(parent, key, ConstReference(this, begin));
     }
+    return begin;
+}
 
-    std::stack<ConstIterator> from_stack;
-    from_stack.push(iter);
-    std::stack<Iterator> to_stack;
-    to_stack.push(result.iter());
+int Object::index_move(int index, int parent, const std::string* key) {
+    for (int ancestor = parent; ancestor != -1; ancestor = nodes[ancestor].parent) {
+        if (ancestor == index) {
+            throw ValueException("Tried to move a node into itself");
+        }
+    }
+    JournalScope scope(*this);
+    index_unshare(parent);
+    auto iter = Iterator(this, parent);
+    if (iter->is_null()) {
+        *iter = key ? value_t(map_t()) : value_t(list_t());
+    } else if (key ? !iter->is_map() : !iter->is_list()) {
+        throw ValueException(key ? "Tried to move a node to a non-map node" : "Tried to move a node to a non-list node");
+    }
+    index_expand(parent);
 
-    while (!from_stack.empty()) {
-        auto from = from_stack.top();
-        from_stack.pop();
-        if (!from){
-            to_stack.pop();
+    // Recorded first, since the node's position is needed
+    if (auto journal = scope.journal()) {
+        journal->record_move(index, parent, key);
+    }
+    unlink(index);
+    int old_key = nodes[index].key;
+    nodes[index].key = key ? add_key(*key) : 0;
+    release_key(old_key);
+    link_child(parent, index);
+    return index;
+}
+
+std::size_t Object::index_size(int index) const {
+    const value_t& value = nodes[index].value;
+    if (auto array = std::get_if<integer_array_t>(&value)) {
+        return array->size();
+    }
+    if (auto array = std::get_if<floating_array_t>(&value)) {
+        return array->size();
+    }
+    if (!std::get_if<map_t>(&value) && !std::get_if<list_t>(&value)) {
+        throw ValueException("Tried to query size on a node that is not a map or list");
+    }
+    return nodes[index].child_count;
+}
+
+template <typename Array>
+static void expand_array(Array array, Object::Iterator list) {
+    *list = Object::list_t();
+    for (const auto& value : array) {
+        list->push_back(value);
+    }
+}
+
+void Object::index_expand(int index) {
+    // Doesn't change the value, so isn't recorded
+    JournalScope scope(*this);
+    value_t& value = nodes[index].value;
+    if (auto array = std::get_if<integer_array_t>(&value)) {
+        expand_array(std::move(*array), Iterator(this, index));
+    }
+    else if (auto array = std::get_if<floating_array_t>(&value)) {
+        expand_array(std::move(*array), Iterator(this, index));
+    }
+}
+
+void Object::copy_into(Iterator to, ConstReference from, bool keep_shared) {
+    int depth = 0;
+    for (auto cursor = Object::ConstCursor(from); cursor; cursor.next()) {
+        if (!cursor.entering()) {
+            if (cursor.depth() < depth) {
+                to = to.parent();
+            }
+            depth = cursor.depth();
             continue;
         }
-        from_stack.push(from.next());
 
-        auto to = to_stack.top();
-        Iterator new_to;
-        if (to->is_map()) {
-            new_to = to->insert(from->key(), from->value());
+        auto node = cursor.iter();
+        if (cursor.depth() == 0) {
+            *to = node->value();
+            continue;
         }
-        else if (to->is_list()) {
-            new_to = to->push_back(from->value());
+        auto parent = (cursor.depth() > depth ? to : to.parent());
+        if (parent->is_map()) {
+            to = parent->insert(node->key(), node->value());
+        } else {
+            to = parent->push_back(node->value());
         }
-        else {
-            assert(false);
+        if (node->is_shared() && keep_shared) {
+            to.ref.object->index_share(to.index(), node.ref.object->shared_nodes.at(node.index()));
+            cursor.skip();
+        }
+        depth = cursor.depth();
+    }
+}
+
+Object Object::index_clone(int index, bool keep_shared) const {
+    Object result;
+    copy_into(result.iter(), ConstReference(this, index), keep_shared);
+    return result;
+}
+
+void Object::index_share(int index, std::shared_ptr<const Object> shared) {
+    JournalScope scope(*this);
+    index_clear(index);
+    nodes[index].child_count = -1;
+    shared_nodes[index] = std::move(shared);
+}
+
+void Object::index_unshare(int index) {
+    if (nodes[index].child_count >= 0) {
+        return;
+    }
+    JournalScope scope(*this);
+    auto shared = std::move(shared_nodes.at(index));
+    shared_nodes.erase(index);
+    nodes[index].child_count = 0;
+    copy_into(Iterator(this, index), ConstReference(shared.get(), shared->root_index));
+}
+
+static std::uint64_t hash_combine(std::uint64_t hash, std::uint64_t value) {
+    return hash ^ (value + 0x9e3779b97f4a7c15 + (hash << 6) + (hash >> 2));
+}
+
+static std::uint64_t hash_bytes(const void* data, std::size_t size) {
+    return std::hash<std::string_view>()(std::string_view((const char*)data, size));
+}
+
+// Hashes the value of a node, without its children. Floats are hashed by
+// their bits, so only identical values match.
+static std::uint64_t hash_value(const Object::value_t& value) {
+    std::uint64_t hash = value.index();
+    if (auto x = std::get_if<Object::integer_t>(&value)) {
+        hash = hash_combine(hash, *x);
+    } else if (auto x = std::get_if<Object::floating_t>(&value)) {
+        hash = hash_combine(hash, std::bit_cast<std::uint64_t>(*x));
+    } else if (auto x = std::get_if<bool>(&value)) {
+        hash = hash_combine(hash, *x);
+    } else if (auto x = std::get_if<std::string>(&value)) {
+        hash = hash_combine(hash, hash_bytes(x->data(), x->size()));
+    } else if (auto x = std::get_if<Object::binary_t>(&value)) {
+        hash = hash_combine(hash, hash_bytes(x->data(), x->size()));
+    } else if (auto x = std::get_if<Object::integer_array_t>(&value)) {
+        hash = hash_combine(hash, hash_bytes(x->data(), x->size() * sizeof(Object::integer_t)));
+    } else if (auto x = std::get_if<Object::floating_array_t>(&value)) {
+        hash = hash_combine(hash, hash_bytes(x->data(), x->size() * sizeof(Object::floating_t)));
+    }
+    return hash;
+}
+
+static bool identical_values(const Object::value_t& lhs, const Object::value_t& rhs) {
+    if (lhs.index() != rhs.index()) {
+        return false;
+    }
+    if (auto x = std::get_if<Object::floating_t>(&lhs)) {
+        return std::bit_cast<std::uint64_t>(*x) == std::bit_cast<std::uint64_t>(std::get<Object::floating_t>(rhs));
+    }
+    if (auto x = std::get_if<Object::floating_array_t>(&lhs)) {
+        const auto& y = std::get<Object::floating_array_t>(rhs);
+        return x->size() == y.size() && std::memcmp(x->data(), y.data(), x->size() * sizeof(Object::floating_t)) == 0;
+    }
+    return std::visit([&rhs](const auto& lhs_value) -> bool {
+        using T = std::decay_t<decltype(lhs_value)>;
+        if constexpr(std::is_same_v<T, Object::null_t> || std::is_same_v<T, Object::map_t> || std::is_same_v<T, Object::list_t>) {
+            return true;
+        } else {
+            return lhs_value == std::get<T>(rhs);
         }
+    }, lhs);
+}
 
-        if (from->is_map() || from->is_list()) {
-            from_stack.push(from.child());
-            to_stack.push(new_to);
+// Compares two subtrees exactly, unlike operator== which allows for rounding
+// errors in floats and treats packed arrays the same as regular lists. The
+// keys of the roots aren't compared.
+static bool identical(Object::ConstReference lhs, Object::ConstReference rhs) {
+    auto lhs_cursor = Object::ConstCursor(lhs);
+    auto rhs_cursor = Object::ConstCursor(rhs);
+    while (lhs_cursor && rhs_cursor) {
+        if (lhs_cursor.entering() != rhs_cursor.entering() || lhs_cursor.depth() != rhs_cursor.depth()) {
+            return false;
+        }
+        if (lhs_cursor.entering()) {
+            auto lhs_node = lhs_cursor.iter();
+            auto rhs_node = rhs_cursor.iter();
+            if (lhs_cursor.depth() > 0 && lhs_node->key() != rhs_node->key()) {
+                return false;
+            }
+            if (!identical_values(lhs_node->value(), rhs_node->value())) {
+                return false;
+            }
+            if (lhs_node->shares_with(*rhs_node)) {
+                lhs_cursor.skip();
+                rhs_cursor.skip();
+            }
         }
+        lhs_cursor.next();
+        rhs_cursor.next();
     }
+    return !lhs_cursor && !rhs_cursor;
+}
 
+// Hashes a subtree from the values and keys of its nodes, the same as
+// Deduper::add, which instead uses the hashes of the maps and lists added
+std::uint64_t Object::Deduper::shared_hash(const std::shared_ptr<const Object>& shared) {
+    if (auto iter = shared_hashes.find(shared.get()); iter != shared_hashes.end()) {
+        return iter->second;
+    }
+    // Hashes of the maps and lists being visited, including their children
+    // visited so far
+    std::vector<std::uint64_t> stack;
+    std::uint64_t result = 0;
+    for (auto cursor = ConstCursor(*shared); cursor; cursor.next()) {
+        auto node = cursor.iter();
+        std::uint64_t hash;
+        if (cursor.entering()) {
+            if (node->is_shared()) {
+                hash = shared_hash(node.ref.object->shared_nodes.at(node.index()));
+                cursor.skip();
+            } else if (node->is_map() || (node->is_list() && !node->is_packed())) {
+                stack.push_back(hash_value(node->value()));
+                continue;
+            } else {
+                hash = hash_value(node->value());
+            }
+        } else {
+            if (node->is_shared()) {
+                continue;
+            }
+            hash = stack.back();
+            stack.pop_back();
+            if (stack.empty()) {
+                result = hash;
+                break;
+            }
+        }
+        stack.back() = hash_combine(hash_combine(stack.back(), hash_bytes(node->key().data(), node->key().size())), hash);
+    }
+    shared_hashes.emplace(shared.get(), result);
     return result;
 }
 
+void Object::Deduper::add(const Reference& node) {
+    Object& object = *node.object;
+    const int index = node.index;
+    if (hashes.size() < object.nodes.size()) {
+        hashes.resize(object.nodes.size());
+    }
+
+    if (node.is_shared()) {
+        const auto& shared = object.shared_nodes.at(index);
+        hashes[index] = shared_hash(shared);
+        auto& bucket = candidates[hashes[index]];
+        if (std::none_of(bucket.begin(), bucket.end(), [&](const Candidate& candidate) { return candidate.shared == shared; })) {
+            bucket.push_back(Candidate{ shared, -1 });
+        }
+        return;
+    }
+    auto is_container = [](const Node& node) {
+        return std::get_if<map_t>(&node.value) || std::get_if<list_t>(&node.value);
+    };
+    const Node& added = object.nodes[index];
+    if (!is_container(added)) {
+        return;
+    }
+
+    std::uint64_t hash = hash_value(added.value);
+    for (int child = added.child; child != -1; child = object.nodes[child].next) {
+        const Node& child_node = object.nodes[child];
+        std::uint64_t child_hash;
+        if (child_node.child_count < 0) {
+            child_hash = shared_hash(object.shared_nodes.at(child));
+        } else if (is_container(child_node)) {
+            child_hash = hashes[child];
+        } else {
+            child_hash = hash_value(child_node.value);
+        }
+        const std::string& key = object.keys[child_node.key];
+        hash = hash_combine(hash_combine(hash, hash_bytes(key.data(), key.size())), child_hash);
+    }
+    hashes[index] = hash;
+    if (added.parent == -1 || added.child == -1) {
+        return;
+    }
+
+    // Candidates that are no longer shared may have been erased since they
+    // were added, which identical() rejects, since only maps and lists that
+    // contain this node are incomplete
+    auto& bucket = candidates[hash];
+    for (auto& candidate: bucket) {
+        if (candidate.shared) {
+            if (identical(node, ConstReference(candidate.shared.get(), candidate.shared->root_index))) {
+                object.index_share(index, candidate.shared);
+                return;
+            }
+            continue;
+        }
+        if (candidate.index == index || std::size_t(candidate.index) >= object.nodes.size()) {
+            continue;
+        }
+        if (identical(node, ConstReference(&object, candidate.index))) {
+            // Shared children are copied into the new shared children, so
+            // they never nest, see Reference_::link
+            auto shared = std::make_shared<const Object>(object.index_clone(candidate.index, false));
+            shared_hashes.emplace(shared.get(), hash);
+            object.index_share(candidate.index, shared);
+            object.index_share(index, shared);
+            candidate.shared = std::move(shared);
+            return;
+        }
+    }
+    bucket.push_back(Candidate{ nullptr, index });
+}
+
+void Object::dedupe() {
+    Deduper deduper;
+    for (auto cursor = ConstCursor(*this); cursor; cursor.next()) {
+        auto node = cursor.iter();
+        if (cursor.entering()) {
+            if (node->is_shared()) {
+                cursor.skip();
+            }
+            continue;
+        }
+        deduper.add(Reference(this, node.index()));
+    }
+    // Nodes replaced by shared children are left as free slots
+    if (!free.empty()) {
+        *this = clone();
+    }
+}
+
 Object merge(const Object::ConstReference& base, const Object::ConstReference& diff) {
+    if (!diff.is_map()) {
+        return diff.clone();
+    }
     Object merged;
+    if (base.is_map() || base.is_list()) {
+        merged = base.clone();
+    } else {
+        merged = Object::map_t();
+    }
 
-    std::stack<Object::ConstIterator> base_nodes;
-    std::stack<Object::ConstIterator> diff_nodes;
-    std::stack<Object::Iterator> merged_nodes;
+    // Erased list elements are set to null, so trailing nulls are removed
+    // once all changes to the list have been applied
+    auto trim_list = [](Object::Iterator list) {
+        if (!list->is_list()) return;
+        while (list->size() > 0) {
+            auto last = (*list)[list->size() - 1];
+            if (!last.is_null()) break;
+            last.erase();
+        }
+    };
 
-    diff_nodes.push(diff.iter());
+    Object::Iterator parent; // Merged node for the parent of the diff node
+    Object::Iterator last = merged.iter(); // Merged node for the last diff node
+    int depth = 0;
 
-    while (!diff_nodes.empty()) {
+    for (auto cursor = Object::ConstCursor(diff); cursor; cursor.next()) {
+        if (!cursor.entering()) {
+            if (cursor.depth() < depth) {
+                trim_list(parent);
+                last = parent;
+                parent = parent.parent();
+            }
+            depth = cursor.depth();
+            continue;
+        }
+        if (cursor.depth() == 0) {
+            continue;
+        }
+        if (cursor.depth() > depth) {
+            parent = last;
+        }
+        depth = cursor.depth();
+
+        auto node = cursor.iter();
+        Object::Iterator target;
+        if (parent->is_map()) {
+            target = parent->find(node->key());
+            if (node->is_null()) {
+                if (target) {
+                    target->erase();
+                }
+                continue;
+            }
+            if (!target) {
+                target = parent->insert(node->key(), Object::null_t());
+            }
+        } else {
+            const std::string& key = node->key();
+            std::size_t list_index = 0;
+            auto result = std::from_chars(key.data(), key.data() + key.size(), list_index);
+            if (result.ec != std::errc() || result.ptr != key.data() + key.size()) {
+                throw Object::ValueException("Invalid list index '" + key + "' in diff");
+            }
+            while (parent->size() <= list_index) {
+                parent->push_back(Object::null_t());
+            }
+            target = (*parent)[list_index].iter();
+        }
 
+        if (node->is_map()) {
+            if (!target->is_map() && !target->is_list()) {
+                *target = Object::map_t();
+            }
+        } else {
+            Object::copy_into(target, *node);
+            cursor.skip();
+        }
+        last = target;
     }
 
     return merged;
@@ -396,56 +1158,136 @@ Object diff(const Object::ConstReference& base, const Object::ConstReference& mo
 }
 
 
-bool operator==(const Object::ConstReference& lhs, const Object::ConstReference& rhs) {
-    static constexpr double float_threshold = 1e-12;
-    std::stack<Object::ConstIterator> nodes_lhs;
-    std::stack<Object::ConstIterator> nodes_rhs;
-    nodes_lhs.push(lhs.iter());
-    nodes_rhs.push(rhs.iter());
-
-    while (!nodes_lhs.empty()) {
-        auto lhs = nodes_lhs.top();
-        auto rhs = nodes_rhs.top();
-        nodes_lhs.pop();
-        nodes_rhs.pop();
-
-        if (bool(lhs) != bool(rhs)) {
+static constexpr double float_threshold = 1e-12;
+
+static bool element_equal(Object::integer_t lhs, Object::integer_t rhs) {
+    return lhs == rhs;
+}
+
+static bool element_equal(Object::floating_t lhs, Object::floating_t rhs) {
+    return std::abs(lhs - rhs) < float_threshold;
+}
+
+// Compares a packed array with a packed array or regular list
+template <typename Array>
+static bool packed_equal(const Array& packed, Object::ConstIterator other) {
+    using element_t = typename Array::value_type;
+    if (auto other_packed = std::get_if<Array>(&other->value())) {
+        if (packed.size() != other_packed->size()) {
             return false;
         }
-        if (!lhs) { // && !rhs
-            continue;
+        for (std::size_t i = 0; i < packed.size(); i++) {
+            if (!element_equal(packed[i], (*other_packed)[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+    if (!std::get_if<Object::list_t>(&other->value()) || other->size() != packed.size()) {
+        return false;
+    }
+    auto element = other.child();
+    for (std::size_t i = 0; i < packed.size(); i++) {
+        if (auto value = std::get_if<element_t>(&element->value())) {
+            if (!element_equal(packed[i], *value)) {
+                return false;
+            }
+        }
+        // Lists may hold integers where a floating array holds an equal float
+        else if (auto value = element->integer_if(); value && std::is_same_v<element_t, Object::floating_t>) {
+            if (!element_equal(packed[i], element_t(*value))) {
+                return false;
+            }
         }
+        else {
+            return false;
+        }
+        element = element.next();
+    }
+    return true;
+}
+
+bool operator==(const Object::ConstReference& lhs, const Object::ConstReference& rhs) {
+    // Walk lhs, keeping rhs_iter at the corresponding node in rhs
+    auto rhs_iter = rhs.iter();
+    int depth = 0;
 
-        if (!nodes_lhs.empty() && lhs.parent() && lhs.parent()->is_map()) {
-            auto lhs_next = lhs.next();
-            nodes_lhs.push(lhs_next);
-            nodes_rhs.push(rhs.parent()->find(lhs_next->key()));
+    for (auto cursor = Object::ConstCursor(lhs); cursor; cursor.next()) {
+        if (!cursor.entering()) {
+            if (cursor.depth() < depth) {
+                rhs_iter = rhs_iter.parent();
+            }
+            depth = cursor.depth();
+            continue;
         }
-        if (!nodes_lhs.empty() && lhs.parent() && lhs.parent()->is_list()) {
-            nodes_lhs.push(lhs.next());
-            nodes_rhs.push(rhs.next());
+
+        auto lhs_iter = cursor.iter();
+        if (cursor.depth() > 0) {
+            bool first_child = cursor.depth() > depth;
+            auto rhs_parent = (first_child ? rhs_iter : rhs_iter.parent());
+            if (rhs_parent->is_map()) {
+                rhs_iter = rhs_parent->find(lhs_iter->key());
+            } else {
+                rhs_iter = (first_child ? rhs_parent.child() : rhs_iter.next());
+            }
         }
+        depth = cursor.depth();
 
-        if (lhs->value().index() != rhs->value().index()) {
+        if (!rhs_iter) {
             return false;
         }
-
-        if (lhs->is_map()) {
-            auto lhs_child = lhs.child();
-            auto rhs_child = rhs->find(lhs_child->key());
-            nodes_lhs.push(lhs_child);
-            nodes_rhs.push(rhs_child);
+        if (lhs_iter->shares_with(*rhs_iter)) {
+            cursor.skip();
+            continue;
+        }
+        // Packed arrays are equal to regular lists with the same elements
+        if (lhs_iter->is_packed() || rhs_iter->is_packed()) {
+            auto packed = (lhs_iter->is_packed() ? lhs_iter : rhs_iter);
+            auto other = (lhs_iter->is_packed() ? rhs_iter : lhs_iter);
+            bool equal = false;
+            if (auto array = packed->integer_array_if()) {
+                equal = packed_equal(*array, other);
+            } else {
+                equal = packed_equal(*packed->floating_array_if(), other);
+            }
+            if (!equal) {
+                return false;
+            }
+            cursor.skip();
+            continue;
+        }
+        // Elements of packed arrays don't have a value(), so numbers are
+        // compared through their accessors
+        if (auto lhs_value = lhs_iter->integer_if()) {
+            auto rhs_value = rhs_iter->integer_if();
+            if (!rhs_value || *rhs_value != *lhs_value) {
+                return false;
+            }
             continue;
         }
-        if (lhs->is_list()) {
-            nodes_lhs.push(lhs.child());
-            nodes_rhs.push(rhs.child());
+        if (auto lhs_value = lhs_iter->floating_if()) {
+            auto rhs_value = rhs_iter->floating_if();
+            if (!rhs_value || !element_equal(*lhs_value, *rhs_value)) {
+                return false;
+            }
+            continue;
+        }
+        if (rhs_iter->integer_if() || rhs_iter->floating_if()) {
+            return false;
+        }
+        if (lhs_iter->value().index() != rhs_iter->value().index()) {
+            return false;
+        }
+        if (lhs_iter->is_map() || lhs_iter->is_list()) {
+            if (lhs_iter->size() != rhs_iter->size()) {
+                return false;
+            }
             continue;
         }
 
-        bool values_equal = std::visit([&rhs](const auto& lhs_value) -> bool {
+        bool values_equal = std::visit([&rhs_iter](const auto& lhs_value) -> bool {
             using T = std::decay_t<decltype(lhs_value)>;
-            auto rhs_value_iter = std::get_if<T>(&rhs->value());
+            auto rhs_value_iter = std::get_if<T>(&rhs_iter->value());
             if (!rhs_value_iter) {
                 return false;
             }
@@ -483,7 +1325,13 @@ bool operator==(const Object::ConstReference& lhs, const Object::ConstReference&
             if constexpr(std::is_same_v<Object::list_t, T>) {
                 return true; // Unreachable
             }
-        }, lhs->value());
+            if constexpr(std::is_same_v<Object::integer_array_t, T>) {
+                return true; // Unreachable
+            }
+            if constexpr(std::is_same_v<Object::floating_array_t, T>) {
+                return true; // Unreachable
+            }
+        }, lhs_iter->value());
         if (!values_equal) {
             return false;
         }
@@ -493,24 +1341,16 @@ bool operator==(const Object::ConstReference& lhs, const Object::ConstReference&
 
 
 std::ostream& operator<<(std::ostream& os, Object::ConstReference object) {
-    std::stack<datapack::Object::ConstIterator> nodes;
-    nodes.push(object.iter());
-    int depth = 0;
-    bool first = true;
-
-    while (!nodes.empty()) {
-        auto node = nodes.top();
-        nodes.pop();
-
-        if (!node) {
-            depth--;
+    for (auto cursor = Object::ConstCursor(object); cursor; cursor.next()) {
+        if (!cursor.entering()) {
             continue;
         }
-        if (!first) {
+        auto node = cursor.iter();
+        int depth = cursor.depth();
+
+        if (depth > 0) {
             os << "\n";
         }
-        first = false;
-
         for (int i = 0; i < depth; i++) {
             os << "    ";
         }
@@ -527,6 +1367,21 @@ std::ostream& operator<<(std::ostream& os, Object::ConstReference object) {
         }
         else if (node->is_list()) {
             os << "list:";
+            // Packed arrays are printed the same as a regular list
+            auto print_elements = [&](const auto& array) {
+                for (const auto& value : array) {
+                    os << "\n";
+                    for (int i = 0; i <= depth; i++) {
+                        os << "    ";
+                    }
+                    os << "- " << value;
+                }
+            };
+            if (auto array = node->integer_array_if()) {
+                print_elements(*array);
+            } else if (auto array = node->floating_array_if()) {
+                print_elements(*array);
+            }
         }
         else if (auto value = node->integer_if()) {
             os << *value << "";
@@ -546,15 +1401,6 @@ std::ostream& operator<<(std::ostream& os, Object::ConstReference object) {
         else if (auto value = node->binary_if()) {
             os << "binary (size=" << value->size() << ")";
         }
-
-        if (depth > 0) {
-            nodes.push(node.next());
-        }
-
-        if (node->is_map() | node->is_list()) {
-            nodes.push(node.child());
-            depth++;
-        }
     }
     return os;
 }
@@ -1,5 +1,10 @@
 #include "datapack/schema/binary.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
 #include "datapack/util/object_reader.hpp"
 #include "datapack/util/object_writer.hpp"
 #include "datapack/format/binary_reader.hpp"
@@ -24,4 +29,118 @@ std::vector<std::uint8_t> object_to_binary(const Schema& schema, const Object::C
     return bytes;
 }
 
+BinaryEncodeJob::BinaryEncodeJob(
+    const Schema& schema,
+    Object snapshot,
+    std::size_t reserve,
+    const BinaryOptions& options
+):
+    schema(schema),
+    snapshot(std::move(snapshot)),
+    reader(this->snapshot),
+    writer(data, options),
+    runner(this->schema, reader, writer)
+{
+    data.reserve(reserve);
+}
+
+// Tokens processed between checks of the budget
+static constexpr std::size_t job_step_tokens = 16;
+
+bool BinaryEncodeJob::step_bytes(std::size_t byte_budget) {
+    std::size_t end = data.size() + byte_budget;
+    while (!runner.step(job_step_tokens)) {
+        if (data.size() >= end) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool BinaryEncodeJob::step(std::chrono::nanoseconds time_budget) {
+    using Clock = std::chrono::steady_clock;
+    auto end = Clock::now() + time_budget;
+    while (!runner.step(job_step_tokens)) {
+        if (Clock::now() >= end) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Seeds of consecutive messages are far apart in the generator's sequence
+static std::uint64_t message_seed(std::uint64_t seed, std::uint64_t index) {
+    std::uint64_t z = seed ^ (index * 0xD1B54A32D192ED03);
+    z = (z ^ (z >> 32)) * 0xD6E8FEB86659FD93;
+    z = (z ^ (z >> 32)) * 0xD6E8FEB86659FD93;
+    return z ^ (z >> 32);
+}
+
+void random_binary(
+    const Schema& schema,
+    std::size_t count,
+    const std::function<void(std::size_t index, const std::vector<std::uint8_t>& data)>& output,
+    const RandomBinaryOptions& options)
+{
+    // Messages are claimed in batches, to limit contention on the counter
+    static constexpr std::size_t batch_size = 64;
+
+    std::size_t threads = options.threads;
+    if (threads == 0) {
+        threads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    threads = std::min(threads, (count + batch_size - 1) / batch_size);
+
+    std::atomic<std::size_t> next_batch = 0;
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    auto worker = [&]() {
+        RandomReader reader(0, options.random);
+        std::vector<std::uint8_t> data;
+        try {
+            while (true) {
+                std::size_t begin = (next_batch++) * batch_size;
+                if (begin >= count) {
+                    break;
+                }
+                std::size_t end = std::min(begin + batch_size, count);
+                for (std::size_t i = begin; i < end; i++) {
+                    reader.seed(message_seed(options.seed, i));
+                    data.clear();
+                    BinaryWriter writer(data, options.binary);
+                    use_schema(schema, reader, writer);
+                    output(i, data);
+                }
+            }
+        } catch (...) {
+            std::scoped_lock lock(error_mutex);
+            error = std::current_exception();
+            next_batch = count;
+        }
+    };
+    std::vector<std::thread> workers;
+    for (std::size_t i = 1; i < threads; i++) {
+        workers.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : workers) {
+        thread.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+std::vector<std::vector<std::uint8_t>> random_binary(
+    const Schema& schema,
+    std::size_t count,
+    const RandomBinaryOptions& options)
+{
+    std::vector<std::vector<std::uint8_t>> messages(count);
+    random_binary(schema, count, [&](std::size_t index, const std::vector<std::uint8_t>& data) {
+        messages[index] = data;
+    }, options);
+    return messages;
+}
+
 } // namespace datapack
@@ -0,0 +1,200 @@
+#include "datapack/schema/layout.hpp"
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+
+
+namespace datapack {
+
+DATAPACK_IMPL(FieldOrder, value, packer) {
+    packer.object_begin();
+    packer.value("path", value.path);
+    packer.value("fields", value.fields);
+    packer.value("suggested", value.suggested);
+    packer.value("size", value.size);
+    packer.value("suggested_size", value.suggested_size);
+    packer.object_end();
+}
+
+namespace {
+
+// Fixed-size values have a size and alignment, as in a C struct
+struct Layout {
+    bool fixed = false;
+    std::size_t size = 0;
+    std::size_t align = 1;
+};
+
+std::size_t align_up(std::size_t offset, std::size_t align) {
+    return (offset + align - 1) / align * align;
+}
+
+Layout struct_layout(const std::vector<Layout>& fields, const std::vector<std::size_t>& order) {
+    Layout result;
+    result.fixed = true;
+    std::size_t offset = 0;
+    for (std::size_t i: order) {
+        offset = align_up(offset, fields[i].align) + fields[i].size;
+        result.align = std::max(result.align, fields[i].align);
+    }
+    result.size = align_up(offset, result.align);
+    return result;
+}
+
+class LayoutParser {
+public:
+    LayoutParser(const std::vector<Token>& tokens, std::vector<FieldOrder>& output):
+        tokens(tokens),
+        pos(0),
+        output(output)
+    {}
+
+    Layout value(const std::string& path) {
+        const Token& token = next();
+        if (auto value = std::get_if<IntType>(&token)) {
+            std::size_t size = int_type_size(*value);
+            return Layout{true, size, size};
+        }
+        if (auto value = std::get_if<FloatType>(&token)) {
+            std::size_t size = *value == FloatType::F32 ? 4 : 8;
+            return Layout{true, size, size};
+        }
+        if (std::get_if<bool>(&token)) {
+            return Layout{true, 1, 1};
+        }
+        if (std::get_if<token::Enumerate>(&token)) {
+            return Layout{true, sizeof(int), sizeof(int)};
+        }
+        if (auto value = std::get_if<token::Binary>(&token)) {
+            if (value->length == 0 || value->stride == 0) {
+                return Layout{};
+            }
+            // Element alignment isn't known, so use the largest power of
+            // two up to 8 that divides the stride
+            std::size_t align = 1;
+            while (align < 8 && value->stride % (align * 2) == 0) {
+                align *= 2;
+            }
+            return Layout{true, value->length * value->stride, align};
+        }
+        if (std::get_if<token::Optional>(&token)) {
+            this->value(path);
+            return Layout{};
+        }
+        if (std::get_if<token::List>(&token)) {
+            this->value(child_path(path, "*"));
+            return Layout{};
+        }
+        if (auto value = std::get_if<token::VariantBegin>(&token)) {
+            while (!std::get_if<token::VariantEnd>(&peek())) {
+                auto next = std::get_if<token::VariantNext>(&this->next());
+                if (!next || next->index < 0 || std::size_t(next->index) >= value->labels.size()) {
+                    throw std::runtime_error("Invalid schema");
+                }
+                this->value(child_path(path, value->labels[next->index]));
+            }
+            pos++;
+            return Layout{};
+        }
+        if (auto value = std::get_if<token::ObjectBegin>(&token)) {
+            return object(path, value->size != 0);
+        }
+        if (std::get_if<token::TupleBegin>(&token)) {
+            return tuple(path);
+        }
+        // Strings
+        return Layout{};
+    }
+
+private:
+    Layout object(const std::string& path, bool trivial) {
+        FieldOrder order;
+        order.path = path;
+        std::vector<Layout> fields;
+        bool fixed = true;
+        while (!std::get_if<token::ObjectEnd>(&peek())) {
+            auto next = std::get_if<token::ObjectNext>(&this->next());
+            if (!next) {
+                throw std::runtime_error("Invalid schema");
+            }
+            order.fields.push_back(next->key);
+            fields.push_back(value(child_path(path, next->key)));
+            fixed &= fields.back().fixed;
+        }
+        pos++;
+        if (!fixed) {
+            return Layout{};
+        }
+
+        std::vector<std::size_t> current(fields.size());
+        std::iota(current.begin(), current.end(), 0);
+        std::vector<std::size_t> suggested = current;
+        std::stable_sort(suggested.begin(), suggested.end(), [&](std::size_t lhs, std::size_t rhs) {
+            return fields[lhs].align > fields[rhs].align;
+        });
+
+        Layout layout = struct_layout(fields, current);
+        if (!trivial) {
+            return layout;
+        }
+        order.size = layout.size;
+        order.suggested_size = struct_layout(fields, suggested).size;
+        if (order.suggested_size < order.size) {
+            for (std::size_t i: suggested) {
+                order.suggested.push_back(order.fields[i]);
+            }
+            output.push_back(order);
+        }
+        return layout;
+    }
+
+    Layout tuple(const std::string& path) {
+        std::vector<Layout> fields;
+        bool fixed = true;
+        while (!std::get_if<token::TupleEnd>(&peek())) {
+            if (!std::get_if<token::TupleNext>(&next())) {
+                throw std::runtime_error("Invalid schema");
+            }
+            fields.push_back(value(child_path(path, std::to_string(fields.size()))));
+            fixed &= fields.back().fixed;
+        }
+        pos++;
+        if (!fixed) {
+            return Layout{};
+        }
+        std::vector<std::size_t> order(fields.size());
+        std::iota(order.begin(), order.end(), 0);
+        return struct_layout(fields, order);
+    }
+
+    static std::string child_path(const std::string& path, const std::string& key) {
+        return path.empty() ? key : path + "." + key;
+    }
+
+    const Token& peek() const {
+        if (pos >= tokens.size()) {
+            throw std::runtime_error("Invalid schema");
+        }
+        return tokens[pos];
+    }
+
+    const Token& next() {
+        const Token& token = peek();
+        pos++;
+        return token;
+    }
+
+    const std::vector<Token>& tokens;
+    std::size_t pos;
+    std::vector<FieldOrder>& output;
+};
+
+} // namespace
+
+std::vector<FieldOrder> suggest_field_order(const Schema& schema) {
+    std::vector<FieldOrder> output;
+    LayoutParser(schema.tokens, output).value("");
+    return output;
+}
+
+} // namespace datapack
@@ -1,5 +1,6 @@
 #include "datapack/schema/schema.hpp"
 #include "datapack/common.hpp"
+#include "datapack/util/metrics.hpp"
 #include <stdexcept>
 
 #include <stack>
@@ -7,7 +8,7 @@
 
 namespace datapack {
 
-static std::size_t get_tokens_end(const std::vector<Token>& tokens, std::size_t begin) {
+std::size_t get_tokens_end(const std::vector<Token>& tokens, std::size_t begin) {
     std::size_t pos = begin;
     std::size_t depth = 0;
     while (true) {
@@ -65,38 +66,25 @@ static std::size_t get_tokens_end(const std::vector<Token>& tokens, std::size_t
     return pos;
 }
 
-void use_schema(const Schema& schema, Reader& reader, Writer& writer) {
-    enum class StateType {
-        None,
-        List,
-        Array,
-        Optional,
-        Variant
-    };
-    struct State {
-        const StateType type;
-        const std::size_t value_tokens_begin;
-        const std::size_t value_tokens_end;
-        int remaining;
-        State(
-            StateType type,
-            std::size_t value_tokens_begin,
-            std::size_t value_tokens_end,
-            int remaining
-        ):
-            type(type),
-            value_tokens_begin(value_tokens_begin),
-            value_tokens_end(value_tokens_end),
-            remaining(remaining)
-        {}
-    };
-    std::stack<State> states;
+SchemaRunner::SchemaRunner(const Schema& schema, Reader& reader, Writer& writer):
+    schema(schema),
+    reader(reader),
+    writer(writer),
+    token_pos(0),
+    finished(false)
+{
     states.push(State(StateType::None, 0, 0, 0));
+}
 
-    std::size_t token_pos = 0;
-    while (true) {
-        if (token_pos == schema.tokens.size()) {
-            break;
+bool SchemaRunner::step(std::size_t max_tokens) {
+    if (finished) {
+        return true;
+    }
+    for (; max_tokens > 0; max_tokens--) {
+        // Containers at the top level still need to be closed
+        if (token_pos == schema.tokens.size() && states.size() == 1) {
+            finished = true;
+            return true;
         }
 
         auto& state = states.top();
@@ -289,10 +277,18 @@ void use_schema(const Schema& schema, Reader& reader, Writer& writer) {
             throw std::runtime_error("Shouldn't be here");
         }
     }
+    return false;
+}
+
+void use_schema(const Schema& schema, Reader& reader, Writer& writer) {
+    MetricTimer timer(MetricOp::UseSchema);
+    SchemaRunner runner(schema, reader, writer);
+    while (!runner.step(std::size_t(-1))) {}
+    timer.done(0, reader.valid());
 }
 
 bool operator==(const Schema& lhs, const Schema& rhs) {
-    return lhs == rhs;
+    return lhs.tokens == rhs.tokens;
 }
 
 DATAPACK_IMPL(Schema, value, packer) {
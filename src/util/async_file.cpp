@@ -0,0 +1,452 @@
+#include "datapack/util/async_file.hpp"
+#include <algorithm>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+
+namespace datapack {
+
+class AsyncIo {
+public:
+    virtual ~AsyncIo() {}
+    virtual void submit(bool write, std::size_t buffer, std::uint8_t* data, std::size_t size, std::uint64_t offset) = 0;
+    // Bytes transferred, or -errno
+    virtual std::int64_t wait(std::size_t buffer) = 0;
+};
+
+// Continues until complete, the end of the file, or an error
+static std::int64_t blocking_io(bool write, int fd, std::uint8_t* data, std::size_t size, std::uint64_t offset) {
+    std::size_t done = 0;
+    while (done < size) {
+        ssize_t result = write
+            ? ::pwrite(fd, data + done, size - done, offset + done)
+            : ::pread(fd, data + done, size - done, offset + done);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -errno;
+        }
+        if (result == 0) {
+            break;
+        }
+        done += result;
+    }
+    return done;
+}
+
+// ===========================================================================
+// io_uring
+
+#ifdef __linux__
+
+// Uses the system calls directly, so liburing isn't required
+static int io_uring_setup(unsigned entries, io_uring_params* params) {
+    return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0);
+}
+
+static int io_uring_register(int fd, unsigned opcode, const void* arg, unsigned count) {
+    return syscall(__NR_io_uring_register, fd, opcode, arg, count);
+}
+
+class UringIo: public AsyncIo {
+public:
+    UringIo(int fd, const std::vector<std::uint8_t*>& buffers, std::size_t buffer_size):
+        fd(fd),
+        results(buffers.size(), 0),
+        done(buffers.size(), false)
+    {
+        // Each buffer has at most one request, so the rings can't overflow
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        ring_fd = io_uring_setup(buffers.size(), &params);
+        if (ring_fd < 0) {
+            throw IoError("io_uring unavailable: " + std::string(std::strerror(errno)));
+        }
+
+        sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap) {
+            sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+        }
+        sq_ring = map(sq_ring_size, IORING_OFF_SQ_RING);
+        cq_ring = single_mmap ? sq_ring : map(cq_ring_size, IORING_OFF_CQ_RING);
+        sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = (io_uring_sqe*)map(sqes_size, IORING_OFF_SQES);
+        if (!sq_ring || !cq_ring || !sqes) {
+            unmap();
+            ::close(ring_fd);
+            throw IoError("Failed to map the io_uring rings");
+        }
+
+        std::uint8_t* sq = (std::uint8_t*)sq_ring;
+        sq_tail = (unsigned*)(sq + params.sq_off.tail);
+        sq_mask = (unsigned*)(sq + params.sq_off.ring_mask);
+        sq_array = (unsigned*)(sq + params.sq_off.array);
+        std::uint8_t* cq = (std::uint8_t*)cq_ring;
+        cq_head = (unsigned*)(cq + params.cq_off.head);
+        cq_tail = (unsigned*)(cq + params.cq_off.tail);
+        cq_mask = (unsigned*)(cq + params.cq_off.ring_mask);
+        cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+
+        // Registering can fail when the buffers exceed the locked memory
+        // limit, in which case requests use unregistered buffers
+        std::vector<iovec> iovecs;
+        for (std::uint8_t* buffer: buffers) {
+            iovecs.push_back(iovec{buffer, buffer_size});
+        }
+        fixed = io_uring_register(ring_fd, IORING_REGISTER_BUFFERS, iovecs.data(), iovecs.size()) == 0;
+    }
+
+    ~UringIo() {
+        unmap();
+        ::close(ring_fd);
+    }
+
+    void submit(bool write, std::size_t buffer, std::uint8_t* data, std::size_t size, std::uint64_t offset) override {
+        unsigned tail = *sq_tail;
+        unsigned index = tail & *sq_mask;
+        io_uring_sqe& sqe = sqes[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        if (fixed) {
+            sqe.opcode = write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+            sqe.buf_index = buffer;
+        } else {
+            sqe.opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+        }
+        sqe.fd = fd;
+        sqe.addr = (std::uint64_t)data;
+        sqe.len = size;
+        sqe.off = offset;
+        sqe.user_data = buffer;
+        sq_array[index] = index;
+        __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+        done[buffer] = false;
+        while (true) {
+            int result = io_uring_enter(ring_fd, 1, 0, 0);
+            if (result >= 0) {
+                break;
+            }
+            if (errno != EINTR && errno != EAGAIN) {
+                throw IoError("io_uring_enter failed: " + std::string(std::strerror(errno)));
+            }
+        }
+    }
+
+    std::int64_t wait(std::size_t buffer) override {
+        while (true) {
+            unsigned head = *cq_head;
+            unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+            for (; head != tail; head++) {
+                const io_uring_cqe& cqe = cqes[head & *cq_mask];
+                results[cqe.user_data] = cqe.res;
+                done[cqe.user_data] = true;
+            }
+            __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+            if (done[buffer]) {
+                return results[buffer];
+            }
+            if (io_uring_enter(ring_fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+                throw IoError("io_uring_enter failed: " + std::string(std::strerror(errno)));
+            }
+        }
+    }
+
+private:
+    void* map(std::size_t size, std::uint64_t offset) {
+        void* result = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, offset);
+        return result == MAP_FAILED ? nullptr : result;
+    }
+
+    void unmap() {
+        if (sqes) {
+            munmap(sqes, sqes_size);
+        }
+        if (cq_ring && cq_ring != sq_ring) {
+            munmap(cq_ring, cq_ring_size);
+        }
+        if (sq_ring) {
+            munmap(sq_ring, sq_ring_size);
+        }
+    }
+
+    int fd;
+    int ring_fd;
+    bool fixed;
+    void* sq_ring = nullptr;
+    void* cq_ring = nullptr;
+    io_uring_sqe* sqes = nullptr;
+    std::size_t sq_ring_size;
+    std::size_t cq_ring_size;
+    std::size_t sqes_size;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    io_uring_cqe* cqes;
+    std::vector<std::int64_t> results;
+    std::vector<bool> done;
+};
+
+bool io_uring_supported() {
+    static const bool supported = []() {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        int fd = io_uring_setup(1, &params);
+        if (fd < 0) {
+            return false;
+        }
+        ::close(fd);
+        return true;
+    }();
+    return supported;
+}
+
+#else
+
+bool io_uring_supported() {
+    return false;
+}
+
+#endif
+
+// ===========================================================================
+// Thread pool
+
+// Shared by all files, so many concurrent streams don't each need threads
+class IoThreadPool {
+public:
+    static IoThreadPool& instance() {
+        static IoThreadPool pool(std::max(std::thread::hardware_concurrency(), 4u));
+        return pool;
+    }
+
+    void submit(std::function<void()> task) {
+        {
+            std::scoped_lock lock(mutex);
+            tasks.push_back(std::move(task));
+        }
+        cv.notify_one();
+    }
+
+    ~IoThreadPool() {
+        {
+            std::scoped_lock lock(mutex);
+            stopping = true;
+        }
+        cv.notify_all();
+        for (auto& thread: threads) {
+            thread.join();
+        }
+    }
+
+private:
+    IoThreadPool(std::size_t count) {
+        for (std::size_t i = 0; i < count; i++) {
+            threads.emplace_back([this]() { run(); });
+        }
+    }
+
+    void run() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock lock(mutex);
+                cv.wait(lock, [this]() { return stopping || !tasks.empty(); });
+                if (tasks.empty()) {
+                    return;
+                }
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<std::function<void()>> tasks;
+    std::vector<std::thread> threads;
+    bool stopping = false;
+};
+
+class ThreadIo: public AsyncIo {
+public:
+    ThreadIo(int fd, std::size_t buffer_count):
+        fd(fd),
+        results(buffer_count, 0),
+        done(buffer_count, true)
+    {}
+
+    void submit(bool write, std::size_t buffer, std::uint8_t* data, std::size_t size, std::uint64_t offset) override {
+        {
+            std::scoped_lock lock(mutex);
+            done[buffer] = false;
+        }
+        IoThreadPool::instance().submit([=, this]() {
+            std::int64_t result = blocking_io(write, fd, data, size, offset);
+            {
+                std::scoped_lock lock(mutex);
+                results[buffer] = result;
+                done[buffer] = true;
+            }
+            cv.notify_all();
+        });
+    }
+
+    std::int64_t wait(std::size_t buffer) override {
+        std::unique_lock lock(mutex);
+        cv.wait(lock, [&]() { return bool(done[buffer]); });
+        return results[buffer];
+    }
+
+private:
+    int fd;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::vector<std::int64_t> results;
+    std::vector<bool> done;
+};
+
+// ===========================================================================
+// AsyncFile
+
+// Page aligned, which also suits O_DIRECT
+static constexpr std::size_t buffer_alignment = 4096;
+
+AsyncFile::AsyncFile(
+    const std::filesystem::path& path,
+    Mode mode,
+    std::size_t buffer_size,
+    std::size_t buffer_count,
+    IoBackend backend):
+    buffer_size_(buffer_size),
+    pending_(buffer_count, false),
+    requests(buffer_count)
+{
+    if (buffer_size == 0 || buffer_count == 0) {
+        throw IoError("Invalid buffer size or count");
+    }
+    int flags = mode == Mode::Read ? O_RDONLY : (O_WRONLY | O_CREAT | O_TRUNC);
+    fd = ::open(path.c_str(), flags | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw IoError("Failed to open " + path.string() + ": " + std::strerror(errno));
+    }
+
+    std::size_t allocation = (buffer_size + buffer_alignment - 1) / buffer_alignment * buffer_alignment;
+    for (std::size_t i = 0; i < buffer_count; i++) {
+        auto buffer = (std::uint8_t*)std::aligned_alloc(buffer_alignment, allocation);
+        if (!buffer) {
+            release();
+            throw std::bad_alloc();
+        }
+        buffers.push_back(buffer);
+    }
+
+#ifdef __linux__
+    if (backend != IoBackend::Threads) {
+        try {
+            io = std::make_unique<UringIo>(fd, buffers, buffer_size);
+            backend_ = IoBackend::IoUring;
+        } catch (const IoError&) {
+            if (backend == IoBackend::IoUring) {
+                release();
+                throw;
+            }
+        }
+    }
+#else
+    if (backend == IoBackend::IoUring) {
+        release();
+        throw IoError("io_uring unavailable");
+    }
+#endif
+    if (!io) {
+        io = std::make_unique<ThreadIo>(fd, buffer_count);
+        backend_ = IoBackend::Threads;
+    }
+}
+
+AsyncFile::~AsyncFile() {
+    for (std::size_t i = 0; i < buffers.size(); i++) {
+        if (pending_[i]) {
+            try {
+                wait(i);
+            } catch (const IoError&) {}
+        }
+    }
+    release();
+}
+
+void AsyncFile::release() {
+    io.reset();
+    for (std::uint8_t* buffer: buffers) {
+        std::free(buffer);
+    }
+    buffers.clear();
+    ::close(fd);
+}
+
+void AsyncFile::write(std::size_t buffer, std::size_t size, std::uint64_t offset) {
+    submit(true, buffer, size, offset);
+}
+
+void AsyncFile::read(std::size_t buffer, std::size_t size, std::uint64_t offset) {
+    submit(false, buffer, size, offset);
+}
+
+void AsyncFile::submit(bool write, std::size_t buffer, std::size_t size, std::uint64_t offset) {
+    if (pending_[buffer] || size > buffer_size_) {
+        throw IoError("Invalid request");
+    }
+    requests[buffer] = Request{write, size, offset};
+    io->submit(write, buffer, buffers[buffer], size, offset);
+    pending_[buffer] = true;
+}
+
+std::size_t AsyncFile::wait(std::size_t buffer) {
+    if (!pending_[buffer]) {
+        return 0;
+    }
+    std::int64_t result = io->wait(buffer);
+    pending_[buffer] = false;
+    const Request& request = requests[buffer];
+    if (result >= 0 && std::size_t(result) < request.size && result != 0) {
+        // io_uring may complete part of a request, so finish the rest here
+        std::int64_t rest = blocking_io(
+            request.write, fd,
+            buffers[buffer] + result, request.size - result, request.offset + result);
+        result = rest < 0 ? rest : result + rest;
+    }
+    if (result < 0) {
+        throw IoError(std::string(request.write ? "Write" : "Read") + " failed: " + std::strerror(-result));
+    }
+    if (request.write && std::size_t(result) != request.size) {
+        throw IoError("Incomplete write");
+    }
+    return result;
+}
+
+} // namespace datapack
@@ -0,0 +1,649 @@
+#include "datapack/util/journal.hpp"
+#include "datapack/encode/varint.hpp"
+#include <cstring>
+
+
+namespace datapack {
+
+// File: sequence of [size (u64) | payload], where the first payload is a
+// checkpoint:   [op | tree]
+// and the rest are entries:
+//   assign:     [op | path | value]
+//   insert:     [op | path | key | value]
+//   push_back:  [op | path | value]
+//   erase:      [op | path]
+//   clear:      [op | path]
+//   splice:     [op | path | has key | key? | tree]
+//   move:       [op | path | parent path | has key | key?]
+// A checkpoint after the first replaces the whole object.
+// A path is a varint count followed by the varint position of each node
+// within its parent. A value is a tag followed by its data, and in a tree,
+// maps and lists are followed by their children, with keys for maps.
+
+enum class JournalOp: std::uint8_t {
+    Checkpoint,
+    Assign,
+    Insert,
+    PushBack,
+    PushBackPacked,
+    Erase,
+    Clear,
+    Splice,
+    Move
+};
+
+enum class ValueTag: std::uint8_t {
+    Null,
+    Integer,
+    Floating,
+    Bool,
+    String,
+    Binary,
+    Map,  // Followed by the child count
+    List, // Followed by the child count
+    IntegerArray,
+    FloatingArray
+};
+
+// ===========================================================================
+// Encoding
+
+static void write_integer(std::vector<std::uint8_t>& output, Object::integer_t value) {
+    // Zigzag, so small negative values are short
+    write_varint(output, zigzag(value));
+}
+
+static void write_floating(std::vector<std::uint8_t>& output, Object::floating_t value) {
+    std::uint8_t bytes[sizeof(value)];
+    std::memcpy(bytes, &value, sizeof(value));
+    output.insert(output.end(), bytes, bytes + sizeof(value));
+}
+
+static void write_bytes(std::vector<std::uint8_t>& output, const void* data, std::size_t size) {
+    write_varint(output, size);
+    output.insert(output.end(), (const std::uint8_t*)data, (const std::uint8_t*)data + size);
+}
+
+static void write_tag(std::vector<std::uint8_t>& output, ValueTag tag) {
+    output.push_back(std::uint8_t(tag));
+}
+
+// Maps and lists are written with the given child count
+static void write_value(std::vector<std::uint8_t>& output, const Object::value_t& value, std::size_t count = 0) {
+    if (std::get_if<Object::null_t>(&value)) {
+        write_tag(output, ValueTag::Null);
+    } else if (auto integer = std::get_if<Object::integer_t>(&value)) {
+        write_tag(output, ValueTag::Integer);
+        write_integer(output, *integer);
+    } else if (auto floating = std::get_if<Object::floating_t>(&value)) {
+        write_tag(output, ValueTag::Floating);
+        write_floating(output, *floating);
+    } else if (auto boolean = std::get_if<bool>(&value)) {
+        write_tag(output, ValueTag::Bool);
+        output.push_back(*boolean);
+    } else if (auto string = std::get_if<std::string>(&value)) {
+        write_tag(output, ValueTag::String);
+        write_bytes(output, string->data(), string->size());
+    } else if (auto binary = std::get_if<Object::binary_t>(&value)) {
+        write_tag(output, ValueTag::Binary);
+        write_bytes(output, binary->data(), binary->size());
+    } else if (std::get_if<Object::map_t>(&value)) {
+        write_tag(output, ValueTag::Map);
+        write_varint(output, count);
+    } else if (std::get_if<Object::list_t>(&value)) {
+        write_tag(output, ValueTag::List);
+        write_varint(output, count);
+    } else if (auto array = std::get_if<Object::integer_array_t>(&value)) {
+        write_tag(output, ValueTag::IntegerArray);
+        write_varint(output, array->size());
+        for (auto element: *array) {
+            write_integer(output, element);
+        }
+    } else if (auto array = std::get_if<Object::floating_array_t>(&value)) {
+        write_tag(output, ValueTag::FloatingArray);
+        write_varint(output, array->size());
+        for (auto element: *array) {
+            write_floating(output, element);
+        }
+    }
+}
+
+static void write_tree(std::vector<std::uint8_t>& output, Object::ConstReference root) {
+    // For each map or list being written, whether it's a map
+    std::vector<bool> is_map;
+    for (auto cursor = Object::ConstCursor(root); cursor; cursor.next()) {
+        auto node = cursor.iter();
+        bool container = node->is_map() || (node->is_list() && !node->is_packed());
+        if (!cursor.entering()) {
+            is_map.pop_back();
+            continue;
+        }
+        if (!is_map.empty() && is_map.back()) {
+            write_bytes(output, node->key().data(), node->key().size());
+        }
+        write_value(output, node->value(), container ? node->size() : 0);
+        if (container) {
+            is_map.push_back(node->is_map());
+        }
+    }
+}
+
+// ===========================================================================
+// Decoding
+
+class Decoder {
+public:
+    Decoder(const std::uint8_t* data, std::size_t size):
+        pos(data),
+        end(data + size)
+    {}
+
+    bool done() const {
+        return pos == end;
+    }
+
+    std::uint8_t byte() {
+        check(1);
+        return *pos++;
+    }
+
+    std::uint64_t varint() {
+        std::uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            std::uint8_t next = byte();
+            value |= std::uint64_t(next & 0x7F) << shift;
+            if (!(next & 0x80)) {
+                return value;
+            }
+        }
+        throw JournalError("Invalid journal varint");
+    }
+
+    Object::integer_t integer() {
+        return unzigzag(varint());
+    }
+
+    Object::floating_t floating() {
+        check(sizeof(Object::floating_t));
+        Object::floating_t value;
+        std::memcpy(&value, pos, sizeof(value));
+        pos += sizeof(value);
+        return value;
+    }
+
+    std::string string() {
+        std::uint64_t size = varint();
+        check(size);
+        std::string value((const char*)pos, size);
+        pos += size;
+        return value;
+    }
+
+    Object::binary_t binary() {
+        std::uint64_t size = varint();
+        check(size);
+        Object::binary_t value(pos, pos + size);
+        pos += size;
+        return value;
+    }
+
+    // Maps and lists also give their child count
+    Object::value_t value(std::uint64_t& count) {
+        count = 0;
+        switch (ValueTag(byte())) {
+        case ValueTag::Null:
+            return Object::null_t();
+        case ValueTag::Integer:
+            return integer();
+        case ValueTag::Floating:
+            return floating();
+        case ValueTag::Bool:
+            return bool(byte());
+        case ValueTag::String:
+            return string();
+        case ValueTag::Binary:
+            return binary();
+        case ValueTag::Map:
+            count = varint();
+            return Object::map_t();
+        case ValueTag::List:
+            count = varint();
+            return Object::list_t();
+        case ValueTag::IntegerArray: {
+            Object::integer_array_t array(array_size(1));
+            for (auto& element: array) {
+                element = integer();
+            }
+            return array;
+        }
+        case ValueTag::FloatingArray: {
+            Object::floating_array_t array(array_size(sizeof(Object::floating_t)));
+            for (auto& element: array) {
+                element = floating();
+            }
+            return array;
+        }
+        }
+        throw JournalError("Invalid journal value");
+    }
+
+    Object::value_t value() {
+        std::uint64_t count;
+        Object::value_t result = value(count);
+        if (count != 0) {
+            throw JournalError("Invalid journal value");
+        }
+        return result;
+    }
+
+    Object tree() {
+        Object result;
+        std::uint64_t count;
+        result = value(count);
+
+        struct Parent {
+            Object::Iterator iter;
+            bool is_map;
+            std::uint64_t remaining;
+        };
+        std::vector<Parent> parents;
+        if (count != 0) {
+            parents.push_back({result.iter(), result.is_map(), count});
+        }
+        while (!parents.empty()) {
+            Parent& parent = parents.back();
+            if (parent.remaining == 0) {
+                parents.pop_back();
+                continue;
+            }
+            parent.remaining--;
+            Object::Iterator child;
+            if (parent.is_map) {
+                std::string key = string();
+                child = parent.iter->insert(key, value(count));
+            } else {
+                child = parent.iter->push_back(value(count));
+            }
+            if (count != 0) {
+                parents.push_back({child, child->is_map(), count});
+            }
+        }
+        return result;
+    }
+
+    Object::Iterator path(Object& object) {
+        Object::Iterator iter = object.iter();
+        std::uint64_t depth = varint();
+        for (std::uint64_t i = 0; i < depth; i++) {
+            iter = iter.child();
+            for (std::uint64_t position = varint(); iter && position > 0; position--) {
+                iter = iter.next();
+            }
+            if (!iter) {
+                throw JournalError("Journal entry refers to a missing node");
+            }
+        }
+        return iter;
+    }
+
+private:
+    void check(std::uint64_t size) const {
+        if (size > std::uint64_t(end - pos)) {
+            throw JournalError("Journal entry is truncated");
+        }
+    }
+
+    // Checks the data has room for the elements before allocating
+    std::uint64_t array_size(std::size_t min_element_size) {
+        std::uint64_t size = varint();
+        if (size > std::uint64_t(end - pos) / min_element_size) {
+            throw JournalError("Journal entry is truncated");
+        }
+        return size;
+    }
+
+    const std::uint8_t* pos;
+    const std::uint8_t* end;
+};
+
+static void apply_entry(Object& object, JournalOp op, Decoder& decoder) {
+    auto iter = decoder.path(object);
+    switch (op) {
+    case JournalOp::Assign:
+        *iter = decoder.value();
+        break;
+    case JournalOp::Insert: {
+        std::string key = decoder.string();
+        iter->insert(key, decoder.value());
+        break;
+    }
+    case JournalOp::PushBack:
+        iter->push_back(decoder.value());
+        break;
+    case JournalOp::PushBackPacked:
+        iter->push_back_packed(decoder.value());
+        break;
+    case JournalOp::Erase:
+        iter->erase();
+        break;
+    case JournalOp::Clear:
+        iter->clear();
+        break;
+    case JournalOp::Splice: {
+        bool has_key = decoder.byte();
+        std::string key = has_key ? decoder.string() : "";
+        Object source = decoder.tree();
+        if (has_key) {
+            iter->splice(key, std::move(source));
+        } else {
+            iter->splice(std::move(source));
+        }
+        break;
+    }
+    case JournalOp::Move: {
+        auto parent = decoder.path(object);
+        if (decoder.byte()) {
+            iter->move_to(*parent, decoder.string());
+        } else {
+            iter->move_to(*parent);
+        }
+        break;
+    }
+    default:
+        throw JournalError("Invalid journal entry");
+    }
+}
+
+Object load_journal(const std::filesystem::path& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        throw JournalError("Failed to open " + path.string());
+    }
+    std::vector<std::uint8_t> data(
+        (std::istreambuf_iterator<char>(file)),
+        std::istreambuf_iterator<char>());
+
+    Object result;
+    bool loaded = false;
+    std::size_t pos = 0;
+    while (data.size() - pos >= sizeof(std::uint64_t)) {
+        std::uint64_t size;
+        std::memcpy(&size, &data[pos], sizeof(size));
+        pos += sizeof(size);
+        if (size > data.size() - pos) {
+            break;
+        }
+        Decoder decoder(&data[pos], size);
+        pos += size;
+
+        auto op = JournalOp(decoder.byte());
+        if (op == JournalOp::Checkpoint) {
+            result = decoder.tree();
+            loaded = true;
+        } else if (!loaded) {
+            throw JournalError("Journal doesn't start with a checkpoint");
+        } else {
+            try {
+                apply_entry(result, op, decoder);
+            } catch (const Object::LookupException& e) {
+                throw JournalError(std::string("Journal entry can't be applied: ") + e.what());
+            } catch (const Object::ValueException& e) {
+                throw JournalError(std::string("Journal entry can't be applied: ") + e.what());
+            }
+        }
+        if (!decoder.done()) {
+            throw JournalError("Journal entry has trailing data");
+        }
+    }
+    if (!loaded) {
+        throw JournalError("Journal doesn't start with a checkpoint");
+    }
+    return result;
+}
+
+// ===========================================================================
+// Journal
+
+static void begin_frame(std::vector<std::uint8_t>& output, JournalOp op) {
+    output.resize(output.size() + sizeof(std::uint64_t));
+    output.push_back(std::uint8_t(op));
+}
+
+static void end_frame(std::vector<std::uint8_t>& output, std::size_t begin) {
+    std::uint64_t size = output.size() - begin - sizeof(std::uint64_t);
+    std::memcpy(&output[begin], &size, sizeof(size));
+}
+
+Journal::Journal(const std::filesystem::path& path, Object& object, const JournalOptions& options):
+    path(path),
+    object(object),
+    options(options),
+    entry_begin(0)
+{
+    if (object.journal_link.journal) {
+        throw JournalError("Object already has a journal");
+    }
+    compact();
+    stats_.compactions = 0;
+    object.journal_link.journal = this;
+}
+
+Journal::~Journal() {
+    try {
+        flush();
+    } catch (const JournalError&) {}
+    object.journal_link.journal = nullptr;
+}
+
+void Journal::flush() {
+    if (options.compact_ratio > 0 && stats_.entry_bytes > options.compact_ratio * stats_.checkpoint_bytes) {
+        compact();
+        return;
+    }
+    write_buffer();
+    file.flush();
+    if (!file) {
+        throw JournalError("Failed to write " + path.string());
+    }
+}
+
+void Journal::compact() {
+    std::vector<std::uint8_t> checkpoint;
+    begin_frame(checkpoint, JournalOp::Checkpoint);
+    write_tree(checkpoint, object);
+    end_frame(checkpoint, 0);
+
+    auto temp_path = path;
+    temp_path += ".tmp";
+    {
+        std::ofstream temp(temp_path, std::ios::binary | std::ios::trunc);
+        temp.write((const char*)checkpoint.data(), checkpoint.size());
+        if (!temp) {
+            throw JournalError("Failed to write " + temp_path.string());
+        }
+    }
+    file.close();
+    std::filesystem::rename(temp_path, path);
+    file.open(path, std::ios::binary | std::ios::app);
+    if (!file.is_open()) {
+        throw JournalError("Failed to open " + path.string());
+    }
+
+    buffer.clear();
+    stats_.entries = 0;
+    stats_.entry_bytes = 0;
+    stats_.checkpoint_bytes = checkpoint.size();
+    stats_.compactions++;
+}
+
+void Journal::write_buffer() {
+    file.write((const char*)buffer.data(), buffer.size());
+    buffer.clear();
+}
+
+void Journal::begin_entry(std::uint8_t op, int index) {
+    entry_begin = buffer.size();
+    begin_frame(buffer, JournalOp(op));
+    write_path(index);
+}
+
+void Journal::write_path(int index) {
+    path_buffer.clear();
+    while (index != object.root_index) {
+        path_buffer.push_back(position(index));
+        index = object.nodes[index].parent;
+    }
+    write_varint(buffer, path_buffer.size());
+    for (auto iter = path_buffer.rbegin(); iter != path_buffer.rend(); iter++) {
+        write_varint(buffer, *iter);
+    }
+}
+
+// Sum of the first "size" entries
+static std::int64_t fenwick_sum(const std::vector<std::int64_t>& tree, std::size_t size) {
+    std::int64_t sum = 0;
+    for (; size > 0; size &= size - 1) {
+        sum += tree[size - 1];
+    }
+    return sum;
+}
+
+static void fenwick_add(std::vector<std::int64_t>& tree, std::size_t i, std::int64_t value) {
+    for (i++; i <= tree.size(); i += i & (~i + 1)) {
+        tree[i - 1] += value;
+    }
+}
+
+static void fenwick_push_back(std::vector<std::int64_t>& tree, std::int64_t value) {
+    std::size_t i = tree.size() + 1;
+    tree.push_back(value + fenwick_sum(tree, i - 1) - fenwick_sum(tree, i - (i & (~i + 1))));
+}
+
+Journal::Siblings& Journal::siblings_of(int parent) {
+    auto [iter, inserted] = siblings.try_emplace(parent);
+    Siblings& result = iter->second;
+    if (inserted) {
+        if (sequence.size() < object.nodes.size()) {
+            sequence.resize(object.nodes.size());
+        }
+        for (int child = object.nodes[parent].child; child != -1; child = object.nodes[child].next) {
+            sequence[child] = result.tree.size();
+            fenwick_push_back(result.tree, 1);
+        }
+        result.count = result.tree.size();
+    }
+    return result;
+}
+
+std::uint64_t Journal::position(int index) {
+    const Siblings& parent = siblings_of(object.nodes[index].parent);
+    return fenwick_sum(parent.tree, sequence[index]);
+}
+
+void Journal::link_node(int parent, int index) {
+    auto iter = siblings.find(parent);
+    if (iter == siblings.end()) {
+        return;
+    }
+    if (sequence.size() < object.nodes.size()) {
+        sequence.resize(object.nodes.size());
+    }
+    sequence[index] = iter->second.tree.size();
+    fenwick_push_back(iter->second.tree, 1);
+    iter->second.count++;
+}
+
+void Journal::unlink_node(int index) {
+    auto iter = siblings.find(object.nodes[index].parent);
+    if (iter == siblings.end()) {
+        return;
+    }
+    Siblings& parent = iter->second;
+    fenwick_add(parent.tree, sequence[index], -1);
+    parent.count--;
+    // Rebuilt when next needed, so the tree stays proportional to the
+    // number of children
+    if (parent.tree.size() > 2 * parent.count + 16) {
+        siblings.erase(iter);
+    }
+}
+
+void Journal::free_node(int index) {
+    siblings.erase(index);
+}
+
+void Journal::reset_nodes() {
+    siblings.clear();
+}
+
+// The object is mid-mutation, so the buffer is written without compacting
+void Journal::end_entry() {
+    end_frame(buffer, entry_begin);
+    stats_.entries++;
+    stats_.entry_bytes += buffer.size() - entry_begin;
+    if (buffer.size() >= options.buffer_size) {
+        write_buffer();
+        if (!file) {
+            throw JournalError("Failed to write " + path.string());
+        }
+    }
+}
+
+void Journal::record_assign(int index, const Object::value_t& value) {
+    begin_entry(std::uint8_t(JournalOp::Assign), index);
+    write_value(buffer, value);
+    end_entry();
+}
+
+void Journal::record_insert(int parent, const std::string& key, const Object::value_t& value) {
+    begin_entry(std::uint8_t(JournalOp::Insert), parent);
+    write_bytes(buffer, key.data(), key.size());
+    write_value(buffer, value);
+    end_entry();
+}
+
+void Journal::record_push_back(int parent, const Object::value_t& value, bool packed) {
+    begin_entry(std::uint8_t(packed ? JournalOp::PushBackPacked : JournalOp::PushBack), parent);
+    write_value(buffer, value);
+    end_entry();
+}
+
+void Journal::record_erase(int index) {
+    begin_entry(std::uint8_t(JournalOp::Erase), index);
+    end_entry();
+}
+
+void Journal::record_clear(int index) {
+    begin_entry(std::uint8_t(JournalOp::Clear), index);
+    end_entry();
+}
+
+static void write_optional_key(std::vector<std::uint8_t>& output, const std::string* key) {
+    output.push_back(key != nullptr);
+    if (key) {
+        write_bytes(output, key->data(), key->size());
+    }
+}
+
+void Journal::record_splice(int parent, const std::string* key, Object::ConstReference subtree) {
+    begin_entry(std::uint8_t(JournalOp::Splice), parent);
+    write_optional_key(buffer, key);
+    write_tree(buffer, subtree);
+    end_entry();
+}
+
+void Journal::record_move(int index, int parent, const std::string* key) {
+    begin_entry(std::uint8_t(JournalOp::Move), index);
+    write_path(parent);
+    write_optional_key(buffer, key);
+    end_entry();
+}
+
+void Journal::record_checkpoint() {
+    entry_begin = buffer.size();
+    begin_frame(buffer, JournalOp::Checkpoint);
+    write_tree(buffer, object);
+    end_entry();
+}
+
+} // namespace datapack
@@ -0,0 +1,183 @@
+#include "datapack/util/logger.hpp"
+#include <algorithm>
+#include "datapack/util/object_writer.hpp"
+
+
+namespace datapack {
+
+DATAPACK_IMPL(LogType, value, packer) {
+    packer.object_begin();
+    packer.value("id", value.id);
+    packer.value("name", value.name);
+    packer.value("schema", value.schema);
+    packer.object_end();
+}
+
+// Records with this type id define a type
+static constexpr std::uint32_t type_definition = 0xFFFFFFFF;
+
+// Append only, so the logger can write the new types before each buffer
+static std::mutex log_types_mutex;
+static std::vector<LogType> log_types;
+
+std::uint32_t register_log_type(const char* name, const Schema& schema) {
+    std::scoped_lock lock(log_types_mutex);
+    std::uint32_t id = log_types.size();
+    log_types.push_back(LogType{id, name, schema});
+    return id;
+}
+
+static std::atomic<std::uint64_t> next_logger_id = 1;
+
+Logger::Logger(const std::filesystem::path& path, const LoggerOptions& options):
+    id(next_logger_id++),
+    options(options),
+    writer(path, options.stream),
+    queue(nullptr),
+    submitted(0),
+    stopping(false)
+{
+    worker = std::thread([this]() { run(); });
+}
+
+Logger::~Logger() {
+    {
+        std::scoped_lock lock(threads_mutex);
+        for (auto& [thread, state]: threads) {
+            if (!state.buffer->data.empty()) {
+                submit(state);
+            }
+            delete state.buffer;
+        }
+    }
+    stopping = true;
+    submitted++;
+    submitted.notify_one();
+    worker.join();
+    try {
+        writer.close();
+    } catch (const IoError&) {}
+}
+
+Logger::ThreadState& Logger::register_thread() {
+    std::scoped_lock lock(threads_mutex);
+    auto [iter, inserted] = threads.try_emplace(std::this_thread::get_id());
+    if (inserted) {
+        iter->second.buffer = new_buffer();
+    }
+    return iter->second;
+}
+
+Logger::Buffer* Logger::new_buffer() {
+    Buffer* buffer = new Buffer();
+    // Room for the event that takes the buffer past its size
+    buffer->data.reserve(options.buffer_size + options.buffer_size / 4);
+    return buffer;
+}
+
+void Logger::flush() {
+    ThreadState& state = thread_state();
+    if (!state.buffer->data.empty()) {
+        submit(state);
+    }
+}
+
+void Logger::submit(ThreadState& state) {
+    Buffer* buffer = state.buffer;
+    state.buffer = new_buffer();
+    // Lock-free stack, which the writer takes all at once
+    buffer->next = queue.load(std::memory_order_relaxed);
+    while (!queue.compare_exchange_weak(buffer->next, buffer, std::memory_order_release, std::memory_order_relaxed)) {}
+    submitted.fetch_add(1, std::memory_order_release);
+    submitted.notify_one();
+}
+
+void Logger::run() {
+    std::size_t written_types = 0;
+    std::vector<std::uint8_t> definition;
+    std::vector<Buffer*> buffers;
+    while (true) {
+        std::uint64_t seen = submitted.load(std::memory_order_acquire);
+        Buffer* list = queue.exchange(nullptr, std::memory_order_acquire);
+        if (!list) {
+            if (stopping) {
+                break;
+            }
+            submitted.wait(seen);
+            continue;
+        }
+
+        // Types are registered before their events are encoded, so any
+        // type in these buffers is already registered
+        {
+            std::scoped_lock lock(log_types_mutex);
+            for (; written_types < log_types.size(); written_types++) {
+                definition.assign(sizeof(std::uint32_t) + sizeof(std::uint64_t), 0);
+                std::memcpy(definition.data(), &type_definition, sizeof(type_definition));
+                BinaryWriter(definition).value(log_types[written_types]);
+                writer.write_message(definition);
+            }
+        }
+
+        // The stack is newest first
+        buffers.clear();
+        for (; list; list = list->next) {
+            buffers.push_back(list);
+        }
+        for (auto iter = buffers.rbegin(); iter != buffers.rend(); iter++) {
+            try {
+                writer.write_framed((*iter)->data);
+            } catch (const IoError&) {
+                // Dropped, since there is nowhere to report the error
+            }
+            delete *iter;
+        }
+    }
+}
+
+Object load_log(const std::filesystem::path& path, const BinaryStreamOptions& options) {
+    static constexpr std::size_t header_size = sizeof(std::uint32_t) + sizeof(std::uint64_t);
+
+    BinaryStreamReader reader(path, options);
+    std::unordered_map<std::uint32_t, LogType> types;
+    Object result;
+    result = Object::list_t();
+    std::span<const std::uint8_t> data;
+    while (reader.next(data)) {
+        if (data.size() < header_size) {
+            throw IoError("Invalid log record");
+        }
+        std::uint32_t type_id;
+        std::uint64_t time;
+        std::memcpy(&type_id, data.data(), sizeof(type_id));
+        std::memcpy(&time, data.data() + sizeof(type_id), sizeof(time));
+        auto payload = data.subspan(header_size);
+
+        if (type_id == type_definition) {
+            LogType type;
+            BinaryReader type_reader(payload);
+            type_reader.value(type);
+            if (!type_reader.valid()) {
+                throw IoError("Invalid log type definition");
+            }
+            types[type.id] = type;
+            continue;
+        }
+        auto type = types.find(type_id);
+        if (type == types.end()) {
+            throw IoError("Log record has an unknown type");
+        }
+        auto record = *result.push_back(Object::map_t());
+        record["type"] = type->second.name;
+        record["time"] = Object::integer_t(time);
+        BinaryReader event_reader(payload);
+        ObjectWriter event_writer(record["event"]);
+        use_schema(type->second.schema, event_reader, event_writer);
+        if (!event_reader.valid()) {
+            throw IoError("Log record doesn't match its type");
+        }
+    }
+    return result;
+}
+
+} // namespace datapack
@@ -0,0 +1,192 @@
+#include "datapack/util/metrics.hpp"
+#include "datapack/object.hpp"
+#include <array>
+#include <atomic>
+#include <bit>
+#include <mutex>
+#include <vector>
+
+
+namespace datapack {
+
+#ifdef DATAPACK_METRICS
+
+static const char* metric_op_names[metric_op_count] = {
+    "write_binary",
+    "read_binary",
+    "load_json",
+    "dump_json",
+    "use_schema"
+};
+
+// Bucket i holds latencies below 2^i ns, with the last bucket holding the rest
+static constexpr std::size_t latency_buckets = 40;
+
+// Counters are atomic so that snapshots can read them while the owning
+// thread writes, but only the owning thread writes, so a relaxed load and
+// store is enough to increment them.
+using Counter = std::atomic<std::uint64_t>;
+
+static void increment(Counter& counter, std::uint64_t amount = 1) {
+    counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+struct OpCounters {
+    Counter calls = 0;
+    Counter failed = 0;
+    Counter bytes = 0;
+    Counter total_ns = 0;
+    std::array<Counter, latency_buckets> latency = {};
+};
+
+struct Counters {
+    std::array<OpCounters, metric_op_count> ops;
+    Counter invalidated = 0;
+
+    // Reads another thread's counters, or adds to counters that aren't
+    // being written
+    void add(const Counters& other) {
+        auto add_counter = [](Counter& to, const Counter& from) {
+            to.store(to.load(std::memory_order_relaxed) + from.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        };
+        for (std::size_t i = 0; i < metric_op_count; i++) {
+            add_counter(ops[i].calls, other.ops[i].calls);
+            add_counter(ops[i].failed, other.ops[i].failed);
+            add_counter(ops[i].bytes, other.ops[i].bytes);
+            add_counter(ops[i].total_ns, other.ops[i].total_ns);
+            for (std::size_t j = 0; j < latency_buckets; j++) {
+                add_counter(ops[i].latency[j], other.ops[i].latency[j]);
+            }
+        }
+        add_counter(invalidated, other.invalidated);
+    }
+
+    void reset() {
+        for (auto& op: ops) {
+            op.calls = 0;
+            op.failed = 0;
+            op.bytes = 0;
+            op.total_ns = 0;
+            for (auto& count: op.latency) {
+                count = 0;
+            }
+        }
+        invalidated = 0;
+    }
+};
+
+// Counters of live threads, and the sum of counters of exited threads
+struct Registry {
+    std::mutex mutex;
+    std::vector<Counters*> threads;
+    Counters exited;
+};
+
+static Registry& registry() {
+    // Never destroyed, since threads may exit after static destruction
+    static Registry* registry = new Registry();
+    return *registry;
+}
+
+struct ThreadCounters {
+    Counters counters;
+    ThreadCounters() {
+        auto& registry = datapack::registry();
+        std::scoped_lock lock(registry.mutex);
+        registry.threads.push_back(&counters);
+    }
+    ~ThreadCounters() {
+        auto& registry = datapack::registry();
+        std::scoped_lock lock(registry.mutex);
+        registry.exited.add(counters);
+        std::erase(registry.threads, &counters);
+    }
+};
+
+static Counters& thread_counters() {
+    thread_local ThreadCounters counters;
+    return counters.counters;
+}
+
+void metric_record(MetricOp op, std::size_t bytes, std::uint64_t ns, bool ok) {
+    auto& counters = thread_counters().ops[std::size_t(op)];
+    increment(counters.calls);
+    if (!ok) {
+        increment(counters.failed);
+    }
+    increment(counters.bytes, bytes);
+    increment(counters.total_ns, ns);
+    increment(counters.latency[std::min<std::size_t>(std::bit_width(ns), latency_buckets - 1)]);
+}
+
+void metric_invalidated() {
+    increment(thread_counters().invalidated);
+}
+
+Object metrics_snapshot() {
+    Counters total;
+    {
+        auto& registry = datapack::registry();
+        std::scoped_lock lock(registry.mutex);
+        total.add(registry.exited);
+        for (const Counters* counters: registry.threads) {
+            total.add(*counters);
+        }
+    }
+
+    Object result;
+    result = Object::map_t();
+    for (std::size_t i = 0; i < metric_op_count; i++) {
+        const auto& counters = total.ops[i];
+        auto op = result[metric_op_names[i]];
+        op = Object::map_t();
+        op["calls"] = Object::integer_t(counters.calls);
+        op["failed"] = Object::integer_t(counters.failed);
+        op["bytes"] = Object::integer_t(counters.bytes);
+        op["total_ns"] = Object::integer_t(counters.total_ns);
+        op["latency"] = Object::list_t();
+        for (std::size_t j = 0; j < latency_buckets; j++) {
+            if (counters.latency[j] == 0) {
+                continue;
+            }
+            auto bucket = *op["latency"].push_back(Object::map_t());
+            bucket["max_ns"] = j + 1 < latency_buckets
+                ? Object::integer_t((std::uint64_t(1) << j) - 1)
+                : Object::integer_t(-1);
+            bucket["count"] = Object::integer_t(counters.latency[j]);
+        }
+    }
+    result["invalidated"] = Object::integer_t(total.invalidated);
+    return result;
+}
+
+void metrics_reset() {
+    auto& registry = datapack::registry();
+    std::scoped_lock lock(registry.mutex);
+    registry.exited.reset();
+    for (Counters* counters: registry.threads) {
+        counters->reset();
+    }
+}
+
+bool metrics_enabled() {
+    return true;
+}
+
+#else
+
+Object metrics_snapshot() {
+    Object result;
+    result = Object::map_t();
+    return result;
+}
+
+void metrics_reset() {}
+
+bool metrics_enabled() {
+    return false;
+}
+
+#endif
+
+} // namespace datapack
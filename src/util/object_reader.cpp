@@ -1,18 +1,44 @@
 #include "datapack/util/object_reader.hpp"
 #include "datapack/encode/base64.hpp"
+#include "datapack/util/simd.hpp"
+#include <cmath>
+#include <limits>
+#include <utility>
 
 
 namespace datapack {
 
-ObjectReader::ObjectReader(Object::ConstReference object):
+ObjectReader::ObjectReader(Object::ConstReference object, bool validate_utf8):
     node(object.iter()),
     list_start(false),
-    next_variant_label(nullptr)
+    next_variant_label(nullptr),
+    packed_index(no_packed_index),
+    validate_utf8(validate_utf8)
 {}
 
+const Object::integer_t* ObjectReader::packed_integer() const {
+    auto array = node->integer_array_if();
+    if (!array || packed_index >= array->size()) {
+        return nullptr;
+    }
+    return &(*array)[packed_index];
+}
+
+const Object::floating_t* ObjectReader::packed_floating() const {
+    auto array = node->floating_array_if();
+    if (!array || packed_index >= array->size()) {
+        return nullptr;
+    }
+    return &(*array)[packed_index];
+}
+
 void ObjectReader::integer(IntType type, void* value) {
     std::int64_t integer_value;
-    if (auto x = node->integer_if()) {
+    if (auto x = (packed_index != no_packed_index ? packed_integer() : node->integer_if())) {
+        integer_value = *x;
+    } else if (auto x = (packed_index != no_packed_index ? packed_floating() : nullptr);
+            x && std::trunc(*x) == *x && std::abs(*x) < 0x1p63) {
+        // Integers may be stored in a packed floating array
         integer_value = *x;
     } else {
         invalidate();
@@ -39,9 +65,9 @@ void ObjectReader::integer(IntType type, void* value) {
 
 void ObjectReader::floating(FloatType type, void* value) {
     double floating_value;
-    if (auto x = node->floating_if()) {
+    if (auto x = (packed_index != no_packed_index ? packed_floating() : node->floating_if())) {
         floating_value = *x;
-    } else if (auto x = node->integer_if()) {
+    } else if (auto x = (packed_index != no_packed_index ? packed_integer() : node->integer_if())) {
         floating_value = *x;
     } else {
         invalidate();
@@ -67,6 +93,10 @@ bool ObjectReader::boolean() {
 
 const char* ObjectReader::string() {
     if (auto x = node->string_if()) {
+        if (validate_utf8 && !simd_kernels().validate_utf8(x->data(), x->size())) {
+            invalidate();
+            return nullptr;
+        }
         return x->c_str();
     }
     invalidate();
@@ -88,12 +118,97 @@ int ObjectReader::enumerate(const std::span<const char*>& labels) {
     return 0;
 }
 
+// Whether a packed element fits in the element type being read. Integers
+// may be stored in floating arrays, see Object::push_back_packed.
+template <typename T, typename Element>
+static bool packed_fits(Element value) {
+    if constexpr (std::is_floating_point_v<T>) {
+        return !std::isfinite(value) || std::abs(value) <= std::numeric_limits<T>::max();
+    } else if constexpr (std::is_floating_point_v<Element>) {
+        return std::trunc(value) == value
+            && value >= double(std::numeric_limits<T>::min())
+            && value < 2 * (double(std::numeric_limits<T>::max() / 2 + 1));
+    } else {
+        return std::in_range<T>(value);
+    }
+}
+
+template <typename T>
+std::tuple<const std::uint8_t*, std::size_t> ObjectReader::packed_array(std::size_t length) {
+    auto read = [&](const auto& array) -> std::tuple<const std::uint8_t*, std::size_t> {
+        if (length != 0 && length != array.size()) {
+            invalidate();
+            return { nullptr, 0 };
+        }
+        using element_t = typename std::decay_t<decltype(array)>::value_type;
+        if constexpr (sizeof(T) == sizeof(element_t) && std::is_floating_point_v<T> == std::is_floating_point_v<element_t>) {
+            // Signed and unsigned 64-bit integers share the same storage,
+            // as with integer()
+            return { (const std::uint8_t*)array.data(), array.size() };
+        } else {
+            data_temp.resize(array.size() * sizeof(T));
+            T* output = (T*)data_temp.data();
+            for (std::size_t i = 0; i < array.size(); i++) {
+                if (!packed_fits<T>(array[i])) {
+                    invalidate();
+                    return { nullptr, 0 };
+                }
+                output[i] = array[i];
+            }
+            return { data_temp.data(), array.size() };
+        }
+    };
+    if (auto x = node->integer_array_if()) {
+        return read(*x);
+    }
+    return read(*node->floating_array_if());
+}
+
+std::tuple<const std::uint8_t*, std::size_t> ObjectReader::integer_array(IntType type, std::size_t length) {
+    if (packed_index != no_packed_index || !node->is_packed()) {
+        return binary(length, int_type_size(type));
+    }
+    switch (type) {
+        case IntType::I32:
+            return packed_array<std::int32_t>(length);
+        case IntType::I64:
+            return packed_array<std::int64_t>(length);
+        case IntType::U32:
+            return packed_array<std::uint32_t>(length);
+        case IntType::U64:
+            return packed_array<std::uint64_t>(length);
+        case IntType::U8:
+            return packed_array<std::uint8_t>(length);
+    }
+    invalidate();
+    return { nullptr, 0 };
+}
+
+std::tuple<const std::uint8_t*, std::size_t> ObjectReader::floating_array(FloatType type, std::size_t length) {
+    if (packed_index != no_packed_index || !node->is_packed()) {
+        return binary(length, float_type_size(type));
+    }
+    switch (type) {
+        case FloatType::F32:
+            return packed_array<float>(length);
+        case FloatType::F64:
+            return packed_array<double>(length);
+    }
+    invalidate();
+    return { nullptr, 0 };
+}
+
 std::tuple<const std::uint8_t*, std::size_t> ObjectReader::binary(
     std::size_t length, std::size_t stride)
 {
     const std::uint8_t* data = nullptr;
     std::size_t size = 0;
 
+    if (packed_index != no_packed_index) {
+        invalidate();
+        return { nullptr, 0 };
+    }
+
     if (auto x = node->binary_if()) {
         if (x->size() % stride != 0) {
             invalidate();
@@ -162,6 +277,10 @@ void ObjectReader::variant_end() {
 
 void ObjectReader::object_begin(std::size_t size) {
     nodes.push(node);
+    if (packed_index != no_packed_index) {
+        invalidate();
+        return;
+    }
     node = node.child();
 }
 
@@ -180,6 +299,15 @@ void ObjectReader::object_next(const char* key) {
         invalidate();
         return;
     }
+    // Fields are usually read in the order they were written, so check the
+    // current and following node before searching the map
+    if (node->key() == key) {
+        return;
+    }
+    if (auto next = node.next(); next && next->key() == key) {
+        node = next;
+        return;
+    }
     auto next = parent->find(std::string(key));
     if (!next) {
         invalidate();
@@ -190,16 +318,30 @@ void ObjectReader::object_next(const char* key) {
 
 
 void ObjectReader::tuple_begin(std::size_t size) {
-    if (!node->is_list()) {
+    if (!node->is_list() || packed_index != no_packed_index) {
         invalidate();
         return;
     }
     list_start = true;
     nodes.push(node);
+    if (node->is_packed()) {
+        packed_index = 0;
+        return;
+    }
     node = node.child();
 }
 
 void ObjectReader::tuple_next() {
+    if (packed_index != no_packed_index) {
+        if (!list_start) {
+            packed_index++;
+        }
+        list_start = false;
+        if (packed_index >= node->size()) {
+            invalidate();
+        }
+        return;
+    }
     if (!list_start) {
         node = node.next();
     }
@@ -212,22 +354,34 @@ void ObjectReader::tuple_next() {
 
 void ObjectReader::tuple_end(std::size_t size) {
     list_start = false;
+    packed_index = no_packed_index;
     node = nodes.top();
     nodes.pop();
 }
 
 
 void ObjectReader::list_begin(bool is_trivial) {
-    if (!node->is_list()) {
+    if (!node->is_list() || packed_index != no_packed_index) {
         invalidate();
         return;
     }
     list_start = true;
     nodes.push(node);
+    if (node->is_packed()) {
+        packed_index = 0;
+        return;
+    }
     node = node.child();
 }
 
 bool ObjectReader::list_next() {
+    if (packed_index != no_packed_index) {
+        if (!list_start) {
+            packed_index++;
+        }
+        list_start = false;
+        return packed_index < node->size();
+    }
     if (!list_start) {
         node = node.next();
     }
@@ -237,6 +391,7 @@ bool ObjectReader::list_next() {
 
 void ObjectReader::list_end() {
     list_start = false;
+    packed_index = no_packed_index;
     node = nodes.top();
     nodes.pop();
 }
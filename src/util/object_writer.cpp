@@ -5,10 +5,14 @@
 
 namespace datapack {
 
-ObjectWriter::ObjectWriter(Object::Reference object):
+ObjectWriter::ObjectWriter(Object::Reference object, bool dedupe):
     object(object),
     next_stride(0)
-{}
+{
+    if (dedupe) {
+        deduper.emplace();
+    }
+}
 
 
 void ObjectWriter::integer(IntType type, const void* value) {
@@ -91,7 +95,7 @@ void ObjectWriter::object_begin(std::size_t size) {
 }
 
 void ObjectWriter::object_end(std::size_t size) {
-    nodes.pop();
+    end_node();
 }
 
 void ObjectWriter::object_next(const char* key) {
@@ -104,7 +108,7 @@ void ObjectWriter::tuple_begin(std::size_t size) {
 }
 
 void ObjectWriter::tuple_end(std::size_t size) {
-    nodes.pop();
+    end_node();
 }
 
 void ObjectWriter::tuple_next() {
@@ -117,7 +121,7 @@ void ObjectWriter::list_begin(bool is_trivial) {
 }
 
 void ObjectWriter::list_end() {
-    nodes.pop();
+    end_node();
 }
 
 void ObjectWriter::list_next() {
@@ -125,6 +129,13 @@ void ObjectWriter::list_next() {
 }
 
 
+void ObjectWriter::end_node() {
+    if (deduper) {
+        deduper->add(*nodes.top());
+    }
+    nodes.pop();
+}
+
 void ObjectWriter::set_value(const Object::value_t& value) {
     Object::Iterator next;
 
@@ -136,6 +147,12 @@ void ObjectWriter::set_value(const Object::value_t& value) {
         if (node->is_map()) {
             next = node->insert(next_key, value);
         } else if (node->is_list()) {
+            // Numbers are appended without creating a node, so the list
+            // is packed if all the numbers have the same type
+            if (std::get_if<Object::integer_t>(&value) || std::get_if<Object::floating_t>(&value)) {
+                node->push_back_packed(value);
+                return;
+            }
             next = node->push_back(value);
         } else {
             throw std::runtime_error("Shouldn't reach here");
@@ -1,21 +1,50 @@
 #include "datapack/util/random.hpp"
+#include <cstdlib>
 #include <cstring>
 
 namespace datapack {
 
-RandomReader::RandomReader()
+RandomReader::RandomReader():
+    RandomReader(rand())
 {}
 
+RandomReader::RandomReader(std::uint64_t seed, const RandomOptions& options):
+    options(options),
+    state(seed)
+{}
+
+// splitmix64, which is cheap enough that generation is limited by the writer
+std::uint64_t RandomReader::next() {
+    std::uint64_t z = (state += 0x9E3779B97F4A7C15);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+    return z ^ (z >> 31);
+}
+
+std::uint64_t RandomReader::uniform(std::uint64_t min, std::uint64_t max) {
+    if (max <= min) {
+        return min;
+    }
+    std::uint64_t range = max - min + 1;
+    return range == 0 ? next() : min + next() % range;
+}
+
+double RandomReader::unit() {
+    return double(next() >> 11) / double(std::uint64_t(1) << 53);
+}
+
 void RandomReader::integer(IntType type, void* value) {
     std::int64_t integer_value;
     if (auto c = constraint<RangeConstraint>()) {
-        integer_value = std::int64_t(c->lower) + rand() % std::int64_t(c->upper - c->lower);
+        std::int64_t lower = c->lower;
+        std::int64_t upper = c->upper;
+        integer_value = lower + std::int64_t(uniform(0, upper > lower ? upper - lower - 1 : 0));
     } else if (type == IntType::U8) {
-        integer_value = rand() % 256;
+        integer_value = uniform(0, 255);
     } else if (type == IntType::I32 || type == IntType::I64){
-        integer_value = -100 + rand() % 200;
+        integer_value = -100 + std::int64_t(uniform(0, 199));
     } else {
-        integer_value = rand() % 100;
+        integer_value = uniform(0, 99);
     }
     switch (type) {
         case IntType::I32:
@@ -39,9 +68,9 @@ void RandomReader::integer(IntType type, void* value) {
 void RandomReader::floating(FloatType type, void* value) {
     double floating_value;
     if (auto c = constraint<RangeConstraint>()) {
-        floating_value = c->lower + (c->upper - c->lower) * rand() / RAND_MAX;
+        floating_value = c->lower + (c->upper - c->lower) * unit();
     } else {
-        floating_value = double(rand()) / RAND_MAX;
+        floating_value = unit();
     }
     switch (type) {
         case FloatType::F32:
@@ -54,33 +83,32 @@ void RandomReader::floating(FloatType type, void* value) {
 }
 
 bool RandomReader::boolean() {
-    return (rand() % 2) == 1;
+    return next() & 1;
 }
 
 const char* RandomReader::string() {
-    // Length: [4, 20]
     // Characters ~ { a, ..., z }
     if (auto c = constraint<LengthConstraint>()) {
         string_temp.resize(c->length);
     } else {
-        string_temp.resize(4 + rand() % 17);
+        string_temp.resize(uniform(options.min_string_length, options.max_string_length));
     }
     for (auto& c: string_temp) {
-        c = 'a' + rand() % 26;
+        c = 'a' + next() % 26;
     }
     return string_temp.c_str();
 }
 
 int RandomReader::enumerate(const std::span<const char*>& labels) {
-    return rand() % labels.size();
+    return next() % labels.size();
 }
 
 bool RandomReader::optional_begin() {
-    return rand() % 2 == 1;
+    return unit() < options.optional_probability;
 }
 
 int RandomReader::variant_begin(const std::span<const char*>& labels) {
-    return rand() % labels.size();
+    return next() % labels.size();
 }
 
 std::tuple<const std::uint8_t*, std::size_t> RandomReader::binary(
@@ -88,18 +116,23 @@ std::tuple<const std::uint8_t*, std::size_t> RandomReader::binary(
     std::size_t stride)
 {
     if (length == 0) {
-        length = rand() % 100;
+        length = uniform(options.min_binary_length, options.max_binary_length);
     }
     std::size_t size = length * stride;
     data_temp.resize(size);
-    for (std::size_t i = 0; i < size; i++) {
-        data_temp[i] = rand() % 256;
+    std::size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        std::uint64_t bytes = next();
+        std::memcpy(&data_temp[i], &bytes, 8);
+    }
+    for (; i < size; i++) {
+        data_temp[i] = next();
     }
-    return { data_temp.data(), data_temp.size() };
+    return { data_temp.data(), length };
 }
 
 void RandomReader::list_begin(bool is_trivial) {
-    list_counters.push(rand() % 10);
+    list_counters.push(uniform(options.min_list_length, options.max_list_length));
 }
 
 bool RandomReader::list_next() {
@@ -0,0 +1,815 @@
+#include "datapack/util/simd.hpp"
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define DATAPACK_SIMD_X86
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define DATAPACK_SIMD_NEON
+#include <arm_neon.h>
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+
+namespace datapack {
+
+// ===========================================================================
+// Scalar
+
+static bool is_whitespace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static std::size_t find_quote_scalar(const char* data, std::size_t size) {
+    for (std::size_t i = 0; i < size; i++) {
+        if (data[i] == '"') {
+            return i;
+        }
+    }
+    return size;
+}
+
+static std::size_t skip_whitespace_scalar(const char* data, std::size_t size) {
+    for (std::size_t i = 0; i < size; i++) {
+        if (!is_whitespace(data[i])) {
+            return i;
+        }
+    }
+    return size;
+}
+
+static void pack_block_scalar(const std::uint32_t* input, int width, std::uint8_t* output) {
+    std::uint32_t words[4 * 32];
+    for (int lane = 0; lane < 4; lane++) {
+        std::uint64_t buffer = 0;
+        int bits = 0;
+        int word = 0;
+        for (int i = 0; i < 32; i++) {
+            buffer |= std::uint64_t(input[4 * i + lane]) << bits;
+            bits += width;
+            if (bits >= 32) {
+                words[4 * word + lane] = buffer;
+                word++;
+                buffer >>= 32;
+                bits -= 32;
+            }
+        }
+    }
+    std::memcpy(output, words, 16 * width);
+}
+
+static void unpack_block_scalar(const std::uint8_t* input, int width, std::uint32_t* output) {
+    const std::uint64_t mask = (std::uint64_t(1) << width) - 1;
+    for (int lane = 0; lane < 4; lane++) {
+        std::uint64_t buffer = 0;
+        int bits = 0;
+        int word = 0;
+        for (int i = 0; i < 32; i++) {
+            if (bits < width) {
+                std::uint32_t next;
+                std::memcpy(&next, input + 16 * word + 4 * lane, 4);
+                buffer |= std::uint64_t(next) << bits;
+                word++;
+                bits += 32;
+            }
+            output[4 * i + lane] = buffer & mask;
+            buffer >>= width;
+            bits -= width;
+        }
+    }
+}
+
+// Length of the UTF-8 sequence at data, or 0 if invalid (RFC 3629: no
+// overlong forms, surrogates or values above U+10FFFF)
+static std::size_t utf8_sequence(const std::uint8_t* data, std::size_t size) {
+    std::uint8_t c = data[0];
+    if (c < 0x80) {
+        return 1;
+    }
+    std::size_t length;
+    std::uint8_t min = 0x80;
+    std::uint8_t max = 0xBF;
+    if (c >= 0xC2 && c <= 0xDF) {
+        length = 2;
+    } else if (c >= 0xE0 && c <= 0xEF) {
+        length = 3;
+        if (c == 0xE0) min = 0xA0;
+        if (c == 0xED) max = 0x9F;
+    } else if (c >= 0xF0 && c <= 0xF4) {
+        length = 4;
+        if (c == 0xF0) min = 0x90;
+        if (c == 0xF4) max = 0x8F;
+    } else {
+        return 0;
+    }
+    if (length > size || data[1] < min || data[1] > max) {
+        return 0;
+    }
+    for (std::size_t i = 2; i < length; i++) {
+        if (data[i] < 0x80 || data[i] > 0xBF) {
+            return 0;
+        }
+    }
+    return length;
+}
+
+// Validates the sequences starting before end, moving i to the end of
+// the last one
+static bool validate_utf8_until(const std::uint8_t* data, std::size_t size, std::size_t& i, std::size_t end) {
+    while (i < end) {
+        std::size_t length = utf8_sequence(data + i, size - i);
+        if (length == 0) {
+            return false;
+        }
+        i += length;
+    }
+    return true;
+}
+
+static bool validate_utf8_scalar(const char* data, std::size_t size) {
+    const std::uint8_t* bytes = (const std::uint8_t*)data;
+    std::size_t i = 0;
+    while (i < size) {
+        if (i + 8 <= size) {
+            std::uint64_t word;
+            std::memcpy(&word, bytes + i, 8);
+            if (!(word & 0x8080808080808080)) {
+                i += 8;
+                continue;
+            }
+        }
+        std::size_t length = utf8_sequence(bytes + i, size - i);
+        if (length == 0) {
+            return false;
+        }
+        i += length;
+    }
+    return true;
+}
+
+// Lookup tables for the vectorized UTF-8 validators (Keiser and Lemire,
+// "Validating UTF-8 in less than one instruction per byte"). Each pair of
+// bytes is classified by the high nibble of the first byte, the low nibble
+// of the first byte and the high nibble of the second byte. The AND of the
+// three lookups is non-zero where the pair is an error.
+namespace utf8 {
+constexpr std::uint8_t TOO_SHORT = 1 << 0;
+constexpr std::uint8_t TOO_LONG = 1 << 1;
+constexpr std::uint8_t OVERLONG_3 = 1 << 2;
+constexpr std::uint8_t TOO_LARGE = 1 << 3;
+constexpr std::uint8_t SURROGATE = 1 << 4;
+constexpr std::uint8_t OVERLONG_2 = 1 << 5;
+constexpr std::uint8_t TOO_LARGE_1000 = 1 << 6;
+constexpr std::uint8_t OVERLONG_4 = 1 << 6;
+// Set when the second byte must be a continuation, so the error is the
+// absence of this bit in the pair lookup
+constexpr std::uint8_t TWO_CONTS = 1 << 7;
+constexpr std::uint8_t CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS;
+
+constexpr std::uint8_t byte_1_high[16] = {
+    TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+    TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+    TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+    TOO_SHORT | OVERLONG_2,
+    TOO_SHORT,
+    TOO_SHORT | OVERLONG_3 | SURROGATE,
+    TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4
+};
+constexpr std::uint8_t byte_1_low[16] = {
+    CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+    CARRY | OVERLONG_2,
+    CARRY,
+    CARRY,
+    CARRY | TOO_LARGE,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000
+};
+constexpr std::uint8_t byte_2_high[16] = {
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT
+};
+// Bytes at or above these, in the last three positions of a block, start
+// a sequence that continues into the next block
+constexpr std::uint8_t incomplete[16] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xF0 - 1, 0xE0 - 1, 0xC0 - 1
+};
+} // namespace utf8
+
+// ===========================================================================
+// x86
+
+#ifdef DATAPACK_SIMD_X86
+
+__attribute__((target("sse2")))
+static std::size_t find_quote_sse2(const char* data, std::size_t size) {
+    const __m128i quote = _mm_set1_epi8('"');
+    std::size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(data + i));
+        unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, quote));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + find_quote_scalar(data + i, size - i);
+}
+
+__attribute__((target("sse2")))
+static std::size_t skip_whitespace_sse2(const char* data, std::size_t size) {
+    std::size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(data + i));
+        __m128i space = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\t'))),
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\r'))));
+        unsigned mask = ~_mm_movemask_epi8(space) & 0xFFFF;
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + skip_whitespace_scalar(data + i, size - i);
+}
+
+// SSE4.2 string instructions compare against a set of characters directly
+__attribute__((target("sse4.2")))
+static std::size_t skip_whitespace_sse42(const char* data, std::size_t size) {
+    const __m128i whitespace = _mm_setr_epi8(' ', '\t', '\n', '\r', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    std::size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(data + i));
+        int index = _mm_cmpestri(whitespace, 4, chunk, 16,
+            _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_NEGATIVE_POLARITY | _SIDD_LEAST_SIGNIFICANT);
+        if (index != 16) {
+            return i + index;
+        }
+    }
+    return i + skip_whitespace_scalar(data + i, size - i);
+}
+
+// Each lane of the vector holds one of the four streams, so the shifts
+// are the same for every lane
+__attribute__((target("sse2")))
+static void pack_block_sse2(const std::uint32_t* input, int width, std::uint8_t* output) {
+    if (width == 0) {
+        return;
+    }
+    __m128i word = _mm_setzero_si128();
+    int shift = 0;
+    for (int i = 0; i < 32; i++) {
+        __m128i value = _mm_loadu_si128((const __m128i*)(input + 4 * i));
+        word = _mm_or_si128(word, _mm_sll_epi32(value, _mm_cvtsi32_si128(shift)));
+        shift += width;
+        if (shift >= 32) {
+            _mm_storeu_si128((__m128i*)output, word);
+            output += 16;
+            shift -= 32;
+            word = shift > 0
+                ? _mm_srl_epi32(value, _mm_cvtsi32_si128(width - shift))
+                : _mm_setzero_si128();
+        }
+    }
+}
+
+__attribute__((target("sse2")))
+static void unpack_block_sse2(const std::uint8_t* input, int width, std::uint32_t* output) {
+    if (width == 0) {
+        std::memset(output, 0, 128 * sizeof(std::uint32_t));
+        return;
+    }
+    const __m128i mask = _mm_set1_epi32(width == 32 ? -1 : (1 << width) - 1);
+    __m128i word = _mm_loadu_si128((const __m128i*)input);
+    int shift = 0;
+    for (int i = 0; i < 32; i++) {
+        __m128i value = _mm_srl_epi32(word, _mm_cvtsi32_si128(shift));
+        shift += width;
+        if (shift >= 32 && i != 31) {
+            input += 16;
+            word = _mm_loadu_si128((const __m128i*)input);
+            shift -= 32;
+            if (shift > 0) {
+                value = _mm_or_si128(value, _mm_sll_epi32(word, _mm_cvtsi32_si128(width - shift)));
+            }
+        }
+        _mm_storeu_si128((__m128i*)(output + 4 * i), _mm_and_si128(value, mask));
+    }
+}
+
+__attribute__((target("sse2")))
+static bool validate_utf8_sse2(const char* data, std::size_t size) {
+    const std::uint8_t* bytes = (const std::uint8_t*)data;
+    std::size_t i = 0;
+    while (i + 16 <= size) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(bytes + i));
+        if (_mm_movemask_epi8(chunk) == 0) {
+            i += 16;
+            continue;
+        }
+        // No byte shuffle before SSSE3, so check the sequences in this
+        // block one at a time
+        if (!validate_utf8_until(bytes, size, i, i + 16)) {
+            return false;
+        }
+    }
+    return validate_utf8_until(bytes, size, i, size);
+}
+
+// Checks the 16-byte blocks of input, given the previous input for pairs
+// that cross the block boundary. Returns non-zero bytes on error.
+__attribute__((target("sse4.2")))
+static __m128i utf8_errors_sse42(__m128i input, __m128i prev_input) {
+    const __m128i low_nibble = _mm_set1_epi8(0x0F);
+    const __m128i byte_1_high = _mm_loadu_si128((const __m128i*)utf8::byte_1_high);
+    const __m128i byte_1_low = _mm_loadu_si128((const __m128i*)utf8::byte_1_low);
+    const __m128i byte_2_high = _mm_loadu_si128((const __m128i*)utf8::byte_2_high);
+
+    __m128i prev1 = _mm_alignr_epi8(input, prev_input, 15);
+    __m128i special = _mm_and_si128(
+        _mm_and_si128(
+            _mm_shuffle_epi8(byte_1_high, _mm_and_si128(_mm_srli_epi16(prev1, 4), low_nibble)),
+            _mm_shuffle_epi8(byte_1_low, _mm_and_si128(prev1, low_nibble))),
+        _mm_shuffle_epi8(byte_2_high, _mm_and_si128(_mm_srli_epi16(input, 4), low_nibble)));
+
+    // Third and fourth bytes of a sequence must be continuations
+    __m128i prev2 = _mm_alignr_epi8(input, prev_input, 14);
+    __m128i prev3 = _mm_alignr_epi8(input, prev_input, 13);
+    __m128i must23 = _mm_or_si128(
+        _mm_subs_epu8(prev2, _mm_set1_epi8(char(0xE0 - 0x80))),
+        _mm_subs_epu8(prev3, _mm_set1_epi8(char(0xF0 - 0x80))));
+    __m128i must23_80 = _mm_and_si128(must23, _mm_set1_epi8(char(0x80)));
+    return _mm_xor_si128(must23_80, special);
+}
+
+__attribute__((target("sse4.2")))
+static bool validate_utf8_sse42(const char* data, std::size_t size) {
+    const __m128i incomplete_max = _mm_loadu_si128((const __m128i*)utf8::incomplete);
+    __m128i error = _mm_setzero_si128();
+    __m128i prev_input = _mm_setzero_si128();
+    __m128i prev_incomplete = _mm_setzero_si128();
+
+    std::uint8_t tail[16] = {};
+    for (std::size_t i = 0; i < size; i += 16) {
+        __m128i input;
+        if (i + 16 <= size) {
+            input = _mm_loadu_si128((const __m128i*)(data + i));
+        } else {
+            std::memcpy(tail, data + i, size - i);
+            input = _mm_loadu_si128((const __m128i*)tail);
+        }
+        if (_mm_movemask_epi8(input) == 0) {
+            // ASCII can't complete a sequence from the previous block
+            error = _mm_or_si128(error, prev_incomplete);
+        } else {
+            error = _mm_or_si128(error, utf8_errors_sse42(input, prev_input));
+            prev_incomplete = _mm_subs_epu8(input, incomplete_max);
+            prev_input = input;
+        }
+    }
+    error = _mm_or_si128(error, prev_incomplete);
+    return _mm_testz_si128(error, error);
+}
+
+__attribute__((target("avx2")))
+static __m256i utf8_errors_avx2(__m256i input, __m256i prev_input) {
+    const __m256i low_nibble = _mm256_set1_epi8(0x0F);
+    const __m256i byte_1_high = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)utf8::byte_1_high));
+    const __m256i byte_1_low = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)utf8::byte_1_low));
+    const __m256i byte_2_high = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)utf8::byte_2_high));
+
+    // alignr works within each 128-bit lane, so first combine the high lane
+    // of the previous input with the low lane of this input
+    __m256i shifted = _mm256_permute2x128_si256(prev_input, input, 0x21);
+    __m256i prev1 = _mm256_alignr_epi8(input, shifted, 15);
+    __m256i special = _mm256_and_si256(
+        _mm256_and_si256(
+            _mm256_shuffle_epi8(byte_1_high, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), low_nibble)),
+            _mm256_shuffle_epi8(byte_1_low, _mm256_and_si256(prev1, low_nibble))),
+        _mm256_shuffle_epi8(byte_2_high, _mm256_and_si256(_mm256_srli_epi16(input, 4), low_nibble)));
+
+    __m256i prev2 = _mm256_alignr_epi8(input, shifted, 14);
+    __m256i prev3 = _mm256_alignr_epi8(input, shifted, 13);
+    __m256i must23 = _mm256_or_si256(
+        _mm256_subs_epu8(prev2, _mm256_set1_epi8(char(0xE0 - 0x80))),
+        _mm256_subs_epu8(prev3, _mm256_set1_epi8(char(0xF0 - 0x80))));
+    __m256i must23_80 = _mm256_and_si256(must23, _mm256_set1_epi8(char(0x80)));
+    return _mm256_xor_si256(must23_80, special);
+}
+
+// Processes 64 bytes per iteration, as two 32-byte halves
+__attribute__((target("avx2")))
+static bool validate_utf8_avx2(const char* data, std::size_t size) {
+    const __m256i incomplete_max = _mm256_setr_m128i(
+        _mm_set1_epi8(char(0xFF)),
+        _mm_loadu_si128((const __m128i*)utf8::incomplete));
+    __m256i error = _mm256_setzero_si256();
+    __m256i prev_input = _mm256_setzero_si256();
+    __m256i prev_incomplete = _mm256_setzero_si256();
+
+    std::uint8_t tail[64] = {};
+    for (std::size_t i = 0; i < size; i += 64) {
+        const char* block = data + i;
+        if (i + 64 > size) {
+            std::memcpy(tail, data + i, size - i);
+            block = (const char*)tail;
+        }
+        __m256i input_a = _mm256_loadu_si256((const __m256i*)block);
+        __m256i input_b = _mm256_loadu_si256((const __m256i*)(block + 32));
+        if (_mm256_movemask_epi8(_mm256_or_si256(input_a, input_b)) == 0) {
+            error = _mm256_or_si256(error, prev_incomplete);
+            continue;
+        }
+        error = _mm256_or_si256(error, utf8_errors_avx2(input_a, prev_input));
+        error = _mm256_or_si256(error, utf8_errors_avx2(input_b, input_a));
+        prev_incomplete = _mm256_subs_epu8(input_b, incomplete_max);
+        prev_input = input_b;
+    }
+    error = _mm256_or_si256(error, prev_incomplete);
+    return _mm256_testz_si256(error, error);
+}
+
+__attribute__((target("avx2")))
+static std::size_t find_quote_avx2(const char* data, std::size_t size) {
+    const __m256i quote = _mm256_set1_epi8('"');
+    std::size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i*)(data + i));
+        unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, quote));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + find_quote_sse2(data + i, size - i);
+}
+
+__attribute__((target("avx2")))
+static std::size_t skip_whitespace_avx2(const char* data, std::size_t size) {
+    std::size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i*)(data + i));
+        __m256i space = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\t'))),
+            _mm256_or_si256(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\n')), _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\r'))));
+        unsigned mask = ~unsigned(_mm256_movemask_epi8(space));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + skip_whitespace_sse2(data + i, size - i);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static std::size_t find_quote_avx512(const char* data, std::size_t size) {
+    const __m512i quote = _mm512_set1_epi8('"');
+    std::size_t i = 0;
+    for (; i + 64 <= size; i += 64) {
+        __m512i chunk = _mm512_loadu_si512((const void*)(data + i));
+        std::uint64_t mask = _mm512_cmpeq_epi8_mask(chunk, quote);
+        if (mask != 0) {
+            return i + __builtin_ctzll(mask);
+        }
+    }
+    return i + find_quote_avx2(data + i, size - i);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static std::size_t skip_whitespace_avx512(const char* data, std::size_t size) {
+    std::size_t i = 0;
+    for (; i + 64 <= size; i += 64) {
+        __m512i chunk = _mm512_loadu_si512((const void*)(data + i));
+        std::uint64_t space =
+            _mm512_cmpeq_epi8_mask(chunk, _mm512_set1_epi8(' '))
+            | _mm512_cmpeq_epi8_mask(chunk, _mm512_set1_epi8('\t'))
+            | _mm512_cmpeq_epi8_mask(chunk, _mm512_set1_epi8('\n'))
+            | _mm512_cmpeq_epi8_mask(chunk, _mm512_set1_epi8('\r'));
+        if (~space != 0) {
+            return i + __builtin_ctzll(~space);
+        }
+    }
+    return i + skip_whitespace_avx2(data + i, size - i);
+}
+
+#endif
+
+// ===========================================================================
+// ARM
+
+#ifdef DATAPACK_SIMD_NEON
+
+// NEON has no movemask, so narrow each byte of the comparison to 4 bits
+static std::uint64_t neon_mask(uint8x16_t compare) {
+    uint8x8_t narrowed = vshrn_n_u16(vreinterpretq_u16_u8(compare), 4);
+    return vget_lane_u64(vreinterpret_u64_u8(narrowed), 0);
+}
+
+static std::size_t find_quote_neon(const char* data, std::size_t size) {
+    const uint8x16_t quote = vdupq_n_u8('"');
+    std::size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        uint8x16_t chunk = vld1q_u8((const std::uint8_t*)(data + i));
+        std::uint64_t mask = neon_mask(vceqq_u8(chunk, quote));
+        if (mask != 0) {
+            return i + __builtin_ctzll(mask) / 4;
+        }
+    }
+    return i + find_quote_scalar(data + i, size - i);
+}
+
+static std::size_t skip_whitespace_neon(const char* data, std::size_t size) {
+    std::size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        uint8x16_t chunk = vld1q_u8((const std::uint8_t*)(data + i));
+        uint8x16_t space = vorrq_u8(
+            vorrq_u8(vceqq_u8(chunk, vdupq_n_u8(' ')), vceqq_u8(chunk, vdupq_n_u8('\t'))),
+            vorrq_u8(vceqq_u8(chunk, vdupq_n_u8('\n')), vceqq_u8(chunk, vdupq_n_u8('\r'))));
+        std::uint64_t mask = ~neon_mask(space);
+        if (mask != 0) {
+            return i + __builtin_ctzll(mask) / 4;
+        }
+    }
+    return i + skip_whitespace_scalar(data + i, size - i);
+}
+
+static bool validate_utf8_neon(const char* data, std::size_t size) {
+    const uint8x16_t byte_1_high = vld1q_u8(utf8::byte_1_high);
+    const uint8x16_t byte_1_low = vld1q_u8(utf8::byte_1_low);
+    const uint8x16_t byte_2_high = vld1q_u8(utf8::byte_2_high);
+    const uint8x16_t incomplete_max = vld1q_u8(utf8::incomplete);
+    uint8x16_t error = vdupq_n_u8(0);
+    uint8x16_t prev_input = vdupq_n_u8(0);
+    uint8x16_t prev_incomplete = vdupq_n_u8(0);
+
+    std::uint8_t tail[16] = {};
+    for (std::size_t i = 0; i < size; i += 16) {
+        uint8x16_t input;
+        if (i + 16 <= size) {
+            input = vld1q_u8((const std::uint8_t*)(data + i));
+        } else {
+            std::memcpy(tail, data + i, size - i);
+            input = vld1q_u8(tail);
+        }
+        if (vmaxvq_u8(input) < 0x80) {
+            error = vorrq_u8(error, prev_incomplete);
+            continue;
+        }
+        uint8x16_t prev1 = vextq_u8(prev_input, input, 15);
+        uint8x16_t special = vandq_u8(
+            vandq_u8(
+                vqtbl1q_u8(byte_1_high, vshrq_n_u8(prev1, 4)),
+                vqtbl1q_u8(byte_1_low, vandq_u8(prev1, vdupq_n_u8(0x0F)))),
+            vqtbl1q_u8(byte_2_high, vshrq_n_u8(input, 4)));
+        uint8x16_t prev2 = vextq_u8(prev_input, input, 14);
+        uint8x16_t prev3 = vextq_u8(prev_input, input, 13);
+        uint8x16_t must23 = vorrq_u8(
+            vqsubq_u8(prev2, vdupq_n_u8(0xE0 - 0x80)),
+            vqsubq_u8(prev3, vdupq_n_u8(0xF0 - 0x80)));
+        error = vorrq_u8(error, veorq_u8(vandq_u8(must23, vdupq_n_u8(0x80)), special));
+        prev_incomplete = vqsubq_u8(input, incomplete_max);
+        prev_input = input;
+    }
+    error = vorrq_u8(error, prev_incomplete);
+    return vmaxvq_u8(error) == 0;
+}
+
+static void pack_block_neon(const std::uint32_t* input, int width, std::uint8_t* output) {
+    if (width == 0) {
+        return;
+    }
+    uint32x4_t word = vdupq_n_u32(0);
+    int shift = 0;
+    for (int i = 0; i < 32; i++) {
+        uint32x4_t value = vld1q_u32(input + 4 * i);
+        word = vorrq_u32(word, vshlq_u32(value, vdupq_n_s32(shift)));
+        shift += width;
+        if (shift >= 32) {
+            vst1q_u32((std::uint32_t*)output, word);
+            output += 16;
+            shift -= 32;
+            // Negative shifts are right shifts
+            word = shift > 0 ? vshlq_u32(value, vdupq_n_s32(shift - width)) : vdupq_n_u32(0);
+        }
+    }
+}
+
+static void unpack_block_neon(const std::uint8_t* input, int width, std::uint32_t* output) {
+    if (width == 0) {
+        std::memset(output, 0, 128 * sizeof(std::uint32_t));
+        return;
+    }
+    const uint32x4_t mask = vdupq_n_u32(width == 32 ? 0xFFFFFFFF : (1u << width) - 1);
+    uint32x4_t word = vld1q_u32((const std::uint32_t*)input);
+    int shift = 0;
+    for (int i = 0; i < 32; i++) {
+        uint32x4_t value = vshlq_u32(word, vdupq_n_s32(-shift));
+        shift += width;
+        if (shift >= 32 && i != 31) {
+            input += 16;
+            word = vld1q_u32((const std::uint32_t*)input);
+            shift -= 32;
+            if (shift > 0) {
+                value = vorrq_u32(value, vshlq_u32(word, vdupq_n_s32(width - shift)));
+            }
+        }
+        vst1q_u32(output + 4 * i, vandq_u32(value, mask));
+    }
+}
+
+#endif
+
+// ===========================================================================
+// Dispatch
+
+static const SimdKernels kernels_scalar = {
+    SimdLevel::Scalar,
+    find_quote_scalar,
+    skip_whitespace_scalar,
+    pack_block_scalar,
+    unpack_block_scalar,
+    validate_utf8_scalar
+};
+
+#ifdef DATAPACK_SIMD_X86
+static const SimdKernels kernels_sse2 = {
+    SimdLevel::SSE2,
+    find_quote_sse2,
+    skip_whitespace_sse2,
+    pack_block_sse2,
+    unpack_block_sse2,
+    validate_utf8_sse2
+};
+static const SimdKernels kernels_sse42 = {
+    SimdLevel::SSE42,
+    find_quote_sse2,
+    skip_whitespace_sse42,
+    pack_block_sse2,
+    unpack_block_sse2,
+    validate_utf8_sse42
+};
+static const SimdKernels kernels_avx2 = {
+    SimdLevel::AVX2,
+    find_quote_avx2,
+    skip_whitespace_avx2,
+    // The block layout has four lanes, which matches SSE2
+    pack_block_sse2,
+    unpack_block_sse2,
+    validate_utf8_avx2
+};
+static const SimdKernels kernels_avx512 = {
+    SimdLevel::AVX512,
+    find_quote_avx512,
+    skip_whitespace_avx512,
+    pack_block_sse2,
+    unpack_block_sse2,
+    // AVX-512 shuffles and alignr also work within 128-bit lanes, so
+    // there's little to gain over two AVX2 vectors
+    validate_utf8_avx2
+};
+#endif
+
+#ifdef DATAPACK_SIMD_NEON
+static const SimdKernels kernels_neon = {
+    SimdLevel::NEON,
+    find_quote_neon,
+    skip_whitespace_neon,
+    pack_block_neon,
+    unpack_block_neon,
+    validate_utf8_neon
+};
+#endif
+
+static const char* level_names[] = {
+    "scalar", "sse2", "sse42", "avx2", "avx512", "neon"
+};
+
+const char* simd_level_name(SimdLevel level) {
+    return level_names[int(level)];
+}
+
+bool simd_level_from_name(const char* name, SimdLevel& level) {
+    for (int i = 0; i <= int(SimdLevel::NEON); i++) {
+        if (std::strcmp(name, level_names[i]) == 0) {
+            level = SimdLevel(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool simd_supported(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::Scalar:
+            return true;
+#ifdef DATAPACK_SIMD_X86
+        case SimdLevel::SSE2:
+            return __builtin_cpu_supports("sse2");
+        case SimdLevel::SSE42:
+            return __builtin_cpu_supports("sse4.2");
+        case SimdLevel::AVX2:
+            return __builtin_cpu_supports("avx2");
+        case SimdLevel::AVX512:
+            return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+#endif
+#ifdef DATAPACK_SIMD_NEON
+        case SimdLevel::NEON:
+            return getauxval(AT_HWCAP) & HWCAP_ASIMD;
+#endif
+        default:
+            return false;
+    }
+}
+
+SimdLevel simd_detected_level() {
+    static const SimdLevel detected = []() {
+        for (int i = int(SimdLevel::NEON); i > 0; i--) {
+            if (simd_supported(SimdLevel(i))) {
+                return SimdLevel(i);
+            }
+        }
+        return SimdLevel::Scalar;
+    }();
+    return detected;
+}
+
+static SimdLevel best_supported(SimdLevel level) {
+    if (level == SimdLevel::NEON && !simd_supported(level)) {
+        return simd_detected_level();
+    }
+    for (int i = int(level); i > 0; i--) {
+        if (simd_supported(SimdLevel(i))) {
+            return SimdLevel(i);
+        }
+    }
+    return SimdLevel::Scalar;
+}
+
+// Kernels for a level that best_supported has already checked
+static const SimdKernels& supported_kernels(SimdLevel level) {
+    switch (level) {
+#ifdef DATAPACK_SIMD_X86
+        case SimdLevel::SSE2:
+            return kernels_sse2;
+        case SimdLevel::SSE42:
+            return kernels_sse42;
+        case SimdLevel::AVX2:
+            return kernels_avx2;
+        case SimdLevel::AVX512:
+            return kernels_avx512;
+#endif
+#ifdef DATAPACK_SIMD_NEON
+        case SimdLevel::NEON:
+            return kernels_neon;
+#endif
+        default:
+            return kernels_scalar;
+    }
+}
+
+// Detected once, so simd_kernels() is a single load on the paths that call
+// it per string or per block
+static std::atomic<const SimdKernels*>& active_kernels() {
+    static std::atomic<const SimdKernels*> kernels = []() {
+        const char* name = std::getenv("DATAPACK_SIMD");
+        SimdLevel level;
+        if (name && simd_level_from_name(name, level)) {
+            return &supported_kernels(best_supported(level));
+        }
+        return &supported_kernels(simd_detected_level());
+    }();
+    return kernels;
+}
+
+SimdLevel simd_level() {
+    return simd_kernels().level;
+}
+
+SimdLevel set_simd_level(SimdLevel level) {
+    const SimdKernels& kernels = supported_kernels(best_supported(level));
+    active_kernels().store(&kernels, std::memory_order_relaxed);
+    return kernels.level;
+}
+
+const SimdKernels& simd_kernels() {
+    return *active_kernels().load(std::memory_order_relaxed);
+}
+
+const SimdKernels& simd_kernels(SimdLevel level) {
+    return supported_kernels(best_supported(level));
+}
+
+} // namespace datapack
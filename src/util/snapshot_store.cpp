@@ -0,0 +1,305 @@
+#include "datapack/util/snapshot_store.hpp"
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+
+namespace datapack {
+
+// ===========================================================================
+// Chunking
+
+static std::uint64_t splitmix64(std::uint64_t& state) {
+    std::uint64_t z = (state += 0x9E3779B97F4A7C15);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+    return z ^ (z >> 31);
+}
+
+static const std::array<std::uint64_t, 256>& gear_table() {
+    static const std::array<std::uint64_t, 256> table = []() {
+        std::array<std::uint64_t, 256> table;
+        std::uint64_t state = 0;
+        for (auto& value: table) {
+            value = splitmix64(state);
+        }
+        return table;
+    }();
+    return table;
+}
+
+// Uses the high bits of the hash, which depend on the most recent 64 bytes
+static std::uint64_t gear_mask(int bits) {
+    return bits == 0 ? 0 : ~std::uint64_t(0) << (64 - bits);
+}
+
+static std::size_t find_cut(
+    const std::uint8_t* data,
+    std::size_t size,
+    const ChunkingOptions& options,
+    std::uint64_t mask_small,
+    std::uint64_t mask_large)
+{
+    if (size <= options.min_size) {
+        return size;
+    }
+    const auto& gear = gear_table();
+    std::size_t end = std::min(size, options.max_size);
+    std::size_t normal = std::min(end, options.average_size);
+    std::uint64_t hash = 0;
+    std::size_t i = options.min_size;
+    // Harder to cut before the average size, and easier after it
+    for (; i < normal; i++) {
+        hash = (hash << 1) + gear[data[i]];
+        if (!(hash & mask_small)) {
+            return i + 1;
+        }
+    }
+    for (; i < end; i++) {
+        hash = (hash << 1) + gear[data[i]];
+        if (!(hash & mask_large)) {
+            return i + 1;
+        }
+    }
+    return end;
+}
+
+std::vector<std::size_t> find_chunks(
+    const std::span<const std::uint8_t>& data,
+    const ChunkingOptions& options,
+    const std::vector<std::size_t>& boundaries)
+{
+    int bits = 0;
+    while ((std::size_t(1) << bits) < options.average_size) {
+        bits++;
+    }
+    if ((std::size_t(1) << bits) != options.average_size
+        || options.min_size >= options.average_size
+        || options.average_size >= options.max_size)
+    {
+        throw SnapshotError("Invalid chunking options");
+    }
+    const std::uint64_t mask_small = gear_mask(bits + 2);
+    const std::uint64_t mask_large = gear_mask(bits - 2);
+    const std::size_t window = options.average_size / 4;
+
+    std::vector<std::size_t> chunks;
+    std::size_t begin = 0;
+    auto boundary = boundaries.begin();
+    while (begin < data.size()) {
+        std::size_t end = begin + find_cut(&data[begin], data.size() - begin, options, mask_small, mask_large);
+
+        boundary = std::lower_bound(boundary, boundaries.end(), end);
+        if (boundary != boundaries.end()
+            && *boundary - end <= window
+            && *boundary - begin <= options.max_size)
+        {
+            end = *boundary;
+        }
+        chunks.push_back(end);
+        begin = end;
+    }
+    return chunks;
+}
+
+// Hash for chunk keys, reading 8 bytes at a time
+static std::uint64_t hash_chunk(const std::uint8_t* data, std::size_t size) {
+    const std::uint64_t k = 0x9E3779B97F4A7C15;
+    std::uint64_t h1 = size * k;
+    std::uint64_t h2 = ~size;
+    std::size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        std::uint64_t a, b;
+        std::memcpy(&a, data + i, 8);
+        std::memcpy(&b, data + i + 8, 8);
+        h1 = (h1 ^ a) * 0xBF58476D1CE4E5B9;
+        h2 = (h2 ^ b) * 0x94D049BB133111EB;
+        h1 = (h1 << 31) | (h1 >> 33);
+        h2 = (h2 << 27) | (h2 >> 37);
+    }
+    for (; i < size; i++) {
+        h1 = (h1 ^ data[i]) * k;
+    }
+    std::uint64_t state = h1 ^ ((h2 << 17) | (h2 >> 47));
+    return splitmix64(state);
+}
+
+// ===========================================================================
+// SnapshotStore
+
+// Pack file: sequence of [hash (u64) | size (u64) | data]
+// Manifest file: sequence of [count (u64) | ChunkRef * count]
+
+static void open_file(std::fstream& file, const std::filesystem::path& path) {
+    if (!std::filesystem::exists(path)) {
+        std::ofstream create(path, std::ios::binary);
+    }
+    file.open(path, std::ios::in | std::ios::out | std::ios::binary);
+    if (!file.is_open()) {
+        throw SnapshotError("Failed to open " + path.string());
+    }
+}
+
+template <typename T>
+static bool read_value(std::fstream& file, T& value) {
+    file.read((char*)&value, sizeof(T));
+    return bool(file);
+}
+
+SnapshotStore::SnapshotStore(const std::filesystem::path& directory, const ChunkingOptions& options):
+    options(options),
+    pack_size(0),
+    manifest_size(0),
+    logical_bytes(0)
+{
+    std::filesystem::create_directories(directory);
+    open_file(pack, directory / "chunks.pack");
+    open_file(manifest, directory / "snapshots.manifest");
+
+    // Rebuild the chunk index, ignoring an incomplete chunk at the end
+    std::uint64_t file_size = std::filesystem::file_size(directory / "chunks.pack");
+    while (true) {
+        std::uint64_t hash, size;
+        pack.seekg(pack_size);
+        if (!read_value(pack, hash) || !read_value(pack, size)) {
+            break;
+        }
+        std::uint64_t end = pack_size + 2 * sizeof(std::uint64_t) + size;
+        if (end > file_size) {
+            break;
+        }
+        chunks.emplace(ChunkKey{hash, size}, pack_size + 2 * sizeof(std::uint64_t));
+        pack_size = end;
+    }
+    pack.clear();
+
+    std::uint64_t manifest_file_size = std::filesystem::file_size(directory / "snapshots.manifest");
+    while (true) {
+        std::uint64_t count;
+        manifest.seekg(manifest_size);
+        if (!read_value(manifest, count)) {
+            break;
+        }
+        // An incomplete snapshot at the end, checked before allocating
+        if (count > (manifest_file_size - manifest_size - sizeof(count)) / sizeof(ChunkRef)) {
+            break;
+        }
+        std::vector<ChunkRef> refs(count);
+        manifest.read((char*)refs.data(), count * sizeof(ChunkRef));
+        if (!manifest) {
+            break;
+        }
+        for (const auto& ref: refs) {
+            if (ref.offset + ref.size > pack_size) {
+                throw SnapshotError("Snapshot refers to a missing chunk");
+            }
+            logical_bytes += ref.size;
+        }
+        snapshots.push_back(std::move(refs));
+        manifest_size += sizeof(std::uint64_t) + count * sizeof(ChunkRef);
+    }
+    manifest.clear();
+}
+
+std::size_t SnapshotStore::add(
+    const std::span<const std::uint8_t>& data,
+    const std::vector<std::size_t>& boundaries)
+{
+    std::vector<ChunkRef> refs;
+    std::size_t begin = 0;
+    for (std::size_t end: find_chunks(data, options, boundaries)) {
+        const std::uint8_t* chunk = &data[begin];
+        std::uint64_t size = end - begin;
+        begin = end;
+
+        ChunkKey key{hash_chunk(chunk, size), size};
+        if (std::int64_t offset = find_chunk(key, chunk); offset != -1) {
+            refs.push_back(ChunkRef{std::uint64_t(offset), size});
+            continue;
+        }
+        pack.seekp(pack_size);
+        pack.write((const char*)&key.hash, sizeof(key.hash));
+        pack.write((const char*)&size, sizeof(size));
+        pack.write((const char*)chunk, size);
+        std::uint64_t offset = pack_size + 2 * sizeof(std::uint64_t);
+        chunks.emplace(key, offset);
+        refs.push_back(ChunkRef{offset, size});
+        pack_size = offset + size;
+    }
+    pack.flush();
+    if (!pack) {
+        throw SnapshotError("Failed to write to the pack file");
+    }
+
+    // The manifest is written after the chunks it refers to
+    std::uint64_t count = refs.size();
+    manifest.seekp(manifest_size);
+    manifest.write((const char*)&count, sizeof(count));
+    manifest.write((const char*)refs.data(), count * sizeof(ChunkRef));
+    manifest.flush();
+    if (!manifest) {
+        throw SnapshotError("Failed to write to the manifest file");
+    }
+    manifest_size += sizeof(count) + count * sizeof(ChunkRef);
+
+    logical_bytes += data.size();
+    snapshots.push_back(std::move(refs));
+    return snapshots.size() - 1;
+}
+
+std::int64_t SnapshotStore::find_chunk(const ChunkKey& key, const std::uint8_t* data) {
+    auto [begin, end] = chunks.equal_range(key);
+    for (auto iter = begin; iter != end; iter++) {
+        compare_buffer.resize(key.size);
+        pack.seekg(iter->second);
+        pack.read((char*)compare_buffer.data(), key.size);
+        if (!pack) {
+            pack.clear();
+            throw SnapshotError("Failed to read from the pack file");
+        }
+        if (std::memcmp(compare_buffer.data(), data, key.size) == 0) {
+            return iter->second;
+        }
+    }
+    return -1;
+}
+
+std::vector<std::uint8_t> SnapshotStore::load(std::size_t snapshot) {
+    std::vector<std::uint8_t> output;
+    load_into(snapshot, output);
+    return output;
+}
+
+void SnapshotStore::load_into(std::size_t snapshot, std::vector<std::uint8_t>& output) {
+    if (snapshot >= snapshots.size()) {
+        throw SnapshotError("Invalid snapshot index");
+    }
+    const auto& refs = snapshots[snapshot];
+    std::size_t size = 0;
+    for (const auto& ref: refs) {
+        size += ref.size;
+    }
+    output.resize(size);
+
+    std::size_t pos = 0;
+    for (const auto& ref: refs) {
+        pack.seekg(ref.offset);
+        pack.read((char*)&output[pos], ref.size);
+        pos += ref.size;
+    }
+    if (!pack) {
+        pack.clear();
+        throw SnapshotError("Failed to read from the pack file");
+    }
+}
+
+SnapshotStats SnapshotStore::stats() const {
+    SnapshotStats stats;
+    stats.snapshots = snapshots.size();
+    stats.chunks = chunks.size();
+    stats.logical_bytes = logical_bytes;
+    stats.stored_bytes = pack_size + manifest_size;
+    return stats;
+}
+
+} // namespace datapack
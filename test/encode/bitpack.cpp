@@ -0,0 +1,63 @@
+#include <gtest/gtest.h>
+#include <datapack/encode/bitpack.hpp>
+#include <datapack/util/simd.hpp>
+#include <random>
+
+TEST(Encode, BitpackKernels) {
+    using namespace datapack;
+    std::mt19937 rng(0);
+
+    const auto& scalar = simd_kernels(SimdLevel::Scalar);
+    for (int width = 0; width <= 32; width++) {
+        std::uint32_t input[bitpack_block_size];
+        for (auto& value: input) {
+            value = width == 0 ? 0 : rng() >> (32 - width);
+        }
+        std::vector<std::uint8_t> expected(16 * width);
+        scalar.pack_block(input, width, expected.data());
+
+        // Every level uses the same layout
+        for (int i = 0; i <= int(SimdLevel::NEON); i++) {
+            SimdLevel level = SimdLevel(i);
+            if (!simd_supported(level)) {
+                continue;
+            }
+            const auto& kernels = simd_kernels(level);
+            std::vector<std::uint8_t> packed(16 * width);
+            kernels.pack_block(input, width, packed.data());
+            EXPECT_EQ(packed, expected) << simd_level_name(level) << " width " << width;
+
+            std::uint32_t output[bitpack_block_size];
+            kernels.unpack_block(packed.data(), width, output);
+            for (std::size_t j = 0; j < bitpack_block_size; j++) {
+                ASSERT_EQ(output[j], input[j]) << simd_level_name(level) << " width " << width;
+            }
+        }
+    }
+}
+
+TEST(Encode, Bitpack) {
+    using namespace datapack;
+    std::mt19937 rng(1);
+
+    // Full blocks followed by a remainder
+    for (std::size_t count: {0, 1, 7, 128, 300}) {
+        for (int width: {0, 1, 3, 10, 17, 32}) {
+            std::vector<std::uint32_t> input(count);
+            for (auto& value: input) {
+                value = width == 0 ? 0 : rng() >> (32 - width);
+            }
+            std::vector<std::uint8_t> packed(bitpacked_size(count, width));
+            bitpack(input.data(), count, width, packed.data());
+
+            std::vector<std::uint32_t> output(count);
+            bitunpack(packed.data(), count, width, output.data());
+            EXPECT_EQ(output, input) << "count " << count << " width " << width;
+        }
+    }
+
+    EXPECT_EQ(bitpack_width(0), 0);
+    EXPECT_EQ(bitpack_width(1), 1);
+    EXPECT_EQ(bitpack_width(1023), 10);
+    EXPECT_EQ(bitpack_width(UINT32_MAX), 32);
+}
@@ -0,0 +1,30 @@
+#include <gtest/gtest.h>
+#include <datapack/encode/varint.hpp>
+#include <limits>
+
+TEST(Encode, Varint) {
+    using namespace datapack;
+
+    EXPECT_EQ(zigzag(0), 0);
+    EXPECT_EQ(zigzag(-1), 1);
+    EXPECT_EQ(zigzag(1), 2);
+    EXPECT_EQ(zigzag(-2), 3);
+    for (std::int64_t value: {
+        std::int64_t(0), std::int64_t(-300), std::int64_t(300),
+        std::numeric_limits<std::int64_t>::min(),
+        std::numeric_limits<std::int64_t>::max() })
+    {
+        EXPECT_EQ(unzigzag(zigzag(value)), value);
+    }
+
+    std::vector<std::uint8_t> output;
+    write_varint(output, 300);
+    EXPECT_EQ(output, std::vector<std::uint8_t>({ 0xAC, 0x02 }));
+    EXPECT_EQ(varint_size(300), 2);
+    EXPECT_EQ(varint_size(0x7F), 1);
+
+    output.clear();
+    write_varint(output, std::numeric_limits<std::uint64_t>::max());
+    EXPECT_EQ(output.size(), 10);
+    EXPECT_EQ(varint_size(std::numeric_limits<std::uint64_t>::max()), 10);
+}
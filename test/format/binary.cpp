@@ -2,6 +2,7 @@
 #include <datapack/examples/entity.hpp>
 #include <datapack/format/binary_writer.hpp>
 #include <datapack/format/binary_reader.hpp>
+#include <datapack/common.hpp>
 
 TEST(Format, Binary) {
     Entity in = Entity::example();
@@ -11,3 +12,151 @@ TEST(Format, Binary) {
 
     ASSERT_EQ(in, out);
 }
+
+struct Indices {
+    std::vector<std::uint32_t> ids;
+    std::vector<std::int64_t> offsets;
+    std::vector<std::uint64_t> hashes;
+    std::vector<std::uint8_t> flags;
+    std::array<int, 3> triple;
+};
+
+bool operator==(const Indices& a, const Indices& b) {
+    return a.ids == b.ids && a.offsets == b.offsets && a.hashes == b.hashes
+        && a.flags == b.flags && a.triple == b.triple;
+}
+
+namespace datapack {
+DATAPACK_INLINE(Indices, value, packer) {
+    packer.object_begin();
+    packer.value("ids", value.ids);
+    packer.value("offsets", value.offsets);
+    packer.value("hashes", value.hashes);
+    packer.value("flags", value.flags);
+    packer.value("triple", value.triple);
+    packer.object_end();
+}
+} // namespace datapack
+
+TEST(Format, BinaryPackedIntegers) {
+    Indices in;
+    for (std::uint32_t i = 0; i < 1000; i++) {
+        in.ids.push_back((i * 37) % 1024);
+        in.offsets.push_back(-500 + std::int64_t(i));
+        in.hashes.push_back(i % 3 == 0 ? std::uint64_t(i) << 40 : i);
+        in.flags.push_back(i % 2);
+    }
+    in.triple = {-1, 5, 100};
+
+    datapack::BinaryOptions options;
+    options.pack_integers = true;
+    std::vector<std::uint8_t> packed = datapack::write_binary(in, options);
+    Indices out = datapack::read_binary<Indices>(packed, options);
+    ASSERT_EQ(in, out);
+
+    // 10-bit ids use roughly a third of the space
+    Indices ids;
+    ids.ids = in.ids;
+    std::size_t plain_size = datapack::write_binary(ids).size();
+    std::size_t packed_size = datapack::write_binary(ids, options).size();
+    ASSERT_LT(packed_size * 3, plain_size);
+
+    // Other values still use the plain encoding
+    Entity entity = Entity::example();
+    ASSERT_EQ(entity, datapack::read_binary<Entity>(datapack::write_binary(entity, options), options));
+
+    // Truncated data is rejected
+    packed.resize(packed.size() / 2);
+    datapack::BinaryReader reader(packed, options);
+    reader.value(out);
+    ASSERT_FALSE(reader.valid());
+}
+
+TEST(Format, BinaryLimits) {
+    using Names = std::vector<std::vector<std::string>>;
+    Names in = {{"a", "bb"}, {"ccc", "dddd", "eeeee"}};
+    std::vector<std::uint8_t> data = datapack::write_binary(in);
+    ASSERT_EQ(in, datapack::read_binary<Names>(data));
+
+    auto read_valid = [&](const datapack::BinaryOptions& options) {
+        Names out;
+        datapack::BinaryReader reader(data, options);
+        reader.value(out);
+        return reader.valid() && out == in;
+    };
+    datapack::BinaryOptions options;
+    options.limits.max_depth = 2;
+    ASSERT_TRUE(read_valid(options));
+    options.limits.max_depth = 1;
+    ASSERT_FALSE(read_valid(options));
+
+    options = {};
+    options.limits.max_length = 5;
+    ASSERT_TRUE(read_valid(options));
+    options.limits.max_length = 4;
+    ASSERT_FALSE(read_valid(options));
+
+    options = {};
+    options.limits.max_allocation = 20; // Strings, including terminators
+    ASSERT_TRUE(read_valid(options));
+    options.limits.max_allocation = 19;
+    ASSERT_FALSE(read_valid(options));
+}
+
+TEST(Format, BinaryUntrustedLength) {
+    std::vector<std::int32_t> in = {1, 2, 3};
+    std::vector<std::uint8_t> data = datapack::write_binary(in);
+
+    // Lengths that overflow or exceed the data are rejected before the
+    // vector is resized
+    for (std::uint64_t length: {std::uint64_t(1) << 62, ~std::uint64_t(0), std::uint64_t(4)}) {
+        std::memcpy(data.data(), &length, sizeof(length));
+        std::vector<std::int32_t> out = {5};
+        datapack::BinaryReader reader(data);
+        reader.value(out);
+        ASSERT_FALSE(reader.valid());
+        ASSERT_TRUE(out.empty());
+    }
+
+    // Without trivial_as_binary, decoding stops once the data runs out
+    datapack::BinaryOptions list_options;
+    list_options.trivial_as_binary = false;
+    std::vector<std::uint8_t> list_data = datapack::write_binary(in, list_options);
+    std::uint64_t length = std::uint64_t(1) << 62;
+    std::memcpy(list_data.data(), &length, sizeof(length));
+    std::vector<std::int32_t> out;
+    datapack::BinaryReader reader(list_data, list_options);
+    reader.value(out);
+    ASSERT_FALSE(reader.valid());
+    ASSERT_LE(out.size(), in.size() + 1);
+}
+
+TEST(Format, BinaryValidateUtf8) {
+    std::vector<std::string> in = {"caf\xC3\xA9", "\xE6\x97\xA5\xE6\x9C\xAC"};
+    datapack::BinaryOptions options;
+    options.validate_utf8 = true;
+    ASSERT_EQ(in, datapack::read_binary<std::vector<std::string>>(datapack::write_binary(in), options));
+
+    in.push_back("caf\xE9"); // Latin-1
+    std::vector<std::uint8_t> data = datapack::write_binary(in);
+    std::vector<std::string> out;
+    datapack::BinaryReader reader(data, options);
+    reader.value(out);
+    ASSERT_FALSE(reader.valid());
+    ASSERT_EQ(in, datapack::read_binary<std::vector<std::string>>(data));
+}
+
+TEST(Format, BinaryFailFast) {
+    Entity in = Entity::example();
+    std::vector<std::uint8_t> data = datapack::write_binary(in);
+    data.resize(data.size() / 2);
+
+    datapack::BinaryOptions options;
+    options.fail_fast = true;
+    ASSERT_THROW(datapack::read_binary<Entity>(data, options), datapack::BinaryReadError);
+
+    // The list terminator isn't a valid boolean
+    std::vector<std::uint8_t> names = datapack::write_binary(std::vector<std::string>{"a"});
+    names.back() = 7;
+    ASSERT_THROW(datapack::read_binary<std::vector<std::string>>(names, options), datapack::BinaryReadError);
+}
@@ -129,3 +129,95 @@ TEST(Format, BinaryArrayOfArrays) {
         EXPECT_TRUE(compare(a, b));
     }
 }
+
+TEST(Format, BinaryPacked) {
+    std::vector<Point> points(3);
+    for (std::size_t i = 0; i < points.size(); i++) {
+        points[i].x = i;
+        points[i].y = 0.5 * i;
+        points[i].z = -float(i);
+    }
+    datapack::BinaryOptions options;
+    options.trivial_as_binary = false;
+    options.packed = true;
+
+    // Each point is a list element flag and the fields, without the 8
+    // bytes of padding
+    auto padded = datapack::write_binary(points, datapack::BinaryOptions{false});
+    auto packed = datapack::write_binary(points, options);
+    EXPECT_EQ(padded.size(), points.size() * (1 + sizeof(Point)) + 1);
+    EXPECT_EQ(packed.size(), points.size() * (1 + 16) + 1);
+    EXPECT_EQ(datapack::write_binary(points[0], options).size(), 16);
+
+    std::vector<Point> result;
+    datapack::BinaryReader reader(packed, options);
+    reader.value(result);
+    ASSERT_TRUE(reader.valid());
+    EXPECT_TRUE(compare(points, result));
+}
+
+struct Samples {
+    std::string name;
+    std::vector<double> values;
+    std::vector<float> weights;
+};
+namespace datapack {
+DATAPACK_INLINE(Samples, value, packer) {
+    packer.object_begin();
+    packer.value("name", value.name);
+    packer.value("values", value.values);
+    packer.value("weights", value.weights);
+    packer.object_end();
+}
+}
+
+TEST(Format, BinaryAlignment) {
+    Samples samples;
+    samples.name = "abc";
+    for (std::size_t i = 0; i < 20; i++) {
+        samples.values.push_back(0.5 * i);
+        samples.weights.push_back(0.25f * i);
+    }
+    datapack::BinaryOptions options;
+    options.binary_alignment = 64;
+    auto data = datapack::write_binary(samples, options);
+
+    // Copy into a cache-line aligned buffer, as for a mapped file
+    alignas(64) std::uint8_t buffer[1024];
+    ASSERT_LE(data.size(), sizeof(buffer));
+    std::memcpy(buffer, data.data(), data.size());
+    std::span<const std::uint8_t> aligned(buffer, data.size());
+
+    auto result = datapack::read_binary<Samples>(aligned, options);
+    EXPECT_EQ(result.name, samples.name);
+    EXPECT_EQ(result.values, samples.values);
+    EXPECT_EQ(result.weights, samples.weights);
+
+    datapack::BinaryReader reader(aligned, options);
+    reader.object_begin(0);
+    reader.object_next("name");
+    EXPECT_EQ(std::string(reader.string()), "abc");
+    reader.object_next("values");
+    auto values = reader.binary_view<double>();
+    reader.object_next("weights");
+    auto weights = reader.binary_view<float>();
+    reader.object_end(0);
+    ASSERT_TRUE(reader.valid());
+    EXPECT_EQ((std::uintptr_t)values.data() % 64, 0);
+    EXPECT_EQ((std::uintptr_t)weights.data() % 64, 0);
+    EXPECT_TRUE(std::equal(values.begin(), values.end(), samples.values.begin(), samples.values.end()));
+    EXPECT_TRUE(std::equal(weights.begin(), weights.end(), samples.weights.begin(), samples.weights.end()));
+
+    // Misaligned data invalidates the reader, rather than returning a
+    // pointer that can't be dereferenced
+    std::vector<std::uint8_t> misaligned(data.size() + 1);
+    std::memcpy(misaligned.data() + 1, data.data(), data.size());
+    std::span<const std::uint8_t> misaligned_data(misaligned.data() + 1, data.size());
+    datapack::BinaryReader misaligned_reader(misaligned_data, options);
+    misaligned_reader.object_begin(0);
+    misaligned_reader.object_next("name");
+    misaligned_reader.string();
+    misaligned_reader.object_next("values");
+    EXPECT_TRUE(misaligned_reader.binary_view<double>().empty());
+    EXPECT_FALSE(misaligned_reader.valid());
+}
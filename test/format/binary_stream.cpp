@@ -0,0 +1,115 @@
+#include <gtest/gtest.h>
+#include <datapack/format/binary_stream.hpp>
+#include <datapack/common.hpp>
+#include <datapack/util/random.hpp>
+
+struct Record {
+    std::uint64_t id;
+    std::string name;
+    std::vector<double> values;
+};
+
+bool operator==(const Record& a, const Record& b) {
+    return a.id == b.id && a.name == b.name && a.values == b.values;
+}
+
+namespace datapack {
+DATAPACK_INLINE(Record, value, packer) {
+    packer.object_begin();
+    packer.value("id", value.id);
+    packer.value("name", value.name);
+    packer.value("values", value.values);
+    packer.object_end();
+}
+} // namespace datapack
+
+static std::filesystem::path temp_file(const std::string& name) {
+    auto path = std::filesystem::temp_directory_path() / ("datapack_test_" + name);
+    std::filesystem::remove(path);
+    return path;
+}
+
+static std::vector<datapack::IoBackend> available_backends() {
+    std::vector<datapack::IoBackend> backends = {datapack::IoBackend::Threads};
+    if (datapack::io_uring_supported()) {
+        backends.push_back(datapack::IoBackend::IoUring);
+    }
+    return backends;
+}
+
+TEST(Format, AsyncFile) {
+    using datapack::AsyncFile;
+    auto path = temp_file("async_file");
+
+    for (auto backend: available_backends()) {
+        {
+            AsyncFile file(path, AsyncFile::Mode::Write, 1000, 2, backend);
+            ASSERT_EQ(file.backend(), backend);
+            for (std::size_t i = 0; i < 10; i++) {
+                std::size_t buffer = i % 2;
+                file.wait(buffer);
+                std::memset(file.buffer(buffer), int(i), 1000);
+                file.write(buffer, 1000, i * 1000);
+            }
+        }
+        ASSERT_EQ(std::filesystem::file_size(path), 10000);
+
+        AsyncFile file(path, AsyncFile::Mode::Read, 1000, 2, backend);
+        file.read(0, 1000, 3000);
+        file.read(1, 1000, 9500);
+        ASSERT_EQ(file.wait(0), 1000);
+        ASSERT_EQ(file.buffer(0)[999], 3);
+        // Short at the end of the file
+        ASSERT_EQ(file.wait(1), 500);
+        ASSERT_EQ(file.buffer(1)[0], 9);
+    }
+    ASSERT_THROW(AsyncFile(temp_file("missing"), AsyncFile::Mode::Read, 1000), datapack::IoError);
+}
+
+TEST(Format, BinaryStream) {
+    auto path = temp_file("binary_stream");
+
+    std::vector<Record> records;
+    for (int i = 0; i < 300; i++) {
+        records.push_back(datapack::random<Record>());
+    }
+    // Small buffers, so messages and sizes cross buffer boundaries
+    datapack::BinaryStreamOptions options;
+    options.buffer_size = 256;
+    options.buffer_count = 3;
+
+    for (auto backend: available_backends()) {
+        options.backend = backend;
+        {
+            datapack::BinaryStreamWriter writer(path, options);
+            for (const auto& record: records) {
+                writer.write(record);
+            }
+        }
+
+        datapack::BinaryStreamReader reader(path, options);
+        Record record;
+        std::size_t count = 0;
+        while (reader.read(record)) {
+            ASSERT_EQ(record, records[count]);
+            count++;
+        }
+        ASSERT_EQ(count, records.size());
+    }
+
+    // A stream cut short in the middle of a message
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) - 10);
+    datapack::BinaryStreamReader reader(path, options);
+    Record record;
+    ASSERT_THROW(while (reader.read(record)) {}, datapack::IoError);
+
+    // A corrupt size larger than the file fails before allocating
+    {
+        datapack::BinaryStreamWriter writer(path, options);
+        std::uint64_t size = std::uint64_t(1) << 60;
+        writer.write_framed(std::span((const std::uint8_t*)&size, sizeof(size)));
+    }
+    datapack::BinaryStreamReader corrupt_reader(path, options);
+    std::span<const std::uint8_t> data;
+    ASSERT_THROW(corrupt_reader.next(data), datapack::IoError);
+}
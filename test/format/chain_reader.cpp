@@ -0,0 +1,103 @@
+#include <gtest/gtest.h>
+#include <datapack/format/chain_reader.hpp>
+#include <datapack/format/binary_writer.hpp>
+#include <datapack/common.hpp>
+
+struct Packet {
+    std::uint32_t id;
+    std::string source;
+    std::vector<double> samples;
+    std::vector<std::int64_t> counters;
+    std::optional<std::string> note;
+    bool operator==(const Packet&) const = default;
+};
+
+namespace datapack {
+DATAPACK_INLINE(Packet, value, packer) {
+    packer.object_begin();
+    packer.value("id", value.id);
+    packer.value("source", value.source);
+    packer.value("samples", value.samples);
+    packer.value("counters", value.counters);
+    packer.value("note", value.note);
+    packer.object_end();
+}
+} // namespace datapack
+
+static std::vector<std::span<const std::uint8_t>> split(const std::vector<std::uint8_t>& data, std::size_t size) {
+    std::vector<std::span<const std::uint8_t>> buffers;
+    for (std::size_t begin = 0; begin < data.size(); begin += size) {
+        buffers.emplace_back(data.data() + begin, std::min(size, data.size() - begin));
+    }
+    return buffers;
+}
+
+TEST(Format, ChainReader) {
+    std::vector<Packet> packets;
+    for (std::uint32_t i = 0; i < 20; i++) {
+        Packet packet;
+        packet.id = i;
+        packet.source = "sensor-" + std::string(i * 3, 'x');
+        for (std::uint32_t j = 0; j < i; j++) {
+            packet.samples.push_back(0.5 * j);
+            packet.counters.push_back(1000 + j * j);
+        }
+        if (i % 3 == 0) {
+            packet.note = "note " + std::to_string(i);
+        }
+        packets.push_back(packet);
+    }
+
+    datapack::BinaryOptions packed;
+    packed.pack_integers = true;
+    packed.binary_alignment = 16;
+    for (const auto& options: {datapack::BinaryOptions{}, packed}) {
+        auto data = datapack::write_binary(packets, options);
+        for (std::size_t size: {1, 3, 7, 64, 1000000}) {
+            datapack::ChainReader reader(split(data, size), options);
+            std::vector<Packet> result;
+            reader.value(result);
+            ASSERT_TRUE(reader.valid()) << "Buffer size " << size;
+            EXPECT_EQ(result, packets) << "Buffer size " << size;
+        }
+
+        // Missing the last byte
+        auto buffers = split(data, 5);
+        buffers.back() = buffers.back().first(buffers.back().size() - 1);
+        std::vector<Packet> result;
+        datapack::ChainReader reader(buffers, options);
+        reader.value(result);
+        EXPECT_FALSE(reader.valid());
+    }
+}
+
+TEST(Format, ChainReaderInPlace) {
+    Packet packet;
+    packet.id = 1;
+    packet.source = "abcdefgh";
+    packet.samples.resize(100, 1.5);
+    auto data = datapack::write_binary(packet);
+
+    // Break the input just after the id, and in the middle of the samples
+    std::size_t middle = data.size() - 400;
+    std::vector<std::span<const std::uint8_t>> buffers = {
+        std::span(data).first(4),
+        std::span(data).subspan(4, middle - 4),
+        std::span(data).subspan(middle)
+    };
+    datapack::ChainReader reader(buffers);
+    std::uint32_t id;
+    reader.object_begin(0);
+    reader.object_next("id");
+    reader.value(id);
+    reader.object_next("source");
+    // The string lies within one buffer, so isn't copied
+    const char* source = reader.string();
+    EXPECT_EQ(source, (const char*)data.data() + 4);
+    reader.object_next("samples");
+    auto [samples, length] = reader.binary(0, sizeof(double));
+    ASSERT_TRUE(reader.valid());
+    EXPECT_EQ(length, 100);
+    EXPECT_FALSE(samples >= data.data() && samples < data.data() + data.size());
+    EXPECT_EQ(std::memcmp(samples, packet.samples.data(), length * sizeof(double)), 0);
+}
@@ -0,0 +1,223 @@
+#include <cstring>
+#include <gtest/gtest.h>
+#include <datapack/examples/entity.hpp>
+#include <datapack/format/columnar.hpp>
+#include <datapack/common.hpp>
+
+struct Reading {
+    std::int64_t time;
+    double value;
+    std::string sensor;
+    std::optional<int> error;
+};
+
+bool operator==(const Reading& a, const Reading& b) {
+    return a.time == b.time && a.value == b.value && a.sensor == b.sensor && a.error == b.error;
+}
+
+namespace datapack {
+DATAPACK_INLINE(Reading, value, packer) {
+    packer.object_begin();
+    packer.value("time", value.time);
+    packer.value("value", value.value);
+    packer.value("sensor", value.sensor);
+    packer.value("error", value.error);
+    packer.object_end();
+}
+} // namespace datapack
+
+static std::vector<Reading> example_readings(std::size_t count) {
+    std::vector<Reading> readings;
+    for (std::size_t i = 0; i < count; i++) {
+        Reading reading;
+        reading.time = 1000 + 10 * i;
+        reading.value = 0.5 * i;
+        reading.sensor = "sensor_" + std::to_string(i % 3);
+        if (i % 4 == 0) {
+            reading.error = i;
+        }
+        readings.push_back(reading);
+    }
+    return readings;
+}
+
+TEST(Format, ColumnarColumns) {
+    auto columns = datapack::get_columns(datapack::create_schema<Entity>());
+    std::vector<std::string> paths;
+    for (const auto& column: columns) {
+        paths.push_back(column.path);
+    }
+    std::vector<std::string> expected = {
+        "index", "name", "enabled", "pose.x", "pose.y", "pose.angle", "physics",
+        "hitbox", "sprite.width", "sprite.height", "sprite.data", "items",
+        "assigned_items.0", "assigned_items.1", "assigned_items.2"
+    };
+    ASSERT_EQ(paths, expected);
+    ASSERT_EQ(columns[7].type, datapack::ColumnType::Opaque);
+    ASSERT_EQ(columns[6].type, datapack::ColumnType::Enumerate);
+}
+
+TEST(Format, ColumnarEntity) {
+    std::vector<Entity> in;
+    for (int i = 0; i < 5; i++) {
+        Entity entity = Entity::example();
+        entity.index = i;
+        if (i % 2 == 0) {
+            entity.hitbox = Rect { 1.0, 0.5 * i };
+        }
+        in.push_back(entity);
+    }
+
+    auto data = datapack::write_columnar(in, 2);
+    datapack::ColumnarReader reader(data);
+    ASSERT_EQ(reader.metadata().row_groups.size(), 3);
+    ASSERT_EQ(reader.row_count(), 5);
+
+    auto out = datapack::read_columnar<Entity>(data);
+    ASSERT_EQ(in, out);
+}
+
+TEST(Format, ColumnarReadings) {
+    auto in = example_readings(1000);
+    auto data = datapack::write_columnar(in, 100);
+    datapack::ColumnarReader reader(data);
+    ASSERT_EQ(reader.read<Reading>(reader.select_row_groups()), in);
+
+    // Sensor names repeat, so use a dictionary
+    const auto& chunk = reader.metadata().row_groups[0].columns[2];
+    ASSERT_EQ(chunk.encoding, datapack::ColumnEncoding::Dictionary);
+    ASSERT_EQ(chunk.statistics.min, datapack::ColumnValue(std::string("sensor_0")));
+    ASSERT_EQ(chunk.statistics.max, datapack::ColumnValue(std::string("sensor_2")));
+    ASSERT_EQ(reader.metadata().row_groups[0].columns[3].statistics.null_count, 75);
+
+    // Smaller than the binary format with one record after another
+    ASSERT_LT(data.size(), datapack::write_binary(in).size());
+}
+
+TEST(Format, ColumnarSelect) {
+    auto in = example_readings(1000);
+    auto data = datapack::write_columnar(in, 100);
+    datapack::ColumnarReader reader(data);
+
+    // Times 3000 to 4000 are in rows 200 to 300
+    auto row_groups = reader.select_row_groups({
+        {"time", std::int64_t(3000), std::int64_t(4000)}
+    });
+    ASSERT_EQ(row_groups, std::vector<std::size_t>({2, 3}));
+
+    auto out = reader.read<Reading>(row_groups);
+    ASSERT_EQ(out.size(), 200);
+    ASSERT_EQ(out.front(), in[200]);
+
+    // Numeric columns can be compared with either numeric type
+    ASSERT_EQ(reader.select_row_groups({{"value", 10, std::nullopt}}).size(), 10);
+    ASSERT_EQ(reader.select_row_groups({{"value", 1000.0, std::nullopt}}).size(), 0);
+    ASSERT_EQ(reader.select_row_groups({{"sensor", std::string("sensor_3"), std::nullopt}}).size(), 0);
+    ASSERT_THROW(reader.select_row_groups({{"missing", std::nullopt, std::nullopt}}), datapack::ColumnarError);
+}
+
+TEST(Format, ColumnarBitpacked) {
+    // Unordered values in a small range, over several blocks of 128
+    std::vector<std::int64_t> in;
+    for (std::int64_t i = 0; i < 1000; i++) {
+        in.push_back(-1000 + (i * 7919) % 500);
+    }
+    auto data = datapack::write_columnar(in, 1000);
+    datapack::ColumnarReader reader(data);
+    ASSERT_EQ(reader.metadata().row_groups[0].columns[0].encoding, datapack::ColumnEncoding::Bitpacked);
+    ASSERT_EQ(reader.read<std::int64_t>(reader.select_row_groups()), in);
+
+    // Validity and dictionary indices are bitpacked the same way
+    auto readings = example_readings(1000);
+    auto readings_data = datapack::write_columnar(readings, 1000);
+    ASSERT_EQ(datapack::read_columnar<Reading>(readings_data), readings);
+}
+
+TEST(Format, ColumnarSelectUnsigned) {
+    // U64 values from 2^63 are ordered above smaller values
+    std::vector<std::uint64_t> in;
+    for (std::uint64_t i = 0; i < 100; i++) {
+        in.push_back(i < 50 ? i : (std::uint64_t(1) << 63) + i);
+    }
+    auto data = datapack::write_columnar(in, 10);
+    datapack::ColumnarReader reader(data);
+
+    auto row_groups = reader.select_row_groups({{"", std::uint64_t(1) << 63, std::nullopt}});
+    ASSERT_EQ(row_groups, std::vector<std::size_t>({5, 6, 7, 8, 9}));
+    ASSERT_EQ(reader.read<std::uint64_t>(row_groups).front(), in[50]);
+    ASSERT_EQ(reader.select_row_groups({{"", std::int64_t(-1), std::int64_t(5)}}).size(), 1);
+    ASSERT_EQ(reader.select_row_groups({{"", std::int64_t(60), std::nullopt}}).size(), 5);
+}
+
+TEST(Format, ColumnarProjection) {
+    auto in = example_readings(100);
+    auto data = datapack::write_columnar(in, 30);
+    datapack::ColumnarReader reader(data);
+
+    auto out = reader.read<Reading>(reader.select_row_groups(), {"time", "error"});
+    ASSERT_EQ(out.size(), in.size());
+    for (std::size_t i = 0; i < in.size(); i++) {
+        ASSERT_EQ(out[i].time, in[i].time);
+        ASSERT_EQ(out[i].error, in[i].error);
+        ASSERT_EQ(out[i].sensor, "");
+    }
+
+    auto entities = datapack::write_columnar(std::vector<Entity>{Entity::example()});
+    datapack::ColumnarReader entity_reader(entities);
+    auto entity = entity_reader.read<Entity>({0}, {"pose"});
+    ASSERT_EQ(entity[0].pose.x, Entity::example().pose.x);
+    ASSERT_TRUE(entity[0].items.empty());
+    ASSERT_FALSE(entity[0].hitbox.has_value());
+}
+
+TEST(Format, ColumnarReadColumn) {
+    auto in = example_readings(10);
+    auto data = datapack::write_columnar(in, 4);
+    datapack::ColumnarReader reader(data);
+    auto row_groups = reader.select_row_groups();
+
+    datapack::Object times = reader.read_column("time", row_groups);
+    ASSERT_TRUE(times.is_packed());
+    ASSERT_EQ(times.size(), 10);
+    ASSERT_EQ(*times[9].integer_if(), 1090);
+
+    datapack::Object errors = reader.read_column("error", row_groups);
+    ASSERT_EQ(*errors[4].integer_if(), 4);
+    ASSERT_TRUE(errors[5].is_null());
+
+    auto entities = datapack::write_columnar(std::vector<Entity>{Entity::example()});
+    datapack::ColumnarReader entity_reader(entities);
+    datapack::Object items = entity_reader.read_column("items", {0});
+    ASSERT_EQ(items.size(), 1);
+    ASSERT_EQ(items[0].size(), Entity::example().items.size());
+}
+
+TEST(Format, ColumnarInvalid) {
+    auto data = datapack::write_columnar(example_readings(10));
+    ASSERT_THROW(datapack::ColumnarReader(std::span(data).subspan(0, 10)), datapack::ColumnarError);
+    datapack::ColumnarReader reader(data);
+    ASSERT_THROW(reader.read<Entity>({0}), datapack::ColumnarError);
+}
+
+TEST(Format, ColumnarLimits) {
+    auto data = datapack::write_columnar(example_readings(200));
+    ASSERT_THROW(datapack::ColumnarReader(data, {.max_length = 100}), datapack::ColumnarError);
+    ASSERT_EQ(datapack::read_columnar<Reading>(data, {.max_length = 200}), example_readings(200));
+
+    // Replace the footer with one claiming far more rows than the chunks hold
+    std::uint64_t footer_size;
+    std::memcpy(&footer_size, data.data() + data.size() - 12, sizeof(footer_size));
+    std::size_t footer_begin = data.size() - 12 - footer_size;
+    auto metadata = datapack::ColumnarReader(data).metadata();
+    metadata.row_groups[0].row_count = std::uint64_t(1) << 60;
+    auto footer = datapack::write_binary(metadata);
+    std::vector<std::uint8_t> corrupt(data.begin(), data.begin() + footer_begin);
+    corrupt.insert(corrupt.end(), footer.begin(), footer.end());
+    footer_size = footer.size();
+    corrupt.insert(corrupt.end(), (std::uint8_t*)&footer_size, (std::uint8_t*)&footer_size + sizeof(footer_size));
+    corrupt.insert(corrupt.end(), data.end() - 4, data.end());
+
+    datapack::ColumnarReader reader(corrupt);
+    ASSERT_THROW(reader.read<Reading>({0}), datapack::ColumnarError);
+    ASSERT_THROW(reader.read_column("time", {0}), datapack::ColumnarError);
+}
@@ -0,0 +1,162 @@
+#include <gtest/gtest.h>
+#include <datapack/format/encoding_plan.hpp>
+#include <datapack/format/binary_reader.hpp>
+#include <datapack/format/binary_writer.hpp>
+#include <datapack/common.hpp>
+
+struct Sample {
+    std::uint64_t time;
+    std::int32_t level;
+    std::string source;
+    double value;
+};
+
+struct Trace {
+    std::uint32_t id;
+    std::string name;
+    std::vector<Sample> samples;
+};
+
+struct Offset {
+    std::int32_t x;
+    std::int32_t y;
+};
+
+struct Marker {
+    std::uint32_t id;
+    Offset offset;
+};
+
+bool operator==(const Sample& a, const Sample& b) {
+    return a.time == b.time && a.level == b.level && a.source == b.source && a.value == b.value;
+}
+
+bool operator==(const Trace& a, const Trace& b) {
+    return a.id == b.id && a.name == b.name && a.samples == b.samples;
+}
+
+namespace datapack {
+DATAPACK_INLINE(Sample, value, packer) {
+    packer.object_begin();
+    packer.value("time", value.time);
+    packer.value("level", value.level);
+    packer.value("source", value.source);
+    packer.value("value", value.value);
+    packer.object_end();
+}
+DATAPACK_INLINE(Trace, value, packer) {
+    packer.object_begin();
+    packer.value("id", value.id);
+    packer.value("name", value.name);
+    packer.value("samples", value.samples);
+    packer.object_end();
+}
+DATAPACK_INLINE(Offset, value, packer) {
+    packer.object_begin(sizeof(Offset));
+    packer.value("x", value.x);
+    packer.value("y", value.y);
+    packer.object_end(sizeof(Offset));
+}
+DATAPACK_INLINE(Marker, value, packer) {
+    packer.object_begin();
+    packer.value("id", value.id);
+    packer.value("offset", value.offset);
+    packer.object_end();
+}
+} // namespace datapack
+
+static Trace example_trace(std::uint32_t id) {
+    Trace trace;
+    trace.id = id;
+    trace.name = "trace_" + std::to_string(id);
+    std::uint64_t time = 1700000000000 + id * 1000;
+    for (int i = 0; i < 50; i++) {
+        time += 1 + (i * 7 + id) % 20;
+        Sample sample;
+        sample.time = time;
+        sample.level = -2 + (i + id) % 5;
+        sample.source = "source_" + std::to_string(i % 4);
+        sample.value = 0.1 * i + id;
+        trace.samples.push_back(sample);
+    }
+    return trace;
+}
+
+TEST(Format, EncodingPlanTrain) {
+    std::vector<Trace> traces;
+    std::vector<std::vector<std::uint8_t>> corpus;
+    for (std::uint32_t i = 0; i < 100; i++) {
+        traces.push_back(example_trace(i));
+        corpus.push_back(datapack::write_binary(traces.back()));
+    }
+
+    auto report = datapack::train_encoding_plan(datapack::create_schema<Trace>(), corpus);
+    const auto& plan = report.plan;
+    EXPECT_EQ(plan.encoding("id"), datapack::FieldEncoding::Varint);
+    EXPECT_EQ(plan.encoding("name"), datapack::FieldEncoding::Fixed);
+    EXPECT_EQ(plan.encoding("samples.*.time"), datapack::FieldEncoding::Delta);
+    EXPECT_EQ(plan.encoding("samples.*.level"), datapack::FieldEncoding::Varint);
+    EXPECT_EQ(plan.encoding("samples.*.source"), datapack::FieldEncoding::Dictionary);
+    EXPECT_LT(report.planned_bytes * 2, report.default_bytes);
+
+    for (const auto& field: report.fields) {
+        if (field.path == "samples.*.time") {
+            EXPECT_EQ(field.count, 5000);
+            EXPECT_GT(field.monotonic, 0.99);
+        }
+        if (field.path == "samples.*.source") {
+            EXPECT_EQ(field.distinct, 4);
+        }
+    }
+
+    // The plan can be stored, and data written with it is read back
+    // unchanged
+    auto loaded = datapack::read_binary<datapack::EncodingPlan>(datapack::write_binary(plan));
+    datapack::BinaryOptions options;
+    options.plan = &loaded;
+    for (const auto& trace: traces) {
+        auto data = datapack::write_binary(trace, options);
+        EXPECT_EQ(datapack::read_binary<Trace>(data, options), trace);
+    }
+}
+
+TEST(Format, EncodingPlanTrivial) {
+    std::vector<std::vector<std::uint8_t>> corpus;
+    for (std::uint32_t i = 0; i < 100; i++) {
+        corpus.push_back(datapack::write_binary(Marker{i, Offset{std::int32_t(i % 3), 1}}));
+    }
+
+    // Trivial blocks are written as they are in memory, so their fields
+    // aren't planned
+    auto report = datapack::train_encoding_plan(datapack::create_schema<Marker>(), corpus);
+    EXPECT_EQ(report.plan.encoding("id"), datapack::FieldEncoding::Varint);
+    EXPECT_EQ(report.plan.encoding("offset.x"), datapack::FieldEncoding::Fixed);
+    for (const auto& field: report.fields) {
+        EXPECT_EQ(field.path, "id");
+    }
+}
+
+TEST(Format, EncodingPlanInvalid) {
+    datapack::EncodingPlan plan({
+        {"id", datapack::FieldEncoding::Varint},
+        {"name", datapack::FieldEncoding::Dictionary}
+    });
+    datapack::BinaryOptions options;
+    options.plan = &plan;
+    auto data = datapack::write_binary(example_trace(1000000), options);
+
+    data.resize(2);
+    datapack::BinaryReader reader(data, options);
+    Trace trace;
+    reader.value(trace);
+    EXPECT_FALSE(reader.valid());
+
+    // Planned values that don't fit the field are rejected
+    data = datapack::write_binary(example_trace(1), options);
+    ASSERT_EQ(data[0], 1);
+    data.erase(data.begin());
+    data.insert(data.begin(), {0x80, 0x80, 0x80, 0x80, 0x80, 0x20});
+    datapack::BinaryReader range_reader(data, options);
+    range_reader.value(trace);
+    EXPECT_FALSE(range_reader.valid());
+}
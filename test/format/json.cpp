@@ -1,5 +1,6 @@
 #include <gtest/gtest.h>
 #include <datapack/format/json.hpp>
+#include <datapack/common.hpp>
 #include <datapack/examples/entity.hpp>
 
 static std::vector<std::string> get_lines(const std::string& text) {
@@ -97,3 +98,110 @@ TEST(Format, JsonLoad) {
     auto expected = Entity::example();
     ASSERT_EQ(value, expected);
 }
+
+TEST(Format, JsonPackedArray) {
+    const std::string json = "[\n    0.5,\n    1.5,\n    -2.25\n]";
+    auto object = datapack::load_json(json);
+    ASSERT_TRUE(object.floating_array_if());
+    EXPECT_EQ(object.memory_stats().node_count, 1);
+    EXPECT_EQ(datapack::dump_json(object), json);
+
+    auto values = datapack::read_object<std::vector<double>>(object);
+    EXPECT_EQ(values, std::vector<double>({0.5, 1.5, -2.25}));
+
+    datapack::ObjectReader reader(object);
+    auto [data, length] = reader.floating_array(datapack::FloatType::F32, 0);
+    ASSERT_EQ(length, 3);
+    EXPECT_EQ(((const float*)data)[2], -2.25f);
+
+    // Packed arrays are only read with their element type
+    EXPECT_FALSE(std::get<0>(reader.integer_array(datapack::IntType::I64, 0)));
+    EXPECT_FALSE(reader.valid());
+    datapack::ObjectReader struct_reader(object);
+    EXPECT_FALSE(std::get<0>(struct_reader.binary(0, sizeof(double))));
+
+    // Elements that don't fit in the element type invalidate the reader
+    auto integers = datapack::load_json("[1, 300, 2]");
+    ASSERT_TRUE(integers.integer_array_if());
+    datapack::ObjectReader narrow_reader(integers);
+    EXPECT_FALSE(std::get<0>(narrow_reader.integer_array(datapack::IntType::U8, 0)));
+    EXPECT_FALSE(narrow_reader.valid());
+    datapack::ObjectReader wide_reader(integers);
+    auto [wide, wide_length] = wide_reader.integer_array(datapack::IntType::U32, 3);
+    ASSERT_EQ(wide_length, 3);
+    EXPECT_EQ(((const std::uint32_t*)wide)[1], 300);
+
+    auto numbers = datapack::load_json("[1, 2.5]");
+    EXPECT_FALSE(numbers.is_packed());
+    ASSERT_TRUE(numbers[0].integer_if());
+    EXPECT_EQ(numbers[1].floating(), 2.5);
+
+    auto mixed = datapack::load_json("[1, 2.5, true]");
+    EXPECT_FALSE(mixed.is_packed());
+    EXPECT_EQ(mixed.size(), 3);
+    EXPECT_TRUE(mixed[2].boolean());
+}
+
+TEST(Format, JsonDedupe) {
+    std::string json = "[";
+    for (int i = 0; i < 50; i++) {
+        json += (i == 0 ? "" : ",") + entity_json;
+    }
+    json += "]";
+
+    auto object = datapack::load_json(json, {.dedupe = true});
+    auto expected = datapack::load_json(json);
+    EXPECT_EQ(object.memory_stats().node_count, 51);
+    EXPECT_EQ(object, expected);
+    EXPECT_EQ(datapack::dump_json(object), datapack::dump_json(expected));
+
+    // Shared children are read in place
+    auto values = datapack::read_object<std::vector<Entity>>(object);
+    ASSERT_EQ(values.size(), 50);
+    EXPECT_EQ(datapack::write_json(values[49]), datapack::write_json(Entity::example()));
+}
+
+TEST(Format, JsonDumpParallel) {
+    datapack::Object object;
+    object["name"] = "large";
+    auto records = object["records"];
+    for (std::size_t i = 0; i < 20000; i++) {
+        auto record = *records.push_back(datapack::Object::map_t());
+        record["index"] = datapack::Object::integer_t(i);
+        record["label"] = "record_" + std::to_string(i);
+        record["position"]["x"] = 0.5 * i + 0.25;
+        record["position"]["y"] = -0.25 * i - 0.125;
+        record["tags"].push_back("a");
+        record["tags"].push_back("b");
+    }
+    object["empty"] = datapack::Object::list_t();
+
+    const std::string serial = datapack::dump_json(object);
+    EXPECT_EQ(datapack::dump_json(object, 2), serial);
+    EXPECT_EQ(datapack::dump_json(object, 7), serial);
+    EXPECT_EQ(datapack::dump_json(object, 0), serial);
+    EXPECT_EQ(datapack::load_json(serial), object);
+
+    // Subtree sizes include shared children
+    datapack::Object deduped = object.clone();
+    deduped.dedupe();
+    EXPECT_EQ(datapack::dump_json(deduped, 4), serial);
+}
+
+TEST(Format, JsonValidateUtf8) {
+    const std::string valid = "{\"caf\xC3\xA9\": \"\xE6\x97\xA5\"}";
+    ASSERT_EQ(datapack::load_json(valid, {.validate_utf8 = true}), datapack::load_json(valid));
+
+    // Overlong encoding of '/', then a truncated sequence in a key
+    EXPECT_THROW(datapack::load_json("[\"a\xC0\xAF\"]", {.validate_utf8 = true}), datapack::JsonLoadError);
+    EXPECT_THROW(datapack::load_json("{\"\xE6\x97\": 1}", {.validate_utf8 = true}), datapack::JsonLoadError);
+    EXPECT_NO_THROW(datapack::load_json("[\"a\xC0\xAF\"]"));
+
+    // Objects can hold any bytes, so ObjectReader validates separately
+    datapack::Object object;
+    object = std::string("\xFF");
+    std::string out;
+    datapack::ObjectReader reader(object, true);
+    reader.value(out);
+    EXPECT_FALSE(reader.valid());
+}
@@ -0,0 +1,73 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fcntl.h>
+#include <unistd.h>
+#include <datapack/format/scatter_writer.hpp>
+#include <datapack/format/binary_reader.hpp>
+#include <datapack/common.hpp>
+
+struct Image {
+    std::string name;
+    std::vector<std::uint8_t> pixels;
+    std::vector<double> histogram;
+    std::uint32_t id;
+};
+
+namespace datapack {
+DATAPACK_INLINE(Image, value, packer) {
+    packer.object_begin();
+    packer.value("name", value.name);
+    packer.value("pixels", value.pixels);
+    packer.value("histogram", value.histogram);
+    packer.value("id", value.id);
+    packer.object_end();
+}
+} // namespace datapack
+
+TEST(Format, ScatterWriter) {
+    Image image;
+    image.name = "frame";
+    image.pixels.resize(1 << 20);
+    for (std::size_t i = 0; i < image.pixels.size(); i++) {
+        image.pixels[i] = i * 7;
+    }
+    image.histogram = {0.5, 0.25, 0.25};
+    image.id = 42;
+
+    for (std::size_t alignment: {0, 64}) {
+        datapack::BinaryOptions options;
+        options.binary_alignment = alignment;
+        auto expected = datapack::write_binary(image, options);
+
+        std::vector<std::uint8_t> buffer;
+        datapack::ScatterWriter writer(buffer, 4096, options);
+        writer.value(image);
+
+        // The pixels are referenced, and the small fields around them are
+        // in the buffer
+        auto segments = writer.segments();
+        ASSERT_EQ(segments.size(), 3);
+        EXPECT_EQ(segments[1].iov_base, image.pixels.data());
+        EXPECT_LT(buffer.size(), 4096);
+        EXPECT_EQ(writer.size(), expected.size());
+        EXPECT_EQ(writer.flatten(), expected);
+
+        auto path = std::filesystem::temp_directory_path() / "datapack_test_scatter";
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        ASSERT_GE(fd, 0);
+        writer.write_to(fd);
+        writer.write_to(fd, expected.size());
+        std::vector<std::uint8_t> written(2 * expected.size());
+        ASSERT_EQ(::pread(fd, written.data(), written.size(), 0), written.size());
+        ::close(fd);
+        std::filesystem::remove(path);
+
+        std::span<const std::uint8_t> second(written.data() + expected.size(), expected.size());
+        EXPECT_TRUE(std::equal(second.begin(), second.end(), expected.begin()));
+        auto result = datapack::read_binary<Image>(second, options);
+        EXPECT_EQ(result.name, image.name);
+        EXPECT_EQ(result.pixels, image.pixels);
+        EXPECT_EQ(result.histogram, image.histogram);
+        EXPECT_EQ(result.id, image.id);
+    }
+}
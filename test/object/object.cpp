@@ -1,5 +1,6 @@
 #include <gtest/gtest.h>
 #include <datapack/object.hpp>
+#include <datapack/format/json.hpp>
 
 TEST(Object, Edit) {
     using namespace datapack;
@@ -59,3 +60,327 @@ TEST(Object, Compare) {
 
     ASSERT_TRUE(a == b);
 }
+
+TEST(Object, Cursor) {
+    using namespace datapack;
+
+    Object object;
+    object["a"] = 1;
+    object["b"].push_back(2);
+    object["b"].push_back(3);
+    object["c"] = Object::map_t();
+
+    std::vector<std::string> events;
+    for (auto cursor = Object::ConstCursor(object); cursor; cursor.next()) {
+        std::string event = (cursor.entering() ? "enter " : "exit ");
+        event += cursor.iter()->key() + " " + std::to_string(cursor.depth());
+        events.push_back(event);
+    }
+
+    std::vector<std::string> expected = {
+        "enter  0",
+        "enter a 1",
+        "enter b 1",
+        "enter  2",
+        "enter  2",
+        "exit b 1",
+        "enter c 1",
+        "exit c 1",
+        "exit  0"
+    };
+    EXPECT_EQ(events, expected);
+}
+
+TEST(Object, Merge) {
+    using namespace datapack;
+
+    Object base;
+    base["a"] = 1;
+    base["b"]["c"] = 2;
+    base["b"]["d"] = 3;
+    base["l"].push_back(1);
+    base["l"].push_back(2);
+    base["l"].push_back(3);
+
+    Object diff;
+    diff["a"] = Object::null_t();
+    diff["b"]["c"] = 5;
+    diff["e"]["f"] = 1;
+    diff["l"]["1"] = 7;
+    diff["l"]["2"] = Object::null_t();
+
+    Object expected;
+    expected["b"]["c"] = 5;
+    expected["b"]["d"] = 3;
+    expected["l"].push_back(1);
+    expected["l"].push_back(7);
+    expected["e"]["f"] = 1;
+
+    EXPECT_EQ(merge(base, diff), expected);
+}
+
+TEST(Object, MemoryStats) {
+    using namespace datapack;
+
+    Object object;
+    object["a"] = 1;
+    object["b"] = std::string(100, 'x');
+    object["c"] = Object::binary_t(50);
+    object["d"] = 2;
+    object.find("d")->erase();
+    object["e"].push_back(3);
+
+    auto stats = object.memory_stats();
+    EXPECT_EQ(stats.node_count, 6);
+    EXPECT_EQ(stats.node_slots, stats.node_count + stats.free_slots);
+    EXPECT_GE(stats.string_bytes, 100);
+    EXPECT_GE(stats.binary_bytes, 50);
+    EXPECT_EQ(stats.key_bytes, 0);
+    EXPECT_GT(stats.overhead_per_node(), 0);
+}
+
+TEST(Object, KeyTable) {
+    using namespace datapack;
+
+    const std::string key = "a_key_too_long_for_the_small_string_buffer";
+    Object object;
+    for (int i = 0; i < 100; i++) {
+        auto record = *object.push_back(Object::map_t());
+        record[key] = i;
+        record["id"] = i;
+    }
+    auto stats = object.memory_stats();
+    EXPECT_EQ(stats.node_count, 301);
+    EXPECT_LT(stats.key_bytes, 2 * key.size());
+    EXPECT_EQ(object[99].at(key).integer(), 99);
+    EXPECT_EQ(object[99].iter().child()->key(), key);
+    EXPECT_FALSE(object[0].find("missing"));
+
+    // Keys are copied between objects by value
+    Object copy = object[5].clone();
+    EXPECT_EQ(copy.at(key).integer(), 5);
+    EXPECT_EQ(copy.at("id").integer(), 5);
+}
+
+TEST(Object, KeyChurn) {
+    using namespace datapack;
+
+    // Maps keyed by changing ids reuse the slots of erased keys
+    Object object;
+    object["fixed"] = -1;
+    std::size_t key_table_bytes = 0;
+    for (int i = 0; i < 1000; i++) {
+        object["id_" + std::to_string(i)] = i;
+        if (i >= 10) {
+            object.at("id_" + std::to_string(i - 10)).erase();
+        }
+        if (i == 100) {
+            key_table_bytes = object.memory_stats().key_table_bytes;
+        }
+    }
+    EXPECT_EQ(object.memory_stats().key_table_bytes, key_table_bytes);
+    EXPECT_EQ(object.at("fixed").integer(), -1);
+    EXPECT_FALSE(object.find("id_989"));
+    for (int i = 990; i < 1000; i++) {
+        EXPECT_EQ(object.at("id_" + std::to_string(i)).integer(), i);
+        EXPECT_EQ(object.at("id_" + std::to_string(i)).key(), "id_" + std::to_string(i));
+    }
+
+    // A key stays while any node still uses it
+    Object records;
+    (*records.push_back(Object::map_t()))["shared"] = 1;
+    (*records.push_back(Object::map_t()))["shared"] = 2;
+    records[0].erase();
+    EXPECT_EQ(records[0].at("shared").integer(), 2);
+}
+
+TEST(Object, Dedupe) {
+    using namespace datapack;
+
+    // Two distinct records, which share the same range and tags
+    Object object;
+    for (int i = 0; i < 100; i++) {
+        auto record = *object.push_back(Object::map_t());
+        record["unit"] = "metres";
+        record["range"]["min"] = 0.0;
+        record["range"]["max"] = 10.0;
+        record["tags"].push_back("sensor");
+        record["tags"].push_back("outdoor");
+        record["id"] = i % 2;
+    }
+    const Object original = object.clone();
+    auto before = object.memory_stats();
+
+    object.dedupe();
+    auto after = object.memory_stats();
+    EXPECT_EQ(after.node_count, 101);
+    // The records share their children, which include copies of the range
+    // and tags shared earlier, since shared children don't nest
+    EXPECT_EQ(after.shared_count, 2);
+    EXPECT_LT(after.total_bytes(), before.total_bytes() / 2);
+    EXPECT_EQ(object, original);
+    EXPECT_EQ(original, object);
+
+    const Object& view = object;
+    EXPECT_TRUE(view[0].shares_with(view[2]));
+    EXPECT_FALSE(view[0].shares_with(view[1]));
+    EXPECT_EQ(view[1].size(), 4);
+    EXPECT_EQ(view[3].at("range").at("max").floating(), 10.0);
+    EXPECT_EQ(view[3].at("tags")[1].string(), "outdoor");
+
+    // parent() leaves shared children through the node that shares them
+    auto max = view[3].at("range").find("max");
+    EXPECT_EQ(max.parent().parent()->at("id").integer(), 1);
+    EXPECT_EQ(max.parent().parent().parent()->size(), 100);
+
+    std::size_t nodes = 0;
+    for (auto cursor = Object::ConstCursor(object); cursor; cursor.next()) {
+        nodes += cursor.entering();
+        auto root = cursor.iter();
+        for (int i = 0; i < cursor.depth(); i++) {
+            root = root.parent();
+        }
+        EXPECT_EQ(root->size(), 100);
+    }
+    EXPECT_EQ(nodes, before.node_count);
+
+    // Copies keep sharing, and modifying a node copies its shared children
+    Object copy = object;
+    EXPECT_TRUE(copy[0].shares_with(view[0]));
+    copy[4]["range"]["max"] = 20.0;
+    EXPECT_FALSE(copy[4].is_shared());
+    EXPECT_TRUE(copy[2].shares_with(view[4]));
+    EXPECT_EQ(copy[4].at("range").at("max").floating(), 20.0);
+    EXPECT_EQ(view[4].at("range").at("max").floating(), 10.0);
+    EXPECT_EQ(copy[2].at("range").at("max").floating(), 10.0);
+    EXPECT_FALSE(copy == original);
+    copy[4]["range"]["max"] = 10.0;
+    EXPECT_EQ(copy, original);
+
+    // Packed arrays in shared children are read in place, and expanded in
+    // the modified copy only
+    Object arrays = load_json(R"([{ "x": [1, 2, 3] }, { "x": [1, 2, 3] }])");
+    arrays.dedupe();
+    Object arrays_copy = arrays;
+    const Object& arrays_view = arrays;
+    ASSERT_TRUE(arrays_view[0].shares_with(arrays_copy[1]));
+    EXPECT_EQ(arrays_view[0].at("x")[2].integer(), 3);
+    EXPECT_EQ(arrays_view[1].at("x").iter().child().next()->integer(), 2);
+    EXPECT_TRUE(arrays_view[1].at("x").is_packed());
+    arrays_copy[1]["x"][0] = 5;
+    EXPECT_FALSE(arrays_copy[1].at("x").is_packed());
+    EXPECT_TRUE(arrays_view[1].at("x").is_packed());
+    EXPECT_TRUE(arrays_view[0].shares_with(arrays_copy[0]));
+    EXPECT_EQ(arrays_view[1].at("x")[0].integer(), 1);
+}
+
+TEST(Object, PackedArray) {
+    using namespace datapack;
+
+    Object packed;
+    packed.push_back_packed(1);
+    packed.push_back_packed(2);
+    packed.push_back_packed(3);
+    ASSERT_TRUE(packed.integer_array_if());
+    EXPECT_TRUE(packed.is_list());
+    EXPECT_EQ(packed.size(), 3);
+
+    Object expanded;
+    expanded.push_back(1);
+    expanded.push_back(2);
+    expanded.push_back(3);
+    EXPECT_EQ(packed, expanded);
+    EXPECT_EQ(expanded, packed);
+
+    // Integers and floats together fall back to a regular list, so each
+    // element keeps its type
+    Object numbers = packed.clone();
+    numbers.push_back_packed(4.5);
+    EXPECT_FALSE(numbers.is_packed());
+    EXPECT_EQ(numbers.size(), 4);
+    EXPECT_EQ(numbers[0].integer(), 1);
+    EXPECT_EQ(numbers[3].floating(), 4.5);
+    Object floats;
+    floats.push_back_packed(0.5);
+    floats.push_back_packed(2);
+    EXPECT_FALSE(floats.is_packed());
+    EXPECT_EQ(floats[1].integer(), 2);
+
+    // Other types fall back to a regular list
+    Object mixed = packed.clone();
+    mixed.push_back_packed("a");
+    EXPECT_FALSE(mixed.is_packed());
+    EXPECT_EQ(mixed.size(), 4);
+    EXPECT_EQ(mixed[0].integer(), 1);
+    EXPECT_EQ(mixed[3].string(), "a");
+
+    // Const access reads elements in place
+    const Object& const_packed = packed;
+    EXPECT_EQ(const_packed[1].integer(), 2);
+    EXPECT_FALSE(const_packed[3].iter());
+    EXPECT_THROW(const_packed[1].size(), Object::ValueException);
+    std::vector<Object::integer_t> elements;
+    for (auto iter = const_packed.iter().child(); iter; iter = iter.next()) {
+        EXPECT_EQ(iter.parent()->size(), 3);
+        elements.push_back(iter->integer());
+    }
+    EXPECT_EQ(elements, (std::vector<Object::integer_t>{1, 2, 3}));
+    EXPECT_EQ(const_packed[2].clone().integer(), 3);
+    ASSERT_TRUE(packed.is_packed());
+
+    // Element accessors refer into the array, so outlive the reference
+    const auto& element = const_packed[1].integer();
+    EXPECT_EQ(&element, &(*packed.integer_array_if())[1]);
+    EXPECT_EQ(element, 2);
+    EXPECT_FALSE(const_packed[1].floating_if());
+    EXPECT_THROW(const_packed[1].value(), Object::ValueException);
+    EXPECT_TRUE(const_packed[1] == expanded[1]);
+    EXPECT_FALSE(const_packed[1] == expanded[2]);
+
+    // Accessing elements through a mutable reference expands the array
+    packed[1] = 5;
+    EXPECT_FALSE(packed.is_packed());
+    EXPECT_EQ(packed[1].integer(), 5);
+    EXPECT_EQ(packed.size(), 3);
+}
+
+TEST(Object, Splice) {
+    using namespace datapack;
+
+    Object fragment;
+    fragment["text"] = "a string too long for the small string buffer";
+    fragment["values"] = Object::integer_array_t{1, 2, 3};
+    fragment["items"].push_back("a");
+    fragment["items"].push_back("b");
+    fragment["items"][0].erase();
+    const Object expected = fragment.clone();
+    const char* text = fragment["text"].string().data();
+
+    Object response;
+    response["status"] = "ok";
+    auto body = response.splice("body", std::move(fragment));
+    EXPECT_TRUE(fragment.is_null());
+    EXPECT_EQ(body->key(), "body");
+    EXPECT_EQ(*body, expected);
+    EXPECT_EQ(response["body"]["items"][0].string(), "b");
+    // Strings are moved, not copied
+    EXPECT_EQ(response["body"]["text"].string().data(), text);
+
+    response["pages"].splice(expected.clone());
+    response["pages"].splice(expected.clone());
+    EXPECT_EQ(response["pages"].size(), 2);
+    EXPECT_EQ(response["pages"][1], expected);
+    EXPECT_THROW(response["status"].splice(Object()), Object::ValueException);
+
+    // Moving within an object relinks the node, so references stay valid
+    auto items = response["body"]["items"];
+    auto moved = items.move_to(response, "items");
+    EXPECT_EQ(moved->key(), "items");
+    EXPECT_EQ(items[0].string(), "b");
+    EXPECT_FALSE(response["body"].find("items"));
+    EXPECT_EQ(response["body"].size(), 2);
+    response["pages"][0].move_to(response["pages"]);
+    EXPECT_EQ(response["pages"].size(), 2);
+    EXPECT_THROW(response["pages"].move_to(response["pages"][0]), Object::ValueException);
+    EXPECT_THROW(response["pages"].move_to(expected.clone()), Object::ValueException);
+}
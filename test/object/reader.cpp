@@ -12,3 +12,23 @@ TEST(Object, Reader) {
 
     EXPECT_EQ(in, out);
 }
+
+TEST(Object, ReaderKeyOrder) {
+    using namespace datapack;
+
+    // Fields are found when they aren't in the order they're read
+    Object object;
+    object["angle"] = 3.0;
+    object["x"] = 1.0;
+    object["extra"] = "ignored";
+    object["y"] = 2.0;
+    Pose pose = read_object<Pose>(object);
+    EXPECT_EQ(pose.x, 1.0);
+    EXPECT_EQ(pose.y, 2.0);
+    EXPECT_EQ(pose.angle, 3.0);
+
+    object.find("y")->erase();
+    ObjectReader reader(object);
+    reader.value(pose);
+    EXPECT_FALSE(reader.valid());
+}
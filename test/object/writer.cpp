@@ -1,6 +1,7 @@
 #include <gtest/gtest.h>
 #include <datapack/util/object_writer.hpp>
 #include <datapack/examples/entity.hpp>
+#include <datapack/common.hpp>
 #include <cmath>
 
 TEST(Object, Writer) {
@@ -18,14 +19,14 @@ TEST(Object, Writer) {
 
         auto pose = expected["pose"];
         pose["x"] = 1.0;
-        pose["y"] = 1.0;
-        pose["angle"] = M_PI/2;
+        pose["y"] = 2.0;
+        pose["angle"] = 3.0;
 
         expected["physics"] = "kinematic";
 
         auto hitbox = expected["hitbox"];
         hitbox["type"] = "circle";
-        hitbox["value"]["radius"] = 1.0;
+        hitbox["value_circle"]["radius"] = 1.0;
 
         auto sprite = expected["sprite"];
         sprite["width"] = 2;
@@ -51,6 +52,11 @@ TEST(Object, Writer) {
         add_item(1, "map");
         add_item(120, "gold");
 
+        auto assigned_items = expected["assigned_items"];
+        assigned_items.push_back(1);
+        assigned_items.push_back(2);
+        assigned_items.push_back(-1);
+
         return expected;
     }();
 
@@ -62,5 +68,16 @@ TEST(Object, Writer) {
     EXPECT_TRUE(object.at("hitbox") == expected.at("hitbox"));
     EXPECT_TRUE(object.at("sprite") == expected.at("sprite"));
     EXPECT_TRUE(object.at("items") == expected.at("items"));
+    EXPECT_TRUE(object.at("assigned_items") == expected.at("assigned_items"));
     EXPECT_TRUE(object == expected);
 }
+
+TEST(Object, WriterDedupe) {
+    using namespace datapack;
+
+    std::vector<Entity> entities(20, Entity::example());
+    const Object object = write_object(entities, true);
+    EXPECT_EQ(object.memory_stats().node_count, 21);
+    EXPECT_EQ(object, write_object(entities));
+    EXPECT_TRUE(object[0].shares_with(object[19]));
+}
@@ -0,0 +1,93 @@
+#include <gtest/gtest.h>
+#include <datapack/aggregate.hpp>
+#include <datapack/common.hpp>
+#include <datapack/format/binary_reader.hpp>
+#include <datapack/format/binary_writer.hpp>
+#include <datapack/schema/schema.hpp>
+
+struct AutoPose {
+    float x;
+    double y;
+    float angle;
+    bool operator==(const AutoPose& other) const {
+        return x == other.x && y == other.y && angle == other.angle;
+    }
+};
+
+struct AutoBody {
+    std::string name;
+    AutoPose pose;
+    std::vector<AutoPose> path;
+    std::optional<std::uint32_t> parent;
+    bool operator==(const AutoBody& other) const {
+        return name == other.name && pose == other.pose && path == other.path && parent == other.parent;
+    }
+};
+
+// The same types, with handwritten pack functions
+struct HandPose {
+    float x;
+    double y;
+    float angle;
+};
+
+struct HandBody {
+    std::string name;
+    HandPose pose;
+    std::vector<HandPose> path;
+    std::optional<std::uint32_t> parent;
+};
+
+namespace datapack {
+DATAPACK_AUTO(AutoPose);
+DATAPACK_AUTO(AutoBody);
+
+DATAPACK_INLINE(HandPose, value, packer) {
+    packer.object_begin(sizeof(HandPose));
+    packer.value("x", value.x);
+    packer.value("y", value.y);
+    packer.value("angle", value.angle);
+    packer.object_end(sizeof(HandPose));
+}
+DATAPACK_INLINE(HandBody, value, packer) {
+    packer.object_begin();
+    packer.value("name", value.name);
+    packer.value("pose", value.pose);
+    packer.value("path", value.path);
+    packer.value("parent", value.parent);
+    packer.object_end();
+}
+} // namespace datapack
+
+static_assert(datapack::aggregate_field_count<AutoPose> == 3);
+static_assert(datapack::aggregate_field_count<AutoBody> == 4);
+static_assert(datapack::is_trivial_aggregate<AutoPose>());
+static_assert(!datapack::is_trivial_aggregate<AutoBody>());
+
+TEST(Schema, Aggregate) {
+    auto names = datapack::aggregate_field_names<AutoBody>();
+    ASSERT_EQ(names.size(), 4);
+    EXPECT_STREQ(names[0], "name");
+    EXPECT_STREQ(names[1], "pose");
+    EXPECT_STREQ(names[2], "path");
+    EXPECT_STREQ(names[3], "parent");
+
+    // Identical to the handwritten definitions
+    EXPECT_EQ(datapack::create_schema<AutoBody>(), datapack::create_schema<HandBody>());
+
+    AutoBody body;
+    body.name = "body";
+    body.pose = {1, 2, 3};
+    body.path = {{4, 5, 6}, {7, 8, 9}};
+    body.parent = 12;
+    HandBody hand;
+    hand.name = body.name;
+    hand.pose = {1, 2, 3};
+    hand.path = {{4, 5, 6}, {7, 8, 9}};
+    hand.parent = 12;
+    // The path is copied as binary, including the padding of each pose, so
+    // compare values rather than bytes
+    EXPECT_EQ(datapack::read_binary<AutoBody>(datapack::write_binary(hand)), body);
+    EXPECT_EQ(datapack::read_binary<AutoBody>(datapack::write_binary(body)), body);
+    EXPECT_EQ(datapack::write_binary(body).size(), datapack::write_binary(hand).size());
+}
@@ -7,6 +7,71 @@
 #include <datapack/format/binary_writer.hpp>
 #include <datapack/format/binary_reader.hpp>
 
+// Trivial, with 8 bytes of padding
+struct Sample {
+    float x;
+    double y;
+    float z;
+};
+
+struct Track {
+    std::vector<Sample> samples;
+    Sample last;
+};
+
+namespace datapack {
+DATAPACK_INLINE(Sample, value, packer) {
+    packer.object_begin(sizeof(Sample));
+    packer.value("x", value.x);
+    packer.value("y", value.y);
+    packer.value("z", value.z);
+    packer.object_end(sizeof(Sample));
+}
+DATAPACK_INLINE(Track, value, packer) {
+    packer.object_begin();
+    packer.value("samples", value.samples);
+    packer.value("last", value.last);
+    packer.object_end();
+}
+}
+
+struct Series {
+    std::string name;
+    std::vector<double> values;
+    std::array<float, 3> scale;
+};
+
+namespace datapack {
+DATAPACK_INLINE(Series, value, packer) {
+    packer.object_begin();
+    packer.value("name", value.name);
+    packer.value("values", value.values);
+    packer.value("scale", value.scale);
+    packer.object_end();
+}
+}
+
+// Reads data written by the typed writer through the schema, returning the
+// re-encoded data and the decoded object
+static std::tuple<std::vector<std::uint8_t>, datapack::Object> schema_round_trip(
+    const datapack::Schema& schema,
+    const std::vector<std::uint8_t>& data,
+    const datapack::BinaryOptions& options)
+{
+    std::vector<std::uint8_t> encoded;
+    datapack::BinaryReader reader(data, options);
+    datapack::BinaryWriter writer(encoded, options);
+    datapack::use_schema(schema, reader, writer);
+    EXPECT_TRUE(reader.valid());
+
+    datapack::Object object;
+    datapack::BinaryReader object_reader(data, options);
+    datapack::ObjectWriter object_writer(object);
+    datapack::use_schema(schema, object_reader, object_writer);
+    EXPECT_TRUE(object_reader.valid());
+    return std::make_tuple(encoded, object);
+}
+
 
 TEST(Schema, ObjectToBinary) {
     auto schema = datapack::create_schema<Entity>();
@@ -34,3 +99,122 @@ TEST(Schema, BinaryToObject) {
 
     EXPECT_EQ(out_direct, out_schema);
 }
+
+TEST(Schema, RandomBinary) {
+    auto schema = datapack::create_schema<Entity>();
+
+    datapack::RandomBinaryOptions options;
+    options.seed = 5;
+    options.threads = 4;
+    auto messages = datapack::random_binary(schema, 500, options);
+    ASSERT_EQ(messages.size(), 500);
+    for (const auto& message: messages) {
+        Entity value;
+        datapack::BinaryReader reader(message);
+        reader.value(value);
+        ASSERT_TRUE(reader.valid());
+    }
+
+    // Same output with a single thread
+    options.threads = 1;
+    ASSERT_EQ(messages, datapack::random_binary(schema, 500, options));
+    options.seed = 6;
+    ASSERT_NE(messages, datapack::random_binary(schema, 500, options));
+
+    // Sizes follow the options
+    using Names = std::vector<std::string>;
+    options.random.min_list_length = 3;
+    options.random.max_list_length = 3;
+    options.random.min_string_length = 5;
+    options.random.max_string_length = 5;
+    for (const auto& message: datapack::random_binary(datapack::create_schema<Names>(), 10, options)) {
+        Names names = datapack::read_binary<Names>(message);
+        ASSERT_EQ(names.size(), 3);
+        for (const auto& name: names) {
+            ASSERT_EQ(name.size(), 5);
+        }
+    }
+}
+
+TEST(Schema, BinaryEncodeJob) {
+    auto schema = datapack::create_schema<std::vector<Entity>>();
+
+    std::vector<Entity> value;
+    for (int i = 0; i < 20; i++) {
+        value.push_back(datapack::random<Entity>());
+    }
+    datapack::Object object = datapack::write_object(value);
+    std::vector<std::uint8_t> expected = datapack::write_binary(value);
+
+    // The job encodes its own snapshot, so the source can change
+    datapack::BinaryEncodeJob job(schema, object);
+    object = datapack::Object::null_t();
+
+    std::size_t steps = 0;
+    while (!job.step_bytes(64)) {
+        steps++;
+        ASSERT_FALSE(job.done());
+    }
+    EXPECT_GT(steps, expected.size() / 1024);
+    EXPECT_TRUE(job.done());
+    EXPECT_TRUE(job.valid());
+    EXPECT_EQ(job.result(), expected);
+
+    datapack::BinaryEncodeJob timed(schema, datapack::write_object(value), expected.size());
+    EXPECT_TRUE(timed.step(std::chrono::seconds(10)));
+    EXPECT_EQ(timed.result(), expected);
+}
+
+TEST(Schema, BinaryPacked) {
+    auto schema = datapack::create_schema<Track>();
+    Track value;
+    value.samples = { Sample{1, 2, 3}, Sample{4, 5, 6} };
+    value.last = Sample{7, 8, 9};
+
+    datapack::BinaryOptions options;
+    options.packed = true;
+    std::vector<std::uint8_t> typed = datapack::write_binary(value, options);
+    // Length, then each sample without padding
+    EXPECT_EQ(typed.size(), 8 + 3 * 16);
+
+    auto [encoded, object] = schema_round_trip(schema, typed, options);
+    EXPECT_EQ(encoded, typed);
+    EXPECT_EQ(object, datapack::write_object(value));
+
+    datapack::BinaryEncodeJob job(schema, object, 0, options);
+    EXPECT_TRUE(job.step(std::chrono::seconds(10)));
+    EXPECT_EQ(job.result(), typed);
+
+    Track result = datapack::read_binary<Track>(typed, options);
+    EXPECT_EQ(result.samples[1].y, 5);
+    EXPECT_EQ(result.last.z, 9);
+}
+
+TEST(Schema, BinaryAlignment) {
+    auto schema = datapack::create_schema<Series>();
+    Series value;
+    value.name = "abc";
+    value.values = { 0.5, 1.5, 2.5 };
+    value.scale = { 1, 2, 3 };
+
+    datapack::BinaryOptions options;
+    options.binary_alignment = 64;
+    std::vector<std::uint8_t> typed = datapack::write_binary(value, options);
+    // Name and length, then each array at a multiple of 64 bytes
+    EXPECT_EQ(typed.size(), 128 + 3 * 4);
+
+    auto [encoded, object] = schema_round_trip(schema, typed, options);
+    EXPECT_EQ(encoded, typed);
+    EXPECT_EQ(object, datapack::write_object(value));
+
+    datapack::BinaryEncodeJob job(schema, object, 0, options);
+    EXPECT_TRUE(job.step(std::chrono::seconds(10)));
+    EXPECT_EQ(job.result(), typed);
+
+    // Element by element is the same as written as binary
+    options.trivial_as_binary = false;
+    EXPECT_EQ(datapack::write_binary(value, options), typed);
+    Series result = datapack::read_binary<Series>(typed, options);
+    EXPECT_EQ(result.values, value.values);
+    EXPECT_EQ(result.scale, value.scale);
+}
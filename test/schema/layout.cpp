@@ -0,0 +1,63 @@
+#include <gtest/gtest.h>
+#include <datapack/schema/layout.hpp>
+#include <datapack/common.hpp>
+
+struct Reading {
+    std::uint8_t flags;
+    double value;
+    std::uint8_t sensor;
+    std::uint32_t count;
+};
+
+struct ReadingLog {
+    std::string name;
+    std::vector<Reading> readings;
+};
+
+// The fields of Reading in the suggested order
+struct SortedReading {
+    double value;
+    std::uint32_t count;
+    std::uint8_t flags;
+    std::uint8_t sensor;
+};
+
+namespace datapack {
+DATAPACK_INLINE(Reading, value, packer) {
+    packer.object_begin(sizeof(Reading));
+    packer.value("flags", value.flags);
+    packer.value("value", value.value);
+    packer.value("sensor", value.sensor);
+    packer.value("count", value.count);
+    packer.object_end(sizeof(Reading));
+}
+DATAPACK_INLINE(SortedReading, value, packer) {
+    packer.object_begin(sizeof(SortedReading));
+    packer.value("value", value.value);
+    packer.value("count", value.count);
+    packer.value("flags", value.flags);
+    packer.value("sensor", value.sensor);
+    packer.object_end(sizeof(SortedReading));
+}
+DATAPACK_INLINE(ReadingLog, value, packer) {
+    packer.object_begin();
+    packer.value("name", value.name);
+    packer.value("readings", value.readings);
+    packer.object_end();
+}
+} // namespace datapack
+
+TEST(Schema, SuggestFieldOrder) {
+    auto orders = datapack::suggest_field_order(datapack::create_schema<ReadingLog>());
+    ASSERT_EQ(orders.size(), 1);
+    const auto& order = orders[0];
+    EXPECT_EQ(order.path, "readings.*");
+    EXPECT_EQ(order.size, sizeof(Reading));
+    EXPECT_EQ(order.suggested, (std::vector<std::string>{"value", "count", "flags", "sensor"}));
+    EXPECT_EQ(order.suggested_size, 16);
+
+    // No suggestion once the fields are in order
+    EXPECT_EQ(sizeof(SortedReading), order.suggested_size);
+    EXPECT_TRUE(datapack::suggest_field_order(datapack::create_schema<SortedReading>()).empty());
+    EXPECT_TRUE(datapack::suggest_field_order(datapack::create_schema<std::vector<SortedReading>>()).empty());
+}
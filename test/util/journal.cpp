@@ -0,0 +1,157 @@
+#include <gtest/gtest.h>
+#include <datapack/util/journal.hpp>
+#include <datapack/format/json.hpp>
+
+static std::filesystem::path temp_journal(const std::string& name) {
+    auto path = std::filesystem::temp_directory_path() / ("datapack_test_" + name);
+    std::filesystem::remove(path);
+    return path;
+}
+
+TEST(Util, Journal) {
+    using namespace datapack;
+    auto path = temp_journal("journal");
+
+    Object object = load_json(R"({ "name": "sensor", "readings": [1, 2, 3] })");
+    {
+        Journal journal(path, object, JournalOptions{.buffer_size = 64, .compact_ratio = 0});
+        object["name"] = "lidar";
+        object["range"]["min"] = 0.5;
+        object["range"]["max"] = 20.0;
+        object["readings"].push_back(4);
+        object["readings"][0].erase();
+        object["samples"] = Object::floating_array_t{0.1, 0.2};
+        object["samples"].push_back_packed(0.3);
+        object["tags"].push_back("outdoor");
+        object["tags"].push_back("fast");
+        object["tags"].clear();
+        object["enabled"] = true;
+        object.find("enabled")->erase();
+        // Creating a key through operator[] is an entry of its own
+        EXPECT_EQ(journal.stats().entries, 18);
+
+        // Copies aren't journaled
+        Object copy = object;
+        copy["name"] = "camera";
+        EXPECT_EQ(journal.stats().entries, 18);
+    }
+    Object loaded = load_journal(path);
+    EXPECT_EQ(loaded, object);
+    EXPECT_EQ(dump_json(loaded), dump_json(object));
+
+    // Modifying shared children is recorded at the node it's made through
+    object = load_json(R"([{ "x": [1, 2] }, { "x": [1, 2] }])");
+    object.dedupe();
+    {
+        Journal journal(path, object);
+        object[1]["x"][0] = 5;
+        EXPECT_FALSE(object[1].is_shared());
+    }
+    loaded = load_journal(path);
+    EXPECT_EQ(loaded, object);
+    EXPECT_EQ(loaded[0]["x"][0].integer(), 1);
+    EXPECT_EQ(loaded[1]["x"][0].integer(), 5);
+
+    // Assigning the whole object is recorded, and values can be read
+    // through mutable references
+    {
+        Journal journal(path, object);
+        object = load_json(R"({ "count": 1 })");
+        Object::integer_t count = object["count"].integer();
+        EXPECT_EQ(count, 1);
+        EXPECT_EQ(object.at("count").integer(), 1);
+        object["count"] = count + 1;
+        EXPECT_EQ(journal.stats().entries, 2);
+    }
+    loaded = load_journal(path);
+    EXPECT_EQ(loaded, object);
+    EXPECT_EQ(loaded["count"].integer(), 2);
+
+    // Only one journal per object
+    Journal journal(path, object);
+    EXPECT_THROW(Journal(path, object), JournalError);
+    std::filesystem::remove(path);
+}
+
+TEST(Util, JournalCompaction) {
+    using namespace datapack;
+    auto path = temp_journal("journal_compaction");
+
+    Object object;
+    object["count"] = 0;
+    {
+        Journal journal(path, object, JournalOptions{.compact_ratio = 4});
+        for (int i = 1; i <= 1000; i++) {
+            object["count"] = i;
+            if (i % 100 == 0) {
+                journal.flush();
+                EXPECT_LE(journal.stats().entry_bytes, 4 * journal.stats().checkpoint_bytes);
+            }
+        }
+        EXPECT_GT(journal.stats().compactions, 0);
+    }
+    EXPECT_LT(std::filesystem::file_size(path), 200);
+    EXPECT_EQ(load_journal(path)["count"].integer(), 1000);
+
+    // An entry cut off by a crash is ignored
+    {
+        Journal journal(path, object, JournalOptions{.compact_ratio = 0});
+        object["count"] = 1001;
+        object["count"] = 1002;
+    }
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) - 1);
+    EXPECT_EQ(load_journal(path)["count"].integer(), 1001);
+
+    std::filesystem::resize_file(path, 4);
+    EXPECT_THROW(load_journal(path), JournalError);
+    std::filesystem::remove(path);
+}
+
+TEST(Util, JournalSplice) {
+    using namespace datapack;
+    auto path = temp_journal("journal_splice");
+
+    Object object = load_json(R"({ "pages": [] })");
+    Object fragment = load_json(R"({ "title": "a", "lines": [1, 2] })");
+    {
+        Journal journal(path, object);
+        object["pages"].splice(fragment.clone());
+        object["pages"].splice(std::move(fragment));
+        object["pages"][0].move_to(object, "first");
+        object["pages"][0]["lines"].move_to(object["pages"]);
+    }
+    Object loaded = load_journal(path);
+    EXPECT_EQ(loaded, object);
+    EXPECT_EQ(loaded["first"]["title"].string(), "a");
+    EXPECT_EQ(loaded["pages"][1][1].integer(), 2);
+    std::filesystem::remove(path);
+}
+
+TEST(Util, JournalPositions) {
+    using namespace datapack;
+    auto path = temp_journal("journal_positions");
+
+    Object object;
+    for (int i = 0; i < 100; i++) {
+        object["items"].push_back(i);
+    }
+    {
+        Journal journal(path, object);
+        // Erasing shifts the positions of the later siblings
+        for (int i = 0; i < 40; i++) {
+            object["items"][10].erase();
+            object["items"][50] = -i;
+            object["items"].push_back(100 + i);
+        }
+        for (int i = 0; i < 80; i++) {
+            object["items"][0].erase();
+        }
+        object["items"][5] = 0;
+        object["items"][10].move_to(object, "moved");
+        object["items"][10] = 1;
+    }
+    Object loaded = load_journal(path);
+    EXPECT_EQ(loaded, object);
+    EXPECT_EQ(loaded["items"].size(), 19);
+    std::filesystem::remove(path);
+}
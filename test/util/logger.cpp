@@ -0,0 +1,86 @@
+#include <gtest/gtest.h>
+#include <datapack/util/logger.hpp>
+#include <datapack/common.hpp>
+#include <datapack/format/json.hpp>
+
+struct RequestEvent {
+    std::uint32_t thread;
+    std::uint32_t index;
+    std::string path;
+};
+
+struct ErrorEvent {
+    std::int32_t code;
+    std::optional<std::string> message;
+};
+
+namespace datapack {
+DATAPACK_INLINE(RequestEvent, value, packer) {
+    packer.object_begin();
+    packer.value("thread", value.thread);
+    packer.value("index", value.index);
+    packer.value("path", value.path);
+    packer.object_end();
+}
+DATAPACK_INLINE(ErrorEvent, value, packer) {
+    packer.object_begin();
+    packer.value("code", value.code);
+    packer.value("message", value.message);
+    packer.object_end();
+}
+} // namespace datapack
+
+TEST(Util, Logger) {
+    auto path = std::filesystem::temp_directory_path() / "datapack_test_logger";
+    const std::uint32_t thread_count = 4;
+    const std::uint32_t event_count = 5000;
+
+    {
+        datapack::LoggerOptions options;
+        options.buffer_size = 1024;
+        datapack::Logger logger(path, options);
+        std::vector<std::thread> threads;
+        for (std::uint32_t t = 0; t < thread_count; t++) {
+            threads.emplace_back([&, t]() {
+                for (std::uint32_t i = 0; i < event_count; i++) {
+                    logger.log("request", RequestEvent{t, i, "/items/" + std::to_string(i)});
+                    if (i % 1000 == 0) {
+                        logger.log("error", ErrorEvent{-int(i), "failed"});
+                    }
+                }
+            });
+        }
+        for (auto& thread: threads) {
+            thread.join();
+        }
+    }
+
+    datapack::Object log = datapack::load_log(path);
+    std::vector<std::uint32_t> next_index(thread_count, 0);
+    std::size_t errors = 0;
+    // Lists are linked, so iterate rather than index
+    for (auto iter = log.iter().child(); iter; iter = iter.next()) {
+        const auto& record = *iter;
+        ASSERT_GT(record.at("time").integer(), 0);
+        if (record.at("type").string() == "error") {
+            EXPECT_EQ(record.at("event").at("message").string(), "failed");
+            errors++;
+            continue;
+        }
+        ASSERT_EQ(record.at("type").string(), "request");
+        auto event = record.at("event");
+        auto thread = event.at("thread").integer();
+        auto index = event.at("index").integer();
+        // Each thread's events stay in order
+        ASSERT_EQ(index, next_index[thread]++);
+        ASSERT_EQ(event.at("path").string(), "/items/" + std::to_string(index));
+    }
+    for (auto count: next_index) {
+        ASSERT_EQ(count, event_count);
+    }
+    ASSERT_EQ(errors, thread_count * event_count / 1000);
+
+    // Viewable as JSON
+    ASSERT_NE(datapack::dump_json(log[0]).find("\"request\""), std::string::npos);
+    std::filesystem::remove(path);
+}
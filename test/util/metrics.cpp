@@ -0,0 +1,74 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include <datapack/util/metrics.hpp>
+#include <datapack/common.hpp>
+#include <datapack/format/binary_reader.hpp>
+#include <datapack/format/binary_writer.hpp>
+#include <datapack/format/json.hpp>
+
+struct MetricPoint {
+    std::int32_t x;
+    std::vector<std::int32_t> values;
+};
+
+namespace datapack {
+DATAPACK_INLINE(MetricPoint, value, packer) {
+    packer.object_begin();
+    packer.value("x", value.x);
+    packer.value("values", value.values);
+    packer.object_end();
+}
+} // namespace datapack
+
+TEST(Util, Metrics) {
+    if (!datapack::metrics_enabled()) {
+        ASSERT_EQ(datapack::metrics_snapshot().size(), 0);
+        GTEST_SKIP() << "Built without DATAPACK_METRICS";
+    }
+    datapack::metrics_reset();
+
+    MetricPoint point{1, {2, 3, 4}};
+    std::size_t bytes = 0;
+    // Counts from threads that have exited are kept
+    std::thread thread([&]() {
+        for (int i = 0; i < 10; i++) {
+            bytes += datapack::write_binary(point).size();
+        }
+    });
+    thread.join();
+
+    auto data = datapack::write_binary(point);
+    datapack::read_binary<MetricPoint>(data);
+    data.resize(data.size() - 1);
+    datapack::read_binary<MetricPoint>(data);
+
+    std::string json = datapack::dump_json(datapack::write_object(point));
+    datapack::load_json(json);
+    EXPECT_THROW(datapack::load_json("{"), datapack::JsonLoadError);
+
+    auto metrics = datapack::metrics_snapshot();
+    auto write = metrics.at("write_binary");
+    EXPECT_EQ(write.at("calls").integer(), 11);
+    EXPECT_EQ(write.at("failed").integer(), 0);
+    EXPECT_EQ(write.at("bytes").integer(), bytes + data.size() + 1);
+
+    auto read = metrics.at("read_binary");
+    EXPECT_EQ(read.at("calls").integer(), 2);
+    EXPECT_EQ(read.at("failed").integer(), 1);
+    EXPECT_EQ(metrics.at("invalidated").integer(), 1);
+
+    EXPECT_EQ(metrics.at("dump_json").at("calls").integer(), 1);
+    EXPECT_EQ(metrics.at("dump_json").at("bytes").integer(), json.size());
+    EXPECT_EQ(metrics.at("load_json").at("calls").integer(), 2);
+    EXPECT_EQ(metrics.at("load_json").at("failed").integer(), 1);
+
+    // The latency histogram covers every call
+    std::int64_t count = 0;
+    for (auto bucket = write.at("latency").iter().child(); bucket; bucket = bucket.next()) {
+        count += bucket->at("count").integer();
+    }
+    EXPECT_EQ(count, 11);
+
+    datapack::metrics_reset();
+    EXPECT_EQ(datapack::metrics_snapshot().at("write_binary").at("calls").integer(), 0);
+}
@@ -0,0 +1,131 @@
+#include <gtest/gtest.h>
+#include <datapack/util/simd.hpp>
+#include <random>
+#include <string>
+
+TEST(Util, SimdKernels) {
+    using namespace datapack;
+
+    // Covers chunk boundaries and tails for every vector width
+    std::string text;
+    for (int i = 0; i < 300; i++) {
+        text += " \t\r\n"[i % 4];
+        if (i % 37 == 0) {
+            text += "ab";
+        }
+        if (i % 53 == 0) {
+            text += '"';
+        }
+    }
+
+    const auto& scalar = simd_kernels(SimdLevel::Scalar);
+    for (int i = 0; i <= int(SimdLevel::NEON); i++) {
+        SimdLevel level = SimdLevel(i);
+        if (!simd_supported(level)) {
+            continue;
+        }
+        const auto& kernels = simd_kernels(level);
+        EXPECT_EQ(kernels.level, level);
+        for (std::size_t begin = 0; begin < text.size(); begin++) {
+            const char* data = text.data() + begin;
+            std::size_t size = text.size() - begin;
+            ASSERT_EQ(kernels.find_quote(data, size), scalar.find_quote(data, size)) << simd_level_name(level);
+            ASSERT_EQ(kernels.skip_whitespace(data, size), scalar.skip_whitespace(data, size)) << simd_level_name(level);
+        }
+    }
+}
+
+static std::string encode_utf8(std::uint32_t c) {
+    std::string result;
+    if (c < 0x80) {
+        result += char(c);
+    } else if (c < 0x800) {
+        result += char(0xC0 | (c >> 6));
+        result += char(0x80 | (c & 0x3F));
+    } else if (c < 0x10000) {
+        result += char(0xE0 | (c >> 12));
+        result += char(0x80 | ((c >> 6) & 0x3F));
+        result += char(0x80 | (c & 0x3F));
+    } else {
+        result += char(0xF0 | (c >> 18));
+        result += char(0x80 | ((c >> 12) & 0x3F));
+        result += char(0x80 | ((c >> 6) & 0x3F));
+        result += char(0x80 | (c & 0x3F));
+    }
+    return result;
+}
+
+TEST(Util, SimdValidateUtf8) {
+    using namespace datapack;
+
+    const std::vector<std::string> valid = {
+        "", "hello", "h\xC3\xA9llo", "\xE6\x97\xA5\xE6\x9C\xAC", "\xF0\x9F\x98\x80",
+        "\x7F", "\xC2\x80", "\xDF\xBF", "\xE0\xA0\x80", "\xED\x9F\xBF", "\xEE\x80\x80",
+        "\xEF\xBF\xBF", "\xF0\x90\x80\x80", "\xF4\x8F\xBF\xBF"
+    };
+    const std::vector<std::string> invalid = {
+        "\x80", "\xBF", "\xC0\x80", "\xC1\xBF", "\xE0\x80\x80", "\xE0\x9F\xBF",
+        "\xED\xA0\x80", "\xED\xBF\xBF", "\xF0\x80\x80\x80", "\xF4\x90\x80\x80",
+        "\xF5\x80\x80\x80", "\xFF", "\xC3", "\xE2\x82", "\xF0\x9F\x98",
+        "\xC3\xA9\x80", "\xE2\x82\xAC\xAC", "\xC3" "A"
+    };
+
+    // Random code points, with some bytes then changed
+    std::mt19937 rng(0);
+    std::vector<std::string> random_strings;
+    for (int i = 0; i < 200; i++) {
+        std::string text;
+        while (text.size() < 150) {
+            std::uint32_t c = rng() % 4 == 0 ? rng() % 0x80 : rng() % 0x110000;
+            if (c >= 0xD800 && c < 0xE000) {
+                continue;
+            }
+            text += encode_utf8(c);
+        }
+        if (i % 2 == 1) {
+            text[rng() % text.size()] = char(rng());
+        }
+        random_strings.push_back(text);
+    }
+
+    const auto& scalar = simd_kernels(SimdLevel::Scalar);
+    for (int i = 0; i <= int(SimdLevel::NEON); i++) {
+        SimdLevel level = SimdLevel(i);
+        if (!simd_supported(level)) {
+            continue;
+        }
+        const auto& kernels = simd_kernels(level);
+        // Surrounded by ASCII, to cover each position relative to the blocks
+        for (std::size_t offset = 0; offset < 70; offset++) {
+            for (const auto& text: valid) {
+                std::string padded = std::string(offset, 'a') + text + std::string(offset % 7, 'b');
+                ASSERT_TRUE(kernels.validate_utf8(padded.data(), padded.size())) << simd_level_name(level) << " " << offset;
+            }
+            for (const auto& text: invalid) {
+                std::string padded = std::string(offset, 'a') + text + std::string(offset % 7, 'b');
+                ASSERT_FALSE(kernels.validate_utf8(padded.data(), padded.size())) << simd_level_name(level) << " " << offset;
+            }
+        }
+        for (const auto& text: random_strings) {
+            ASSERT_EQ(kernels.validate_utf8(text.data(), text.size()), scalar.validate_utf8(text.data(), text.size()))
+                << simd_level_name(level);
+        }
+    }
+}
+
+TEST(Util, SimdLevel) {
+    using namespace datapack;
+
+    SimdLevel initial = simd_level();
+    EXPECT_EQ(set_simd_level(SimdLevel::Scalar), SimdLevel::Scalar);
+    EXPECT_EQ(simd_kernels().level, SimdLevel::Scalar);
+    // Unsupported levels fall back to a supported level
+    EXPECT_TRUE(simd_supported(set_simd_level(SimdLevel::AVX512)));
+    EXPECT_TRUE(simd_supported(set_simd_level(SimdLevel::NEON)));
+    set_simd_level(initial);
+
+    SimdLevel level;
+    EXPECT_TRUE(simd_level_from_name("avx2", level));
+    EXPECT_EQ(level, SimdLevel::AVX2);
+    EXPECT_FALSE(simd_level_from_name("mmx", level));
+}
@@ -0,0 +1,144 @@
+#include <gtest/gtest.h>
+#include <datapack/util/snapshot_store.hpp>
+#include <datapack/common.hpp>
+#include <random>
+
+struct Account {
+    std::uint64_t id;
+    std::string owner;
+    std::int64_t balance;
+};
+
+bool operator==(const Account& a, const Account& b) {
+    return a.id == b.id && a.owner == b.owner && a.balance == b.balance;
+}
+
+namespace datapack {
+DATAPACK_INLINE(Account, value, packer) {
+    packer.object_begin();
+    packer.value("id", value.id);
+    packer.value("owner", value.owner);
+    packer.value("balance", value.balance);
+    packer.object_end();
+}
+} // namespace datapack
+
+static std::filesystem::path temp_store(const std::string& name) {
+    auto path = std::filesystem::temp_directory_path() / ("datapack_test_" + name);
+    std::filesystem::remove_all(path);
+    return path;
+}
+
+TEST(Util, SnapshotChunking) {
+    std::mt19937 rng(0);
+    std::vector<std::uint8_t> data(1 << 20);
+    for (auto& byte: data) {
+        byte = rng();
+    }
+    datapack::ChunkingOptions options;
+    auto chunks = datapack::find_chunks(data, options);
+    ASSERT_EQ(chunks.back(), data.size());
+    std::size_t begin = 0;
+    for (std::size_t end: chunks) {
+        ASSERT_LE(end - begin, options.max_size);
+        if (end != data.size()) {
+            ASSERT_GE(end - begin, options.min_size);
+        }
+        begin = end;
+    }
+    double average = double(data.size()) / chunks.size();
+    EXPECT_GT(average, options.average_size / 2);
+    EXPECT_LT(average, options.average_size * 2);
+
+    // Inserting bytes only changes the chunks around the insertion
+    std::vector<std::uint8_t> edited = data;
+    edited.insert(edited.begin() + 1000, {1, 2, 3});
+    auto edited_chunks = datapack::find_chunks(edited, options);
+    std::size_t shared = 0;
+    for (std::size_t end: edited_chunks) {
+        if (end > 2000 && std::binary_search(chunks.begin(), chunks.end(), end - 3)) {
+            shared++;
+        }
+    }
+    EXPECT_GE(shared + 2, edited_chunks.size());
+}
+
+TEST(Util, SnapshotStore) {
+    auto path = temp_store("snapshot_store");
+    std::mt19937 rng(1);
+
+    std::vector<Account> accounts;
+    for (std::uint64_t i = 0; i < 20000; i++) {
+        accounts.push_back(Account{i, "owner_" + std::to_string(rng()), std::int64_t(rng())});
+    }
+
+    std::vector<std::vector<Account>> history;
+    {
+        datapack::SnapshotStore store(path);
+        for (int i = 0; i < 50; i++) {
+            // A few accounts change, and some are added, between snapshots
+            for (int j = 0; j < 2; j++) {
+                accounts[rng() % accounts.size()].balance = rng();
+            }
+            accounts.push_back(Account{accounts.size(), "new", 0});
+            history.push_back(accounts);
+            ASSERT_EQ(store.write(accounts), i);
+        }
+
+        auto stats = store.stats();
+        EXPECT_EQ(stats.snapshots, 50);
+        EXPECT_LT(stats.stored_bytes * 10, stats.logical_bytes);
+        ASSERT_EQ(store.read<std::vector<Account>>(3), history[3]);
+    }
+
+    // Reopening rebuilds the index from the files
+    datapack::SnapshotStore store(path);
+    ASSERT_EQ(store.size(), history.size());
+    for (std::size_t i = 0; i < history.size(); i++) {
+        ASSERT_EQ(store.read<std::vector<Account>>(i), history[i]);
+    }
+    auto before = store.stats();
+    store.write(accounts);
+    EXPECT_EQ(store.stats().chunks, before.chunks);
+
+    std::filesystem::remove_all(path);
+}
+
+TEST(Util, SnapshotStoreCollision) {
+    auto path = temp_store("snapshot_store_collision");
+    std::vector<std::uint8_t> data(100, 7);
+    {
+        datapack::SnapshotStore store(path);
+        store.add(data);
+    }
+
+    // A chunk with the same key but different bytes, as if the hashes
+    // collided, isn't reused
+    {
+        std::fstream pack(path / "chunks.pack", std::ios::in | std::ios::out | std::ios::binary);
+        pack.seekp(2 * sizeof(std::uint64_t));
+        std::vector<char> other(data.size(), 8);
+        pack.write(other.data(), other.size());
+    }
+    {
+        datapack::SnapshotStore store(path);
+        store.add(data);
+        EXPECT_EQ(store.stats().chunks, 2);
+        EXPECT_EQ(store.load(1), data);
+        store.add(data);
+        EXPECT_EQ(store.stats().chunks, 2);
+    }
+
+    // An incomplete snapshot at the end of the manifest is ignored, even if
+    // its count is too large to allocate
+    {
+        std::ofstream manifest(path / "snapshots.manifest", std::ios::app | std::ios::binary);
+        std::uint64_t count = std::uint64_t(1) << 60;
+        manifest.write((const char*)&count, sizeof(count));
+    }
+    datapack::SnapshotStore store(path);
+    EXPECT_EQ(store.size(), 3);
+    EXPECT_EQ(store.load(2), data);
+
+    std::filesystem::remove_all(path);
+}